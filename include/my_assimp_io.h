@@ -0,0 +1,158 @@
+#ifndef MY_ASSIMP_IO_H
+#define MY_ASSIMP_IO_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <my_mapped_file.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem> // Requires C++17
+#include <string>
+#include <system_error>
+
+// Assimp file access served from a memory mapping instead of stdio
+// Reads copy straight from the mapped pages (no stdio buffer in between), the window ahead of the read
+// position is prefetched and pages behind it are dropped, so the mapping never holds much of the file resident
+
+const size_t MAPPED_IO_WINDOW_BYTES = 4 * 1024 * 1024;
+
+class MappedIOStream : public Assimp::IOStream
+{
+public:
+    explicit MappedIOStream(MappedFile&& mappedFile)
+        : file(std::move(mappedFile))
+    {
+        advanceWindow(0);
+    }
+
+    size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override
+    {
+        if (pSize == 0 || position >= file.size())
+            return 0;
+        size_t count = std::min(pCount, (file.size() - position) / pSize);
+
+        // Big reads (FBX/glTF binaries read the whole file at once) go window by window
+        unsigned char* destination = static_cast<unsigned char*>(pvBuffer);
+        size_t remaining = count * pSize;
+        while (remaining > 0)
+        {
+            size_t bytes = std::min(remaining, MAPPED_IO_WINDOW_BYTES);
+            advanceWindow(position + bytes);
+            std::memcpy(destination, file.data() + position, bytes);
+            destination += bytes;
+            position += bytes;
+            remaining -= bytes;
+            evictBehind();
+        }
+        return count;
+    }
+
+    size_t Write(const void* /*pvBuffer*/, size_t /*pSize*/, size_t /*pCount*/) override
+    {
+        return 0; // Read-only
+    }
+
+    aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override
+    {
+        size_t target = 0;
+        if (pOrigin == aiOrigin_SET)
+            target = pOffset;
+        else if (pOrigin == aiOrigin_CUR)
+            target = position + pOffset;
+        else if (pOrigin == aiOrigin_END)
+            target = file.size() - std::min(pOffset, file.size());
+        else
+            return aiReturn_FAILURE;
+        if (target > file.size())
+            return aiReturn_FAILURE;
+
+        // Pages behind a backwards seek may have been dropped, they fault back in and are dropped again once passed
+        position = target;
+        evictedTo = std::min(evictedTo, position);
+        prefetchedTo = std::min(prefetchedTo, position);
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override
+    {
+        return position;
+    }
+
+    size_t FileSize() const override
+    {
+        return file.size();
+    }
+
+    void Flush() override
+    {
+    }
+
+private:
+    MappedFile file;
+    size_t position = 0;
+    size_t prefetchedTo = 0;
+    size_t evictedTo = 0;
+
+    // Keep one window prefetched past end
+    void advanceWindow(size_t end)
+    {
+        if (end + MAPPED_IO_WINDOW_BYTES / 2 <= prefetchedTo)
+            return;
+        size_t from = std::max(prefetchedTo, position);
+        size_t to = std::min(file.size(), end + MAPPED_IO_WINDOW_BYTES);
+        if (to > from)
+            file.prefetch(file.data() + from, to - from);
+        prefetchedTo = to;
+    }
+
+    // Drop everything more than a window behind the read position
+    void evictBehind()
+    {
+        if (position < evictedTo + 2 * MAPPED_IO_WINDOW_BYTES)
+            return;
+        size_t to = position - MAPPED_IO_WINDOW_BYTES;
+        file.evict(file.data() + evictedTo, to - evictedTo);
+        evictedTo = to;
+    }
+};
+
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+    bool Exists(const char* pFile) const override
+    {
+        std::error_code error;
+        return std::filesystem::is_regular_file(pFile, error);
+    }
+
+    char getOsSeparator() const override
+    {
+#ifdef _WIN32
+        return '\\';
+#else
+        return '/';
+#endif
+    }
+
+    Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override
+    {
+        // Importers only ever read, anything else is not ours to serve
+        if (std::strchr(pMode, 'w') || std::strchr(pMode, 'a') || std::strchr(pMode, '+'))
+            return nullptr;
+
+        MappedFile file;
+        if (!file.open(pFile))
+            return nullptr;
+        return new MappedIOStream(std::move(file));
+    }
+
+    void Close(Assimp::IOStream* pFile) override
+    {
+        delete pFile;
+    }
+};
+
+#endif // MY_ASSIMP_IO_H
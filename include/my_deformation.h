@@ -0,0 +1,291 @@
+#ifndef MY_DEFORMATION_H
+#define MY_DEFORMATION_H
+
+#include <glm/glm.hpp>
+
+#include <my_dn_baker.h>
+#include <my_mesh_data.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// CPU side of deforming meshes: per-frame positions from a callback, vertex normals that follow them, and d_N
+// kept up to date by refitting the BVH and re-casting only the vertices whose thickness can have changed
+// Nothing in here touches OpenGL (MeshDeformer in my_mesh_deformer.h does the uploads)
+
+// Writes the deformed position of every rest vertex for a point in time (seconds)
+using MeshDeformFunction = std::function<void(const std::vector<Vertex>& rest, float time, std::vector<glm::vec3>& positions)>;
+
+struct DeformSettings
+{
+    float rebakeThreshold = 0.002f; // Movement (fraction of the rest bounds diagonal) that makes nearby d_N stale
+    unsigned int gridResolution = 32; // Cells per axis of the grid that finds rays whose far side moved
+};
+
+// Timings of one DeformableThickness::update
+struct ThicknessUpdateStats
+{
+    double refitMilliseconds = 0.0;
+    double detectMilliseconds = 0.0;
+    double rebakeMilliseconds = 0.0;
+    size_t movedVertices = 0;
+    size_t rebakedVertices = 0;
+};
+
+// A ripple in a band that travels up and down the model, pushing vertices along their rest normals
+// (used by the "Deform" checkbox and deform_bench). Vertices outside the band keep their rest position exactly
+MeshDeformFunction makeWaveDeformer(const glm::vec3& boundsCenter, float boundsRadius)
+{
+    float size = std::max(2.0f * boundsRadius, 1e-6f);
+    float amplitude = 0.03f * size;
+    float waveNumber = 6.2831853f / (0.25f * size);
+    float bandWidth = 0.15f * size;
+    float bottom = boundsCenter.y - boundsRadius;
+    return [=](const std::vector<Vertex>& rest, float time, std::vector<glm::vec3>& positions)
+    {
+        float bandCenter = bottom + size * (0.5f + 0.5f * std::sin(0.5f * time));
+        positions.resize(rest.size());
+        globalThreadPool().parallelFor(rest.size(), 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const Vertex& vertex = rest[i];
+                float band = (vertex.Position.y - bandCenter) / bandWidth;
+                if (std::fabs(band) >= 3.0f)
+                {
+                    positions[i] = vertex.Position;
+                    continue;
+                }
+                float offset = amplitude * std::sin(waveNumber * vertex.Position.y - 3.0f * time) * std::exp(-band * band);
+                positions[i] = vertex.Position + vertex.Normal * offset;
+            }
+        });
+    };
+}
+
+class DeformableThickness
+{
+public:
+    // Build the BVH and adjacency for the rest pose, taking d_N as already baked for it
+    void init(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& triangleIndices, const DeformSettings& deformSettings = DeformSettings())
+    {
+        settings = deformSettings;
+        indices = triangleIndices;
+        size_t vertexCount = vertices.size();
+        gridPositions.resize(vertexCount);
+        castPositions.resize(vertexCount);
+        restNormals.resize(vertexCount);
+        d_N.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            gridPositions[i] = castPositions[i] = vertices[i].Position;
+            restNormals[i] = vertices[i].Normal;
+            d_N[i] = vertices[i].d_N;
+        }
+
+        // Vertex -> triangle lists
+        triangleStart.assign(vertexCount + 1, 0);
+        for (unsigned int index : indices)
+            triangleStart[index + 1]++;
+        for (size_t i = 0; i < vertexCount; i++)
+            triangleStart[i + 1] += triangleStart[i];
+        vertexTriangles.resize(indices.size());
+        std::vector<uint32_t> fill(triangleStart.begin(), triangleStart.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            vertexTriangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+        // Recomputed normals are applied as a change from the rest ones, so authored normals survive
+        computeNormals(gridPositions, restFaceNormals);
+
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (const glm::vec3& position : gridPositions)
+        {
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+        if (vertexCount == 0)
+            boundsMin = boundsMax = glm::vec3(0.0f);
+        glm::vec3 margin = (boundsMax - boundsMin) * 0.25f + glm::vec3(1e-6f);
+        gridMin = boundsMin - margin;
+        gridCellSize = (boundsMax - boundsMin + margin * 2.0f) / static_cast<float>(settings.gridResolution);
+        threshold = settings.rebakeThreshold * glm::length(boundsMax - boundsMin);
+
+        bvh.build(gridPositions, indices, bakeSettings.leafSize);
+        castNormals = restNormals;
+        exitPoints.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            exitPoints[i] = exitPoint(gridPositions[i], restNormals[i], d_N[i]);
+    }
+
+    // Vertex normals for new positions: the rest normal turned by the change in area-weighted face normals
+    void deformNormals(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals) const
+    {
+        computeNormals(positions, normals);
+        for (size_t i = 0; i < normals.size(); i++)
+        {
+            glm::vec3 normal = restNormals[i] + normals[i] - restFaceNormals[i];
+            float len = glm::length(normal);
+            normals[i] = len > 0.0f ? normal / len : restNormals[i];
+        }
+    }
+
+    // Refit the BVH to the new pose and re-cast d_N where it can have changed
+    ThicknessUpdateStats update(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals)
+    {
+        ThicknessUpdateStats stats;
+        auto start = std::chrono::high_resolution_clock::now();
+        bvh.refit(positions, indices);
+        auto refitted = std::chrono::high_resolution_clock::now();
+        stats.refitMilliseconds = std::chrono::duration<double, std::milli>(refitted - start).count();
+
+        findStaleVertices(positions, normals, stats);
+        auto detected = std::chrono::high_resolution_clock::now();
+        stats.detectMilliseconds = std::chrono::duration<double, std::milli>(detected - refitted).count();
+
+        bakeThickness(bvh, positions, normals, rebaked, d_N, bakeSettings);
+        for (uint32_t v : rebaked)
+        {
+            castPositions[v] = positions[v];
+            castNormals[v] = normals[v];
+            exitPoints[v] = exitPoint(positions[v], normals[v], d_N[v]);
+        }
+        stats.rebakedVertices = rebaked.size();
+        stats.rebakeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - detected).count();
+        return stats;
+    }
+
+    const std::vector<float>& thickness() const
+    {
+        return d_N;
+    }
+
+    // Vertices re-cast by the last update
+    const std::vector<uint32_t>& rebakedVertices() const
+    {
+        return rebaked;
+    }
+
+private:
+    DeformSettings settings;
+    DNBakeSettings bakeSettings;
+    TriangleBvh bvh;
+    std::vector<unsigned int> indices;
+    std::vector<uint32_t> triangleStart, vertexTriangles; // Triangles around each vertex
+    std::vector<glm::vec3> gridPositions;   // Where each vertex was when its last move was marked in the grid
+    std::vector<glm::vec3> castPositions, castNormals; // Each vertex's last d_N ray
+    std::vector<glm::vec3> exitPoints;      // Where that ray left the mesh
+    std::vector<glm::vec3> restNormals, restFaceNormals;
+    std::vector<float> d_N;
+    std::vector<uint8_t> moved, stale, grid;
+    std::vector<uint32_t> rebaked;
+    glm::vec3 gridMin = glm::vec3(0.0f), gridCellSize = glm::vec3(1.0f);
+    float threshold = 0.0f;
+
+    static glm::vec3 exitPoint(const glm::vec3& position, const glm::vec3& normal, float thickness)
+    {
+        float len = glm::length(normal);
+        return len > 0.0f ? position - normal * (thickness / len) : position;
+    }
+
+    void computeNormals(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals) const
+    {
+        normals.resize(positions.size());
+        globalThreadPool().parallelFor(positions.size(), 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                glm::vec3 sum(0.0f);
+                for (uint32_t t = triangleStart[v]; t < triangleStart[v + 1]; t++)
+                {
+                    size_t first = static_cast<size_t>(vertexTriangles[t]) * 3;
+                    const glm::vec3& a = positions[indices[first]];
+                    sum += glm::cross(positions[indices[first + 1]] - a, positions[indices[first + 2]] - a); // Length = 2x area
+                }
+                float len = glm::length(sum);
+                normals[v] = len > 0.0f ? sum / len : glm::vec3(0.0f);
+            }
+        });
+    }
+
+    glm::ivec3 cellOf(const glm::vec3& position) const
+    {
+        int resolution = static_cast<int>(settings.gridResolution);
+        glm::vec3 cell = (position - gridMin) / gridCellSize;
+        return glm::ivec3(std::min(std::max(static_cast<int>(cell.x), 0), resolution - 1),
+            std::min(std::max(static_cast<int>(cell.y), 0), resolution - 1),
+            std::min(std::max(static_cast<int>(cell.z), 0), resolution - 1));
+    }
+
+    size_t cellIndex(const glm::ivec3& cell) const
+    {
+        return (static_cast<size_t>(cell.z) * settings.gridResolution + cell.y) * settings.gridResolution + cell.x;
+    }
+
+    // A vertex is stale if its ray's origin or far end moved past the threshold since it was cast (the far end
+    // swings with the normal), or if its last exit point lies in a grid cell touched by a moved triangle (the far
+    // side changed). Triangle movement is measured from where each vertex was last marked, not last cast, so
+    // small steps can't add up unseen
+    void findStaleVertices(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, ThicknessUpdateStats& stats)
+    {
+        size_t vertexCount = positions.size();
+        moved.assign(vertexCount, 0);
+        globalThreadPool().parallelFor(vertexCount, 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t v = begin; v < end; v++)
+                moved[v] = glm::length(positions[v] - gridPositions[v]) > threshold ? 1 : 0;
+        });
+
+        // Mark the cells covered by every moved triangle, before and after the move, padded so a ray ending
+        // next to it (and now hitting it instead) is caught too
+        size_t resolution = settings.gridResolution;
+        grid.assign(resolution * resolution * resolution, 0);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            if (!moved[indices[t]] && !moved[indices[t + 1]] && !moved[indices[t + 2]])
+                continue;
+            glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+            for (size_t k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t + k];
+                boxMin = glm::min(boxMin, glm::min(positions[v], gridPositions[v]));
+                boxMax = glm::max(boxMax, glm::max(positions[v], gridPositions[v]));
+            }
+            glm::ivec3 low = cellOf(boxMin - glm::vec3(threshold)), high = cellOf(boxMax + glm::vec3(threshold));
+            for (int z = low.z; z <= high.z; z++)
+                for (int y = low.y; y <= high.y; y++)
+                    for (int x = low.x; x <= high.x; x++)
+                        grid[cellIndex(glm::ivec3(x, y, z))] = 1;
+        }
+
+        stale.assign(vertexCount, 0);
+        globalThreadPool().parallelFor(vertexCount, 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                bool isStale = glm::length(positions[v] - castPositions[v]) > threshold
+                    || glm::length(normals[v] - castNormals[v]) * d_N[v] > threshold
+                    || grid[cellIndex(cellOf(exitPoints[v]))] != 0;
+                stale[v] = isStale ? 1 : 0;
+            }
+        });
+
+        rebaked.clear();
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            if (moved[v])
+            {
+                gridPositions[v] = positions[v];
+                stats.movedVertices++;
+            }
+            if (stale[v])
+                rebaked.push_back(static_cast<uint32_t>(v));
+        }
+    }
+};
+
+#endif // MY_DEFORMATION_H
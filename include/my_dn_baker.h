@@ -0,0 +1,728 @@
+#ifndef MY_DN_BAKER_H
+#define MY_DN_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MY_DN_BAKER_SSE
+#include <emmintrin.h>
+#endif
+
+// Native replacement for python_scripts/compute_dN.py
+// d_N is the distance to the furthest surface hit when casting from a vertex along -normal
+// The directional bake adds how that distance changes as the ray tilts away from -normal (see bakeThicknessGradient)
+
+struct DNBakeSettings
+{
+    float maxDistance = 1000.0f;        // Same ray length as compute_dN.py
+    unsigned int leafSize = 4;          // Max triangles per BVH leaf
+    float gradientConeDegrees = 50.0f;  // Widest tilt the directional fit covers (refraction into IOR 1.3 and up)
+};
+
+// Rays per ring of the directional fit, at half the cone angle and at the full angle (15 rays per vertex)
+const unsigned int DN_GRADIENT_RING_RAYS[2] = { 5, 10 };
+
+struct BvhNode
+{
+    glm::vec3 boundsMin;
+    unsigned int leftFirst; // Left child index, or first triangle for leaves
+    glm::vec3 boundsMax;
+    unsigned int count;     // Triangle count (0 for interior nodes)
+};
+
+// Triangle stored in ray-test friendly form
+struct BvhTriangle
+{
+    glm::vec3 v0;
+    glm::vec3 e1;
+    glm::vec3 e2;
+};
+
+// Nearest hit of a single ray: the hit point is (1 - u - v) * a + u * b + v * c of the original triangle a, b, c
+struct BvhHit
+{
+    float t = -1.0f;
+    unsigned int triangle = 0;
+    float u = 0.0f;
+    float v = 0.0f;
+};
+
+// Four rays traversed together, one lane per ray
+struct RayPacket
+{
+    float ox[4], oy[4], oz[4];
+    float dx[4], dy[4], dz[4];
+    float idx[4], idy[4], idz[4];
+    float tFar[4];  // Furthest hit so far (-1 = none)
+    int laneCount;
+};
+
+// Binned-SAH bounding volume hierarchy over a triangle soup
+class TriangleBvh
+{
+public:
+    std::vector<BvhNode> nodes;
+    std::vector<BvhTriangle> triangles;
+    std::vector<unsigned int> triangleIds; // Original triangle index of each stored triangle
+    unsigned int depth = 0;                // Levels below the root, sizes the traversal stacks
+
+    void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, unsigned int leafSize = 4)
+    {
+        size_t triangleCount = indices.size() / 3;
+        nodes.clear();
+        triangles.clear();
+        depth = 0;
+        triangleIds.resize(triangleCount);
+        if (triangleCount == 0)
+            return;
+
+        // Per-triangle bounds and centroids
+        std::vector<glm::vec3> centroids(triangleCount), triMin(triangleCount), triMax(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            const glm::vec3& a = positions[indices[i * 3 + 0]];
+            const glm::vec3& b = positions[indices[i * 3 + 1]];
+            const glm::vec3& c = positions[indices[i * 3 + 2]];
+            triMin[i] = glm::min(a, glm::min(b, c));
+            triMax[i] = glm::max(a, glm::max(b, c));
+            centroids[i] = (a + b + c) / 3.0f;
+            triangleIds[i] = static_cast<unsigned int>(i);
+        }
+
+        nodes.reserve(triangleCount * 2);
+        nodes.push_back(BvhNode{ glm::vec3(0.0f), 0, glm::vec3(0.0f), static_cast<unsigned int>(triangleCount) });
+
+        // Iterative subdivision
+        std::vector<unsigned int> stack = { 0 };
+        while (!stack.empty())
+        {
+            unsigned int nodeIndex = stack.back();
+            stack.pop_back();
+
+            unsigned int first = nodes[nodeIndex].leftFirst;
+            unsigned int count = nodes[nodeIndex].count;
+            updateNodeBounds(nodes[nodeIndex], triMin, triMax);
+            if (count <= leafSize)
+                continue;
+
+            int axis;
+            float splitPos;
+            if (!findSplit(first, count, centroids, triMin, triMax, nodes[nodeIndex], axis, splitPos))
+                continue;
+
+            // Partition triangle ids about the split plane
+            auto begin = triangleIds.begin() + first;
+            auto middle = std::partition(begin, begin + count, [&](unsigned int id) { return centroids[id][axis] < splitPos; });
+            unsigned int leftCount = static_cast<unsigned int>(middle - begin);
+            if (leftCount == 0 || leftCount == count)
+                continue;
+
+            unsigned int leftIndex = static_cast<unsigned int>(nodes.size());
+            nodes.push_back(BvhNode{ glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount });
+            nodes.push_back(BvhNode{ glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), count - leftCount });
+            nodes[nodeIndex].leftFirst = leftIndex;
+            nodes[nodeIndex].count = 0;
+            stack.push_back(leftIndex);
+            stack.push_back(leftIndex + 1);
+        }
+
+        // Children always come after their parent, so one forward sweep finds every node's level
+        std::vector<unsigned int> levels(nodes.size(), 0);
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            if (nodes[n].count > 0)
+                continue;
+            levels[nodes[n].leftFirst] = levels[nodes[n].leftFirst + 1] = levels[n] + 1;
+            depth = std::max(depth, levels[n] + 1);
+        }
+
+        // Store triangles in leaf order
+        triangles.resize(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            unsigned int id = triangleIds[i];
+            const glm::vec3& a = positions[indices[id * 3 + 0]];
+            triangles[i].v0 = a;
+            triangles[i].e1 = positions[indices[id * 3 + 1]] - a;
+            triangles[i].e2 = positions[indices[id * 3 + 2]] - a;
+        }
+    }
+
+    // Move the triangles to new vertex positions and recompute node bounds bottom-up, keeping the tree
+    // (much cheaper than build, but a tree refitted far from the pose it was built for traverses slower)
+    void refit(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+    {
+        globalThreadPool().parallelFor(triangles.size(), 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                unsigned int id = triangleIds[i];
+                const glm::vec3& a = positions[indices[id * 3 + 0]];
+                triangles[i].v0 = a;
+                triangles[i].e1 = positions[indices[id * 3 + 1]] - a;
+                triangles[i].e2 = positions[indices[id * 3 + 2]] - a;
+            }
+        });
+
+        // Children always come after their parent, so a reverse sweep sees them first
+        for (size_t n = nodes.size(); n-- > 0;)
+        {
+            BvhNode& node = nodes[n];
+            if (node.count > 0)
+            {
+                node.boundsMin = glm::vec3(FLT_MAX);
+                node.boundsMax = glm::vec3(-FLT_MAX);
+                for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                {
+                    const BvhTriangle& tri = triangles[i];
+                    node.boundsMin = glm::min(node.boundsMin, glm::min(tri.v0, glm::min(tri.v0 + tri.e1, tri.v0 + tri.e2)));
+                    node.boundsMax = glm::max(node.boundsMax, glm::max(tri.v0, glm::max(tri.v0 + tri.e1, tri.v0 + tri.e2)));
+                }
+            }
+            else
+            {
+                const BvhNode& left = nodes[node.leftFirst];
+                const BvhNode& right = nodes[node.leftFirst + 1];
+                node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+                node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+            }
+        }
+    }
+
+    // Distance to the furthest hit along a ray (0 if nothing is hit)
+    float furthestHit(const glm::vec3& origin, const glm::vec3& dir, float maxDistance) const
+    {
+        if (nodes.empty())
+            return 0.0f;
+
+        glm::vec3 invDir(safeInverse(dir.x), safeInverse(dir.y), safeInverse(dir.z));
+        float best = -1.0f;
+        unsigned int localStack[128];
+        std::vector<unsigned int> deepStack;
+        unsigned int* stack = traversalStack(localStack, deepStack);
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const BvhNode& node = nodes[stack[--stackSize]];
+
+            // Skip nodes that end before the current furthest hit
+            float tEnter, tExit;
+            if (!slabTest(node, origin, invDir, maxDistance, tEnter, tExit) || tExit <= best)
+                continue;
+
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                {
+                    float t = intersect(triangles[i], origin, dir);
+                    if (t >= 0.0f && t <= maxDistance && t > best)
+                        best = t;
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.leftFirst;
+                stack[stackSize++] = node.leftFirst + 1;
+            }
+        }
+        return std::max(best, 0.0f);
+    }
+
+    // Nearest hit along a ray within maxDistance, false if there is none
+    // facing > 0 only accepts triangles whose CCW side faces the ray (front faces), facing < 0 only back faces
+    bool closestHit(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, BvhHit& hit, int facing = 0) const
+    {
+        hit = BvhHit();
+        if (nodes.empty())
+            return false;
+
+        glm::vec3 invDir(safeInverse(dir.x), safeInverse(dir.y), safeInverse(dir.z));
+        float best = maxDistance;
+        unsigned int localStack[128];
+        std::vector<unsigned int> deepStack;
+        unsigned int* stack = traversalStack(localStack, deepStack);
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const BvhNode& node = nodes[stack[--stackSize]];
+            float tEnter, tExit;
+            if (!slabTest(node, origin, invDir, best, tEnter, tExit))
+                continue;
+
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                {
+                    const BvhTriangle& tri = triangles[i];
+                    if (facing != 0 && (glm::dot(glm::cross(tri.e1, tri.e2), dir) < 0.0f) != (facing > 0))
+                        continue;
+                    float u, v;
+                    float t = intersect(tri, origin, dir, u, v);
+                    if (t >= 0.0f && t <= best)
+                    {
+                        best = t;
+                        hit.t = t;
+                        hit.triangle = triangleIds[i];
+                        hit.u = u;
+                        hit.v = v;
+                    }
+                }
+            }
+            else
+            {
+                // Visit the nearer child first so the far one is usually culled by the best hit
+                const BvhNode& left = nodes[node.leftFirst];
+                const BvhNode& right = nodes[node.leftFirst + 1];
+                float leftEnter, rightEnter, unused;
+                bool hitLeft = slabTest(left, origin, invDir, best, leftEnter, unused);
+                bool hitRight = slabTest(right, origin, invDir, best, rightEnter, unused);
+                if (hitLeft && hitRight)
+                {
+                    bool leftFirst = leftEnter <= rightEnter;
+                    stack[stackSize++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+                    stack[stackSize++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+                }
+                else if (hitLeft || hitRight)
+                {
+                    stack[stackSize++] = hitLeft ? node.leftFirst : node.leftFirst + 1;
+                }
+            }
+        }
+        return hit.t >= 0.0f;
+    }
+
+    // Packet version of furthestHit, results land in packet.tFar (-1 = no hit)
+    void furthestHit(RayPacket& packet, float maxDistance) const
+    {
+        for (int i = 0; i < 4; i++)
+            packet.tFar[i] = -1.0f;
+        if (nodes.empty())
+            return;
+
+        unsigned int localStack[128];
+        std::vector<unsigned int> deepStack;
+        unsigned int* stack = traversalStack(localStack, deepStack);
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const BvhNode& node = nodes[stack[--stackSize]];
+
+            // Lanes that still care about this node
+            int laneMask = packetSlabTest(node, packet, maxDistance);
+            if (laneMask == 0)
+                continue;
+
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                    packetIntersect(triangles[i], packet, maxDistance, laneMask);
+            }
+            else
+            {
+                stack[stackSize++] = node.leftFirst;
+                stack[stackSize++] = node.leftFirst + 1;
+            }
+        }
+    }
+
+private:
+    // A depth-first walk holds at most one waiting sibling a level plus the node it visits, so trees up to
+    // 126 levels deep traverse with the stack array, deeper ones (long thin or degenerate meshes) with a heap one
+    unsigned int* traversalStack(unsigned int (&local)[128], std::vector<unsigned int>& heap) const
+    {
+        if (depth + 2 <= 128)
+            return local;
+        heap.resize(depth + 2);
+        return heap.data();
+    }
+
+    static float safeInverse(float v)
+    {
+        if (std::fabs(v) < 1e-20f)
+            v = (v < 0.0f) ? -1e-20f : 1e-20f;
+        return 1.0f / v;
+    }
+
+    void updateNodeBounds(BvhNode& node, const std::vector<glm::vec3>& triMin, const std::vector<glm::vec3>& triMax) const
+    {
+        node.boundsMin = glm::vec3(FLT_MAX);
+        node.boundsMax = glm::vec3(-FLT_MAX);
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+        {
+            unsigned int id = triangleIds[i];
+            node.boundsMin = glm::min(node.boundsMin, triMin[id]);
+            node.boundsMax = glm::max(node.boundsMax, triMax[id]);
+        }
+    }
+
+    static float surfaceArea(const glm::vec3& extent)
+    {
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    // Binned SAH split search, returns false when splitting is not worth it
+    bool findSplit(unsigned int first, unsigned int count, const std::vector<glm::vec3>& centroids,
+        const std::vector<glm::vec3>& triMin, const std::vector<glm::vec3>& triMax,
+        const BvhNode& node, int& bestAxis, float& bestPos) const
+    {
+        const int binCount = 12;
+        float bestCost = FLT_MAX;
+
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            centroidMin = glm::min(centroidMin, centroids[triangleIds[i]]);
+            centroidMax = glm::max(centroidMax, centroids[triangleIds[i]]);
+        }
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float lo = centroidMin[axis], hi = centroidMax[axis];
+            if (hi - lo < 1e-12f)
+                continue;
+
+            glm::vec3 binMin[binCount], binMax[binCount];
+            unsigned int binTris[binCount] = {};
+            for (int b = 0; b < binCount; b++)
+            {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+            }
+
+            float scale = binCount / (hi - lo);
+            for (unsigned int i = first; i < first + count; i++)
+            {
+                unsigned int id = triangleIds[i];
+                int b = std::min(binCount - 1, static_cast<int>((centroids[id][axis] - lo) * scale));
+                binTris[b]++;
+                binMin[b] = glm::min(binMin[b], triMin[id]);
+                binMax[b] = glm::max(binMax[b], triMax[id]);
+            }
+
+            // Sweep from both sides
+            float leftArea[binCount - 1], rightArea[binCount - 1];
+            unsigned int leftCount[binCount - 1], rightCount[binCount - 1];
+            glm::vec3 lMin(FLT_MAX), lMax(-FLT_MAX), rMin(FLT_MAX), rMax(-FLT_MAX);
+            unsigned int lSum = 0, rSum = 0;
+            for (int b = 0; b < binCount - 1; b++)
+            {
+                lSum += binTris[b];
+                lMin = glm::min(lMin, binMin[b]);
+                lMax = glm::max(lMax, binMax[b]);
+                leftCount[b] = lSum;
+                leftArea[b] = lSum ? surfaceArea(lMax - lMin) : 0.0f;
+
+                rSum += binTris[binCount - 1 - b];
+                rMin = glm::min(rMin, binMin[binCount - 1 - b]);
+                rMax = glm::max(rMax, binMax[binCount - 1 - b]);
+                rightCount[binCount - 2 - b] = rSum;
+                rightArea[binCount - 2 - b] = rSum ? surfaceArea(rMax - rMin) : 0.0f;
+            }
+
+            for (int b = 0; b < binCount - 1; b++)
+            {
+                float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestPos = lo + (b + 1) / scale;
+                }
+            }
+        }
+
+        float leafCost = count * surfaceArea(node.boundsMax - node.boundsMin);
+        return bestCost < leafCost;
+    }
+
+    static bool slabTest(const BvhNode& node, const glm::vec3& origin, const glm::vec3& invDir, float maxDistance, float& tEnter, float& tExit)
+    {
+        glm::vec3 t0 = (node.boundsMin - origin) * invDir;
+        glm::vec3 t1 = (node.boundsMax - origin) * invDir;
+        glm::vec3 tSmall = glm::min(t0, t1), tBig = glm::max(t0, t1);
+        tEnter = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+        tExit = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, maxDistance));
+        return tEnter <= tExit;
+    }
+
+    // Moller-Trumbore without back-face culling, returns -1 on a miss
+    static float intersect(const BvhTriangle& tri, const glm::vec3& origin, const glm::vec3& dir)
+    {
+        float u, v;
+        return intersect(tri, origin, dir, u, v);
+    }
+
+    static float intersect(const BvhTriangle& tri, const glm::vec3& origin, const glm::vec3& dir, float& u, float& v)
+    {
+        glm::vec3 p = glm::cross(dir, tri.e2);
+        float det = glm::dot(tri.e1, p);
+        if (std::fabs(det) < 1e-12f)
+            return -1.0f;
+        float invDet = 1.0f / det;
+        glm::vec3 s = origin - tri.v0;
+        u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return -1.0f;
+        glm::vec3 q = glm::cross(s, tri.e1);
+        v = glm::dot(dir, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return -1.0f;
+        return glm::dot(tri.e2, q) * invDet;
+    }
+
+#ifdef MY_DN_BAKER_SSE
+    static int packetSlabTest(const BvhNode& node, const RayPacket& packet, float maxDistance)
+    {
+        __m128 ox = _mm_loadu_ps(packet.ox), oy = _mm_loadu_ps(packet.oy), oz = _mm_loadu_ps(packet.oz);
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), ox), _mm_loadu_ps(packet.idx));
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), ox), _mm_loadu_ps(packet.idx));
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), oy), _mm_loadu_ps(packet.idy));
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), oy), _mm_loadu_ps(packet.idy));
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), oz), _mm_loadu_ps(packet.idz));
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), oz), _mm_loadu_ps(packet.idz));
+
+        __m128 tEnter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+        __m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(maxDistance)));
+
+        // Hit the box, and the box reaches past the lane's current furthest hit
+        __m128 hit = _mm_and_ps(_mm_cmple_ps(tEnter, tExit), _mm_cmpgt_ps(tExit, _mm_loadu_ps(packet.tFar)));
+        return _mm_movemask_ps(hit) & ((1 << packet.laneCount) - 1);
+    }
+
+    static void packetIntersect(const BvhTriangle& tri, RayPacket& packet, float maxDistance, int laneMask)
+    {
+        __m128 dx = _mm_loadu_ps(packet.dx), dy = _mm_loadu_ps(packet.dy), dz = _mm_loadu_ps(packet.dz);
+        __m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+        __m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+
+        // p = dir x e2, det = e1 . p
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+        __m128 valid = _mm_cmpge_ps(absDet, _mm_set1_ps(1e-12f));
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(valid, det), _mm_andnot_ps(valid, _mm_set1_ps(1.0f))));
+
+        // s = origin - v0, u = (s . p) / det
+        __m128 sx = _mm_sub_ps(_mm_loadu_ps(packet.ox), _mm_set1_ps(tri.v0.x));
+        __m128 sy = _mm_sub_ps(_mm_loadu_ps(packet.oy), _mm_set1_ps(tri.v0.y));
+        __m128 sz = _mm_sub_ps(_mm_loadu_ps(packet.oz), _mm_set1_ps(tri.v0.z));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+        // q = s x e1, v = (dir . q) / det, t = (e2 . q) / det
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+        __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, _mm_set1_ps(maxDistance))));
+
+        __m128 tFar = _mm_loadu_ps(packet.tFar);
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, tFar));
+        if ((_mm_movemask_ps(valid) & laneMask) == 0)
+            return;
+        _mm_storeu_ps(packet.tFar, _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, tFar)));
+    }
+#else
+    static int packetSlabTest(const BvhNode& node, const RayPacket& packet, float maxDistance)
+    {
+        int mask = 0;
+        for (int i = 0; i < packet.laneCount; i++)
+        {
+            float tEnter, tExit;
+            glm::vec3 origin(packet.ox[i], packet.oy[i], packet.oz[i]);
+            glm::vec3 invDir(packet.idx[i], packet.idy[i], packet.idz[i]);
+            if (slabTest(node, origin, invDir, maxDistance, tEnter, tExit) && tExit > packet.tFar[i])
+                mask |= 1 << i;
+        }
+        return mask;
+    }
+
+    static void packetIntersect(const BvhTriangle& tri, RayPacket& packet, float maxDistance, int laneMask)
+    {
+        for (int i = 0; i < packet.laneCount; i++)
+        {
+            if (!(laneMask & (1 << i)))
+                continue;
+            float t = intersect(tri, glm::vec3(packet.ox[i], packet.oy[i], packet.oz[i]), glm::vec3(packet.dx[i], packet.dy[i], packet.dz[i]));
+            if (t >= 0.0f && t <= maxDistance && t > packet.tFar[i])
+                packet.tFar[i] = t;
+        }
+    }
+#endif
+};
+
+void setPacketRay(RayPacket& packet, int lane, const glm::vec3& origin, const glm::vec3& dir)
+{
+    packet.ox[lane] = origin.x; packet.oy[lane] = origin.y; packet.oz[lane] = origin.z;
+    packet.dx[lane] = dir.x; packet.dy[lane] = dir.y; packet.dz[lane] = dir.z;
+    packet.idx[lane] = 1.0f / (std::fabs(dir.x) < 1e-20f ? 1e-20f : dir.x);
+    packet.idy[lane] = 1.0f / (std::fabs(dir.y) < 1e-20f ? 1e-20f : dir.y);
+    packet.idz[lane] = 1.0f / (std::fabs(dir.z) < 1e-20f ? 1e-20f : dir.z);
+}
+
+// Tangent frame around a unit vector (Duff et al. 2017)
+void orthonormalBasis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+{
+    float sign = std::copysign(1.0f, n.z);
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+// Recompute d_N for the listed vertices only, casting against an already built (or refitted) BVH
+void bakeThickness(const TriangleBvh& bvh, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+    const std::vector<uint32_t>& vertexList, std::vector<float>& d_N, const DNBakeSettings& settings = DNBakeSettings())
+{
+    if (vertexList.empty() || bvh.nodes.empty())
+        return;
+
+    const size_t packetCount = (vertexList.size() + 3) / 4;
+    globalThreadPool().parallelFor(packetCount, 64, [&](size_t begin, size_t end)
+    {
+        for (size_t p = begin; p < end; p++)
+        {
+            RayPacket packet;
+            size_t first = p * 4;
+            packet.laneCount = static_cast<int>(std::min<size_t>(4, vertexList.size() - first));
+            for (int lane = 0; lane < 4; lane++)
+            {
+                // Pad the last packet by repeating its final ray
+                size_t v = vertexList[first + std::min(lane, packet.laneCount - 1)];
+                glm::vec3 dir = -normals[v];
+                float len = glm::length(dir);
+                dir = (len > 0.0f) ? dir / len : glm::vec3(0.0f, 0.0f, -1.0f);
+                setPacketRay(packet, lane, positions[v], dir);
+            }
+
+            bvh.furthestHit(packet, settings.maxDistance);
+            for (int lane = 0; lane < packet.laneCount; lane++)
+                d_N[vertexList[first + lane]] = std::max(packet.tFar[lane], 0.0f); // No hit found = 0
+        }
+    });
+}
+
+// Compute d_N for every vertex, casting against an already built BVH
+std::vector<float> bakeThickness(const TriangleBvh& bvh, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+    const DNBakeSettings& settings = DNBakeSettings())
+{
+    std::vector<float> d_N(positions.size(), 0.0f);
+    std::vector<uint32_t> vertexList(positions.size());
+    for (size_t i = 0; i < vertexList.size(); i++)
+        vertexList[i] = static_cast<uint32_t>(i);
+    bakeThickness(bvh, positions, normals, vertexList, d_N, settings);
+    return d_N;
+}
+
+// Compute d_N for every vertex of an indexed triangle mesh
+// Vertices are cast in packets of four spread across the pool's threads
+std::vector<float> bakeThickness(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+    const std::vector<unsigned int>& indices, const DNBakeSettings& settings = DNBakeSettings())
+{
+    if (positions.empty() || indices.size() < 3)
+        return std::vector<float>(positions.size(), 0.0f);
+
+    TriangleBvh bvh;
+    bvh.build(positions, indices, settings.leafSize);
+    return bakeThickness(bvh, positions, normals, settings);
+}
+
+// Fit thickness along an inward direction w as d(w) = d_N + dot(gradient, w + normal) for every vertex
+// Least squares over two rings of rays inside the cone around -normal, so d_N itself stays exact along -normal
+// Vertices with no d_N (nothing behind them) get a zero gradient
+std::vector<glm::vec3> bakeThicknessGradient(const TriangleBvh& bvh, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+    const std::vector<float>& d_N, const DNBakeSettings& settings = DNBakeSettings())
+{
+    std::vector<glm::vec3> gradients(positions.size(), glm::vec3(0.0f));
+    if (positions.empty() || bvh.nodes.empty())
+        return gradients;
+
+    // Cone directions in the vertex frame (tangent, bitangent, -normal), the outer ring offset by half a step
+    std::vector<glm::vec3> cone;
+    float outerAngle = glm::radians(settings.gradientConeDegrees);
+    for (int ring = 0; ring < 2; ring++)
+    {
+        float polar = outerAngle * (ring + 1) * 0.5f;
+        for (unsigned int i = 0; i < DN_GRADIENT_RING_RAYS[ring]; i++)
+        {
+            float azimuth = 6.2831853f * (i + 0.5f * ring) / DN_GRADIENT_RING_RAYS[ring];
+            cone.push_back(glm::vec3(std::sin(polar) * std::cos(azimuth), std::sin(polar) * std::sin(azimuth), std::cos(polar)));
+        }
+    }
+    // Packets hold the same cone ray from four neighbouring vertices, which traverse the BVH much alike
+    const size_t packetCount = (positions.size() + 3) / 4;
+    globalThreadPool().parallelFor(packetCount, 16, [&](size_t begin, size_t end)
+    {
+        for (size_t p = begin; p < end; p++)
+        {
+            size_t first = p * 4;
+            int laneCount = static_cast<int>(std::min<size_t>(4, positions.size() - first));
+            glm::vec3 n[4], tangent[4], bitangent[4];
+            glm::mat3 normalMatrix[4];
+            glm::vec3 rhs[4];
+            for (int lane = 0; lane < 4; lane++)
+            {
+                // Pad the last packet by repeating its final vertex
+                size_t v = first + std::min(lane, laneCount - 1);
+                float len = glm::length(normals[v]);
+                n[lane] = (len > 0.0f) ? normals[v] / len : glm::vec3(0.0f, 0.0f, 1.0f);
+                orthonormalBasis(n[lane], tangent[lane], bitangent[lane]);
+                normalMatrix[lane] = glm::mat3(0.0f);
+                rhs[lane] = glm::vec3(0.0f);
+            }
+
+            for (const glm::vec3& c : cone)
+            {
+                RayPacket packet;
+                packet.laneCount = laneCount;
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    size_t v = first + std::min(lane, laneCount - 1);
+                    setPacketRay(packet, lane, positions[v], tangent[lane] * c.x + bitangent[lane] * c.y - n[lane] * c.z);
+                }
+
+                bvh.furthestHit(packet, settings.maxDistance);
+                for (int lane = 0; lane < laneCount; lane++)
+                {
+                    // Rays that escape (or only graze the neighbouring triangles) say nothing about thickness
+                    if (packet.tFar[lane] <= 1e-6f)
+                        continue;
+                    glm::vec3 offset = glm::vec3(packet.dx[lane], packet.dy[lane], packet.dz[lane]) + n[lane];
+                    normalMatrix[lane] += glm::outerProduct(offset, offset);
+                    rhs[lane] += (packet.tFar[lane] - d_N[first + lane]) * offset;
+                }
+            }
+
+            for (int lane = 0; lane < laneCount; lane++)
+            {
+                // A small ridge term keeps the solve stable when only a few rays hit
+                const glm::mat3& m = normalMatrix[lane];
+                float ridge = 1e-3f * (m[0][0] + m[1][1] + m[2][2]);
+                size_t v = first + lane;
+                if (d_N[v] > 0.0f && glm::length(normals[v]) > 0.0f && ridge > 0.0f)
+                    gradients[v] = glm::inverse(m + glm::mat3(ridge)) * rhs[lane];
+            }
+        }
+    });
+
+    return gradients;
+}
+
+#endif // MY_DN_BAKER_H
@@ -0,0 +1,276 @@
+#ifndef MY_ENVIRONMENT_PROBE_H
+#define MY_ENVIRONMENT_PROBE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <my_gl_resource.h>
+#include <my_gpu_timer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// Dynamic environment probe: a cubemap render target the scene around the model is drawn into, one face at a time,
+// so the glass refracts things that move. A full capture is six extra scene passes, so each frame only re-renders
+// a budget of faces and the rest keep what they last saw
+// The faces are RGBA16F, holding what the skybox shader samples before tone mapping (radiance for HDR skyboxes),
+// and the mips are regenerated after each update for the shaders' footprint LOD
+
+// Which faces a frame's budget goes to
+enum class ProbeSchedule
+{
+    RoundRobin = 0, // In turn, each face every 6 / budget frames
+    Priority = 1    // The stalest, weighted towards the face behind the model, which most refracted rays leave through
+};
+
+class EnvironmentProbe
+{
+public:
+    static const int FACE_COUNT = 6;
+    using DrawScene = std::function<void(const glm::mat4& projection, const glm::mat4& view)>;
+
+    EnvironmentProbe() = default;
+    EnvironmentProbe(const EnvironmentProbe&) = delete;
+    EnvironmentProbe& operator=(const EnvironmentProbe&) = delete;
+
+    // Face size of the cube created on the first update (texels)
+    void setFaceSize(int size)
+    {
+        if (size != faceSize)
+            reset();
+        faceSize = std::max(size, 1);
+    }
+
+    int size() const
+    {
+        return faceSize;
+    }
+
+    // Re-render up to budget faces around center, returns how many were
+    // viewDirection points from the camera towards the probe (the priority schedule favours the faces it faces)
+    // drawScene draws with the render target, viewport and depth buffer already set
+    int update(int budget, ProbeSchedule schedule, const glm::vec3& center, const glm::vec3& viewDirection, const DrawScene& drawScene)
+    {
+        if (!cube)
+            create();
+        frame++;
+        std::vector<int> faces = pickFaces(std::min(std::max(budget, 0), FACE_COUNT), schedule, viewDirection);
+        if (faces.empty())
+            return 0;
+
+        // Face directions and up vectors in GL's cubemap orientation
+        static const glm::vec3 directions[FACE_COUNT] = { { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+            { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+        static const glm::vec3 ups[FACE_COUNT] = { { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } };
+
+        auto start = std::chrono::high_resolution_clock::now();
+        GLint previousFramebuffer = 0, previousViewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
+        glViewport(0, 0, faceSize, faceSize);
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, 100.0f);
+        for (int face : faces)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cube.id(), 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            faceTimers[face].begin();
+            drawScene(projection, glm::lookAt(center, center + directions[face], ups[face]));
+            faceTimers[face].end();
+            lastUpdated[face] = frame;
+            rendered[face] = true;
+            updates++;
+        }
+
+        // The refracted lookups pick their mip from the ray footprint, so the chain follows the faces
+        mipTimer.begin();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cube.id());
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        mipTimer.end();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFramebuffer));
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        lastCpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return static_cast<int>(faces.size());
+    }
+
+    // The scene changed under every face (another skybox): they go to the front of the priority schedule
+    void invalidate()
+    {
+        for (uint64_t& updated : lastUpdated)
+            updated = 0;
+    }
+
+    // Every face has been rendered once, so the cube can stand in for the environment
+    bool complete() const
+    {
+        return std::all_of(rendered, rendered + FACE_COUNT, [](bool faceRendered) { return faceRendered; });
+    }
+
+    GLuint id() const
+    {
+        return cube.id();
+    }
+
+    // GPU time of a face's latest update, and the mean over all face updates
+    double faceMilliseconds(int face) const
+    {
+        return faceTimers[face].lastMilliseconds();
+    }
+
+    double averageFaceMilliseconds() const
+    {
+        double sum = 0.0;
+        int samples = 0;
+        for (const GpuTimer& timer : faceTimers)
+        {
+            sum += timer.averageMilliseconds() * timer.samples();
+            samples += timer.samples();
+        }
+        return samples > 0 ? sum / samples : 0.0;
+    }
+
+    double mipMilliseconds() const
+    {
+        return mipTimer.lastMilliseconds();
+    }
+
+    // CPU time of the last update (submission, the GPU runs it later)
+    double cpuMilliseconds() const
+    {
+        return lastCpuMilliseconds;
+    }
+
+    // Frames since the stalest face was rendered
+    uint64_t oldestFaceAge() const
+    {
+        return frame - *std::min_element(lastUpdated, lastUpdated + FACE_COUNT);
+    }
+
+    uint64_t faceUpdates() const
+    {
+        return updates;
+    }
+
+    // VRAM of the cube with its mips (RGBA16F) and the depth buffer
+    size_t gpuBytes() const
+    {
+        if (!cube)
+            return 0;
+        return static_cast<size_t>(FACE_COUNT) * faceSize * faceSize * 8 * 4 / 3 + static_cast<size_t>(faceSize) * faceSize * 4;
+    }
+
+    void reset()
+    {
+        cube.reset();
+        depth.reset();
+        framebuffer.reset();
+        for (GpuTimer& timer : faceTimers)
+            timer.reset();
+        mipTimer.reset();
+        std::fill(lastUpdated, lastUpdated + FACE_COUNT, 0);
+        std::fill(rendered, rendered + FACE_COUNT, false);
+        nextFace = 0;
+        frame = 0;
+        updates = 0;
+        lastCpuMilliseconds = 0.0;
+    }
+
+private:
+    int faceSize = 256;
+    GLTexture cube;
+    GLTexture depth;
+    GLFramebuffer framebuffer;
+    GpuTimer faceTimers[FACE_COUNT];
+    GpuTimer mipTimer;
+    uint64_t lastUpdated[FACE_COUNT] = {};
+    bool rendered[FACE_COUNT] = {};
+    int nextFace = 0;
+    uint64_t frame = 0;
+    uint64_t updates = 0;
+    double lastCpuMilliseconds = 0.0;
+
+    void create()
+    {
+        cube = GLTexture::create();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cube.id());
+        for (GLenum face = 0; face < FACE_COUNT; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA16F, faceSize, faceSize, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP); // Allocates the chain
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        depth = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, depth.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, faceSize, faceSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLint previousFramebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        framebuffer = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, cube.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth.id(), 0);
+        GLenum drawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
+        glDrawBuffers(1, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::FRAMEBUFFER:: Environment probe FBO is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFramebuffer));
+    }
+
+    // This frame's faces: faces never rendered always come first
+    std::vector<int> pickFaces(int budget, ProbeSchedule schedule, const glm::vec3& viewDirection)
+    {
+        std::vector<int> faces;
+        for (int face = 0; face < FACE_COUNT && static_cast<int>(faces.size()) < budget; face++)
+            if (!rendered[face])
+                faces.push_back(face);
+
+        if (schedule == ProbeSchedule::RoundRobin)
+        {
+            for (int i = 0; i < FACE_COUNT && static_cast<int>(faces.size()) < budget; i++)
+            {
+                int face = (nextFace + i) % FACE_COUNT;
+                if (std::find(faces.begin(), faces.end(), face) == faces.end())
+                    faces.push_back(face);
+            }
+            if (!faces.empty())
+                nextFace = (faces.back() + 1) % FACE_COUNT;
+            return faces;
+        }
+
+        // Staleness times a weight of 1 (the faces beside and in front of the model) to 3 (the face behind it)
+        float view[3] = { viewDirection.x, viewDirection.y, viewDirection.z };
+        std::vector<std::pair<float, int>> scores;
+        for (int face = 0; face < FACE_COUNT; face++)
+        {
+            if (std::find(faces.begin(), faces.end(), face) != faces.end())
+                continue;
+            float facing = (face % 2 == 0 ? 1.0f : -1.0f) * view[face / 2];
+            scores.emplace_back(static_cast<float>(frame - lastUpdated[face]) * (1.0f + 2.0f * std::max(facing, 0.0f)), face);
+        }
+        std::sort(scores.begin(), scores.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+        for (const auto& score : scores)
+        {
+            if (static_cast<int>(faces.size()) >= budget)
+                break;
+            faces.push_back(score.second);
+        }
+        return faces;
+    }
+};
+
+#endif // MY_ENVIRONMENT_PROBE_H
@@ -0,0 +1,214 @@
+#ifndef MY_EQUIRECT_H
+#define MY_EQUIRECT_H
+
+#include <glm/glm.hpp>
+
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MY_EQUIRECT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Resampling of equirectangular panoramas (longitude across, latitude down, RGB) into cubemap faces
+// The centre of the panorama faces -Z and its right quarter +X. The top row is straight up (+Y)
+// Faces come out in GL order (+X, -X, +Y, -Y, +Z, -Z), first row at t = 0 like the PNG faces
+// Each face is cut into tiles spread over the thread pool. Inside a tile, four texels at a time get their
+// direction, panorama coordinates (a polynomial atan2) and bilinear weights in SSE2 registers
+
+const int EQUIRECT_TILE_SIZE = 64;
+const float EQUIRECT_PI = 3.14159265358979f;
+
+// Direction through (sc, tc) in [-1, 1] of a face: origin + sc * sAxis + tc * tAxis (the GL cube map selection, inverted)
+const float CUBE_FACE_AXES[6][3][3] =
+{
+    { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },  // +X
+    { { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },  // -X
+    { { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },    // +Y
+    { { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } },  // -Y
+    { { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },   // +Z
+    { { 0.0f, 0.0f, -1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } }  // -Z
+};
+
+glm::vec3 cubeFaceDirection(int face, float sc, float tc)
+{
+    const float (*axes)[3] = CUBE_FACE_AXES[face];
+    return glm::vec3(axes[0][0] + sc * axes[1][0] + tc * axes[2][0],
+        axes[0][1] + sc * axes[1][1] + tc * axes[2][1],
+        axes[0][2] + sc * axes[1][2] + tc * axes[2][2]);
+}
+
+// Panorama texel coordinates of a direction (texel centres at whole numbers)
+void equirectCoordinates(const glm::vec3& direction, int width, int height, float& x, float& y)
+{
+    float longitude = std::atan2(direction.x, -direction.z);
+    float latitude = std::atan2(direction.y, std::sqrt(direction.x * direction.x + direction.z * direction.z));
+    x = (0.5f + longitude / (2.0f * EQUIRECT_PI)) * width - 0.5f;
+    y = (0.5f - latitude / EQUIRECT_PI) * height - 0.5f;
+}
+
+// Texel addresses and weights of a bilinear lookup, wrapping around in longitude and clamped at the poles
+struct EquirectTaps
+{
+    size_t offsets[4]; // Into the texel array: (x0, y0), (x1, y0), (x0, y1), (x1, y1)
+    float fx;
+    float fy;
+};
+
+EquirectTaps equirectTaps(int x0, int y0, float fx, float fy, int width, int height)
+{
+    x0 = x0 < 0 ? x0 + width : (x0 >= width ? x0 - width : x0);
+    int x1 = x0 + 1 == width ? 0 : x0 + 1;
+    int y1 = std::min(std::max(y0 + 1, 0), height - 1);
+    y0 = std::min(std::max(y0, 0), height - 1);
+    EquirectTaps taps;
+    taps.offsets[0] = (static_cast<size_t>(y0) * width + x0) * 3;
+    taps.offsets[1] = (static_cast<size_t>(y0) * width + x1) * 3;
+    taps.offsets[2] = (static_cast<size_t>(y1) * width + x0) * 3;
+    taps.offsets[3] = (static_cast<size_t>(y1) * width + x1) * 3;
+    taps.fx = fx;
+    taps.fy = fy;
+    return taps;
+}
+
+template <typename T>
+void blendTaps(const T* texels, const EquirectTaps& taps, float* rgb)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        float top = texels[taps.offsets[0] + c] + (static_cast<float>(texels[taps.offsets[1] + c]) - texels[taps.offsets[0] + c]) * taps.fx;
+        float bottom = texels[taps.offsets[2] + c] + (static_cast<float>(texels[taps.offsets[3] + c]) - texels[taps.offsets[2] + c]) * taps.fx;
+        rgb[c] = top + (bottom - top) * taps.fy;
+    }
+}
+
+#ifdef MY_EQUIRECT_SSE2
+// atan2 to about 2e-6 radians (an odd polynomial on the first octant, then the octant fixed up)
+__m128 atan2x4(__m128 y, __m128 x)
+{
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 absX = _mm_andnot_ps(signMask, x), absY = _mm_andnot_ps(signMask, y);
+    __m128 a = _mm_div_ps(_mm_min_ps(absX, absY), _mm_max_ps(_mm_max_ps(absX, absY), _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(-0.01172120f);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.05265332f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.11643287f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.19354346f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.33262347f));
+    r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.99997726f)), a);
+
+    __m128 steep = _mm_cmpgt_ps(absY, absX);
+    r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(_mm_set1_ps(EQUIRECT_PI * 0.5f), r)), _mm_andnot_ps(steep, r));
+    __m128 behind = _mm_cmplt_ps(x, _mm_setzero_ps());
+    r = _mm_or_ps(_mm_and_ps(behind, _mm_sub_ps(_mm_set1_ps(EQUIRECT_PI), r)), _mm_andnot_ps(behind, r));
+    return _mm_xor_ps(r, _mm_and_ps(y, signMask));
+}
+
+__m128 loadTexel(const unsigned char* texel)
+{
+    return _mm_setr_ps(texel[0], texel[1], texel[2], 0.0f);
+}
+
+__m128 loadTexel(const float* texel)
+{
+    return _mm_setr_ps(texel[0], texel[1], texel[2], 0.0f);
+}
+#endif
+
+// Fill one tile of a face with interleaved float RGB (rgb holds tileWidth * tileHeight * 3 floats plus one)
+template <typename T>
+void resampleEquirectTile(const T* texels, int width, int height, int face, int faceSize, int tileX, int tileY, int tileWidth, int tileHeight,
+    float* rgb, bool vectorized = true)
+{
+    float texelSize = 2.0f / faceSize;
+    const float (*axes)[3] = CUBE_FACE_AXES[face];
+    for (int row = 0; row < tileHeight; row++)
+    {
+        float tc = (tileY + row + 0.5f) * texelSize - 1.0f;
+        float* out = rgb + static_cast<size_t>(row) * tileWidth * 3;
+        int column = 0;
+#ifdef MY_EQUIRECT_SSE2
+        if (vectorized)
+        {
+            __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 scaleX = _mm_set1_ps(width / (2.0f * EQUIRECT_PI)), scaleY = _mm_set1_ps(height / EQUIRECT_PI);
+            alignas(16) int x0[4], y0[4];
+            alignas(16) float fx[4], fy[4];
+            for (; column + 4 <= tileWidth; column += 4)
+            {
+                __m128 sc = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(tileX + column)), laneOffsets), _mm_set1_ps(texelSize)),
+                    _mm_set1_ps(1.0f));
+                __m128 dx = _mm_add_ps(_mm_set1_ps(axes[0][0] + tc * axes[2][0]), _mm_mul_ps(sc, _mm_set1_ps(axes[1][0])));
+                __m128 dy = _mm_add_ps(_mm_set1_ps(axes[0][1] + tc * axes[2][1]), _mm_mul_ps(sc, _mm_set1_ps(axes[1][1])));
+                __m128 dz = _mm_add_ps(_mm_set1_ps(axes[0][2] + tc * axes[2][2]), _mm_mul_ps(sc, _mm_set1_ps(axes[1][2])));
+
+                __m128 longitude = atan2x4(dx, _mm_sub_ps(_mm_setzero_ps(), dz));
+                __m128 latitude = atan2x4(dy, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz))));
+                __m128 px = _mm_add_ps(_mm_mul_ps(longitude, scaleX), _mm_set1_ps(width * 0.5f - 0.5f));
+                __m128 py = _mm_sub_ps(_mm_set1_ps(height * 0.5f - 0.5f), _mm_mul_ps(latitude, scaleY));
+
+                // floor() as truncation of a value made positive (both are at least -1)
+                __m128i ix = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(px, _mm_set1_ps(1.0f))), _mm_set1_epi32(1));
+                __m128i iy = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(py, _mm_set1_ps(1.0f))), _mm_set1_epi32(1));
+                _mm_store_si128(reinterpret_cast<__m128i*>(x0), ix);
+                _mm_store_si128(reinterpret_cast<__m128i*>(y0), iy);
+                _mm_store_ps(fx, _mm_sub_ps(px, _mm_cvtepi32_ps(ix)));
+                _mm_store_ps(fy, _mm_sub_ps(py, _mm_cvtepi32_ps(iy)));
+
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    EquirectTaps taps = equirectTaps(x0[lane], y0[lane], fx[lane], fy[lane], width, height);
+                    __m128 t00 = loadTexel(texels + taps.offsets[0]), t10 = loadTexel(texels + taps.offsets[1]);
+                    __m128 t01 = loadTexel(texels + taps.offsets[2]), t11 = loadTexel(texels + taps.offsets[3]);
+                    __m128 wx = _mm_set1_ps(taps.fx);
+                    __m128 top = _mm_add_ps(t00, _mm_mul_ps(_mm_sub_ps(t10, t00), wx));
+                    __m128 bottom = _mm_add_ps(t01, _mm_mul_ps(_mm_sub_ps(t11, t01), wx));
+                    __m128 result = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(taps.fy)));
+                    _mm_storeu_ps(out + (column + lane) * 3, result); // The fourth float is the next texel's, or the padding
+                }
+            }
+        }
+#endif
+        for (; column < tileWidth; column++)
+        {
+            float sc = (tileX + column + 0.5f) * texelSize - 1.0f;
+            float x, y;
+            equirectCoordinates(cubeFaceDirection(face, sc, tc), width, height, x, y);
+            float floorX = std::floor(x), floorY = std::floor(y);
+            EquirectTaps taps = equirectTaps(static_cast<int>(floorX), static_cast<int>(floorY), x - floorX, y - floorY, width, height);
+            blendTaps(texels, taps, out + column * 3);
+        }
+    }
+}
+
+// Resample a width x height panorama into six faceSize x faceSize faces. sink(face, x, y, tileWidth, tileHeight, rgb) receives each
+// tile as interleaved float RGB, from several threads at once when parallel (tiles never overlap)
+template <typename T, typename Sink>
+void equirectToCubemap(const T* texels, int width, int height, int faceSize, Sink&& sink, bool vectorized = true, bool parallel = true)
+{
+    size_t tilesPerRow = static_cast<size_t>((faceSize + EQUIRECT_TILE_SIZE - 1) / EQUIRECT_TILE_SIZE);
+    size_t tilesPerFace = tilesPerRow * tilesPerRow;
+    auto resampleTiles = [&](size_t begin, size_t end)
+    {
+        std::vector<float> tile(static_cast<size_t>(EQUIRECT_TILE_SIZE) * EQUIRECT_TILE_SIZE * 3 + 1);
+        for (size_t index = begin; index < end; index++)
+        {
+            int face = static_cast<int>(index / tilesPerFace);
+            int tileX = static_cast<int>(index % tilesPerFace % tilesPerRow) * EQUIRECT_TILE_SIZE;
+            int tileY = static_cast<int>(index % tilesPerFace / tilesPerRow) * EQUIRECT_TILE_SIZE;
+            int tileWidth = std::min(EQUIRECT_TILE_SIZE, faceSize - tileX), tileHeight = std::min(EQUIRECT_TILE_SIZE, faceSize - tileY);
+            resampleEquirectTile(texels, width, height, face, faceSize, tileX, tileY, tileWidth, tileHeight, tile.data(), vectorized);
+            sink(face, tileX, tileY, tileWidth, tileHeight, tile.data());
+        }
+    };
+    if (parallel)
+        globalThreadPool().parallelFor(6 * tilesPerFace, 2, resampleTiles);
+    else
+        resampleTiles(0, 6 * tilesPerFace);
+}
+
+#endif // MY_EQUIRECT_H
@@ -0,0 +1,489 @@
+#ifndef MY_GEOMETRY_POOL_H
+#define MY_GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <my_gl_resource.h>
+#include <my_shader.h>
+#include <my_staging_ring.h>
+#include <my_vertex_packing.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// All mesh geometry lives in one vertex buffer and two index buffers (16/32-bit) under a single VAO
+// Draws are queued as indirect commands and submitted together: one glMultiDrawElementsIndirect per
+// index width on GL 4.3+, glMultiDrawElementsBaseVertex per mesh otherwise
+
+const size_t GEOMETRY_POOL_INITIAL_VERTICES = 64 * 1024;
+const size_t GEOMETRY_POOL_INITIAL_INDICES = 192 * 1024;
+const size_t GEOMETRY_POOL_INITIAL_SLOTS = 256;
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance; // Selects the per-mesh dequantization in the draw data buffer
+};
+
+// Per-mesh data read as instanced attributes 3 and 4
+struct MeshDrawData
+{
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+};
+
+// First-fit allocator over [0, capacity) that merges neighbouring free ranges
+class RangeAllocator
+{
+public:
+    size_t capacity() const
+    {
+        return totalCapacity;
+    }
+
+    bool allocate(size_t count, size_t& offset)
+    {
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            if (it->second < count)
+                continue;
+            offset = it->first;
+            size_t remaining = it->second - count;
+            freeRanges.erase(it);
+            if (remaining > 0)
+                freeRanges[offset + count] = remaining;
+            return true;
+        }
+        return false;
+    }
+
+    void free(size_t offset, size_t count)
+    {
+        if (count == 0)
+            return;
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                count += previous->second;
+                freeRanges.erase(previous);
+            }
+        }
+        if (next != freeRanges.end() && offset + count == next->first)
+        {
+            count += next->second;
+            freeRanges.erase(next);
+        }
+        freeRanges[offset] = count;
+    }
+
+    void grow(size_t newCapacity)
+    {
+        if (newCapacity > totalCapacity)
+            free(totalCapacity, newCapacity - totalCapacity);
+        totalCapacity = std::max(totalCapacity, newCapacity);
+    }
+
+private:
+    std::map<size_t, size_t> freeRanges; // Offset -> size
+    size_t totalCapacity = 0;
+};
+
+// A GL buffer sub-allocated in fixed-size elements, grown by copying into a bigger buffer
+class GeometryArena
+{
+public:
+    GLBuffer buffer;
+    size_t elementSize = 0;
+
+    void init(size_t elementSize, size_t initialCapacity)
+    {
+        this->elementSize = elementSize;
+        buffer = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.id());
+        glBufferData(GL_COPY_WRITE_BUFFER, initialCapacity * elementSize, nullptr, GL_STATIC_DRAW);
+        ranges.grow(initialCapacity);
+    }
+
+    // Returns false if the buffer had to be replaced (anything pointing at the old one must be rebound)
+    bool allocate(size_t count, size_t& offset)
+    {
+        if (ranges.allocate(count, offset))
+            return true;
+
+        size_t oldCapacity = ranges.capacity();
+        size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + count);
+        GLBuffer newBuffer = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer.id());
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * elementSize, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer.id());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * elementSize);
+        buffer = std::move(newBuffer); // Deletes the old buffer
+
+        ranges.grow(newCapacity);
+        ranges.allocate(count, offset);
+        return false;
+    }
+
+    void upload(size_t offset, size_t count, const void* data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset * elementSize, count * elementSize, data);
+    }
+
+    void free(size_t offset, size_t count)
+    {
+        ranges.free(offset, count);
+    }
+
+    size_t bytes() const
+    {
+        return ranges.capacity() * elementSize;
+    }
+
+private:
+    RangeAllocator ranges;
+};
+
+// Where one mesh lives in the pool
+struct GeometryAllocation
+{
+    uint32_t baseVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    uint32_t drawSlot = 0;  // Index into the draw data buffer
+    bool valid = false;
+};
+
+class GeometryPool
+{
+public:
+    explicit GeometryPool(VertexFormat format)
+        : format(format)
+    {
+        // Indirect draws with baseInstance need 4.3; the fallback sets the per-mesh attributes directly
+        indirect = GLAD_GL_VERSION_4_3 != 0;
+
+        vertices.init(format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex), GEOMETRY_POOL_INITIAL_VERTICES);
+        shortIndices.init(sizeof(uint16_t), GEOMETRY_POOL_INITIAL_INDICES);
+        indices.init(sizeof(unsigned int), GEOMETRY_POOL_INITIAL_INDICES);
+        drawData.init(sizeof(MeshDrawData), GEOMETRY_POOL_INITIAL_SLOTS);
+        indirectBuffer = GLBuffer::create();
+        VAO = GLVertexArray::create();
+        setupAttributes();
+
+        std::cout << "Geometry pool: " << (indirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElementsBaseVertex (GL < 4.3)") << "\n";
+    }
+
+    VertexFormat vertexFormat() const
+    {
+        return format;
+    }
+
+    // Copy a mesh into the pool (indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, indices relative to the mesh)
+    GeometryAllocation allocate(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, GLenum indexType,
+        const glm::vec3& positionScale = glm::vec3(1.0f), const glm::vec3& positionOffset = glm::vec3(0.0f))
+    {
+        GeometryAllocation allocation = reserve(vertexCount, indexCount, indexType, positionScale, positionOffset);
+        vertices.upload(allocation.baseVertex, vertexCount, vertexData);
+        indexArena(indexType).upload(allocation.firstIndex, indexCount, indexData);
+        return allocation;
+    }
+
+    // Claim space for a mesh whose vertices and indices are streamed in later
+    GeometryAllocation reserve(size_t vertexCount, size_t indexCount, GLenum indexType,
+        const glm::vec3& positionScale = glm::vec3(1.0f), const glm::vec3& positionOffset = glm::vec3(0.0f))
+    {
+        GeometryAllocation allocation;
+        size_t vertexOffset = 0, indexOffset = 0, slot = 0;
+        bool vertexBufferKept = vertices.allocate(vertexCount, vertexOffset);
+        indexArena(indexType).allocate(indexCount, indexOffset);
+        bool drawDataKept = drawData.allocate(1, slot);
+        if (!vertexBufferKept || !drawDataKept)
+        {
+            setupAttributes();
+            std::cout << "Geometry pool grown to " << bufferBytes() / (1024 * 1024) << " MB\n";
+        }
+
+        MeshDrawData meshDrawData = { positionScale, positionOffset };
+        drawData.upload(slot, 1, &meshDrawData);
+        if (slotData.size() <= slot)
+            slotData.resize(slot + 1);
+        slotData[slot] = meshDrawData;
+
+        allocation.baseVertex = static_cast<uint32_t>(vertexOffset);
+        allocation.vertexCount = static_cast<uint32_t>(vertexCount);
+        allocation.firstIndex = static_cast<uint32_t>(indexOffset);
+        allocation.indexCount = static_cast<uint32_t>(indexCount);
+        allocation.indexType = indexType;
+        allocation.drawSlot = static_cast<uint32_t>(slot);
+        allocation.valid = true;
+        return allocation;
+    }
+
+    // Fill a reserved allocation from buffers holding exactly its vertices and indices (a GPU-side copy)
+    void copyStaged(const GeometryAllocation& allocation, GLuint vertexBuffer, GLuint indexBuffer)
+    {
+        GeometryArena& arena = indexArena(allocation.indexType);
+        if (allocation.vertexCount > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vertices.buffer.id());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, allocation.baseVertex * vertices.elementSize, allocation.vertexCount * vertices.elementSize);
+        }
+        if (allocation.indexCount > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, arena.buffer.id());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, allocation.firstIndex * arena.elementSize, allocation.indexCount * arena.elementSize);
+        }
+    }
+
+    // Largest vertex/index run streamVertices/streamIndices take per call
+    size_t vertexChunk() const
+    {
+        return STAGING_CHUNK_BYTES / vertices.elementSize;
+    }
+
+    size_t indexChunk(GLenum indexType) const
+    {
+        return STAGING_CHUNK_BYTES / indexSize(indexType);
+    }
+
+    // Stream count vertices from first on through the staging ring; fill writes them in the pool's layout
+    template <typename Fill>
+    void streamVertices(const GeometryAllocation& allocation, size_t first, size_t count, Fill fill)
+    {
+        staging.write(vertices.buffer.id(), (allocation.baseVertex + first) * vertices.elementSize, count * vertices.elementSize, fill);
+    }
+
+    // Overwrite count vertices from first on in place (already in the pool's layout), for small per-frame updates
+    void updateVertices(const GeometryAllocation& allocation, size_t first, size_t count, const void* data)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer.id());
+        glBufferSubData(GL_ARRAY_BUFFER, (allocation.baseVertex + first) * vertices.elementSize, count * vertices.elementSize, data);
+    }
+
+    // Replace a mesh's dequantization (its packed vertices must then be rewritten for it)
+    void updateDrawData(const GeometryAllocation& allocation, const glm::vec3& positionScale, const glm::vec3& positionOffset)
+    {
+        MeshDrawData meshDrawData = { positionScale, positionOffset };
+        drawData.upload(allocation.drawSlot, 1, &meshDrawData);
+        slotData[allocation.drawSlot] = meshDrawData;
+    }
+
+    template <typename Fill>
+    void streamIndices(const GeometryAllocation& allocation, size_t first, size_t count, Fill fill)
+    {
+        GeometryArena& arena = indexArena(allocation.indexType);
+        staging.write(arena.buffer.id(), (allocation.firstIndex + first) * arena.elementSize, count * arena.elementSize, fill);
+    }
+
+    void free(GeometryAllocation& allocation)
+    {
+        if (!allocation.valid)
+            return;
+        vertices.free(allocation.baseVertex, allocation.vertexCount);
+        indexArena(allocation.indexType).free(allocation.firstIndex, allocation.indexCount);
+        drawData.free(allocation.drawSlot, 1);
+        allocation.valid = false;
+    }
+
+    size_t allocationBytes(const GeometryAllocation& allocation) const
+    {
+        return allocation.vertexCount * vertices.elementSize + allocation.indexCount * indexSize(allocation.indexType);
+    }
+
+    // Size of the shared buffers, used or not
+    size_t bufferBytes() const
+    {
+        return vertices.bytes() + shortIndices.bytes() + indices.bytes() + drawData.bytes();
+    }
+
+    // Start collecting draws for one submit (a model, or a whole scene)
+    void beginBatch()
+    {
+        shortCommands.clear();
+        commands.clear();
+    }
+
+    // Queue indexCount indices starting firstIndex indices into an allocation
+    void addDraw(const GeometryAllocation& allocation, uint32_t firstIndex, uint32_t indexCount)
+    {
+        DrawElementsIndirectCommand command = { indexCount, 1, allocation.firstIndex + firstIndex, static_cast<GLint>(allocation.baseVertex), allocation.drawSlot };
+        (allocation.indexType == GL_UNSIGNED_SHORT ? shortCommands : commands).push_back(command);
+    }
+
+    // Draw everything queued since beginBatch
+    void submit(Shader& shader)
+    {
+        shader.setBool("packedNormals", format == VertexFormat::Packed);
+
+        glBindVertexArray(VAO.id());
+        submitCommands(shortCommands, shortIndices, GL_UNSIGNED_SHORT);
+        submitCommands(commands, indices, GL_UNSIGNED_INT);
+        glBindVertexArray(0);
+
+        // Set active back to 0
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    VertexFormat format;
+    bool indirect = false;
+    GLVertexArray VAO;
+    GLBuffer indirectBuffer;
+    GeometryArena vertices, shortIndices, indices, drawData;
+    StagingRing staging;
+    std::vector<MeshDrawData> slotData; // CPU copy for the non-indirect path
+    std::vector<DrawElementsIndirectCommand> shortCommands, commands;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+
+    GeometryArena& indexArena(GLenum indexType)
+    {
+        return (indexType == GL_UNSIGNED_SHORT) ? shortIndices : indices;
+    }
+
+    static size_t indexSize(GLenum indexType)
+    {
+        return (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(unsigned int);
+    }
+
+    // Point the VAO at the current buffers (again after any of them grew)
+    void setupAttributes()
+    {
+        glBindVertexArray(VAO.id());
+        glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer.id());
+        GLsizei stride = static_cast<GLsizei>(vertices.elementSize);
+        if (format == VertexFormat::Packed)
+        {
+            // Vertex positions (unorm16, dequantized in the shader)
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+
+            // Vertex normals (octahedral snorm16, decoded in the shader)
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+
+            // d_N and its directional gradient (half floats)
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, thickness));
+
+            // Surface map coordinates (unorm16)
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, texCoords));
+        }
+        else
+        {
+            // Vertex positions
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+
+            // Vertex normals
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, Normal));
+
+            // d_N and its directional gradient, which follows it in Vertex
+            static_assert(offsetof(Vertex, d_NGradient) == offsetof(Vertex, d_N) + sizeof(float), "d_N gradient must follow d_N");
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, d_N));
+
+            // Surface map coordinates
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, TexCoords));
+        }
+
+        // Per-mesh dequantization, one element per draw picked by baseInstance
+        if (indirect)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, drawData.buffer.id());
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(MeshDrawData), (void*)offsetof(MeshDrawData, positionScale));
+            glVertexAttribDivisor(3, 1);
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(MeshDrawData), (void*)offsetof(MeshDrawData, positionOffset));
+            glVertexAttribDivisor(4, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    void submitCommands(const std::vector<DrawElementsIndirectCommand>& queued, const GeometryArena& indexArena, GLenum indexType)
+    {
+        if (queued.empty())
+            return;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexArena.buffer.id());
+        size_t indexBytes = indexSize(indexType);
+
+        if (indirect)
+        {
+            // Orphan and refill the command buffer, then one call for the whole batch
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.id());
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, queued.size() * sizeof(DrawElementsIndirectCommand), queued.data(), GL_STREAM_DRAW);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, 0, static_cast<GLsizei>(queued.size()), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return;
+        }
+
+        // No baseInstance: set the dequantization as constant attributes, one multi-draw per mesh
+        for (size_t begin = 0; begin < queued.size();)
+        {
+            size_t end = begin;
+            drawCounts.clear();
+            drawOffsets.clear();
+            drawBaseVertices.clear();
+            while (end < queued.size() && queued[end].baseInstance == queued[begin].baseInstance)
+            {
+                drawCounts.push_back(static_cast<GLsizei>(queued[end].count));
+                drawOffsets.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(queued[end].firstIndex) * indexBytes));
+                drawBaseVertices.push_back(queued[end].baseVertex);
+                end++;
+            }
+
+            const MeshDrawData& meshDrawData = slotData[queued[begin].baseInstance];
+            glVertexAttrib3f(3, meshDrawData.positionScale.x, meshDrawData.positionScale.y, meshDrawData.positionScale.z);
+            glVertexAttrib3f(4, meshDrawData.positionOffset.x, meshDrawData.positionOffset.y, meshDrawData.positionOffset.z);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(),
+                static_cast<GLsizei>(drawCounts.size()), drawBaseVertices.data());
+            begin = end;
+        }
+    }
+};
+
+// One shared pool per vertex layout, created on first use (needs the context thread)
+std::unique_ptr<GeometryPool> geometryPools[2];
+
+GeometryPool& geometryPool(VertexFormat format)
+{
+    std::unique_ptr<GeometryPool>& pool = geometryPools[format == VertexFormat::Packed ? 1 : 0];
+    if (!pool)
+        pool = std::make_unique<GeometryPool>(format);
+    return *pool;
+}
+
+// Delete the pools' buffers, after every Mesh in them and before the context goes away
+void releaseGeometryPools()
+{
+    for (auto& pool : geometryPools)
+        pool.reset();
+}
+
+#endif // MY_GEOMETRY_POOL_H
@@ -0,0 +1,123 @@
+#ifndef MY_GL_RESOURCE_H
+#define MY_GL_RESOURCE_H
+
+#include <glad/glad.h>
+
+#include <utility>
+
+// Move-only owners for OpenGL object names, deleted when the owner goes out of scope
+// Destruction calls into GL, so anything global must be reset before the context is destroyed
+
+template <typename Traits>
+class GLResource
+{
+public:
+    GLResource() = default;
+
+    ~GLResource()
+    {
+        reset();
+    }
+
+    GLResource(const GLResource&) = delete;
+    GLResource& operator=(const GLResource&) = delete;
+
+    GLResource(GLResource&& other) noexcept
+        : name(other.name)
+    {
+        other.name = 0;
+    }
+
+    GLResource& operator=(GLResource&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    // Create a new object (extra arguments go to the GL create call, e.g. a shader type)
+    template <typename... Args>
+    static GLResource create(Args... args)
+    {
+        GLResource resource;
+        resource.name = Traits::create(args...);
+        return resource;
+    }
+
+    // Delete the object now
+    void reset()
+    {
+        if (name != 0)
+            Traits::destroy(name);
+        name = 0;
+    }
+
+    GLuint id() const
+    {
+        return name;
+    }
+
+    explicit operator bool() const
+    {
+        return name != 0;
+    }
+
+private:
+    GLuint name = 0;
+};
+
+struct GLBufferTraits
+{
+    static GLuint create() { GLuint name = 0; glGenBuffers(1, &name); return name; }
+    static void destroy(GLuint name) { glDeleteBuffers(1, &name); }
+};
+
+struct GLVertexArrayTraits
+{
+    static GLuint create() { GLuint name = 0; glGenVertexArrays(1, &name); return name; }
+    static void destroy(GLuint name) { glDeleteVertexArrays(1, &name); }
+};
+
+struct GLTextureTraits
+{
+    static GLuint create() { GLuint name = 0; glGenTextures(1, &name); return name; }
+    static void destroy(GLuint name) { glDeleteTextures(1, &name); }
+};
+
+struct GLFramebufferTraits
+{
+    static GLuint create() { GLuint name = 0; glGenFramebuffers(1, &name); return name; }
+    static void destroy(GLuint name) { glDeleteFramebuffers(1, &name); }
+};
+
+struct GLShaderTraits
+{
+    static GLuint create(GLenum type) { return glCreateShader(type); }
+    static void destroy(GLuint name) { glDeleteShader(name); }
+};
+
+struct GLProgramTraits
+{
+    static GLuint create() { return glCreateProgram(); }
+    static void destroy(GLuint name) { glDeleteProgram(name); }
+};
+
+struct GLQueryTraits
+{
+    static GLuint create() { GLuint name = 0; glGenQueries(1, &name); return name; }
+    static void destroy(GLuint name) { glDeleteQueries(1, &name); }
+};
+
+using GLBuffer = GLResource<GLBufferTraits>;
+using GLVertexArray = GLResource<GLVertexArrayTraits>;
+using GLTexture = GLResource<GLTextureTraits>;
+using GLFramebuffer = GLResource<GLFramebufferTraits>;
+using GLShaderObject = GLResource<GLShaderTraits>;
+using GLProgram = GLResource<GLProgramTraits>;
+using GLQuery = GLResource<GLQueryTraits>;
+
+#endif // MY_GL_RESOURCE_H
@@ -0,0 +1,107 @@
+#ifndef MY_GPU_TIMER_H
+#define MY_GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <my_gl_resource.h>
+
+#include <cstdint>
+
+// GPU time of the commands between begin() and end() (GL_TIME_ELAPSED), read back a few frames later from a ring
+// of queries so the render thread never waits on the GPU. Only one timer may be running at a time (GL allows a
+// single TIME_ELAPSED query), so passes are timed one after another, not nested
+class GpuTimer
+{
+public:
+    static const int QUERY_COUNT = 4;
+
+    void begin()
+    {
+        collect();
+        if (!queries[0])
+            for (GLQuery& query : queries)
+                query = GLQuery::create();
+        // Every query still in flight: skip this frame rather than stall
+        running = !pending[next];
+        if (running)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next].id());
+    }
+
+    void end()
+    {
+        if (!running)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % QUERY_COUNT;
+        running = false;
+    }
+
+    // Latest result read back
+    double lastMilliseconds() const
+    {
+        return last;
+    }
+
+    // Mean of the results read back since resetAverage()
+    double averageMilliseconds() const
+    {
+        return count > 0 ? sum / count : 0.0;
+    }
+
+    int samples() const
+    {
+        return count;
+    }
+
+    void resetAverage()
+    {
+        sum = 0.0;
+        count = 0;
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            queries[i].reset();
+            pending[i] = false;
+        }
+        next = 0;
+        running = false;
+        last = 0.0;
+        resetAverage();
+    }
+
+private:
+    GLQuery queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT] = {};
+    int next = 0;
+    bool running = false;
+    double last = 0.0;
+    double sum = 0.0;
+    int count = 0;
+
+    // Read back the results that are available, oldest first
+    void collect()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            int index = (next + i) % QUERY_COUNT;
+            if (!pending[index])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[index].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[index].id(), GL_QUERY_RESULT, &nanoseconds);
+            pending[index] = false;
+            last = static_cast<double>(nanoseconds) / 1e6;
+            sum += last;
+            count++;
+        }
+    }
+};
+
+#endif // MY_GPU_TIMER_H
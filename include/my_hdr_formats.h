@@ -0,0 +1,208 @@
+#ifndef MY_HDR_FORMATS_H
+#define MY_HDR_FORMATS_H
+
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MY_HDR_FORMATS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Packing of linear float RGB into the two 32-bit HDR texture formats, so HDR skyboxes take 4 bytes a texel
+// like the (padded) LDR ones instead of 12 or 16 as float textures:
+// RGB9E5: three 9-bit mantissas sharing a 5-bit exponent (GL_RGB9_E5, GL_UNSIGNED_INT_5_9_9_9_REV). More precise
+// in the brightest channel, but the dim channels of a saturated colour lose bits
+// R11G11B10F: unsigned floats with their own 5-bit exponent and 6, 6 and 5-bit mantissas (GL_R11F_G11F_B10F,
+// GL_UNSIGNED_INT_10F_11F_11F_REV)
+// Negative and NaN values become 0, values past the largest one are clamped to it
+
+enum class HdrPacking
+{
+    RGB9E5,
+    R11G11B10F
+};
+
+const float RGB9E5_MAX = 65408.0f; // (2^9 - 1) / 2^9 * 2^(31 - 15)
+const float FLOAT11_MAX = 65024.0f; // (2 - 2^-6) * 2^15
+const float FLOAT10_MAX = 64512.0f; // (2 - 2^-5) * 2^15
+
+uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+float clampHdr(float value, float maxValue)
+{
+    return value > 0.0f ? std::min(value, maxValue) : 0.0f; // NaN fails the comparison
+}
+
+// EXT_texture_shared_exponent's packing
+uint32_t packRGB9E5(float r, float g, float b)
+{
+    r = clampHdr(r, RGB9E5_MAX);
+    g = clampHdr(g, RGB9E5_MAX);
+    b = clampHdr(b, RGB9E5_MAX);
+    float maxChannel = std::max(r, std::max(g, b));
+
+    // floor(log2(maxChannel)) from the float's exponent, at least -16
+    int exponent = std::max(static_cast<int>(floatBits(maxChannel) >> 23) - 127, -16);
+    int sharedExponent = exponent + 1 + 15;
+    float scale = bitsFloat(static_cast<uint32_t>(151 - sharedExponent) << 23); // 2^(15 + 9 - sharedExponent)
+    if (static_cast<int>(maxChannel * scale + 0.5f) == 512)
+    {
+        sharedExponent++;
+        scale *= 0.5f;
+    }
+    uint32_t rs = static_cast<uint32_t>(r * scale + 0.5f);
+    uint32_t gs = static_cast<uint32_t>(g * scale + 0.5f);
+    uint32_t bs = static_cast<uint32_t>(b * scale + 0.5f);
+    return rs | (gs << 9) | (bs << 18) | (static_cast<uint32_t>(sharedExponent) << 27);
+}
+
+void unpackRGB9E5(uint32_t packed, float rgb[3])
+{
+    float scale = std::ldexp(1.0f, static_cast<int>(packed >> 27) - 15 - 9);
+    rgb[0] = static_cast<float>(packed & 511) * scale;
+    rgb[1] = static_cast<float>((packed >> 9) & 511) * scale;
+    rgb[2] = static_cast<float>((packed >> 18) & 511) * scale;
+}
+
+// Unsigned float with a 5-bit exponent and mantissaBits of mantissa, rounded to nearest even
+uint32_t packUnsignedFloat(float value, int mantissaBits, float maxValue)
+{
+    value = clampHdr(value, maxValue);
+    if (value < 1.0f / 16384.0f)
+        return static_cast<uint32_t>(std::nearbyint(value * std::ldexp(1.0f, 14 + mantissaBits))); // Denormal
+    uint32_t bits = floatBits(value) - (112u << 23); // Rebias the exponent from 127 to 15
+    int shift = 23 - mantissaBits;
+    return (bits + ((1u << (shift - 1)) - 1) + ((bits >> shift) & 1)) >> shift;
+}
+
+float unpackUnsignedFloat(uint32_t packed, int mantissaBits)
+{
+    uint32_t exponent = packed >> mantissaBits, mantissa = packed & ((1u << mantissaBits) - 1);
+    if (exponent == 0)
+        return std::ldexp(static_cast<float>(mantissa), -14 - mantissaBits);
+    return std::ldexp(1.0f + static_cast<float>(mantissa) / static_cast<float>(1u << mantissaBits), static_cast<int>(exponent) - 15);
+}
+
+uint32_t packR11G11B10F(float r, float g, float b)
+{
+    return packUnsignedFloat(r, 6, FLOAT11_MAX) | (packUnsignedFloat(g, 6, FLOAT11_MAX) << 11) | (packUnsignedFloat(b, 5, FLOAT10_MAX) << 22);
+}
+
+void unpackR11G11B10F(uint32_t packed, float rgb[3])
+{
+    rgb[0] = unpackUnsignedFloat(packed & 0x7FF, 6);
+    rgb[1] = unpackUnsignedFloat((packed >> 11) & 0x7FF, 6);
+    rgb[2] = unpackUnsignedFloat(packed >> 22, 5);
+}
+
+#ifdef MY_HDR_FORMATS_SSE2
+__m128i selectInt(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Four texels of packRGB9E5
+__m128i packRGB9E5x4(__m128 r, __m128 g, __m128 b)
+{
+    __m128 maxValue = _mm_set1_ps(RGB9E5_MAX), half = _mm_set1_ps(0.5f);
+    r = _mm_min_ps(_mm_max_ps(r, _mm_setzero_ps()), maxValue); // max_ps returns the second operand for NaN
+    g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), maxValue);
+    b = _mm_min_ps(_mm_max_ps(b, _mm_setzero_ps()), maxValue);
+    __m128 maxChannel = _mm_max_ps(r, _mm_max_ps(g, b));
+
+    __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(maxChannel), 23), _mm_set1_epi32(127));
+    exponent = selectInt(_mm_cmplt_epi32(exponent, _mm_set1_epi32(-16)), _mm_set1_epi32(-16), exponent);
+    __m128i sharedExponent = _mm_add_epi32(exponent, _mm_set1_epi32(16));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(151), sharedExponent), 23));
+
+    __m128i maxScaled = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxChannel, scale), half));
+    __m128i overflow = _mm_cmpeq_epi32(maxScaled, _mm_set1_epi32(512));
+    sharedExponent = _mm_sub_epi32(sharedExponent, overflow); // The mask is -1 where set
+    scale = _mm_mul_ps(scale, _mm_castsi128_ps(selectInt(overflow, _mm_castps_si128(half), _mm_castps_si128(_mm_set1_ps(1.0f)))));
+
+    __m128i rs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+    __m128i gs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+    __m128i bs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+    return _mm_or_si128(_mm_or_si128(rs, _mm_slli_epi32(gs, 9)), _mm_or_si128(_mm_slli_epi32(bs, 18), _mm_slli_epi32(sharedExponent, 27)));
+}
+
+// Four values of packUnsignedFloat
+__m128i packUnsignedFloatx4(__m128 value, int mantissaBits, float maxValue)
+{
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(maxValue));
+    __m128i denormal = _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(std::ldexp(1.0f, 14 + mantissaBits)))); // Rounds to nearest even
+
+    int shift = 23 - mantissaBits;
+    __m128i bits = _mm_sub_epi32(_mm_castps_si128(value), _mm_set1_epi32(112 << 23));
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, shift), _mm_set1_epi32(1));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32((1 << (shift - 1)) - 1)), odd), shift);
+
+    __m128i isDenormal = _mm_castps_si128(_mm_cmplt_ps(value, _mm_set1_ps(1.0f / 16384.0f)));
+    return selectInt(isDenormal, denormal, normal);
+}
+
+__m128i packR11G11B10Fx4(__m128 r, __m128 g, __m128 b)
+{
+    __m128i rp = packUnsignedFloatx4(r, 6, FLOAT11_MAX);
+    __m128i gp = packUnsignedFloatx4(g, 6, FLOAT11_MAX);
+    __m128i bp = packUnsignedFloatx4(b, 5, FLOAT10_MAX);
+    return _mm_or_si128(rp, _mm_or_si128(_mm_slli_epi32(gp, 11), _mm_slli_epi32(bp, 22)));
+}
+#endif
+
+// Pack texels of interleaved float RGB into packed (one thread)
+void packHdrTexels(const float* rgb, size_t texels, HdrPacking packing, uint32_t* packed)
+{
+    size_t i = 0;
+#ifdef MY_HDR_FORMATS_SSE2
+    alignas(16) float r[4], g[4], b[4];
+    for (; i + 4 <= texels; i += 4)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            r[lane] = rgb[(i + lane) * 3];
+            g[lane] = rgb[(i + lane) * 3 + 1];
+            b[lane] = rgb[(i + lane) * 3 + 2];
+        }
+        __m128i result = packing == HdrPacking::RGB9E5 ? packRGB9E5x4(_mm_load_ps(r), _mm_load_ps(g), _mm_load_ps(b))
+            : packR11G11B10Fx4(_mm_load_ps(r), _mm_load_ps(g), _mm_load_ps(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(packed + i), result);
+    }
+#endif
+    for (; i < texels; i++)
+    {
+        const float* texel = rgb + i * 3;
+        packed[i] = packing == HdrPacking::RGB9E5 ? packRGB9E5(texel[0], texel[1], texel[2]) : packR11G11B10F(texel[0], texel[1], texel[2]);
+    }
+}
+
+// Pack texels of interleaved float RGB on the thread pool
+std::vector<uint32_t> packHdrImage(const float* rgb, size_t texels, HdrPacking packing)
+{
+    std::vector<uint32_t> packed(texels);
+    globalThreadPool().parallelFor(texels, 16384, [&](size_t begin, size_t end)
+    {
+        packHdrTexels(rgb + begin * 3, end - begin, packing, packed.data() + begin);
+    });
+    return packed;
+}
+
+#endif // MY_HDR_FORMATS_H
@@ -2,6 +2,8 @@
 #define MY_IMGUI
 
 // <includes>
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <sstream> // Requires C++17
 #include <iomanip> // Requires C++17
@@ -11,6 +13,10 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 #include <stb_image_write.h>
+#include <my_environment_probe.h>
+#include <my_gpu_timer.h>
+#include <my_model_catalog.h>
+#include <my_virtual_texture.h>
 // </includes>
 
 // <Screenshot>
@@ -81,6 +87,7 @@ struct FPSTracker
             std::cout << "> Min FPS: " << minFPS << "\n";
             std::cout << "> Max FPS: " << maxFPS << "\n";
             std::cout << "> Avg FPS: " << avg << "\n";
+            std::cout << "> Avg frame time: " << 1000.0f / avg << " ms\n";
             std::cout << "****************************\n\n";
         }
     }
@@ -95,15 +102,140 @@ struct FPSTracker
 // Global instance
 FPSTracker fpsTracker;
 
-enum ModelTypes
+// <Frame Trace>
+// Every frame's time written to a CSV (--frame-trace), with what was selected and what was actually drawn,
+// so the frames around a model or skybox swap can be checked for hitches
+struct FrameTrace
 {
-    TeaPot = 0,
-    Donut = 1,
-    Sphere = 2,
-    Monkey = 3,
-    Buddha = 4
+    std::ofstream file;
+    std::vector<float> frameTimes; // ms
+    bool active = false;
+
+    bool open(const std::string& path)
+    {
+        file.open(path);
+        active = static_cast<bool>(file);
+        if (active)
+            file << "frame,time_s,frame_ms,selected_model,drawn_model,selected_skybox,drawn_skybox,uploads_pending\n";
+        else
+            std::cerr << "ERROR::FRAME_TRACE:: Could not open " << path << std::endl;
+        return active;
+    }
+
+    void record(float time, float deltaTime, const std::string& selectedModel, const std::string& drawnModel,
+        const char* selectedSkybox, const char* drawnSkybox, size_t uploadsPending)
+    {
+        if (!active)
+            return;
+        float milliseconds = deltaTime * 1000.0f;
+        file << frameTimes.size() << "," << time << "," << milliseconds << "," << selectedModel << "," << drawnModel << ","
+            << selectedSkybox << "," << drawnSkybox << "," << uploadsPending << "\n";
+        frameTimes.push_back(milliseconds);
+    }
+
+    // Summary: frames more than twice the median are counted as hitches
+    void close()
+    {
+        if (!active)
+            return;
+        active = false;
+        file.close();
+        if (frameTimes.empty())
+            return;
+        std::vector<float> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        float median = sorted[sorted.size() / 2];
+        size_t hitches = static_cast<size_t>(std::count_if(frameTimes.begin(), frameTimes.end(), [median](float ms) { return ms > 2.0f * median; }));
+        std::cout << "Frame trace: " << frameTimes.size() << " frames, median " << median << " ms, worst " << sorted.back()
+            << " ms, " << hitches << " frame(s) over twice the median\n";
+    }
+};
+
+FrameTrace frameTrace;
+// </Frame Trace>
+
+// <Environment Comparison>
+// GPU time of the skybox and model passes with a setting off, then on, over the same number of frames and the same
+// view, printed with what the environment takes in VRAM each way: the cubemap against the octahedral map, or
+// sampling the top level only against the mip chain at the footprint's LOD
+// After each switch the timers are given a few frames for the queries still in flight to drain
+struct EnvironmentComparison
+{
+    static const int SETTLE_FRAMES = GpuTimer::QUERY_COUNT + 2;
+    int framesPerMode = 500;
+    int frame = 0;
+    bool active = false;
+    bool* setting = nullptr;
+    bool savedSetting = false;
+    const char* names[2] = {};
+    size_t bytes[2] = {};
+    double skyboxMilliseconds[2] = {};
+    double modelMilliseconds[2] = {};
+
+    void start(bool& compared, const char* offName, const char* onName, size_t offBytes, size_t onBytes, int frames = 500)
+    {
+        framesPerMode = frames;
+        frame = 0;
+        setting = &compared;
+        savedSetting = compared;
+        names[0] = offName;
+        names[1] = onName;
+        bytes[0] = offBytes;
+        bytes[1] = onBytes;
+        active = true;
+    }
+
+    // Once a frame, after the timed passes: sets what the next frame samples
+    void update(GpuTimer& skyboxTimer, GpuTimer& modelTimer)
+    {
+        if (!active)
+            return;
+
+        int framesPerRun = SETTLE_FRAMES + framesPerMode;
+        int mode = frame < framesPerRun ? 0 : 1;
+        int modeFrame = frame - mode * framesPerRun;
+        *setting = mode == 1;
+        if (modeFrame == SETTLE_FRAMES)
+        {
+            skyboxTimer.resetAverage();
+            modelTimer.resetAverage();
+        }
+        else if (modeFrame == framesPerRun - 1)
+        {
+            skyboxMilliseconds[mode] = skyboxTimer.averageMilliseconds();
+            modelMilliseconds[mode] = modelTimer.averageMilliseconds();
+        }
+
+        if (++frame < 2 * framesPerRun)
+            return;
+        active = false;
+        *setting = savedSetting;
+        std::cout << "Environment Comparison Results (" << framesPerMode << " frames each):\n";
+        for (int i = 0; i < 2; i++)
+            std::cout << "> " << names[i] << ": skybox " << skyboxMilliseconds[i] << " ms, model " << modelMilliseconds[i] << " ms, "
+                      << bytes[i] / (1024.0 * 1024.0) << " MB\n";
+        if (modelMilliseconds[0] > 0.0 && skyboxMilliseconds[0] > 0.0)
+            std::cout << "> " << names[1] << " / " << names[0] << ": skybox x" << skyboxMilliseconds[1] / skyboxMilliseconds[0] << ", model x"
+                      << modelMilliseconds[1] / modelMilliseconds[0] << ", memory x" << static_cast<double>(bytes[1]) / std::max<size_t>(bytes[0], 1) << "\n";
+        std::cout << "****************************\n\n";
+    }
 };
 
+EnvironmentComparison environmentComparison;
+GpuTimer skyboxPassTimer;
+GpuTimer modelPassTimer; // Both model passes with two surfaces
+// </Environment Comparison>
+
+// <Environment Probe>
+// The model refracts a cubemap captured around it (skybox and orbiting props) instead of the static skybox,
+// probeFacesPerFrame faces re-rendered each frame
+EnvironmentProbe environmentProbe;
+bool dynamicProbe = false;
+int probeFacesPerFrame = 1;
+int probeSchedule = static_cast<int>(ProbeSchedule::Priority);
+const char* probeScheduleOptions[2] = { "Round Robin", "Priority" };
+// </Environment Probe>
+
 enum RefractionMethods
 {
     OneSurface = 0,
@@ -118,18 +250,38 @@ enum Skyboxes
 };
 
 float IOR = 1.5f;
-const char* modelOptions[5] = { "Teapot", "Donut", "Sphere", "Monkey", "Buddha"};
 const char* refractionOptions[2] = { "One Surface", "Two Surfaces" };
 const char* skyboxOptions[3] = { "Graffiti", "Night Sky", "Museum" };
-ModelTypes selectedModel = TeaPot;
+int selectedModel = 0; // Index into the model catalog
 RefractionMethods selectedRefractionMethod = OneSurface;
 Skyboxes selectedSkybox = Graffiti;
 bool spinModel = false;
+bool deformModel = false;
+DeformFrameStats deformStats; // Last frame's deformation of the selected model
 bool enableReflect = true;
+float exposure = 1.0f; // Applied before tone mapping on HDR skyboxes
+bool octahedralEnvironment = false;     // Sample the octahedral map instead of the cube, once it is built
+bool octahedralAvailable = false;       // The drawn skybox has one (--octahedral-env)
+bool environmentMips = true;            // Sample the environment's mips at the lookup's footprint, else its top level
+size_t cubeEnvironmentBytes = 0;        // VRAM of the drawn skybox's cube
+size_t cubeTopLevelBytes = 0;           // Of its top level alone
+size_t octahedralEnvironmentBytes = 0;  // And of its octahedral map
+bool virtualEnvironmentActive = false;  // The drawn skybox streams from a tile file
+VirtualEnvironmentStats virtualEnvironmentStats;
 bool ImGuiUseMouse = true;
 bool screenSpaceOnly = false;
+bool directionalDN = true; // Use the baked d_N gradient along T1 instead of the d_N/d_V blend
+bool useSurfaceMaps = true; // Sample baked normal and d_N maps on models that have them
 bool takeScreenshot = false;
 bool zoomIn = false;
+bool meshletCulling = true;
+unsigned int backfacePassTriangles = 0;
+unsigned int frontfacePassTriangles = 0;
+bool autoLod = true;
+float lodPixelError = 1.0f;         // Largest simplification error allowed on screen, in pixels
+float backfaceLodErrorScale = 4.0f; // The backface pass only feeds thickness/normal lookups, so it tolerates more
+int frontfacePassLod = 0;
+int backfacePassLod = 0;
 
 void ImGuiSetup(GLFWwindow* window)
 {
@@ -158,7 +310,7 @@ void ImGuiNewFrame()
     ImGui::NewFrame();
 }
 
-void ImGuiDrawWindow()
+void ImGuiDrawWindow(const ModelCatalog& modelCatalog)
 {
     ImGui::SetNextWindowCollapsed(!ImGuiUseMouse);
     ImGui::SetNextWindowPos(ImVec2(50, 50));
@@ -171,15 +323,58 @@ void ImGuiDrawWindow()
     ImGui::Text("Screen Space Only:");
     ImGui::Checkbox("d_V only:", &screenSpaceOnly);
 
+    ImGui::Text("Thickness Along Refracted Ray:");
+    ImGui::Checkbox("Directional d_N:", &directionalDN);
+
+    ImGui::Text("Baked Normal and d_N Maps:");
+    ImGui::Checkbox("Surface Maps:", &useSurfaceMaps);
+
     ImGui::Text("Spin Model:");
     ImGui::Checkbox("Spin:", &spinModel);
 
+    ImGui::Text("Deform Model:");
+    ImGui::Checkbox("Deform:", &deformModel);
+    if (deformModel)
+        ImGui::Text("d_N: %zu / %zu rebaked, refit %.2f ms, rebake %.2f ms\nUpload: %zu vertices in %zu runs",
+            deformStats.thickness.rebakedVertices, deformStats.vertices, deformStats.thickness.refitMilliseconds,
+            deformStats.thickness.rebakeMilliseconds, deformStats.uploadedVertices, deformStats.uploadRuns);
+
     ImGui::Text("Disable Reflectance:");
     ImGui::Checkbox("Reflect:", &enableReflect);
 
     // Dropdown menu for model selection
     ImGui::Text("Select Model:");
-    ImGui::Combo("Model", reinterpret_cast<int*>(&selectedModel), modelOptions, IM_ARRAYSIZE(modelOptions));
+    if (ImGui::BeginCombo("Model", modelCatalog.size() > 0 ? modelCatalog.name(selectedModel).c_str() : "(none)"))
+    {
+        for (int i = 0; i < static_cast<int>(modelCatalog.size()); i++)
+        {
+            // Mark models that are already in GPU memory, and grey out the ones that failed to load
+            std::string label = modelCatalog.name(i) + (modelCatalog.isResident(i) ? " *" : (modelCatalog.isFailed(i) ? " (unavailable)" : ""));
+            if (ImGui::Selectable(label.c_str(), selectedModel == i, modelCatalog.isFailed(i) ? ImGuiSelectableFlags_Disabled : 0))
+                selectedModel = i;
+            if (selectedModel == i)
+                ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::Text("GPU models: %zu, %.1f / %.1f MB", modelCatalog.residentCount(),
+        modelCatalog.residentBytes() / (1024.0 * 1024.0), modelCatalog.gpuBudgetBytes / (1024.0 * 1024.0));
+
+    // Meshlet culling for the two-surface passes
+    ImGui::Text("Meshlet Culling:");
+    ImGui::Checkbox("Cull Meshlets:", &meshletCulling);
+    if (selectedRefractionMethod == TwoSurfaces)
+        ImGui::Text("Triangles: back pass %u, front pass %u", backfacePassTriangles, frontfacePassTriangles);
+
+    // Level of detail from projected size
+    ImGui::Text("Level of Detail:");
+    ImGui::Checkbox("Auto LOD:", &autoLod);
+    ImGui::SliderFloat("Pixel Error", &lodPixelError, 0.25f, 8.0f);
+    ImGui::SliderFloat("Backface Error x", &backfaceLodErrorScale, 1.0f, 16.0f);
+    if (selectedRefractionMethod == TwoSurfaces)
+        ImGui::Text("LOD: back pass %d, front pass %d", backfacePassLod, frontfacePassLod);
+    else
+        ImGui::Text("LOD: %d", frontfacePassLod);
 
     // Dropdown menu for refraction method selection
     ImGui::Text("Select Refraction Method:");
@@ -188,6 +383,59 @@ void ImGuiDrawWindow()
     // Dropdown menu for skybox selection
     ImGui::Text("Select Skybox:");
     ImGui::Combo("Skybox", reinterpret_cast<int*>(&selectedSkybox), skyboxOptions, IM_ARRAYSIZE(skyboxOptions));
+    ImGui::SliderFloat("Exposure", &exposure, 0.1f, 8.0f); // HDR skyboxes only
+    if (octahedralAvailable)
+    {
+        ImGui::Checkbox("Octahedral Env:", &octahedralEnvironment);
+        ImGui::Text("Environment: cube %.1f MB, octahedral %.1f MB", cubeEnvironmentBytes / (1024.0 * 1024.0),
+            octahedralEnvironmentBytes / (1024.0 * 1024.0));
+        if (ImGui::Button("Compare Environments") && !environmentComparison.active)
+        {
+            std::cout << "****************************\n";
+            std::cout << "Starting Environment Comparison:\n";
+            std::cout << "> Active Model: " << (modelCatalog.size() > 0 ? modelCatalog.name(selectedModel) : "(none)") << "\n";
+            std::cout << "> Active Refraction Method: " << refractionOptions[selectedRefractionMethod] << "\n";
+            std::cout << "> Active Skybox: " << skyboxOptions[selectedSkybox] << "\n";
+            std::cout << "> Reflection Active: " << enableReflect << "\n";
+            environmentComparison.start(octahedralEnvironment, "Cubemap", "Octahedral", cubeEnvironmentBytes, octahedralEnvironmentBytes);
+        }
+    }
+    if (!virtualEnvironmentActive)
+    {
+        ImGui::Checkbox("Env Mips:", &environmentMips);
+        ImGui::Text("Cube mips: %.1f MB over the top level's %.1f MB", (cubeEnvironmentBytes - cubeTopLevelBytes) / (1024.0 * 1024.0),
+            cubeTopLevelBytes / (1024.0 * 1024.0));
+        if (ImGui::Button("Compare Env Mips") && !environmentComparison.active)
+        {
+            std::cout << "****************************\n";
+            std::cout << "Starting Environment Mip Comparison:\n";
+            std::cout << "> Active Model: " << (modelCatalog.size() > 0 ? modelCatalog.name(selectedModel) : "(none)") << "\n";
+            std::cout << "> Active Refraction Method: " << refractionOptions[selectedRefractionMethod] << "\n";
+            std::cout << "> Active Skybox: " << skyboxOptions[selectedSkybox] << "\n";
+            std::cout << "> Octahedral Environment: " << (octahedralAvailable && octahedralEnvironment) << "\n";
+            std::cout << "> Reflection Active: " << enableReflect << "\n";
+            environmentComparison.start(environmentMips, "Top level", "Mips at footprint LOD", cubeTopLevelBytes, cubeEnvironmentBytes);
+        }
+    }
+    ImGui::Checkbox("Dynamic Probe:", &dynamicProbe);
+    if (dynamicProbe)
+    {
+        ImGui::SliderInt("Probe Faces/Frame", &probeFacesPerFrame, 0, EnvironmentProbe::FACE_COUNT);
+        ImGui::Combo("Probe Schedule", &probeSchedule, probeScheduleOptions, IM_ARRAYSIZE(probeScheduleOptions));
+        ImGui::Text("Probe %dx%d, %.1f MB, oldest face %llu frames old, CPU %.2f ms", environmentProbe.size(), environmentProbe.size(),
+            environmentProbe.gpuBytes() / (1024.0 * 1024.0), static_cast<unsigned long long>(environmentProbe.oldestFaceAge()),
+            environmentProbe.cpuMilliseconds());
+        ImGui::Text("Probe GPU: faces %.2f %.2f %.2f %.2f %.2f %.2f ms (mean %.2f), mips %.2f ms", environmentProbe.faceMilliseconds(0),
+            environmentProbe.faceMilliseconds(1), environmentProbe.faceMilliseconds(2), environmentProbe.faceMilliseconds(3),
+            environmentProbe.faceMilliseconds(4), environmentProbe.faceMilliseconds(5), environmentProbe.averageFaceMilliseconds(),
+            environmentProbe.mipMilliseconds());
+    }
+    if (virtualEnvironmentActive)
+        ImGui::Text("Virtual env: %zu / %zu tiles, %zu requested\n%.1f MB resident of %.1f MB (whole cubemap %.1f MB)",
+            virtualEnvironmentStats.residentTiles, virtualEnvironmentStats.cacheSlots, virtualEnvironmentStats.requestedTiles,
+            virtualEnvironmentStats.residentBytes / (1024.0 * 1024.0), virtualEnvironmentStats.gpuBytes / (1024.0 * 1024.0),
+            virtualEnvironmentStats.sourceBytes / (1024.0 * 1024.0));
+    ImGui::Text("GPU: skybox %.2f ms, model %.2f ms", skyboxPassTimer.lastMilliseconds(), modelPassTimer.lastMilliseconds());
 
     // FPS test
     ImGui::Text("Run FPS Test:");
@@ -195,12 +443,25 @@ void ImGuiDrawWindow()
     {
         std::cout << "****************************\n";
         std::cout << "Starting FPS Test:\n";
-        std::cout << "> Active Model: " << modelOptions[selectedModel] << "\n";
+        std::cout << "> Active Model: " << (modelCatalog.size() > 0 ? modelCatalog.name(selectedModel) : "(none)") << "\n";
+        std::cout << "> Vertex Format: " << (modelCatalog.vertexFormat == VertexFormat::Packed ? "packed" : "float") << "\n";
         std::cout << "> Active Refraction Method: " << refractionOptions[selectedRefractionMethod] << "\n";
         std::cout << "> Active Skybox: " << skyboxOptions[selectedSkybox] << "\n";
+        std::cout << "> Exposure (HDR skyboxes): " << exposure << "\n";
+        std::cout << "> Octahedral Environment: " << (octahedralAvailable && octahedralEnvironment) << "\n";
+        std::cout << "> Environment Mips: " << environmentMips << "\n";
+        std::cout << "> Dynamic Probe: " << dynamicProbe;
+        if (dynamicProbe)
+            std::cout << " (" << probeFacesPerFrame << " faces a frame, " << probeScheduleOptions[probeSchedule] << ")";
+        std::cout << "\n";
         std::cout << "> Reflection Active: " << enableReflect << "\n";
         std::cout << "> IOR: " << IOR << "\n";
         std::cout << "> Using dV and dN: " << !screenSpaceOnly << "\n";
+        std::cout << "> Directional d_N: " << directionalDN << "\n";
+        std::cout << "> Surface Maps: " << useSurfaceMaps << "\n";
+        std::cout << "> Meshlet Culling: " << meshletCulling << "\n";
+        std::cout << "> Deforming: " << deformModel << "\n";
+        std::cout << "> Auto LOD: " << autoLod << " (" << lodPixelError << " px, backface x" << backfaceLodErrorScale << ")\n";
         std::cout << "****************************\n";
         fpsTracker.start(1000);
     }
@@ -215,6 +476,19 @@ void ImGuiDrawWindow()
         takeScreenshot = true;
 
     ImGui::End();
+
+    // Streaming progress for the selected model, kept outside the main window so it shows when that is collapsed
+    if (modelCatalog.size() > 0 && modelCatalog.isLoading(selectedModel))
+    {
+        ImGui::SetNextWindowPos(ImVec2(50, 925));
+        ImGui::SetNextWindowSize(ImVec2(500, 0));
+        ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs);
+        float progress = modelCatalog.loadProgress(selectedModel);
+        ImGui::Text(progress > 0.0f ? "Streaming %s" : "Reading %s", modelCatalog.name(selectedModel).c_str());
+        ImGui::ProgressBar(progress);
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
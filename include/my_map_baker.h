@@ -0,0 +1,388 @@
+#ifndef MY_MAP_BAKER_H
+#define MY_MAP_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include <my_dn_baker.h>
+#include <my_mesh_data.h>
+#include <my_mesh_simplifier.h>
+#include <my_surface_maps.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// High-to-low bake for tools/bake_maps.cpp: decimate a model with the LOD simplifier, give every low-poly
+// triangle its own cell in a texture atlas, and project the high-poly surface onto it. Each texel stores the
+// high-poly normal in the low-poly's tangent frame (my_surface_maps.h) and the high-poly d_N at that point
+
+struct MapBakeSettings
+{
+    float triangleRatio = 0.05f;    // Low-poly triangles as a fraction of the high-poly ones
+    float maxError = LOD_MAX_ERROR; // Largest collapse distance, relative to the mesh extent
+    unsigned int mapSize = 2048;    // Width and height of both maps
+    unsigned int gutter = 2;        // Texels around each atlas triangle, filled by dilation (at least 2)
+    float cageDistance = 0.02f;     // How far from the low-poly surface the high one is searched, relative to the bounds diagonal
+};
+
+struct MapBakeStats
+{
+    size_t highTriangles = 0;
+    size_t lowTriangles = 0;
+    size_t lowVertices = 0;
+    float simplifyError = 0.0f;     // Largest collapse distance (model units)
+    float cellTexels = 0.0f;        // Atlas cell size, two triangles per cell
+    size_t bakedTexels = 0;
+    size_t missedTexels = 0;        // No high-poly surface within the cage (low-poly normal and d_N kept)
+    double simplifyMilliseconds = 0.0;
+    double bakeMilliseconds = 0.0;
+};
+
+// LOD 0 of every mesh in one vertex and index buffer
+MeshData mergeMeshes(const std::vector<MeshData>& meshes)
+{
+    MeshData merged;
+    for (const MeshData& mesh : meshes)
+    {
+        unsigned int base = static_cast<unsigned int>(merged.vertices.size());
+        merged.vertices.insert(merged.vertices.end(), mesh.vertexData(), mesh.vertexData() + mesh.vertexCount());
+        MeshLod lod0 = mesh.lods.empty() ? MeshLod{ 0, static_cast<uint32_t>(mesh.indexCount()), 0.0f } : mesh.lods[0];
+        for (uint32_t i = lod0.indexOffset; i < lod0.indexOffset + lod0.indexCount; i++)
+            merged.indices.push_back(base + mesh.indexData()[i]);
+    }
+    merged.lods.push_back(MeshLod{ 0, static_cast<uint32_t>(merged.indices.size()), 0.0f });
+    return merged;
+}
+
+// Smooth area-weighted vertex normals
+void computeSmoothNormals(MeshData& mesh)
+{
+    std::vector<glm::vec3> sums(mesh.vertices.size(), glm::vec3(0.0f));
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+    {
+        const glm::vec3& a = mesh.vertices[mesh.indices[t]].Position;
+        glm::vec3 faceNormal = glm::cross(mesh.vertices[mesh.indices[t + 1]].Position - a, mesh.vertices[mesh.indices[t + 2]].Position - a);
+        for (int k = 0; k < 3; k++)
+            sums[mesh.indices[t + k]] += faceNormal;
+    }
+    for (size_t v = 0; v < mesh.vertices.size(); v++)
+    {
+        float len = glm::length(sums[v]);
+        mesh.vertices[v].Normal = len > 0.0f ? sums[v] / len : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+// Decimated copy of high, welded by position first so hard edges and UV seams don't lock the simplifier
+MeshData simplifyForBake(const MeshData& high, const MapBakeSettings& settings, MapBakeStats& stats)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3& p) const
+        {
+            uint32_t words[3];
+            std::memcpy(words, &p, sizeof(words));
+            return static_cast<size_t>((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u));
+        }
+    };
+    MeshData welded;
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> unique;
+    std::vector<unsigned int> remap(high.vertices.size());
+    for (size_t v = 0; v < high.vertices.size(); v++)
+    {
+        auto inserted = unique.emplace(high.vertices[v].Position, static_cast<unsigned int>(welded.vertices.size()));
+        if (inserted.second)
+            welded.vertices.push_back(high.vertices[v]);
+        remap[v] = inserted.first->second;
+    }
+    for (size_t t = 0; t + 2 < high.indices.size(); t += 3)
+    {
+        unsigned int a = remap[high.indices[t]], b = remap[high.indices[t + 1]], c = remap[high.indices[t + 2]];
+        if (a != b && b != c && a != c)
+            welded.indices.insert(welded.indices.end(), { a, b, c });
+    }
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (const Vertex& vertex : welded.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float maxError = settings.maxError * std::max(extent.x, std::max(extent.y, extent.z));
+
+    MeshSimplifier simplifier(welded.vertices.data(), welded.vertices.size(), welded.indices.data(), welded.indices.size());
+    size_t target = static_cast<size_t>(welded.indices.size() / 3 * settings.triangleRatio) * 3;
+    std::vector<unsigned int> lowIndices = simplifier.simplify(std::max<size_t>(target, 3), maxError);
+    stats.simplifyError = simplifier.error();
+
+    // Keep only the vertices the low-poly uses. Collapses keep a subset of the high-poly vertices, so their d_N still holds
+    MeshData low;
+    std::vector<unsigned int> lowIndex(welded.vertices.size(), UINT32_MAX);
+    for (unsigned int index : lowIndices)
+    {
+        if (lowIndex[index] == UINT32_MAX)
+        {
+            lowIndex[index] = static_cast<unsigned int>(low.vertices.size());
+            low.vertices.push_back(welded.vertices[index]);
+        }
+        low.indices.push_back(lowIndex[index]);
+    }
+    computeSmoothNormals(low);
+
+    stats.highTriangles = high.indices.size() / 3;
+    stats.lowTriangles = low.indices.size() / 3;
+    stats.simplifyMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return low;
+}
+
+// Give every triangle its own half of a square atlas cell (one vertex per corner afterwards). The corner with the
+// widest angle takes the cell's right angle, and the two triangles of a cell are kept a gutter apart
+void layoutTriangleAtlas(MeshData& mesh, const MapBakeSettings& settings, MapBakeStats& stats)
+{
+    size_t triangleCount = mesh.indices.size() / 3;
+    size_t cells = (triangleCount + 1) / 2;
+    size_t gridSize = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(cells)))));
+    float cell = static_cast<float>(settings.mapSize) / gridSize;
+    float gutter = static_cast<float>(std::max(settings.gutter, 2u));
+    stats.cellTexels = cell;
+
+    std::vector<Vertex> corners;
+    corners.reserve(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned int tri[3] = { mesh.indices[t * 3], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2] };
+
+        // Rotate (keeping the winding) so corner 0 has the widest angle
+        int widest = 0;
+        float widestCosine = 2.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            glm::vec3 a = mesh.vertices[tri[(k + 1) % 3]].Position - mesh.vertices[tri[k]].Position;
+            glm::vec3 b = mesh.vertices[tri[(k + 2) % 3]].Position - mesh.vertices[tri[k]].Position;
+            float lengths = glm::length(a) * glm::length(b);
+            float cosine = lengths > 0.0f ? glm::dot(a, b) / lengths : 1.0f;
+            if (cosine < widestCosine)
+            {
+                widestCosine = cosine;
+                widest = k;
+            }
+        }
+
+        // Lower-left or upper-right half of the cell, both counter-clockwise like the triangle
+        size_t cellIndex = t / 2;
+        glm::vec2 origin(static_cast<float>(cellIndex % gridSize) * cell, static_cast<float>(cellIndex / gridSize) * cell);
+        glm::vec2 uv[3];
+        if (t % 2 == 0)
+        {
+            uv[0] = origin + glm::vec2(gutter, gutter);
+            uv[1] = origin + glm::vec2(cell - 2.0f * gutter, gutter);
+            uv[2] = origin + glm::vec2(gutter, cell - 2.0f * gutter);
+        }
+        else
+        {
+            uv[0] = origin + glm::vec2(cell - gutter, cell - gutter);
+            uv[1] = origin + glm::vec2(2.0f * gutter, cell - gutter);
+            uv[2] = origin + glm::vec2(cell - gutter, 2.0f * gutter);
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            Vertex vertex = mesh.vertices[tri[(widest + k) % 3]];
+            vertex.TexCoords = uv[k] / static_cast<float>(settings.mapSize);
+            corners.push_back(vertex);
+        }
+    }
+
+    mesh.vertices.swap(corners);
+    mesh.indices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+        mesh.indices[i] = static_cast<unsigned int>(i);
+    mesh.lods.assign(1, MeshLod{ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+    stats.lowVertices = mesh.vertices.size();
+}
+
+// Fill uncovered texels from their covered neighbours, one ring per pass
+void dilateSurfaceMaps(std::vector<glm::vec3>& normals, std::vector<float>& thickness, std::vector<uint8_t>& covered, int width, int height, unsigned int passes)
+{
+    std::vector<uint8_t> next;
+    for (unsigned int pass = 0; pass < passes; pass++)
+    {
+        next = covered;
+        globalThreadPool().parallelFor(static_cast<size_t>(height), 16, [&](size_t begin, size_t end)
+        {
+            for (size_t y = begin; y < end; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    size_t texel = y * width + x;
+                    if (covered[texel])
+                        continue;
+                    glm::vec3 normal(0.0f);
+                    float sum = 0.0f;
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx, ny = static_cast<int>(y) + dy;
+                            if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                                continue;
+                            size_t neighbour = static_cast<size_t>(ny) * width + nx;
+                            if (!covered[neighbour])
+                                continue;
+                            normal += normals[neighbour];
+                            sum += thickness[neighbour];
+                            count++;
+                        }
+                    }
+                    if (count == 0)
+                        continue;
+                    float len = glm::length(normal);
+                    normals[texel] = len > 0.0f ? normal / len : glm::vec3(0.0f, 0.0f, 1.0f);
+                    thickness[texel] = sum / count;
+                    next[texel] = 1;
+                }
+            }
+        });
+        covered.swap(next);
+    }
+}
+
+// Project high onto low (which must have atlas UVs) and fill both maps. highBvh is built over high's LOD 0
+SurfaceMaps bakeSurfaceMaps(const MeshData& high, const TriangleBvh& highBvh, const MeshData& low, const MapBakeSettings& settings, MapBakeStats& stats)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    int size = static_cast<int>(settings.mapSize);
+    size_t texelCount = static_cast<size_t>(size) * size;
+    std::vector<glm::vec3> normals(texelCount, glm::vec3(0.0f, 0.0f, 1.0f));
+    std::vector<float> thickness(texelCount, 0.0f);
+    std::vector<uint8_t> covered(texelCount, 0), missed(texelCount, 0);
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (const Vertex& vertex : high.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    float cage = settings.cageDistance * glm::length(boundsMax - boundsMin);
+
+    // Triangles never share texels (the atlas keeps them a gutter apart), so they bake side by side
+    size_t triangleCount = low.indices.size() / 3;
+    globalThreadPool().parallelFor(triangleCount, 64, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            const Vertex* corner[3] = { &low.vertices[low.indices[t * 3]], &low.vertices[low.indices[t * 3 + 1]], &low.vertices[low.indices[t * 3 + 2]] };
+            glm::vec2 uv[3];
+            for (int k = 0; k < 3; k++)
+                uv[k] = corner[k]->TexCoords * static_cast<float>(size);
+            float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+            if (std::fabs(area) < 1e-8f)
+                continue;
+
+            // Distance (texels) from each corner to its opposite edge, to turn barycentrics into edge distances
+            float heights[3];
+            for (int k = 0; k < 3; k++)
+                heights[k] = std::fabs(area) / std::max(glm::length(uv[(k + 2) % 3] - uv[(k + 1) % 3]), 1e-8f);
+
+            glm::vec3 edge1 = corner[1]->Position - corner[0]->Position, edge2 = corner[2]->Position - corner[0]->Position;
+            glm::vec2 duv1 = corner[1]->TexCoords - corner[0]->TexCoords, duv2 = corner[2]->TexCoords - corner[0]->TexCoords;
+
+            // Texels whose centre is within one texel of the triangle, the rest of the gutter is dilated
+            glm::vec2 uvMin = glm::min(uv[0], glm::min(uv[1], uv[2])) - glm::vec2(1.0f);
+            glm::vec2 uvMax = glm::max(uv[0], glm::max(uv[1], uv[2])) + glm::vec2(1.0f);
+            int x0 = std::max(static_cast<int>(std::floor(uvMin.x)), 0), x1 = std::min(static_cast<int>(std::ceil(uvMax.x)), size - 1);
+            int y0 = std::max(static_cast<int>(std::floor(uvMin.y)), 0), y1 = std::min(static_cast<int>(std::ceil(uvMax.y)), size - 1);
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    glm::vec2 p(x + 0.5f, y + 0.5f);
+                    float b1 = ((p.x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (p.y - uv[0].y)) / area;
+                    float b2 = ((uv[1].x - uv[0].x) * (p.y - uv[0].y) - (p.x - uv[0].x) * (uv[1].y - uv[0].y)) / area;
+                    float bary[3] = { 1.0f - b1 - b2, b1, b2 };
+                    bool inside = true;
+                    for (int k = 0; k < 3; k++)
+                        inside = inside && bary[k] * heights[k] >= -1.0f;
+                    if (!inside)
+                        continue;
+
+                    // Texels just outside take the nearest point on the triangle
+                    float total = 0.0f;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        bary[k] = std::max(bary[k], 0.0f);
+                        total += bary[k];
+                    }
+                    glm::vec3 position(0.0f), normal(0.0f);
+                    float lowThickness = 0.0f;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        position += corner[k]->Position * (bary[k] / total);
+                        normal += corner[k]->Normal * (bary[k] / total);
+                        lowThickness += corner[k]->d_N * (bary[k] / total);
+                    }
+                    normal = glm::normalize(normal);
+
+                    glm::vec3 tangent, bitangent;
+                    cotangentFrame(normal, edge1, edge2, duv1, duv2, tangent, bitangent);
+
+                    // Outermost high-poly front face within the cage along the low-poly normal
+                    size_t texel = static_cast<size_t>(y) * size + x;
+                    BvhHit hit;
+                    glm::vec3 highNormal = normal;
+                    float highThickness = lowThickness;
+                    if (highBvh.closestHit(position + normal * cage, -normal, 2.0f * cage, hit, 1))
+                    {
+                        const unsigned int* tri = &high.indices[static_cast<size_t>(hit.triangle) * 3];
+                        float w[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+                        glm::vec3 interpolated(0.0f);
+                        highThickness = 0.0f;
+                        for (int k = 0; k < 3; k++)
+                        {
+                            interpolated += high.vertices[tri[k]].Normal * w[k];
+                            highThickness += high.vertices[tri[k]].d_N * w[k];
+                        }
+                        float len = glm::length(interpolated);
+                        if (len > 0.0f)
+                            highNormal = interpolated / len;
+                    }
+                    else
+                    {
+                        missed[texel] = 1;
+                    }
+                    normals[texel] = toTangentNormal(tangent, bitangent, normal, highNormal);
+                    thickness[texel] = highThickness;
+                    covered[texel] = 1;
+                }
+            }
+        }
+    });
+
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        stats.bakedTexels += covered[i];
+        stats.missedTexels += missed[i];
+    }
+    dilateSurfaceMaps(normals, thickness, covered, size, size, std::max(settings.gutter, 2u) * 2);
+
+    SurfaceMaps maps;
+    maps.width = maps.height = size;
+    maps.normals.resize(texelCount * 3);
+    maps.thickness.swap(thickness);
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        for (int k = 0; k < 3; k++)
+            maps.normals[i * 3 + k] = encodeNormalChannel(normals[i][k]);
+    }
+    stats.bakeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return maps;
+}
+
+#endif // MY_MAP_BAKER_H
@@ -0,0 +1,192 @@
+#ifndef MY_MAPPED_FILE_H
+#define MY_MAPPED_FILE_H
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            mappedData = other.mappedData;
+            mappedSize = other.mappedSize;
+            other.mappedData = nullptr;
+            other.mappedSize = 0;
+#ifdef _WIN32
+            fileHandle = other.fileHandle;
+            mappingHandle = other.mappingHandle;
+            other.fileHandle = INVALID_HANDLE_VALUE;
+            other.mappingHandle = nullptr;
+#endif
+        }
+        return *this;
+    }
+
+    // Map the file, returns false if it is missing or empty
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mappingHandle)
+        {
+            close();
+            return false;
+        }
+
+        mappedData = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (!mappedData)
+        {
+            close();
+            return false;
+        }
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+            return false;
+
+        struct stat fileStat;
+        if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            ::close(fileDescriptor);
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        ::close(fileDescriptor); // The mapping keeps its own reference
+        if (mapping == MAP_FAILED)
+            return false;
+
+        mappedData = static_cast<const unsigned char*>(mapping);
+        mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (mappedData)
+            UnmapViewOfFile(mappedData);
+        if (mappingHandle)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (mappedData)
+            munmap(const_cast<unsigned char*>(mappedData), mappedSize);
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+
+    // Drop the pages fully inside [begin, begin + bytes) from the resident set once they've been consumed
+    // (they are clean file pages, so touching them again just reads them back in)
+    void evict(const void* begin, size_t bytes) const
+    {
+        if (!mappedData || bytes == 0)
+            return;
+#ifdef _WIN32
+        // Unlocking pages that were never locked removes them from the working set
+        VirtualUnlock(const_cast<void*>(begin), bytes);
+#else
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + pageSize - 1) & ~(pageSize - 1);
+        uintptr_t last = (reinterpret_cast<uintptr_t>(begin) + bytes) & ~(pageSize - 1);
+        if (last > first)
+            madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+#endif
+    }
+
+    // Ask the OS to start reading [begin, begin + bytes) in before it is touched
+    void prefetch(const void* begin, size_t bytes) const
+    {
+        if (!mappedData || bytes == 0)
+            return;
+#ifdef _WIN32
+        // The cache manager already reads ahead on sequential access to a view
+        (void)begin;
+#else
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t first = reinterpret_cast<uintptr_t>(begin) & ~(pageSize - 1);
+        uintptr_t last = reinterpret_cast<uintptr_t>(begin) + bytes;
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_WILLNEED);
+#endif
+    }
+
+    bool isOpen() const
+    {
+        return mappedData != nullptr;
+    }
+
+    const unsigned char* data() const
+    {
+        return mappedData;
+    }
+
+    size_t size() const
+    {
+        return mappedSize;
+    }
+
+private:
+    const unsigned char* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+#endif
+};
+
+#endif // MY_MAPPED_FILE_H
@@ -7,77 +7,400 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <my_shader.h>
+#include <my_mesh_data.h>
+#include <my_vertex_packing.h>
+#include <my_meshlets.h>
+#include <my_geometry_pool.h>
+#include <my_mesh_cache.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <utility>
 #include <vector>
 
-struct Vertex 
+// How a mesh's geometry gets into the pool
+enum class MeshUpload
 {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    float d_N; // For this assignment
+    Immediate,  // Copied in the constructor
+    Streamed    // Space reserved in the constructor, filled a chunk at a time by uploadChunk()
+};
+
+// A mesh copied into GL buffers of its own on the upload thread (my_upload_thread.h), already in the pool's layout
+struct StagedMesh
+{
+    GLBuffer vertices;
+    GLBuffer indices;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionScale = glm::vec3(1.0f);  // Packed layout quantization
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+};
+
+// Upload-thread side of a background upload: quantize if needed and copy into new buffers
+StagedMesh stageMesh(const MeshData& data, VertexFormat format)
+{
+    StagedMesh staged;
+    staged.vertexCount = data.vertexCount();
+    staged.indexCount = data.indexCount();
+    staged.vertices = GLBuffer::create();
+    staged.indices = GLBuffer::create();
+    if (format == VertexFormat::Packed)
+    {
+        PackedMeshData packed = packMeshData(data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount());
+        staged.positionScale = packed.positionScale;
+        staged.positionOffset = packed.positionOffset;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staged.vertices.id());
+        glBufferData(GL_COPY_WRITE_BUFFER, packed.vertices.size() * sizeof(PackedVertex), packed.vertices.data(), GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staged.indices.id());
+        if (!packed.shortIndices.empty())
+        {
+            staged.indexType = GL_UNSIGNED_SHORT;
+            glBufferData(GL_COPY_WRITE_BUFFER, packed.shortIndices.size() * sizeof(uint16_t), packed.shortIndices.data(), GL_STREAM_COPY);
+        }
+        else
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, data.indexCount() * sizeof(unsigned int), data.indexData(), GL_STREAM_COPY);
+        }
+    }
+    else
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staged.vertices.id());
+        glBufferData(GL_COPY_WRITE_BUFFER, data.vertexCount() * sizeof(Vertex), data.vertexData(), GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staged.indices.id());
+        glBufferData(GL_COPY_WRITE_BUFFER, data.indexCount() * sizeof(unsigned int), data.indexData(), GL_STREAM_COPY);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return staged;
+}
+
+// Streaming progress: vertices first, then LODs from the coarsest, so a mesh draws early and sharpens
+struct MeshUploadState
+{
+    size_t vertices = 0;        // Vertices resident
+    size_t lods = 0;            // Complete LODs, counted from the coarsest
+    size_t lodIndices = 0;      // Indices resident of the LOD being streamed
+    size_t bytes = 0;           // Source bytes consumed
+    glm::vec3 positionScale = glm::vec3(1.0f);  // Packed layout quantization
+    glm::vec3 positionOffset = glm::vec3(0.0f);
 };
 
 class Mesh
 {
 public:
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0; // All LODs
     std::string meshName;
+    VertexFormat format = VertexFormat::Float;
+    bool deforming = false; // Vertices are being rewritten by a MeshDeformer, so the rest-pose meshlet bounds don't hold
 
-    // Init the mesh
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
+    // Copy the mesh from CPU data (owned vectors or a mapped mesh cache) into the shared geometry pool,
+    // or with MeshUpload::Streamed only reserve its space and leave the copy to uploadChunk()
+    Mesh(const MeshData& data, GeometryPool& pool, MeshUpload mode = MeshUpload::Immediate)
+        : format(pool.vertexFormat()), pool(&pool)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        setupMesh();
+        meshName = data.name;
+        meshlets = data.meshlets;
+        lods = data.lods;
+        if (lods.empty())
+            lods.push_back(MeshLod{ 0, static_cast<uint32_t>(data.indexCount()), 0.0f });
+        vertexCount = static_cast<unsigned int>(data.vertexCount());
+        indexCount = static_cast<unsigned int>(data.indexCount());
+
+        if (mode == MeshUpload::Streamed)
+        {
+            GLenum indexType = GL_UNSIGNED_INT;
+            if (format == VertexFormat::Packed)
+            {
+                computePackingTransform(data.vertexData(), data.vertexCount(), upload.positionScale, upload.positionOffset);
+                if (usesShortIndices(data.vertexCount()))
+                    indexType = GL_UNSIGNED_SHORT;
+            }
+            allocation = pool.reserve(data.vertexCount(), data.indexCount(), indexType, upload.positionScale, upload.positionOffset);
+            return;
+        }
+
+        upload.vertices = vertexCount;
+        upload.lods = lods.size();
+        upload.bytes = uploadSize();
+        if (format == VertexFormat::Packed)
+        {
+            // Quantize into a temporary that only lives until the upload returns
+            PackedMeshData packed = packMeshData(data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount());
+            upload.positionScale = packed.positionScale;
+            upload.positionOffset = packed.positionOffset;
+            if (!packed.shortIndices.empty())
+                allocation = pool.allocate(packed.vertices.data(), packed.vertices.size(), packed.shortIndices.data(), packed.shortIndices.size(), GL_UNSIGNED_SHORT, packed.positionScale, packed.positionOffset);
+            else
+                allocation = pool.allocate(packed.vertices.data(), packed.vertices.size(), data.indexData(), data.indexCount(), GL_UNSIGNED_INT, packed.positionScale, packed.positionOffset);
+        }
+        else
+        {
+            allocation = pool.allocate(data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount(), GL_UNSIGNED_INT);
+        }
     }
 
-    // Draw the mesh
-    void draw(Shader& shader)
+    // Take a mesh the upload thread has staged (after its fence has signaled). Only the pool space is claimed here
+    // and the copy stays on the GPU; data only needs its name, meshlets and LODs
+    Mesh(const MeshData& data, GeometryPool& pool, const StagedMesh& staged)
+        : format(pool.vertexFormat()), pool(&pool)
     {
-        // Draw
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        meshName = data.name;
+        meshlets = data.meshlets;
+        lods = data.lods;
+        if (lods.empty())
+            lods.push_back(MeshLod{ 0, static_cast<uint32_t>(staged.indexCount), 0.0f });
+        vertexCount = static_cast<unsigned int>(staged.vertexCount);
+        indexCount = static_cast<unsigned int>(staged.indexCount);
 
-        // Set active back to 0
-        glActiveTexture(GL_TEXTURE0);
+        upload.vertices = vertexCount;
+        upload.lods = lods.size();
+        upload.bytes = uploadSize();
+        upload.positionScale = staged.positionScale;
+        upload.positionOffset = staged.positionOffset;
+        allocation = pool.reserve(staged.vertexCount, staged.indexCount, staged.indexType, staged.positionScale, staged.positionOffset);
+        pool.copyStaged(allocation, staged.vertices.id(), staged.indices.id());
     }
 
-private:
-    unsigned int VAO, VBO, EBO;
+    // Owns its pool ranges: moving hands them over, destruction returns them
+    ~Mesh()
+    {
+        release();
+    }
 
-    // Setup
-    void setupMesh()
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&& other) noexcept
+        : vertexCount(other.vertexCount), indexCount(other.indexCount), meshName(std::move(other.meshName)), format(other.format),
+          deforming(other.deforming), pool(other.pool), allocation(std::exchange(other.allocation, GeometryAllocation())),
+          meshlets(std::move(other.meshlets)), lods(std::move(other.lods)), upload(other.upload)
+    {
+    }
+
+    Mesh& operator=(Mesh&& other) noexcept
     {
-        // Create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        if (this != &other)
+        {
+            release();
+            vertexCount = other.vertexCount;
+            indexCount = other.indexCount;
+            meshName = std::move(other.meshName);
+            format = other.format;
+            deforming = other.deforming;
+            pool = other.pool;
+            allocation = std::exchange(other.allocation, GeometryAllocation());
+            meshlets = std::move(other.meshlets);
+            lods = std::move(other.lods);
+            upload = other.upload;
+        }
+        return *this;
+    }
+
+    // Queue one LOD of the mesh in the pool's current batch, skipping meshlets that can't contain a triangle
+    // the pass rasterizes. viewPosition is the camera in model space; returns the number of triangles queued
+    // While streaming, the finest resident LOD stands in for finer ones and nothing draws before the first
+    unsigned int addDraws(MeshletCulling culling = MeshletCulling::None, const glm::vec3& viewPosition = glm::vec3(0.0f), int lodLevel = 0)
+    {
+        if (!drawable())
+            return 0;
+        const MeshLod& lod = this->lod(std::max(static_cast<size_t>(std::max(lodLevel, 0)), lods.size() - upload.lods));
+        if (culling == MeshletCulling::None || lod.meshletCount == 0 || deforming)
+        {
+            pool->addDraw(allocation, lod.indexOffset, lod.indexCount);
+            return lod.indexCount / 3;
+        }
+
+        // Visible meshlets are contiguous in the index buffer, so neighbours merge into one command
+        unsigned int submittedIndices = 0;
+        uint32_t rangeStart = 0, rangeEnd = ~0u;
+        for (uint32_t m = lod.meshletOffset; m < lod.meshletOffset + lod.meshletCount; m++)
+        {
+            const Meshlet& meshlet = meshlets[m];
+            if (!meshletVisible(meshlet, culling, viewPosition))
+                continue;
+            if (meshlet.indexOffset != rangeEnd)
+            {
+                if (rangeEnd != ~0u)
+                    pool->addDraw(allocation, rangeStart, rangeEnd - rangeStart);
+                rangeStart = meshlet.indexOffset;
+            }
+            rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+            submittedIndices += meshlet.indexCount;
+        }
+        if (rangeEnd != ~0u)
+            pool->addDraw(allocation, rangeStart, rangeEnd - rangeStart);
+        return submittedIndices / 3;
+    }
 
-        // Bind VAO
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    // Stream the next chunk of a MeshUpload::Streamed mesh from the same data it was created with,
+    // evicting the consumed pages when the data is mapped from cache. Returns the source bytes consumed
+    size_t uploadChunk(const MeshData& data, const MeshCache* cache = nullptr)
+    {
+        if (uploadComplete())
+            return 0;
 
-        // EBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        if (upload.vertices < vertexCount)
+        {
+            size_t first = upload.vertices;
+            size_t count = std::min(pool->vertexChunk(), vertexCount - first);
+            const Vertex* source = data.vertexData() + first;
+            if (format == VertexFormat::Packed)
+            {
+                // Quantize straight into the staging buffer
+                pool->streamVertices(allocation, first, count, [&](void* destination)
+                {
+                    PackedVertex* packed = static_cast<PackedVertex*>(destination);
+                    for (size_t i = 0; i < count; i++)
+                        packed[i] = packVertex(source[i], upload.positionScale, upload.positionOffset);
+                });
+            }
+            else
+            {
+                pool->streamVertices(allocation, first, count, [&](void* destination) { std::memcpy(destination, source, count * sizeof(Vertex)); });
+            }
+            upload.vertices += count;
+            return consumed(cache, source, count * sizeof(Vertex));
+        }
 
-        // Vertex positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        const MeshLod& lod = lods[lods.size() - 1 - upload.lods];
+        size_t count = std::min(pool->indexChunk(allocation.indexType), lod.indexCount - upload.lodIndices);
+        size_t first = lod.indexOffset + upload.lodIndices;
+        const unsigned int* source = data.indexData() + first;
+        if (count > 0)
+        {
+            if (allocation.indexType == GL_UNSIGNED_SHORT)
+            {
+                pool->streamIndices(allocation, first, count, [&](void* destination)
+                {
+                    uint16_t* shortIndices = static_cast<uint16_t*>(destination);
+                    for (size_t i = 0; i < count; i++)
+                        shortIndices[i] = static_cast<uint16_t>(source[i]);
+                });
+            }
+            else
+            {
+                pool->streamIndices(allocation, first, count, [&](void* destination) { std::memcpy(destination, source, count * sizeof(unsigned int)); });
+            }
+        }
+        upload.lodIndices += count;
+        if (upload.lodIndices >= lod.indexCount)
+        {
+            upload.lods++;
+            upload.lodIndices = 0;
+        }
+        return consumed(cache, source, count * sizeof(unsigned int));
+    }
 
-        // Vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // A packed mesh quantizes positions inside its bounds and clamps any outside them, a float one takes anything
+    bool positionsFit(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+    {
+        if (format != VertexFormat::Packed)
+            return true;
+        for (int k = 0; k < 3; k++)
+        {
+            if (boundsMin[k] < upload.positionOffset[k] || boundsMax[k] > upload.positionOffset[k] + upload.positionScale[k])
+                return false;
+        }
+        return true;
+    }
 
-        // Vertex color attribute d_N
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, d_N));
+    // Quantize a packed mesh's positions inside new bounds (nothing for a float mesh)
+    // Every vertex has to be rewritten with updateVertices afterwards
+    void setPositionBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        if (format != VertexFormat::Packed || !allocation.valid)
+            return;
+        upload.positionScale = boundsMax - boundsMin;
+        upload.positionOffset = boundsMin;
+        pool->updateDrawData(allocation, upload.positionScale, upload.positionOffset);
+    }
 
-        glBindVertexArray(0);
+    // Rewrite count vertices from first on (a packed mesh clamps positions to its bounds, see setPositionBounds)
+    void updateVertices(size_t first, size_t count, const Vertex* source)
+    {
+        if (!allocation.valid || count == 0)
+            return;
+        if (format == VertexFormat::Packed)
+        {
+            packedScratch.resize(count);
+            for (size_t i = 0; i < count; i++)
+                packedScratch[i] = packVertex(source[i], upload.positionScale, upload.positionOffset);
+            pool->updateVertices(allocation, first, count, packedScratch.data());
+        }
+        else
+        {
+            pool->updateVertices(allocation, first, count, source);
+        }
+    }
+
+    bool uploadComplete() const
+    {
+        return upload.vertices == vertexCount && upload.lods == lods.size();
+    }
+
+    // All vertices and at least the coarsest LOD are resident
+    bool drawable() const
+    {
+        return upload.vertices == vertexCount && upload.lods > 0;
+    }
+
+    // Source bytes the upload reads, and how many of them it has read
+    size_t uploadSize() const
+    {
+        return static_cast<size_t>(vertexCount) * sizeof(Vertex) + static_cast<size_t>(indexCount) * sizeof(unsigned int);
+    }
+
+    size_t uploadedBytes() const
+    {
+        return upload.bytes;
+    }
+
+    size_t meshletCount() const
+    {
+        return meshlets.size();
+    }
+
+    size_t lodCount() const
+    {
+        return lods.size();
+    }
+
+    const MeshLod& lod(size_t level) const
+    {
+        return lods[std::min(level, lods.size() - 1)];
+    }
+
+    // Bytes this mesh occupies in the pool
+    size_t gpuBytes() const
+    {
+        return allocation.valid ? pool->allocationBytes(allocation) : 0;
+    }
+
+    // Return the mesh's ranges to the pool now
+    void release()
+    {
+        if (allocation.valid)
+            pool->free(allocation);
+        vertexCount = indexCount = 0;
+    }
+
+private:
+    GeometryPool* pool;
+    GeometryAllocation allocation;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshLod> lods;
+    MeshUploadState upload;
+    std::vector<PackedVertex> packedScratch;
+
+    size_t consumed(const MeshCache* cache, const void* source, size_t bytes)
+    {
+        if (cache)
+            cache->evict(source, bytes);
+        upload.bytes += bytes;
+        return bytes;
     }
 };
 #endif
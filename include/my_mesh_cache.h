@@ -0,0 +1,291 @@
+#ifndef MY_MESH_CACHE_H
+#define MY_MESH_CACHE_H
+
+#include <my_mapped_file.h>
+#include <my_mesh_data.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem> // Requires C++17
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Binary cache of the final vertex/index arrays of a model, one file per source model
+// Blobs are stored exactly as Mesh uploads them so a warm load can hand the mapping straight to glBufferSubData
+
+const char MESH_CACHE_MAGIC[8] = { 'R', 'T', 'R', 'M', 'E', 'S', 'H', '\0' };
+const uint32_t MESH_CACHE_VERSION = 4;
+const uint32_t MESH_CACHE_MAX_LODS = 8;
+std::string meshCacheDirectory = "cache"; // Relative to the working directory
+
+// Everything a cache file must match to be reused
+struct MeshCacheKey
+{
+    std::string sourcePath;
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    uint32_t importFlags = 0;   // Assimp post-process flags
+    uint32_t pipelineFlags = 0; // Our own load-time stages (d_N bake etc.)
+};
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t importFlags;
+    uint32_t pipelineFlags;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t meshCount;
+    uint32_t pathLength;
+};
+
+struct MeshCacheLod
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+struct MeshCacheEntry
+{
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    char name[64];
+    uint32_t lodCount;
+    uint32_t reserved;
+    MeshCacheLod lods[MESH_CACHE_MAX_LODS];
+};
+
+// Mesh arrays to be written, pointing at the caller's data
+struct MeshCacheSource
+{
+    const Vertex* vertices;
+    size_t vertexCount;
+    const unsigned int* indices;
+    size_t indexCount;
+    std::string name;
+    std::vector<MeshLod> lods;
+};
+
+// Fill in the source file part of a key, returns false if the source doesn't exist
+bool makeMeshCacheKey(const std::string& sourcePath, uint32_t importFlags, uint32_t pipelineFlags, MeshCacheKey& key)
+{
+    std::error_code error;
+    auto size = std::filesystem::file_size(sourcePath, error);
+    if (error)
+        return false;
+    auto time = std::filesystem::last_write_time(sourcePath, error);
+    if (error)
+        return false;
+
+    key.sourcePath = sourcePath;
+    key.sourceSize = static_cast<uint64_t>(size);
+    key.sourceTime = static_cast<int64_t>(time.time_since_epoch().count());
+    key.importFlags = importFlags;
+    key.pipelineFlags = pipelineFlags;
+    return true;
+}
+
+// Cache file location for a source model, e.g. models/teapot.fbx -> cache/models_teapot_fbx.meshcache
+std::string meshCachePath(const std::string& sourcePath)
+{
+    std::string flatName = sourcePath;
+    for (char& c : flatName)
+    {
+        if (c == '/' || c == '\\' || c == ':' || c == '.')
+            c = '_';
+    }
+    return (std::filesystem::path(meshCacheDirectory) / (flatName + ".meshcache")).string();
+}
+
+// Round up to the 16 byte alignment used for every blob
+uint64_t alignMeshCacheOffset(uint64_t offset)
+{
+    return (offset + 15) & ~static_cast<uint64_t>(15);
+}
+
+// Write a cache file (via a temporary file so a crash never leaves a half-written cache)
+bool writeMeshCache(const MeshCacheKey& key, const std::vector<MeshCacheSource>& meshes)
+{
+    std::error_code error;
+    std::filesystem::create_directories(meshCacheDirectory, error);
+
+    std::string cachePath = meshCachePath(key.sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.importFlags = key.importFlags;
+    header.pipelineFlags = key.pipelineFlags;
+    header.sourceSize = key.sourceSize;
+    header.sourceTime = key.sourceTime;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.pathLength = static_cast<uint32_t>(key.sourcePath.size());
+
+    // Lay out the entry table and blobs
+    uint64_t offset = alignMeshCacheOffset(sizeof(MeshCacheHeader) + header.pathLength);
+    uint64_t tableOffset = offset;
+    offset = alignMeshCacheOffset(offset + meshes.size() * sizeof(MeshCacheEntry));
+
+    std::vector<MeshCacheEntry> entries(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        MeshCacheEntry& entry = entries[i];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.vertexCount = meshes[i].vertexCount;
+        entry.indexCount = meshes[i].indexCount;
+        std::strncpy(entry.name, meshes[i].name.c_str(), sizeof(entry.name) - 1);
+        entry.lodCount = static_cast<uint32_t>(std::min<size_t>(meshes[i].lods.size(), MESH_CACHE_MAX_LODS));
+        for (uint32_t l = 0; l < entry.lodCount; l++)
+            entry.lods[l] = MeshCacheLod{ meshes[i].lods[l].indexOffset, meshes[i].lods[l].indexCount, meshes[i].lods[l].error, 0 };
+
+        entry.vertexOffset = offset;
+        offset = alignMeshCacheOffset(offset + entry.vertexCount * sizeof(Vertex));
+        entry.indexOffset = offset;
+        offset = alignMeshCacheOffset(offset + entry.indexCount * sizeof(unsigned int));
+    }
+
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    const char padding[16] = {};
+    auto padTo = [&](uint64_t target)
+    {
+        uint64_t position = static_cast<uint64_t>(file.tellp());
+        if (target > position)
+            file.write(padding, static_cast<std::streamsize>(target - position));
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(key.sourcePath.data(), header.pathLength);
+    padTo(tableOffset);
+    file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(MeshCacheEntry)));
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        padTo(entries[i].vertexOffset);
+        file.write(reinterpret_cast<const char*>(meshes[i].vertices), static_cast<std::streamsize>(entries[i].vertexCount * sizeof(Vertex)));
+        padTo(entries[i].indexOffset);
+        file.write(reinterpret_cast<const char*>(meshes[i].indices), static_cast<std::streamsize>(entries[i].indexCount * sizeof(unsigned int)));
+    }
+    padTo(offset);
+    file.close();
+    if (!file)
+    {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    std::filesystem::rename(tempPath, cachePath, error);
+    return !error;
+}
+
+// A validated, memory-mapped cache file
+class MeshCache
+{
+public:
+    // Map the cache for key, returns false if it is missing, stale or malformed
+    bool open(const MeshCacheKey& key)
+    {
+        entries.clear();
+        if (!file.open(meshCachePath(key.sourcePath)))
+            return false;
+
+        if (file.size() < sizeof(MeshCacheHeader))
+            return fail();
+
+        MeshCacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MESH_CACHE_VERSION ||
+            header.vertexSize != sizeof(Vertex) ||
+            header.importFlags != key.importFlags ||
+            header.pipelineFlags != key.pipelineFlags ||
+            header.sourceSize != key.sourceSize ||
+            header.sourceTime != key.sourceTime ||
+            header.pathLength != key.sourcePath.size())
+            return fail();
+
+        if (sizeof(MeshCacheHeader) + header.pathLength > file.size() ||
+            std::memcmp(file.data() + sizeof(MeshCacheHeader), key.sourcePath.data(), header.pathLength) != 0)
+            return fail();
+
+        uint64_t tableOffset = alignMeshCacheOffset(sizeof(MeshCacheHeader) + header.pathLength);
+        if (tableOffset + static_cast<uint64_t>(header.meshCount) * sizeof(MeshCacheEntry) > file.size())
+            return fail();
+
+        entries.resize(header.meshCount);
+        std::memcpy(entries.data(), file.data() + tableOffset, header.meshCount * sizeof(MeshCacheEntry));
+
+        // Every blob must lie inside the file
+        for (MeshCacheEntry& entry : entries)
+        {
+            entry.name[sizeof(entry.name) - 1] = '\0';
+            if (entry.vertexOffset + entry.vertexCount * sizeof(Vertex) > file.size() ||
+                entry.indexOffset + entry.indexCount * sizeof(unsigned int) > file.size() ||
+                entry.lodCount > MESH_CACHE_MAX_LODS)
+                return fail();
+            for (uint32_t l = 0; l < entry.lodCount; l++)
+            {
+                if (static_cast<uint64_t>(entry.lods[l].indexOffset) + entry.lods[l].indexCount > entry.indexCount)
+                    return fail();
+            }
+        }
+        return true;
+    }
+
+    void close()
+    {
+        entries.clear();
+        file.close();
+    }
+
+    size_t meshCount() const
+    {
+        return entries.size();
+    }
+
+    const MeshCacheEntry& entry(size_t i) const
+    {
+        return entries[i];
+    }
+
+    const Vertex* vertices(size_t i) const
+    {
+        return reinterpret_cast<const Vertex*>(file.data() + entries[i].vertexOffset);
+    }
+
+    const unsigned int* indices(size_t i) const
+    {
+        return reinterpret_cast<const unsigned int*>(file.data() + entries[i].indexOffset);
+    }
+
+    // Release mapped pages of a blob that has been uploaded
+    void evict(const void* data, size_t bytes) const
+    {
+        file.evict(data, bytes);
+    }
+
+private:
+    MappedFile file;
+    std::vector<MeshCacheEntry> entries;
+
+    bool fail()
+    {
+        close();
+        return false;
+    }
+};
+
+#endif // MY_MESH_CACHE_H
@@ -0,0 +1,77 @@
+#ifndef MY_MESH_DATA_H
+#define MY_MESH_DATA_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Interleaved vertex layout uploaded to the geometry pool
+struct Vertex 
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    float d_N; // For this assignment
+    glm::vec3 d_NGradient = glm::vec3(0.0f); // Change of d_N as the ray tilts away from -Normal (my_dn_baker.h), zero if not baked
+    glm::vec2 TexCoords = glm::vec2(0.0f); // Surface map coordinates (my_surface_maps.h), only read for models that have maps
+};
+
+// Contiguous run of a mesh's index buffer with culling bounds (built in my_meshlets.h)
+struct Meshlet
+{
+    uint32_t indexOffset;   // First index in the mesh's index buffer
+    uint32_t indexCount;
+    glm::vec3 center;       // Bounding sphere
+    float radius;
+    glm::vec3 coneAxis;     // Average geometric (CCW) normal
+    float coneCutoff;       // Sine of the cone half-angle, > 1 if the cone can never be culled
+};
+
+// One level of detail: a range of the mesh's index buffer (all levels share the vertex buffer)
+struct MeshLod
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;                // Largest simplification distance in model units (0 for LOD 0)
+    uint32_t meshletOffset = 0; // Range in MeshData::meshlets
+    uint32_t meshletCount = 0;
+};
+
+// CPU-side mesh, built without any GL calls so it can be produced on worker threads
+struct MeshData
+{
+    std::string name;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;  // Every LOD's indices, LOD 0 first
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+
+    // Views into a mapped mesh cache, used instead of the vectors on a warm load
+    const Vertex* mappedVertices = nullptr;
+    const unsigned int* mappedIndices = nullptr;
+    size_t mappedVertexCount = 0;
+    size_t mappedIndexCount = 0;
+
+    const Vertex* vertexData() const
+    {
+        return mappedVertices ? mappedVertices : vertices.data();
+    }
+
+    size_t vertexCount() const
+    {
+        return mappedVertices ? mappedVertexCount : vertices.size();
+    }
+
+    const unsigned int* indexData() const
+    {
+        return mappedIndices ? mappedIndices : indices.data();
+    }
+
+    size_t indexCount() const
+    {
+        return mappedIndices ? mappedIndexCount : indices.size();
+    }
+};
+
+#endif // MY_MESH_DATA_H
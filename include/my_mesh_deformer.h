@@ -0,0 +1,160 @@
+#ifndef MY_MESH_DEFORMER_H
+#define MY_MESH_DEFORMER_H
+
+#include <glm/glm.hpp>
+
+#include <my_deformation.h>
+#include <my_mesh.h>
+#include <my_mesh_data.h>
+#include <my_thread_pool.h>
+
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Drives one Mesh from a MeshDeformFunction: deform, follow normals and d_N, then rewrite only the vertex
+// runs that changed since the last frame (glBufferSubData per run, nearby runs merged)
+// The directional d_N gradient is not rebaked, so deformed vertices carry a zero one (restore() puts it back)
+// Packed meshes quantize positions in their rest bounds; a pose that leaves them widens the bounds (with some
+// margin, so a moving wave doesn't do it every frame) and rewrites the whole mesh, restore() narrows them again
+
+const size_t DEFORM_UPLOAD_MERGE_GAP = 16; // Unchanged vertices worth re-sending to join two runs into one call
+
+// Everything one frame of deformation cost, summed over a model's meshes
+struct DeformFrameStats
+{
+    ThicknessUpdateStats thickness;
+    double deformMilliseconds = 0.0;    // Callback plus normals
+    double uploadMilliseconds = 0.0;
+    size_t vertices = 0;
+    size_t uploadedVertices = 0;
+    size_t uploadRuns = 0;
+
+    void add(const DeformFrameStats& other)
+    {
+        thickness.refitMilliseconds += other.thickness.refitMilliseconds;
+        thickness.detectMilliseconds += other.thickness.detectMilliseconds;
+        thickness.rebakeMilliseconds += other.thickness.rebakeMilliseconds;
+        thickness.movedVertices += other.thickness.movedVertices;
+        thickness.rebakedVertices += other.thickness.rebakedVertices;
+        deformMilliseconds += other.deformMilliseconds;
+        uploadMilliseconds += other.uploadMilliseconds;
+        vertices += other.vertices;
+        uploadedVertices += other.uploadedVertices;
+        uploadRuns += other.uploadRuns;
+    }
+};
+
+class MeshDeformer
+{
+public:
+    // Copies the rest vertices and LOD 0 triangles out of data (the GPU copy has no CPU twin after upload)
+    MeshDeformer(const MeshData& data, MeshDeformFunction deformFunction, const DeformSettings& settings = DeformSettings())
+        : deformFunction(std::move(deformFunction))
+    {
+        rest.assign(data.vertexData(), data.vertexData() + data.vertexCount());
+        restMin = glm::vec3(FLT_MAX);
+        restMax = glm::vec3(-FLT_MAX);
+        for (const Vertex& vertex : rest)
+        {
+            restMin = glm::min(restMin, vertex.Position);
+            restMax = glm::max(restMax, vertex.Position);
+        }
+        MeshLod lod0 = data.lods.empty() ? MeshLod{ 0, static_cast<uint32_t>(data.indexCount()), 0.0f } : data.lods[0];
+        std::vector<unsigned int> triangles(data.indexData() + lod0.indexOffset, data.indexData() + lod0.indexOffset + lod0.indexCount);
+        thickness.init(rest, triangles, settings);
+        uploaded = rest;
+        changed.assign(rest.size(), 0);
+    }
+
+    DeformFrameStats update(Mesh& mesh, float time)
+    {
+        DeformFrameStats stats;
+        stats.vertices = rest.size();
+        auto start = std::chrono::high_resolution_clock::now();
+        deformFunction(rest, time, positions);
+        thickness.deformNormals(positions, normals);
+        auto deformed = std::chrono::high_resolution_clock::now();
+        stats.deformMilliseconds = std::chrono::duration<double, std::milli>(deformed - start).count();
+
+        stats.thickness = thickness.update(positions, normals);
+
+        // A pose outside the packed bounds gets wider ones, which every vertex is then rewritten for
+        glm::vec3 poseMin = restMin, poseMax = restMax;
+        for (const glm::vec3& position : positions)
+        {
+            poseMin = glm::min(poseMin, position);
+            poseMax = glm::max(poseMax, position);
+        }
+        bool rewriteAll = false;
+        if (!rest.empty() && !mesh.positionsFit(poseMin, poseMax))
+        {
+            glm::vec3 margin = 0.1f * (poseMax - poseMin);
+            mesh.setPositionBounds(poseMin - margin, poseMax + margin);
+            rewriteAll = true;
+        }
+
+        // Only vertices that differ from what the GPU holds are sent
+        auto uploadStart = std::chrono::high_resolution_clock::now();
+        const std::vector<float>& d_N = thickness.thickness();
+        globalThreadPool().parallelFor(rest.size(), 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                Vertex vertex = rest[i];
+                vertex.Position = positions[i];
+                vertex.Normal = normals[i];
+                vertex.d_N = d_N[i];
+                vertex.d_NGradient = glm::vec3(0.0f); // Baked for the rest pose only: the shaders blend d_N and d_V instead
+                changed[i] = rewriteAll || std::memcmp(&vertex, &uploaded[i], sizeof(Vertex)) != 0 ? 1 : 0;
+                if (changed[i])
+                    uploaded[i] = vertex;
+            }
+        });
+
+        mesh.deforming = true;
+        size_t i = 0;
+        while (i < rest.size())
+        {
+            if (!changed[i])
+            {
+                i++;
+                continue;
+            }
+            size_t first = i, last = i;
+            for (size_t j = i + 1; j < rest.size() && j <= last + DEFORM_UPLOAD_MERGE_GAP; j++)
+            {
+                if (changed[j])
+                    last = j;
+            }
+            mesh.updateVertices(first, last + 1 - first, uploaded.data() + first);
+            stats.uploadedVertices += last + 1 - first;
+            stats.uploadRuns++;
+            i = last + 1;
+        }
+        stats.uploadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+        return stats;
+    }
+
+    // Put the rest pose back on the GPU
+    void restore(Mesh& mesh)
+    {
+        if (!rest.empty())
+            mesh.setPositionBounds(restMin, restMax);
+        mesh.updateVertices(0, rest.size(), rest.data());
+        mesh.deforming = false;
+    }
+
+private:
+    MeshDeformFunction deformFunction;
+    DeformableThickness thickness;
+    std::vector<Vertex> rest, uploaded;
+    glm::vec3 restMin = glm::vec3(0.0f), restMax = glm::vec3(0.0f); // Rest pose bounds, the packed quantization
+    std::vector<glm::vec3> positions, normals;
+    std::vector<uint8_t> changed;
+};
+
+#endif // MY_MESH_DEFORMER_H
@@ -0,0 +1,478 @@
+#ifndef MY_MESH_OPTIMIZER_H
+#define MY_MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <my_mesh_data.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Post-import mesh optimization: weld, vertex cache order, overdraw order, vertex fetch order
+// Runs on the CPU-side MeshData before upload, so both two-surface passes benefit
+
+// Cache sizes used for optimizing and for reporting
+const unsigned int OPTIMIZER_CACHE_SIZE = 32;   // LRU cache modelled by the Forsyth scoring
+const unsigned int ANALYZER_FIFO_SIZE = 16;     // FIFO cache used to report ACMR
+const unsigned int OVERDRAW_GRID_SIZE = 256;    // Software raster resolution per view
+const float OVERDRAW_THRESHOLD = 1.05f;         // Allowed ACMR growth when splitting clusters for overdraw
+
+struct MeshOptimizationStats
+{
+    size_t triangles = 0;
+    size_t verticesBefore = 0, verticesAfter = 0;
+    float acmrBefore = 0.0f, acmrAfter = 0.0f;
+    float overdrawBefore = 0.0f, overdrawAfter = 0.0f;
+};
+
+// Average cache miss ratio (misses per triangle) for a FIFO post-transform cache
+float analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = ANALYZER_FIFO_SIZE)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+
+    // Timestamp FIFO: a vertex is cached if it was inserted within the last cacheSize misses
+    std::vector<unsigned int> insertedAt(vertexCount, 0);
+    unsigned int misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > cacheSize)
+        {
+            misses++;
+            insertedAt[index] = misses;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+// Shaded pixels per covered pixel, rasterized from the six axis directions with back-face culling
+float analyzeOverdraw(const std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices)
+{
+    if (indices.size() < 3 || vertices.empty())
+        return 0.0f;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (const Vertex& vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float scale = (OVERDRAW_GRID_SIZE - 1) / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-12f));
+
+    const int grid = static_cast<int>(OVERDRAW_GRID_SIZE);
+    std::vector<float> depthBuffer(grid * grid);
+    uint64_t shaded = 0, covered = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int uAxis = (axis + 1) % 3, vAxis = (axis + 2) % 3;
+        for (int side = -1; side <= 1; side += 2)
+        {
+            std::fill(depthBuffer.begin(), depthBuffer.end(), FLT_MAX);
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                glm::vec3 p[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    glm::vec3 position = (vertices[indices[t + k]].Position - boundsMin) * scale;
+                    // Screen x, screen y, depth (viewer on the +side of the axis)
+                    p[k] = glm::vec3(position[uAxis], position[vAxis], -side * position[axis]);
+                }
+
+                // Signed area in screen space, flipped for the viewer on the negative side
+                float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+                if (side * area <= 0.0f)
+                    continue;
+
+                int xMin = std::max(0, static_cast<int>(std::floor(std::min(p[0].x, std::min(p[1].x, p[2].x)))));
+                int xMax = std::min(grid - 1, static_cast<int>(std::ceil(std::max(p[0].x, std::max(p[1].x, p[2].x)))));
+                int yMin = std::max(0, static_cast<int>(std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y)))));
+                int yMax = std::min(grid - 1, static_cast<int>(std::ceil(std::max(p[0].y, std::max(p[1].y, p[2].y)))));
+
+                float invArea = 1.0f / area;
+                for (int y = yMin; y <= yMax; y++)
+                {
+                    for (int x = xMin; x <= xMax; x++)
+                    {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float w0 = ((p[1].x - px) * (p[2].y - py) - (p[2].x - px) * (p[1].y - py)) * invArea;
+                        float w1 = ((p[2].x - px) * (p[0].y - py) - (p[0].x - px) * (p[2].y - py)) * invArea;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                            continue;
+
+                        float depth = w0 * p[0].z + w1 * p[1].z + w2 * p[2].z;
+                        float& stored = depthBuffer[y * grid + x];
+                        if (depth < stored)
+                        {
+                            if (stored == FLT_MAX)
+                                covered++;
+                            stored = depth;
+                            shaded++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return covered ? static_cast<float>(shaded) / static_cast<float>(covered) : 0.0f;
+}
+
+// Merge bit-identical vertices (position, normal and d_N) and remap the indices
+void weldVertices(MeshData& meshData)
+{
+    struct VertexHash
+    {
+        size_t operator()(const Vertex& vertex) const
+        {
+            const uint32_t* words = reinterpret_cast<const uint32_t*>(&vertex);
+            uint64_t hash = 1469598103934665603ull;
+            for (size_t i = 0; i < sizeof(Vertex) / sizeof(uint32_t); i++)
+                hash = (hash ^ words[i]) * 1099511628211ull;
+            return static_cast<size_t>(hash);
+        }
+    };
+    struct VertexEqual
+    {
+        bool operator()(const Vertex& a, const Vertex& b) const
+        {
+            return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+
+    std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+    unique.reserve(meshData.vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(meshData.vertices.size());
+    std::vector<unsigned int> remap(meshData.vertices.size());
+
+    for (size_t i = 0; i < meshData.vertices.size(); i++)
+    {
+        // -0.0 and 0.0 should weld together
+        Vertex key = meshData.vertices[i];
+        float* components = reinterpret_cast<float*>(&key);
+        for (size_t c = 0; c < sizeof(Vertex) / sizeof(float); c++)
+            components[c] += 0.0f;
+
+        auto inserted = unique.emplace(key, static_cast<unsigned int>(welded.size()));
+        if (inserted.second)
+            welded.push_back(meshData.vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+
+    for (unsigned int& index : meshData.indices)
+        index = remap[index];
+    meshData.vertices.swap(welded);
+}
+
+// Forsyth's linear-speed vertex cache optimization
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    const int cacheSize = static_cast<int>(OPTIMIZER_CACHE_SIZE);
+    auto vertexScore = [cacheSize](int cachePosition, unsigned int remainingValence) -> float
+    {
+        if (remainingValence == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // The last triangle's vertices get a fixed score so the next triangle doesn't just reuse them
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / static_cast<float>(cacheSize - 3), 1.5f);
+        }
+
+        // Favour vertices with few triangles left so they get finished off
+        return score + 2.0f * std::pow(static_cast<float>(remainingValence), -0.5f);
+    };
+
+    // Vertex -> triangle adjacency (CSR)
+    std::vector<unsigned int> valence(vertexCount, 0);
+    for (unsigned int index : indices)
+        valence[index]++;
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, valence[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(cacheSize + 3);
+    newCache.reserve(cacheSize + 3);
+
+    size_t cursor = 0;
+    long long bestTriangle = -1;
+    while (output.size() < indices.size())
+    {
+        // Nothing good in the cache: restart from the next unused triangle in input order
+        if (bestTriangle < 0)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+                cursor++;
+            if (cursor == triangleCount)
+                break;
+            bestTriangle = static_cast<long long>(cursor);
+        }
+
+        size_t t = static_cast<size_t>(bestTriangle);
+        emitted[t] = 1;
+        unsigned int tri[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+        output.insert(output.end(), tri, tri + 3);
+
+        // Remove the triangle from its vertices' remaining lists
+        for (unsigned int v : tri)
+        {
+            unsigned int* begin = &adjacency[adjacencyOffset[v]];
+            unsigned int* end = begin + valence[v];
+            unsigned int* found = std::find(begin, end, static_cast<unsigned int>(t));
+            if (found != end)
+            {
+                std::swap(*found, *(end - 1));
+                valence[v]--;
+            }
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        newCache.assign(tri, tri + 3);
+        for (unsigned int v : cache)
+        {
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache.push_back(v);
+        }
+        for (size_t i = cacheSize; i < newCache.size(); i++)
+        {
+            cachePosition[newCache[i]] = -1;
+            score[newCache[i]] = vertexScore(-1, valence[newCache[i]]);
+        }
+        if (newCache.size() > static_cast<size_t>(cacheSize))
+            newCache.resize(cacheSize);
+        cache.swap(newCache);
+
+        for (int i = 0; i < static_cast<int>(cache.size()); i++)
+        {
+            cachePosition[cache[i]] = i;
+            score[cache[i]] = vertexScore(i, valence[cache[i]]);
+        }
+
+        // Rescore triangles touching the cache and pick the best one
+        bestTriangle = -1;
+        float bestScore = 0.0f;
+        for (unsigned int v : cache)
+        {
+            for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + valence[v]; a++)
+            {
+                unsigned int candidate = adjacency[a];
+                float candidateScore = score[indices[candidate * 3]] + score[indices[candidate * 3 + 1]] + score[indices[candidate * 3 + 2]];
+                triangleScore[candidate] = candidateScore;
+                if (candidateScore > bestScore)
+                {
+                    bestScore = candidateScore;
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+// Reorder clusters of the cache-optimized sequence so outward-facing clusters are drawn first
+// (Sander et al. 2007: split where the cache restarts or ACMR stays within threshold, sort by facing)
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold = OVERDRAW_THRESHOLD)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // Per-triangle FIFO misses, and hard boundaries where all three vertices miss
+    std::vector<unsigned int> insertedAt(vertices.size(), 0);
+    std::vector<unsigned char> triangleMisses(triangleCount);
+    std::vector<size_t> hardBoundaries;
+    unsigned int misses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned char triMisses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int index = indices[t * 3 + k];
+            if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > ANALYZER_FIFO_SIZE)
+            {
+                misses++;
+                triMisses++;
+                insertedAt[index] = misses;
+            }
+        }
+        triangleMisses[t] = triMisses;
+        if (t == 0 || triMisses == 3)
+            hardBoundaries.push_back(t);
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Soft boundaries inside each hard cluster, wherever the running ACMR is within threshold of the cluster's
+    const size_t minimumClusterSize = 16;
+    std::vector<size_t> clusterStarts;
+    for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+    {
+        size_t begin = hardBoundaries[h], end = hardBoundaries[h + 1];
+        unsigned int clusterMisses = 0;
+        for (size_t t = begin; t < end; t++)
+            clusterMisses += triangleMisses[t];
+        float clusterAcmr = static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+        clusterStarts.push_back(begin);
+        unsigned int runningMisses = 0;
+        size_t start = begin;
+        for (size_t t = begin; t < end; t++)
+        {
+            runningMisses += triangleMisses[t];
+            size_t length = t + 1 - start;
+            if (length >= minimumClusterSize && t + 1 < end &&
+                static_cast<float>(runningMisses) / static_cast<float>(length) <= clusterAcmr * threshold)
+            {
+                start = t + 1;
+                runningMisses = 0;
+                clusterStarts.push_back(start);
+            }
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    // Mesh centroid (area weighted)
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3& a = vertices[indices[t * 3]].Position;
+        const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& c = vertices[indices[t * 3 + 2]].Position;
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    meshCentroid = (meshArea > 0.0f) ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+    // Sort key: how far the cluster faces away from the centre
+    struct Cluster
+    {
+        size_t begin, end;
+        float key;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 areaNormal = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(areaNormal);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += areaNormal;
+            area += triangleArea;
+        }
+        float key = 0.0f;
+        float normalLength = glm::length(normal);
+        if (area > 0.0f && normalLength > 0.0f)
+            key = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+        clusters.push_back(Cluster{ clusterStarts[c], clusterStarts[c + 1], key });
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+        output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    indices.swap(output);
+}
+
+// Renumber vertices in first-use order so vertex fetches walk memory linearly (drops unused vertices)
+void optimizeVertexFetch(MeshData& meshData)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(meshData.vertices.size(), unused);
+    std::vector<Vertex> reordered;
+    reordered.reserve(meshData.vertices.size());
+
+    for (unsigned int& index : meshData.indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(meshData.vertices[index]);
+        }
+        index = remap[index];
+    }
+    meshData.vertices.swap(reordered);
+}
+
+// Full pipeline on an owned (not mapped) triangle mesh
+MeshOptimizationStats optimizeMesh(MeshData& meshData)
+{
+    MeshOptimizationStats stats;
+    stats.triangles = meshData.indices.size() / 3;
+    stats.verticesBefore = meshData.vertices.size();
+    stats.acmrBefore = analyzeVertexCache(meshData.indices, meshData.vertices.size());
+    stats.overdrawBefore = analyzeOverdraw(meshData.indices, meshData.vertices);
+
+    weldVertices(meshData);
+    optimizeVertexCache(meshData.indices, meshData.vertices.size());
+    optimizeOverdraw(meshData.indices, meshData.vertices);
+    optimizeVertexFetch(meshData);
+
+    stats.verticesAfter = meshData.vertices.size();
+    stats.acmrAfter = analyzeVertexCache(meshData.indices, meshData.vertices.size());
+    stats.overdrawAfter = analyzeOverdraw(meshData.indices, meshData.vertices);
+    return stats;
+}
+
+// Combine per-mesh stats into a model total (ratios weighted by triangle count)
+void accumulateOptimizationStats(MeshOptimizationStats& total, const MeshOptimizationStats& mesh)
+{
+    size_t triangles = total.triangles + mesh.triangles;
+    if (triangles == 0)
+        return;
+
+    auto blend = [&](float a, float b) { return (a * total.triangles + b * mesh.triangles) / static_cast<float>(triangles); };
+    total.acmrBefore = blend(total.acmrBefore, mesh.acmrBefore);
+    total.acmrAfter = blend(total.acmrAfter, mesh.acmrAfter);
+    total.overdrawBefore = blend(total.overdrawBefore, mesh.overdrawBefore);
+    total.overdrawAfter = blend(total.overdrawAfter, mesh.overdrawAfter);
+    total.verticesBefore += mesh.verticesBefore;
+    total.verticesAfter += mesh.verticesAfter;
+    total.triangles = triangles;
+}
+
+#endif // MY_MESH_OPTIMIZER_H
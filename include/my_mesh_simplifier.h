@@ -0,0 +1,281 @@
+#ifndef MY_MESH_SIMPLIFIER_H
+#define MY_MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <my_mesh_data.h>
+#include <my_mesh_optimizer.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Quadric error edge collapse (Garland & Heckbert) for the LOD chain
+// Collapses are vertex-restricted: a vertex is merged into one of its neighbours, never moved,
+// so every LOD indexes the original vertex buffer and keeps the exact d_N of the vertices it uses
+
+const float LOD_MAX_ERROR = 0.05f;      // Largest collapse distance, relative to the mesh extent
+const float LOD_DN_WEIGHT = 1.0f;       // d_N is a distance, so its squared change is added to the quadric error as is
+const float LOD_MIN_REDUCTION = 0.75f;  // Drop a level that keeps more than this fraction of the previous one
+
+// Symmetric 4x4 plane quadric, normalized by its accumulated area weight
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& normal, float distance, float area)
+    {
+        double nx = normal.x, ny = normal.y, nz = normal.z, d = distance, w = area;
+        a00 += w * nx * nx; a01 += w * nx * ny; a02 += w * nx * nz;
+        a11 += w * ny * ny; a12 += w * ny * nz; a22 += w * nz * nz;
+        b0 += w * nx * d; b1 += w * ny * d; b2 += w * nz * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02;
+        a11 += other.a11; a12 += other.a12; a22 += other.a22;
+        b0 += other.b0; b1 += other.b1; b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+        return *this;
+    }
+
+    // Mean squared distance of p to the accumulated planes
+    double evaluate(const glm::vec3& p) const
+    {
+        if (weight <= 0.0)
+            return 0.0;
+        double x = p.x, y = p.y, z = p.z;
+        double value = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+            + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(value, 0.0) / weight;
+    }
+};
+
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+        : vertices(vertices), quadrics(vertexCount), current(indices, indices + indexCount)
+    {
+        for (size_t t = 0; t + 2 < current.size(); t += 3)
+        {
+            const glm::vec3& a = vertices[current[t]].Position;
+            const glm::vec3& b = vertices[current[t + 1]].Position;
+            const glm::vec3& c = vertices[current[t + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+            normal /= length;
+            for (int k = 0; k < 3; k++)
+                quadrics[current[t + k]].addPlane(normal, -glm::dot(normal, a), length * 0.5f);
+        }
+    }
+
+    // Collapse edges until at most targetIndexCount indices remain or the next collapse would move
+    // the surface further than maxError. Continues from the previous call, so levels chain.
+    const std::vector<unsigned int>& simplify(size_t targetIndexCount, float maxError)
+    {
+        double maxCost = static_cast<double>(maxError) * maxError;
+        while (current.size() > targetIndexCount)
+        {
+            size_t collapsed = collapsePass(targetIndexCount, maxCost);
+            if (collapsed == 0)
+                break;
+        }
+        return current;
+    }
+
+    // Largest collapse distance so far (model units)
+    float error() const
+    {
+        return static_cast<float>(std::sqrt(resultCost));
+    }
+
+private:
+    struct Collapse
+    {
+        unsigned int from, to;
+        double cost;
+    };
+
+    const Vertex* vertices;
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned int> current;
+    double resultCost = 0.0;
+
+    double collapseCost(unsigned int from, unsigned int to) const
+    {
+        Quadric combined = quadrics[from];
+        combined += quadrics[to];
+        float dN = vertices[from].d_N - vertices[to].d_N;
+        return combined.evaluate(vertices[to].Position) + LOD_DN_WEIGHT * dN * dN;
+    }
+
+    // One round of independent collapses (no two touch the same neighbourhood), cheapest first
+    size_t collapsePass(size_t targetIndexCount, double maxCost)
+    {
+        const size_t triangleCount = current.size() / 3;
+        const size_t vertexCount = quadrics.size();
+
+        // Edges with their use count: open and non-manifold edges lock their vertices
+        std::vector<std::pair<unsigned int, unsigned int>> edges;
+        edges.reserve(current.size());
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = current[t * 3 + k], b = current[t * 3 + (k + 1) % 3];
+                edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        std::vector<char> locked(vertexCount, 0);
+        std::vector<Collapse> collapses;
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i])
+                j++;
+            unsigned int a = edges[i].first, b = edges[i].second;
+            if (j - i != 2)
+            {
+                locked[a] = locked[b] = 1;
+            }
+            else
+            {
+                double costAB = collapseCost(a, b), costBA = collapseCost(b, a);
+                collapses.push_back(costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA });
+                collapses.push_back(costAB <= costBA ? Collapse{ b, a, costBA } : Collapse{ a, b, costAB });
+            }
+            i = j;
+        }
+        collapses.erase(std::remove_if(collapses.begin(), collapses.end(), [&](const Collapse& c) { return locked[c.from] || c.cost > maxCost; }), collapses.end());
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // Vertex -> triangle adjacency (CSR) for the flip test
+        std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+        for (unsigned int index : current)
+            adjacencyOffset[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffset[v + 1] += adjacencyOffset[v];
+        std::vector<unsigned int> adjacency(current.size());
+        std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+                adjacency[fill[current[t * 3 + k]]++] = static_cast<unsigned int>(t);
+        }
+
+        // Each interior collapse removes two triangles
+        size_t collapseBudget = (current.size() - targetIndexCount) / 6 + 1;
+        std::vector<char> touched(vertexCount, 0);
+        std::vector<unsigned int> remap(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = static_cast<unsigned int>(v);
+
+        size_t collapsed = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapsed >= collapseBudget)
+                break;
+            if (touched[collapse.from] || touched[collapse.to] || flips(collapse, adjacency, adjacencyOffset))
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            resultCost = std::max(resultCost, collapse.cost);
+            collapsed++;
+
+            // Freeze the one-ring so later collapses this pass see up-to-date triangles
+            for (unsigned int a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; a++)
+            {
+                for (int k = 0; k < 3; k++)
+                    touched[current[adjacency[a] * 3 + k]] = 1;
+            }
+        }
+
+        // Rebuild the index buffer without the triangles that collapsed
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            unsigned int a = remap[current[t * 3]], b = remap[current[t * 3 + 1]], c = remap[current[t * 3 + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            current[write++] = a;
+            current[write++] = b;
+            current[write++] = c;
+        }
+        current.resize(write);
+        return collapsed;
+    }
+
+    // Would merging from into to turn any surviving triangle around it over?
+    bool flips(const Collapse& collapse, const std::vector<unsigned int>& adjacency, const std::vector<unsigned int>& adjacencyOffset) const
+    {
+        for (unsigned int a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; a++)
+        {
+            const unsigned int* tri = &current[adjacency[a] * 3];
+            if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                continue;
+
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = vertices[tri[k]].Position;
+                q[k] = (tri[k] == collapse.from) ? vertices[collapse.to].Position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            // Also reject turns of more than ~75 degrees, which leave slivers that are nearly flipped
+            if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Append up to levels simplified index ranges after the full-detail indices, each about half the last
+void buildMeshLods(MeshData& meshData, unsigned int levels)
+{
+    meshData.lods.clear();
+    meshData.lods.push_back(MeshLod{ 0, static_cast<uint32_t>(meshData.indices.size()), 0.0f });
+    if (levels == 0 || meshData.indices.empty() || meshData.indices.size() % 3 != 0)
+        return;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (const Vertex& vertex : meshData.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float maxError = LOD_MAX_ERROR * std::max(extent.x, std::max(extent.y, extent.z));
+
+    MeshSimplifier simplifier(meshData.vertices.data(), meshData.vertices.size(), meshData.indices.data(), meshData.indices.size());
+    size_t previous = meshData.indices.size();
+    for (unsigned int level = 1; level <= levels; level++)
+    {
+        size_t target = previous / 6 * 3;
+        std::vector<unsigned int> lodIndices = simplifier.simplify(target, maxError);
+        if (lodIndices.empty() || lodIndices.size() > previous * LOD_MIN_REDUCTION)
+            break;
+
+        optimizeVertexCache(lodIndices, meshData.vertices.size());
+        meshData.lods.push_back(MeshLod{ static_cast<uint32_t>(meshData.indices.size()), static_cast<uint32_t>(lodIndices.size()), simplifier.error() });
+        meshData.indices.insert(meshData.indices.end(), lodIndices.begin(), lodIndices.end());
+        previous = lodIndices.size();
+    }
+}
+
+#endif // MY_MESH_SIMPLIFIER_H
@@ -0,0 +1,150 @@
+#ifndef MY_MESHLETS_H
+#define MY_MESHLETS_H
+
+#include <glm/glm.hpp>
+
+#include <my_mesh_data.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Meshlets: contiguous runs of the index buffer with a bounding sphere and a normal cone,
+// so a pass can skip runs whose triangles all face the wrong way before they are transformed
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+const float MESHLET_NORMAL_SPLIT = 0.5f;    // Start a new meshlet when a triangle is > 60 degrees off the running axis
+
+// Which triangles the current pass rasterizes, matching glCullFace
+enum class MeshletCulling
+{
+    None,           // Draw every meshlet
+    DrawFrontFaces, // glCullFace(GL_BACK): skip meshlets that are entirely back-facing
+    DrawBackFaces   // glCullFace(GL_FRONT): skip meshlets that are entirely front-facing
+};
+
+// True if every triangle of the meshlet faces away from viewPosition (model space)
+bool meshletBackFacing(const Meshlet& meshlet, const glm::vec3& viewPosition)
+{
+    glm::vec3 toCenter = meshlet.center - viewPosition;
+    return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+bool meshletFrontFacing(const Meshlet& meshlet, const glm::vec3& viewPosition)
+{
+    glm::vec3 toCenter = meshlet.center - viewPosition;
+    return -glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+bool meshletVisible(const Meshlet& meshlet, MeshletCulling culling, const glm::vec3& viewPosition)
+{
+    if (culling == MeshletCulling::DrawFrontFaces)
+        return !meshletBackFacing(meshlet, viewPosition);
+    if (culling == MeshletCulling::DrawBackFaces)
+        return !meshletFrontFacing(meshlet, viewPosition);
+    return true;
+}
+
+// Sphere and cone for triangles [indexOffset, indexOffset + indexCount)
+Meshlet computeMeshletBounds(const Vertex* vertices, const unsigned int* indices, uint32_t indexOffset, uint32_t indexCount)
+{
+    Meshlet meshlet;
+    meshlet.indexOffset = indexOffset;
+    meshlet.indexCount = indexCount;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX), normalSum(0.0f);
+    std::vector<glm::vec3> normals;
+    normals.reserve(indexCount / 3);
+    for (uint32_t i = indexOffset; i < indexOffset + indexCount; i += 3)
+    {
+        const glm::vec3& a = vertices[indices[i]].Position;
+        const glm::vec3& b = vertices[indices[i + 1]].Position;
+        const glm::vec3& c = vertices[indices[i + 2]].Position;
+        boundsMin = glm::min(boundsMin, glm::min(a, glm::min(b, c)));
+        boundsMax = glm::max(boundsMax, glm::max(a, glm::max(b, c)));
+
+        // Degenerate triangles are never rasterized, so they don't constrain the cone
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+        {
+            normals.push_back(normal / length);
+            normalSum += normal / length;
+        }
+    }
+
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (uint32_t i = indexOffset; i < indexOffset + indexCount; i++)
+    {
+        glm::vec3 offset = vertices[indices[i]].Position - meshlet.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    // Widest normal decides the cone; a cone of 90 degrees or more can't be culled
+    float axisLength = glm::length(normalSum);
+    meshlet.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+    for (const glm::vec3& normal : normals)
+        minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+    meshlet.coneCutoff = (minDot <= 0.0f) ? 2.0f : std::sqrt(1.0f - minDot * minDot);
+    return meshlet;
+}
+
+// Split an index buffer (best after vertex cache optimization) into meshlets without reordering it
+std::vector<Meshlet> buildMeshlets(const Vertex* vertices, const unsigned int* indices, size_t indexCount)
+{
+    std::vector<Meshlet> meshlets;
+    if (indexCount == 0 || indexCount % 3 != 0)
+        return meshlets;
+
+    std::vector<unsigned int> meshletVertices;
+    meshletVertices.reserve(MESHLET_MAX_VERTICES);
+    glm::vec3 normalSum(0.0f);
+    uint32_t start = 0;
+
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        const glm::vec3& a = vertices[indices[i]].Position;
+        const glm::vec3& b = vertices[indices[i + 1]].Position;
+        const glm::vec3& c = vertices[indices[i + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+        // Count the triangle's new vertices
+        unsigned int newVertices = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) == meshletVertices.end())
+                newVertices++;
+        }
+
+        uint32_t triangles = (i - start) / 3;
+        float axisLength = glm::length(normalSum);
+        bool full = meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES || triangles >= MESHLET_MAX_TRIANGLES;
+        bool divergent = axisLength > 0.0f && length > 0.0f && glm::dot(normal, normalSum / axisLength) < MESHLET_NORMAL_SPLIT;
+        if (triangles > 0 && (full || divergent))
+        {
+            meshlets.push_back(computeMeshletBounds(vertices, indices, start, i - start));
+            start = i;
+            meshletVertices.clear();
+            normalSum = glm::vec3(0.0f);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) == meshletVertices.end())
+                meshletVertices.push_back(indices[i + k]);
+        }
+        normalSum += normal;
+    }
+    meshlets.push_back(computeMeshletBounds(vertices, indices, start, static_cast<uint32_t>(indexCount) - start));
+    return meshlets;
+}
+
+#endif // MY_MESHLETS_H
@@ -0,0 +1,135 @@
+#ifndef MY_MIP_CHAIN_H
+#define MY_MIP_CHAIN_H
+
+#include <my_hdr_formats.h>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MY_MIP_CHAIN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Mip chains for skybox faces that don't come with one (PNG, HDR and panorama faces; BC1 cubemaps carry theirs in
+// the KTX file). Each level is a 2x2 box filter of the one above, like glGenerateMipmap, but built once with the
+// decode on the thread pool rather than by the driver, with SSE2 where the compiler targets it
+// HDR levels are filtered in float from the unpacked top level and packed at the end, so the shared-exponent
+// rounding doesn't pile up level after level
+
+// Next level of a square RGBA8 image (odd sizes drop the last row and column, as GL's level sizes do)
+void downsampleRGBA8(const uint32_t* source, int size, uint32_t* target)
+{
+    int next = size / 2;
+    for (int y = 0; y < next; y++)
+    {
+        const uint32_t* row0 = source + static_cast<size_t>(2 * y) * size;
+        const uint32_t* row1 = row0 + size;
+        uint32_t* out = target + static_cast<size_t>(y) * next;
+        int x = 0;
+#ifdef MY_MIP_CHAIN_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; x + 2 <= next; x += 2)
+        {
+            // Four texels of both rows make two: widen to 16 bits, add the rows, then each texel to its neighbour
+            __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x));
+            __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x));
+            __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+            right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+            __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(left, right), rounding), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, zero));
+        }
+#endif
+        for (; x < next; x++)
+        {
+            uint32_t texel = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                uint32_t sum = ((row0[2 * x] >> shift) & 0xFF) + ((row0[2 * x + 1] >> shift) & 0xFF)
+                    + ((row1[2 * x] >> shift) & 0xFF) + ((row1[2 * x + 1] >> shift) & 0xFF);
+                texel |= ((sum + 2) / 4) << shift;
+            }
+            out[x] = texel;
+        }
+    }
+}
+
+// Next level of a square image of four floats a texel
+void downsampleFloat4(const float* source, int size, float* target)
+{
+    int next = size / 2;
+    for (int y = 0; y < next; y++)
+    {
+        for (int x = 0; x < next; x++)
+        {
+            const float* a = source + (static_cast<size_t>(2 * y) * size + 2 * x) * 4;
+            const float* b = a + static_cast<size_t>(size) * 4;
+            float* out = target + (static_cast<size_t>(y) * next + x) * 4;
+#ifdef MY_MIP_CHAIN_SSE2
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(a + 4)), _mm_add_ps(_mm_loadu_ps(b), _mm_loadu_ps(b + 4)));
+            _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; c++)
+                out[c] = (a[c] + a[c + 4] + b[c] + b[c + 4]) * 0.25f;
+#endif
+        }
+    }
+}
+
+// Levels 1 and down (to 1x1) of a square RGB8 face, as RGBA8 bytes in memory order
+std::vector<std::vector<uint32_t>> buildMipChainRGB8(const unsigned char* rgb, int size)
+{
+    std::vector<std::vector<uint32_t>> levels;
+    if (size < 2)
+        return levels;
+    std::vector<uint32_t> top(static_cast<size_t>(size) * size);
+    for (size_t i = 0; i < top.size(); i++)
+        top[i] = 0xFF000000u | rgb[i * 3] | (static_cast<uint32_t>(rgb[i * 3 + 1]) << 8) | (static_cast<uint32_t>(rgb[i * 3 + 2]) << 16);
+
+    const std::vector<uint32_t>* previous = &top;
+    for (int levelSize = size; levelSize > 1; levelSize /= 2)
+    {
+        std::vector<uint32_t> next(static_cast<size_t>(levelSize / 2) * (levelSize / 2));
+        downsampleRGBA8(previous->data(), levelSize, next.data());
+        levels.push_back(std::move(next));
+        previous = &levels.back();
+    }
+    return levels;
+}
+
+// Levels 1 and down (to 1x1) of a square face packed to RGB9E5 or R11G11B10F, packed the same way
+std::vector<std::vector<uint32_t>> buildMipChainHdr(const uint32_t* packed, int size, HdrPacking packing)
+{
+    std::vector<std::vector<uint32_t>> levels;
+    if (size < 2)
+        return levels;
+    std::vector<float> current(static_cast<size_t>(size) * size * 4, 0.0f);
+    for (size_t i = 0; i < static_cast<size_t>(size) * size; i++)
+    {
+        if (packing == HdrPacking::RGB9E5)
+            unpackRGB9E5(packed[i], &current[i * 4]);
+        else
+            unpackR11G11B10F(packed[i], &current[i * 4]);
+    }
+
+    for (int levelSize = size; levelSize > 1; levelSize /= 2)
+    {
+        size_t texels = static_cast<size_t>(levelSize / 2) * (levelSize / 2);
+        std::vector<float> next(texels * 4);
+        downsampleFloat4(current.data(), levelSize, next.data());
+        std::vector<uint32_t> level(texels);
+        for (size_t i = 0; i < texels; i++)
+        {
+            const float* rgb = &next[i * 4];
+            level[i] = packing == HdrPacking::RGB9E5 ? packRGB9E5(rgb[0], rgb[1], rgb[2]) : packR11G11B10F(rgb[0], rgb[1], rgb[2]);
+        }
+        levels.push_back(std::move(level));
+        current.swap(next);
+    }
+    return levels;
+}
+
+#endif // MY_MIP_CHAIN_H
@@ -7,20 +7,122 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <stb_image.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
 #include <my_mesh.h>
+#include <my_mesh_deformer.h>
 #include <my_shader.h>
+#include <my_model_loader.h>
+#include <my_memory_usage.h>
+#include <my_upload_thread.h>
 
+#include <algorithm>
 #include <string>
+#include <chrono>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 
+// Decode the normal and d_N maps stored next to a model file (my_surface_maps.h)
+bool loadSurfaceMaps(const std::string& modelPath, SurfaceMaps& maps)
+{
+    std::string normalMapPath, thicknessMapPath;
+    surfaceMapPaths(modelPath, normalMapPath, thicknessMapPath);
+
+    int width, height, channels, thicknessWidth, thicknessHeight;
+    unsigned char* normals = stbi_load(normalMapPath.c_str(), &width, &height, &channels, 3);
+    float* thickness = stbi_loadf(thicknessMapPath.c_str(), &thicknessWidth, &thicknessHeight, &channels, 1);
+    bool loaded = normals && thickness && width == thicknessWidth && height == thicknessHeight;
+    if (loaded)
+    {
+        size_t texels = static_cast<size_t>(width) * static_cast<size_t>(height);
+        maps.width = width;
+        maps.height = height;
+        maps.normals.assign(normals, normals + texels * 3);
+        maps.thickness.assign(thickness, thickness + texels);
+    }
+    stbi_image_free(normals);
+    stbi_image_free(thickness);
+    return loaded;
+}
+
+// GL copies of a model's surface maps
+struct SurfaceMapTextures
+{
+    GLTexture normalMap;
+    GLTexture thicknessMap;
+    size_t bytes = 0;
+};
+
+SurfaceMapTextures uploadSurfaceMaps(const SurfaceMaps& maps)
+{
+    SurfaceMapTextures textures;
+    if (!maps.valid())
+        return textures;
+
+    // Few mips: the atlas gutters are only a couple of texels wide
+    textures.normalMap = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, textures.normalMap.id());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, maps.width, maps.height, 0, GL_RGB, GL_UNSIGNED_BYTE, maps.normals.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 2);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    textures.thicknessMap = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, textures.thicknessMap.id());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, maps.width, maps.height, 0, GL_RED, GL_FLOAT, maps.thickness.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    textures.bytes = maps.gpuBytes();
+    return textures;
+}
+
+// A model whose buffers and textures the upload thread is filling, made into a Model once fence has signaled
+struct StagedModel
+{
+    ModelData data;                 // Names, meshlets and LODs only once staged (the arrays are freed on the upload thread)
+    std::vector<StagedMesh> meshes;
+    SurfaceMapTextures maps;
+    double stageMilliseconds = 0.0; // Spent on the upload thread
+    std::shared_ptr<UploadFence> fence;
+};
+
+// Queue a model's geometry and maps on the upload thread
+std::shared_ptr<StagedModel> stageModel(ModelData data, VertexFormat format)
+{
+    auto staged = std::make_shared<StagedModel>();
+    staged->data = std::move(data);
+    staged->fence = globalUploadThread().submit([staged, format]()
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        staged->meshes.reserve(staged->data.meshes.size());
+        for (MeshData& meshData : staged->data.meshes)
+        {
+            staged->meshes.push_back(stageMesh(meshData, format));
+            meshData.vertices = std::vector<Vertex>();
+            meshData.indices = std::vector<unsigned int>();
+            meshData.mappedVertices = nullptr;
+            meshData.mappedIndices = nullptr;
+        }
+        staged->data.cache.reset(); // Unmap the mesh cache
+        staged->maps = uploadSurfaceMaps(staged->data.maps);
+        staged->data.maps = SurfaceMaps();
+        staged->stageMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    });
+    return staged;
+}
+
 class Model
 {
 public:
@@ -28,110 +130,316 @@ public:
     std::vector<Mesh> meshes;
 
     // Constructor (expects a filepath to a 3D model)
-    Model(std::string const& objPath, const std::string& modelName)
+    Model(std::string const& objPath, const std::string& modelName, const ModelLoadSettings& settings = ModelLoadSettings(), VertexFormat format = VertexFormat::Float)
+        : Model(ModelLoader(settings).load(objPath, modelName), format)
+    {
+    }
+
+    // Constructor from CPU data loaded elsewhere, only the GL upload happens here (needs the context thread)
+    // Takes the data by value so each mesh's arrays are freed as soon as they are on the GPU
+    // With MeshUpload::Streamed the constructor only reserves pool space and streamUpload() does the copy
+    Model(ModelData data, VertexFormat format = VertexFormat::Float, MeshUpload mode = MeshUpload::Immediate)
+        : pool(&geometryPool(format))
+    {
+        copyLoadDetails(data);
+        surfaceMaps = uploadSurfaceMaps(data.maps);
+        data.maps = SurfaceMaps();
+
+        if (mode == MeshUpload::Streamed)
+        {
+            meshes.reserve(data.meshes.size());
+            for (const MeshData& meshData : data.meshes)
+                meshes.emplace_back(meshData, *pool, MeshUpload::Streamed);
+            streamSource = std::move(data);
+            streamed = true;
+            return;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        meshes.reserve(data.meshes.size());
+        for (MeshData& meshData : data.meshes)
+        {
+            meshes.emplace_back(meshData, *pool);
+            meshData = MeshData();
+        }
+        data.cache.reset(); // Unmap the mesh cache
+        auto end = std::chrono::high_resolution_clock::now();
+        uploadMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+        printModelDetails();
+    }
+
+    // Constructor from a model the upload thread has staged (context thread, after staged.fence has signaled)
+    // Only claims pool space and queues GPU-side copies, so it costs the frame next to nothing
+    Model(StagedModel& staged, VertexFormat format)
+        : pool(&geometryPool(format))
     {
-        this->modelName = modelName;
-        loadModel(objPath);
+        copyLoadDetails(staged.data);
+        surfaceMaps = std::move(staged.maps);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        meshes.reserve(staged.meshes.size());
+        for (size_t i = 0; i < staged.meshes.size(); i++)
+            meshes.emplace_back(staged.data.meshes[i], *pool, staged.meshes[i]);
+        staged.meshes.clear(); // The copies are queued, the staging buffers can go
+        auto end = std::chrono::high_resolution_clock::now();
+        uploadMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        stageMilliseconds = staged.stageMilliseconds;
+        backgroundUpload = true;
+
         printModelDetails();
     }
 
-    // Draw the model (all its meshes)
-    void draw(Shader& shader)
+    // Meshes own pool ranges, so models move but never copy
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = default;
+
+    // Draw the model (all its meshes) at one LOD with a single multi-draw, returns the number of triangles submitted
+    unsigned int draw(Shader& shader, MeshletCulling culling = MeshletCulling::None, const glm::vec3& viewPosition = glm::vec3(0.0f), int lodLevel = 0)
     {
-        for (unsigned int i = 0; i < static_cast<unsigned int>(meshes.size()); i++)
-            meshes[i].draw(shader);
+        pool->beginBatch();
+        unsigned int triangles = addDraws(culling, viewPosition, lodLevel);
+        pool->submit(shader);
+        return triangles;
     }
 
-private:
-    std::string modelName;
+    // Queue the model's draws into the pool's current batch (to draw several models in one call)
+    unsigned int addDraws(MeshletCulling culling = MeshletCulling::None, const glm::vec3& viewPosition = glm::vec3(0.0f), int lodLevel = 0)
+    {
+        unsigned int triangles = 0;
+        for (auto& mesh : meshes)
+            triangles += mesh.addDraws(culling, viewPosition, lodLevel);
+        return triangles;
+    }
 
-    // Load a 3D model specified by path
-    void loadModel(std::string const& path)
+    // Upload streamed chunks for about budgetMilliseconds (at least one), returns true once everything is resident
+    // Every mesh is made drawable at its coarsest LOD before any is refined
+    bool streamUpload(double budgetMilliseconds)
     {
-        // Read file
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        
-        // Check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        if (uploadComplete())
+            return true;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        double elapsed = 0.0;
+        do
         {
-            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-            return;
-        }
+            size_t next = nextStreamedMesh();
+            if (next == meshes.size())
+                break;
+            meshes[next].uploadChunk(streamSource.meshes[next], streamSource.cache.get());
+            if (meshes[next].uploadComplete())
+                streamSource.meshes[next] = MeshData();
+            elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        } while (elapsed < budgetMilliseconds);
+        uploadMilliseconds += elapsed;
 
-        // Process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        if (!uploadComplete())
+            return false;
+        streamSource = ModelData(); // Unmap the mesh cache
+        printModelDetails();
+        return true;
     }
 
-    // Processes a node recursively
-    void processNode(aiNode* node, const aiScene* scene)
+    bool uploadComplete() const
     {
-        // Process each mesh located at current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        for (const auto& mesh : meshes)
         {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            if (!mesh.uploadComplete())
+                return false;
         }
-        // Recursively process children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
-            processNode(node->mChildren[i], scene);
+        return true;
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    float uploadProgress() const
     {
-        // Data to fill
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-
-        // Loop through mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        size_t total = 0, uploaded = 0;
+        for (const auto& mesh : meshes)
         {
-            Vertex vertex;
-            glm::vec3 vector;
-
-            // Positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-
-            // Normals (if it has)
-            if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
-
-            // Precomputed d_N vertex color attribute from Blender
-            if (mesh->HasVertexColors(0))
-                vertex.d_N = mesh->mColors[0][i].r; // Assuming r = g = b = d_N
-            else 
-                vertex.d_N = 0.0f; // Fallback value        
-
-            vertices.push_back(vertex);
+            total += mesh.uploadSize();
+            uploaded += mesh.uploadedBytes();
         }
+        return total > 0 ? static_cast<float>(uploaded) / total : 1.0f;
+    }
 
-        // Loop through mesh's faces and retrieve the corresponding vertex indices
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
+    unsigned int triangleCount(int lodLevel = 0) const
+    {
+        unsigned int triangles = 0;
+        for (const auto& mesh : meshes)
+            triangles += mesh.lod(static_cast<size_t>(lodLevel)).indexCount / 3;
+        return triangles;
+    }
 
-            // Retrieve all indices of the face and store them in the indices vector
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+    int lodCount() const
+    {
+        size_t count = 1;
+        for (const auto& mesh : meshes)
+            count = std::max(count, mesh.lodCount());
+        return static_cast<int>(count);
+    }
+
+    // Worst simplification distance of a level over all meshes (model units)
+    float lodError(int lodLevel) const
+    {
+        float error = 0.0f;
+        for (const auto& mesh : meshes)
+            error = std::max(error, mesh.lod(static_cast<size_t>(lodLevel)).error);
+        return error;
+    }
+
+    // Coarsest level whose error stays under maxPixelError when one model unit covers pixelsPerUnit pixels
+    int selectLod(float pixelsPerUnit, float maxPixelError) const
+    {
+        int level = 0;
+        for (int i = 1; i < lodCount(); i++)
+        {
+            if (lodError(i) * pixelsPerUnit <= maxPixelError)
+                level = i;
         }
+        return level;
+    }
+
+    // Bounding sphere in model space (for projected size)
+    glm::vec3 boundsCenter() const
+    {
+        return (boundsMin + boundsMax) * 0.5f;
+    }
+
+    float boundsRadius() const
+    {
+        return glm::length(boundsMax - boundsMin) * 0.5f;
+    }
+
+    size_t meshletCount() const
+    {
+        size_t count = 0;
+        for (const auto& mesh : meshes)
+            count += mesh.meshletCount();
+        return count;
+    }
 
-        // Return a mesh object created from the extracted mesh data
-        Mesh tempMesh(vertices, indices);
+    size_t gpuBytes() const
+    {
+        size_t bytes = surfaceMaps.bytes;
+        for (const auto& mesh : meshes)
+            bytes += mesh.gpuBytes();
+        return bytes;
+    }
 
-        // Set name if present
-        std::string meshName = std::string(mesh->mName.C_Str());
-        if (!meshName.empty())
-            tempMesh.meshName = meshName;
+    // Baked normal and d_N maps (my_surface_maps.h) were found next to the model file
+    bool hasSurfaceMaps() const
+    {
+        return surfaceMaps.bytes > 0;
+    }
 
-        return tempMesh;
+    // Bind the surface maps to units 3 and 4 for the two-surface shaders, which fall back to the vertex normal and d_N without them
+    void bindSurfaceMaps(Shader& shader, bool enabled)
+    {
+        bool useMaps = enabled && hasSurfaceMaps();
+        shader.setBool("surfaceMaps", useMaps);
+        shader.setInt("normalMap", 3);
+        shader.setInt("thicknessMap", 4);
+        if (!useMaps)
+            return;
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, surfaceMaps.normalMap.id());
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, surfaceMaps.thicknessMap.id());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Start animating the meshes, data being a CPU copy of this model (e.g. a warm reload from the mesh cache)
+    void setDeformer(const ModelData& data, const MeshDeformFunction& deformFunction, const DeformSettings& settings = DeformSettings())
+    {
+        clearDeformer();
+        if (data.meshes.size() != meshes.size() || !uploadComplete())
+            return;
+        deformers.reserve(meshes.size());
+        for (const MeshData& meshData : data.meshes)
+            deformers.emplace_back(meshData, deformFunction, settings);
+    }
+
+    // Stop animating and put the rest pose back
+    void clearDeformer()
+    {
+        for (size_t i = 0; i < deformers.size(); i++)
+            deformers[i].restore(meshes[i]);
+        deformers.clear();
+    }
+
+    bool isDeforming() const
+    {
+        return !deformers.empty();
+    }
+
+    // Pose every mesh for time (seconds) and update its d_N and GPU vertices
+    DeformFrameStats deform(float time)
+    {
+        DeformFrameStats stats;
+        for (size_t i = 0; i < deformers.size(); i++)
+            stats.add(deformers[i].update(meshes[i], time));
+        return stats;
+    }
+
+    // Return the model's geometry to the pool now (the destructor does the same)
+    void release()
+    {
+        deformers.clear();
+        for (auto& mesh : meshes)
+            mesh.release();
+        meshes.clear();
+    }
+
+private:
+    GeometryPool* pool;
+    std::string modelName;
+    unsigned int bakedMeshes = 0;
+    double bakeMilliseconds = 0.0;
+    bool loadedFromCache = false;
+    double loadMilliseconds = 0.0;
+    double uploadMilliseconds = 0.0;
+    unsigned int optimizedMeshes = 0;
+    double optimizeMilliseconds = 0.0;
+    MeshOptimizationStats optimization;
+    double lodMilliseconds = 0.0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    bool streamed = false;
+    ModelData streamSource; // CPU data still to be streamed (mapped cache views or imported arrays)
+    SurfaceMapTextures surfaceMaps;
+    bool backgroundUpload = false;
+    double stageMilliseconds = 0.0;
+    std::vector<MeshDeformer> deformers; // One per mesh while deforming
+
+    void copyLoadDetails(const ModelData& data)
+    {
+        modelName = data.modelName;
+        loadedFromCache = data.loadedFromCache;
+        loadMilliseconds = data.loadMilliseconds;
+        bakedMeshes = data.bakedMeshes;
+        bakeMilliseconds = data.bakeMilliseconds;
+        optimizedMeshes = data.optimizedMeshes;
+        optimizeMilliseconds = data.optimizeMilliseconds;
+        optimization = data.optimization;
+        lodMilliseconds = data.lodMilliseconds;
+        boundsMin = data.boundsMin;
+        boundsMax = data.boundsMax;
+    }
+
+    size_t nextStreamedMesh() const
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (!meshes[i].drawable())
+                return i;
+        }
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (!meshes[i].uploadComplete())
+                return i;
+        }
+        return meshes.size();
     }
 
     void printModelDetails()
@@ -141,8 +449,8 @@ private:
 
         for (const auto& mesh : meshes)
         {
-            totalVertices += static_cast<unsigned int>(mesh.vertices.size());
-            totalTriangles += static_cast<unsigned int>(mesh.indices.size()) / 3;
+            totalVertices += mesh.vertexCount;
+            totalTriangles += mesh.lod(0).indexCount / 3;
         }
 
         std::cout << "****************************\n";
@@ -150,6 +458,48 @@ private:
         std::cout << "Model contains " << meshes.size() << " mesh(es).\n";
         std::cout << "Total vertices: " << totalVertices << "\n";
         std::cout << "Total triangles: " << totalTriangles << "\n";
+        if (lodCount() > 1)
+        {
+            std::cout << "LODs:";
+            for (int i = 0; i < lodCount(); i++)
+                std::cout << " " << triangleCount(i) << (i + 1 < lodCount() ? "," : "");
+            std::cout << " triangles (max error " << lodError(lodCount() - 1) << ")";
+            if (lodMilliseconds > 0.0)
+                std::cout << ", built in " << lodMilliseconds << " ms";
+            std::cout << "\n";
+        }
+        if (meshletCount() > 0)
+            std::cout << "Meshlets: " << meshletCount() << " (" << static_cast<float>(totalTriangles) / meshletCount() << " triangles each)\n";
+        std::cout << (loadedFromCache ? "Loaded from mesh cache in " : "Imported with Assimp in ") << loadMilliseconds << " ms\n";
+        if (backgroundUpload)
+            std::cout << "Uploaded on the upload thread in " << stageMilliseconds << " ms, published in " << uploadMilliseconds << " ms of frame time\n";
+        else if (streamed)
+            std::cout << "Streamed to GPU in " << uploadMilliseconds << " ms of frame time\n";
+        else
+            std::cout << "Uploaded to GPU in " << uploadMilliseconds << " ms\n";
+        std::cout << "Peak RSS so far: " << peakResidentBytes() / (1024 * 1024) << " MB\n";
+        // Geometry only, over every LOD's indices, so the packed and float sides cover the same ranges
+        size_t geometryBytes = 0, floatBytes = 0;
+        for (const auto& mesh : meshes)
+        {
+            geometryBytes += mesh.gpuBytes();
+            floatBytes += static_cast<size_t>(mesh.vertexCount) * sizeof(Vertex) + static_cast<size_t>(mesh.indexCount) * sizeof(unsigned int);
+        }
+        std::cout << "GPU memory: " << gpuBytes() / 1024 << " KB";
+        if (!meshes.empty() && meshes[0].format == VertexFormat::Packed)
+            std::cout << " packed (geometry " << geometryBytes / 1024 << " KB, float layout: " << floatBytes / 1024 << " KB, " << 100.0 * geometryBytes / std::max<size_t>(floatBytes, 1) << "%)";
+        std::cout << "\n";
+        if (hasSurfaceMaps())
+            std::cout << "Surface maps: " << surfaceMaps.bytes / 1024 << " KB (normal + d_N)\n";
+        if (bakedMeshes > 0)
+            std::cout << "Baked d_N for " << bakedMeshes << " mesh(es) in " << bakeMilliseconds << " ms\n";
+        if (optimizedMeshes > 0)
+        {
+            std::cout << "Optimized " << optimizedMeshes << " mesh(es) in " << optimizeMilliseconds << " ms\n";
+            std::cout << "  Welded vertices: " << optimization.verticesBefore << " -> " << optimization.verticesAfter << "\n";
+            std::cout << "  ACMR (FIFO " << ANALYZER_FIFO_SIZE << "): " << optimization.acmrBefore << " -> " << optimization.acmrAfter << "\n";
+            std::cout << "  Overdraw: " << optimization.overdrawBefore << " -> " << optimization.overdrawAfter << "\n";
+        }
         std::cout << "****************************\n\n";
     }
 };
@@ -0,0 +1,359 @@
+#ifndef MY_MODEL_CATALOG_H
+#define MY_MODEL_CATALOG_H
+
+#include <my_model.h>
+#include <my_model_loader.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <filesystem> // Requires C++17
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+const uint64_t STREAM_UPLOAD_MIN_FILE_BYTES = 64ull * 1024 * 1024; // Model files this big are streamed
+const double STREAM_UPLOAD_FRAME_MILLISECONDS = 4.0;               // Upload time spent per frame while streaming
+
+// One model file known to the catalog
+struct CatalogEntry
+{
+    std::string name;               // Shown in the model menu
+    std::string path;
+    uint64_t fileSize = 0;
+    std::unique_ptr<Model> model;   // GPU-resident copy, null until first selected
+    std::future<ModelData> pendingLoad; // CPU load running on the thread pool (streamed and background models)
+    std::shared_ptr<StagedModel> pendingUpload; // GL upload running on the upload thread
+    std::future<ModelData> pendingDeform; // CPU copy for the deformer, loading on the thread pool
+    size_t gpuBytes = 0;
+    uint64_t lastUsed = 0;
+    bool failed = false;            // Its load failed, so it isn't tried again
+    bool deformFailed = false;      // Its CPU copy failed to load, so it can't be deformed
+};
+
+// Directory of candidate models, loaded on first use and evicted least-recently-used over a GPU budget
+class ModelCatalog
+{
+public:
+    size_t gpuBudgetBytes = 256ull * 1024 * 1024;
+    ModelLoadSettings loadSettings{ DNBakeMode::IfMissing };
+    VertexFormat vertexFormat = VertexFormat::Float;
+    bool streamAll = false; // Stream every model, not only big ones
+
+    // Register every supported model file in a directory (file metadata only, nothing is parsed)
+    void scanDirectory(const std::string& directory)
+    {
+        std::error_code error;
+        std::vector<std::filesystem::path> files;
+        for (const auto& item : std::filesystem::directory_iterator(directory, error))
+        {
+            if (item.is_regular_file(error) && isSupportedModel(item.path()))
+                files.push_back(item.path());
+        }
+        if (error)
+            std::cerr << "ERROR::MODEL_CATALOG:: Could not scan " << directory << ": " << error.message() << std::endl;
+
+        // Stable menu order
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files)
+            addModel(file.generic_string(), file.filename().string());
+
+        std::cout << "Model catalog: " << entries.size() << " model(s) found in " << directory << "\n\n";
+    }
+
+    void addModel(const std::string& path, const std::string& name)
+    {
+        CatalogEntry entry;
+        entry.name = name;
+        entry.path = path;
+        std::error_code error;
+        entry.fileSize = static_cast<uint64_t>(std::filesystem::file_size(path, error));
+        entries.push_back(std::move(entry));
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    const std::string& name(size_t index) const
+    {
+        return entries[index].name;
+    }
+
+    bool isResident(size_t index) const
+    {
+        return entries[index].model != nullptr;
+    }
+
+    // Could not be loaded, acquire() returns null for it without reading the file again
+    bool isFailed(size_t index) const
+    {
+        return entries[index].failed;
+    }
+
+    // Still being read or streamed to the GPU
+    bool isLoading(size_t index) const
+    {
+        const CatalogEntry& entry = entries[index];
+        return entry.pendingLoad.valid() || entry.pendingUpload || (entry.model && !entry.model->uploadComplete());
+    }
+
+    // Fraction of the model's geometry on the GPU (0 while the file is still being read)
+    float loadProgress(size_t index) const
+    {
+        const CatalogEntry& entry = entries[index];
+        return entry.model ? entry.model->uploadProgress() : 0.0f;
+    }
+
+    // Index of the first model whose name starts with prefix (0 if none)
+    size_t find(const std::string& prefix) const
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].name.compare(0, prefix.size(), prefix) == 0)
+                return i;
+        }
+        return 0;
+    }
+
+    // Get a model for drawing, loading it on first use (needs the context thread)
+    // Streamed models load on the thread pool and return null until update() has created them;
+    // after that they draw whatever part is already resident
+    // With the upload thread running, other models load on the thread pool, upload on the upload thread
+    // and return null until update() has seen their fence signal; otherwise they load right here
+    Model* acquire(size_t index)
+    {
+        if (index >= entries.size())
+            return nullptr;
+
+        CatalogEntry& entry = entries[index];
+        if (entry.failed)
+            return nullptr;
+        entry.lastUsed = ++useCounter;
+        if (!entry.model && !entry.pendingLoad.valid() && !entry.pendingUpload)
+        {
+            if (streamed(entry) || globalUploadThread().running())
+            {
+                std::string path = entry.path, name = entry.name;
+                ModelLoadSettings settings = loadSettings;
+                entry.pendingLoad = globalThreadPool().submit([path, name, settings]() { return loadModel(settings, path, name); });
+                return nullptr;
+            }
+            makeResident(entry, loadModel(loadSettings, entry.path, entry.name));
+            evictOverBudget(index);
+        }
+        return entry.model.get();
+    }
+
+    // A model that is already resident, without loading it or marking it used (null otherwise)
+    Model* resident(size_t index) const
+    {
+        return index < entries.size() ? entries[index].model.get() : nullptr;
+    }
+
+    // Once per frame on the context thread: create streamed models whose CPU load finished and
+    // spend a fixed slice of the frame streaming their geometry. Background models go to the upload
+    // thread when their CPU load finishes and become resident here once their fence has signaled
+    void update(double budgetMilliseconds = STREAM_UPLOAD_FRAME_MILLISECONDS)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            CatalogEntry& entry = entries[i];
+            if (entry.pendingLoad.valid() && entry.pendingLoad.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                ModelData data = entry.pendingLoad.get();
+                if (streamed(entry) || !data.valid)
+                {
+                    makeResident(entry, std::move(data));
+                    evictOverBudget(i);
+                }
+                else
+                {
+                    entry.pendingUpload = stageModel(std::move(data), vertexFormat);
+                }
+            }
+            if (entry.pendingUpload && entry.pendingUpload->fence->signaled())
+            {
+                entry.model = std::make_unique<Model>(*entry.pendingUpload, vertexFormat);
+                entry.gpuBytes = entry.model->gpuBytes();
+                entry.pendingUpload.reset();
+                evictOverBudget(i);
+            }
+        }
+
+        for (auto& entry : entries)
+        {
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            if (elapsed >= budgetMilliseconds)
+                break;
+            if (entry.model && !entry.model->uploadComplete())
+                entry.model->streamUpload(budgetMilliseconds - elapsed);
+        }
+    }
+
+    // Deform a resident model for one frame (stops any other deforming model). Its CPU copy loads on the thread
+    // pool first, and the model stays in its rest pose until that arrives
+    DeformFrameStats deform(size_t index, float time)
+    {
+        stopDeforming(index);
+        if (index >= entries.size())
+            return DeformFrameStats();
+        CatalogEntry& entry = entries[index];
+        if (!entry.model || !entry.model->uploadComplete() || entry.deformFailed)
+            return DeformFrameStats();
+        if (!entry.model->isDeforming())
+        {
+            if (!entry.pendingDeform.valid())
+            {
+                std::string path = entry.path, name = entry.name;
+                ModelLoadSettings settings = loadSettings;
+                entry.pendingDeform = globalThreadPool().submit([path, name, settings]() { return ModelLoader(settings).load(path, name); });
+            }
+            if (entry.pendingDeform.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return DeformFrameStats();
+            ModelData data = entry.pendingDeform.get();
+            if (!data.valid)
+            {
+                entry.deformFailed = true;
+                return DeformFrameStats();
+            }
+            entry.model->setDeformer(data, makeWaveDeformer(entry.model->boundsCenter(), entry.model->boundsRadius()));
+        }
+        return entry.model->deform(time);
+    }
+
+    // Put every deforming model except keep back in its rest pose
+    void stopDeforming(size_t keep = SIZE_MAX)
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (i == keep)
+                continue;
+            entries[i].pendingDeform = std::future<ModelData>(); // A CPU copy still loading is dropped when it finishes
+            if (entries[i].model && entries[i].model->isDeforming())
+                entries[i].model->clearDeformer();
+        }
+    }
+
+    // Load every model at once on the thread pool, stopping uploads once the budget is full
+    void preloadAll()
+    {
+        std::vector<std::future<ModelData>> pending(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const CatalogEntry& entry = entries[i];
+            if (entry.failed)
+                continue;
+            std::string path = entry.path, name = entry.name;
+            ModelLoadSettings settings = loadSettings;
+            pending[i] = globalThreadPool().submit([path, name, settings]() { return loadModel(settings, path, name); });
+        }
+
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (!pending[i].valid())
+                continue;
+            ModelData data = pending[i].get();
+            if (!entries[i].model && residentBytes() < gpuBudgetBytes)
+            {
+                entries[i].lastUsed = ++useCounter;
+                makeResident(entries[i], std::move(data)); // Streamed ones finish in update()
+            }
+        }
+    }
+
+    size_t residentBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& entry : entries)
+            bytes += entry.gpuBytes;
+        return bytes;
+    }
+
+    size_t residentCount() const
+    {
+        size_t count = 0;
+        for (const auto& entry : entries)
+            count += entry.model ? 1 : 0;
+        return count;
+    }
+
+    // Drop every resident model (before the context goes away)
+    void releaseAll()
+    {
+        for (auto& entry : entries)
+        {
+            entry.model.reset();
+            entry.pendingLoad = std::future<ModelData>(); // Its result is dropped when the worker finishes
+            entry.pendingUpload.reset();
+            entry.pendingDeform = std::future<ModelData>();
+            entry.gpuBytes = 0;
+        }
+    }
+
+private:
+    std::vector<CatalogEntry> entries;
+    uint64_t useCounter = 0;
+
+    static bool isSupportedModel(const std::filesystem::path& path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".fbx" || extension == ".obj";
+    }
+
+    // Model data plus its decoded surface maps, if it has any (thread-pool safe)
+    static ModelData loadModel(const ModelLoadSettings& settings, const std::string& path, const std::string& name)
+    {
+        ModelData data = ModelLoader(settings).load(path, name);
+        if (data.valid && data.hasTexCoords && !loadSurfaceMaps(path, data.maps))
+            std::cerr << "ERROR::MODEL_CATALOG:: Could not read the surface maps of " << name << std::endl;
+        return data;
+    }
+
+    bool streamed(const CatalogEntry& entry) const
+    {
+        return streamAll || entry.fileSize >= STREAM_UPLOAD_MIN_FILE_BYTES;
+    }
+
+    void makeResident(CatalogEntry& entry, ModelData data)
+    {
+        if (!data.valid)
+        {
+            entry.failed = true;
+            return;
+        }
+        entry.model = std::make_unique<Model>(std::move(data), vertexFormat, streamed(entry) ? MeshUpload::Streamed : MeshUpload::Immediate);
+        entry.gpuBytes = entry.model->gpuBytes();
+    }
+
+    // Drop least-recently-used models until the budget fits, never the one just acquired
+    void evictOverBudget(size_t keepIndex)
+    {
+        while (residentBytes() > gpuBudgetBytes)
+        {
+            CatalogEntry* oldest = nullptr;
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                if (i != keepIndex && entries[i].model && (!oldest || entries[i].lastUsed < oldest->lastUsed))
+                    oldest = &entries[i];
+            }
+            if (!oldest)
+                return;
+
+            std::cout << "Evicting model " << oldest->name << " (" << oldest->gpuBytes / 1024 << " KB)\n";
+            oldest->model.reset();
+            oldest->gpuBytes = 0;
+        }
+    }
+};
+
+#endif // MY_MODEL_CATALOG_H
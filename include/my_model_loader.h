@@ -0,0 +1,466 @@
+#ifndef MY_MODEL_LOADER_H
+#define MY_MODEL_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <my_assimp_io.h>
+#include <my_mesh_data.h>
+#include <my_mesh_cache.h>
+#include <my_dn_baker.h>
+#include <my_mesh_optimizer.h>
+#include <my_meshlets.h>
+#include <my_mesh_simplifier.h>
+#include <my_obj_loader.h>
+#include <my_surface_maps.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cctype>
+#include <chrono>
+#include <filesystem> // Requires C++17
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// CPU half of model loading: import, vertex/index building, d_N bake and mesh cache
+// Nothing in here touches OpenGL, so it runs on worker threads and without a context
+
+// Assimp post-processing used for every model (part of the mesh cache key)
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// When to run the native d_N baker during loading
+enum class DNBakeMode
+{
+    Never,      // Only use d_N vertex colours exported from Blender
+    IfMissing,  // Bake meshes that have no d_N vertex colours
+    Always      // Re-bake every mesh
+};
+
+const uint32_t MESH_CACHE_TEXCOORDS_FLAG = 0x800u; // Cache key bit for models whose vertices keep their UVs
+
+// CPU pipeline options, every one that changes the output is part of the mesh cache key
+struct ModelLoadSettings
+{
+    DNBakeMode bakeMode = DNBakeMode::Never;
+    bool optimizeMeshes = true; // Weld + vertex cache/overdraw/fetch ordering
+    unsigned int lodLevels = 4; // Simplified levels generated after LOD 0 (0 disables)
+    bool buildMeshlets = true;  // Culling clusters, rebuilt on every load (not stored in the cache)
+    bool fastObj = true;        // Parse .obj files with the parallel loader in my_obj_loader.h instead of Assimp
+    bool mappedIO = true;       // Let Assimp read through the memory-mapped IOSystem (doesn't change the output)
+    bool directionalDN = true;  // Bake the d_N gradient for meshes that don't store one (vertex colour set 1 beside grey d_N in set 0)
+
+    // Bits for the settings that change the cached arrays
+    uint32_t pipelineFlags() const
+    {
+        return static_cast<uint32_t>(bakeMode) | (optimizeMeshes ? 0x100u : 0u) | (fastObj ? 0x200u : 0u) | (directionalDN ? 0x400u : 0u) | (std::min(lodLevels, 15u) << 12);
+    }
+};
+
+// Everything Model needs to create its GPU buffers
+struct ModelData
+{
+    std::string modelName;
+    std::string path;
+    std::vector<MeshData> meshes;
+    std::shared_ptr<MeshCache> cache; // Keeps mapped MeshData views alive
+    bool valid = false;
+    bool hasTexCoords = false;  // Vertices carry UVs, only read for models with surface maps (UV seams would stop welds otherwise)
+    SurfaceMaps maps;           // Decoded by ModelCatalog, empty if the model has none
+
+    // Stats
+    bool loadedFromCache = false;
+    double loadMilliseconds = 0.0;
+    unsigned int bakedMeshes = 0;
+    double bakeMilliseconds = 0.0;
+    unsigned int optimizedMeshes = 0;
+    double optimizeMilliseconds = 0.0;
+    MeshOptimizationStats optimization; // Whole model, only filled when imported
+    double lodMilliseconds = 0.0;
+    glm::vec3 boundsMin = glm::vec3(0.0f); // All meshes, model space
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+class ModelLoader
+{
+public:
+    explicit ModelLoader(const ModelLoadSettings& settings = ModelLoadSettings())
+        : settings(settings)
+    {
+    }
+
+    // Run the CPU pipeline for one model file (safe to call from any thread)
+    ModelData load(std::string const& path, const std::string& modelName) const
+    {
+        ModelData data;
+        data.modelName = modelName;
+        data.path = path;
+        auto start = std::chrono::high_resolution_clock::now();
+
+        // Warm start: point straight into the mesh cache if it matches the source file
+        bool texCoords = hasSurfaceMaps(path);
+        MeshCacheKey cacheKey;
+        bool cacheable = makeMeshCacheKey(path, MODEL_IMPORT_FLAGS, settings.pipelineFlags() | (texCoords ? MESH_CACHE_TEXCOORDS_FLAG : 0u), cacheKey);
+        if (cacheable && loadFromCache(cacheKey, data))
+        {
+            data.loadedFromCache = true;
+            data.hasTexCoords = texCoords;
+        }
+        else
+        {
+            if (!importModel(path, data))
+                return data;
+
+            // Reorder for the post-transform cache and overdraw before the arrays are frozen in the cache
+            if (settings.optimizeMeshes)
+                optimizeMeshes(data);
+
+            // Simplified levels go after LOD 0 in the same index buffer
+            buildLods(data);
+
+            // Save the final arrays for the next launch
+            if (cacheable)
+                saveToCache(cacheKey, data);
+        }
+
+        if (settings.buildMeshlets)
+            buildModelMeshlets(data);
+        computeBounds(data);
+
+        data.valid = true;
+        auto end = std::chrono::high_resolution_clock::now();
+        data.loadMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        return data;
+    }
+
+    // Read the source file into data.meshes (d_N bake included, no optimization, LODs or cache)
+    bool importModel(const std::string& path, ModelData& data) const
+    {
+        data.hasTexCoords = hasSurfaceMaps(path);
+        if (settings.fastObj && isObjFile(path))
+        {
+            ObjFile obj;
+            if (loadObj(path, obj, data.hasTexCoords))
+            {
+                for (MeshData& meshData : obj.meshes)
+                {
+                    bool bakeDN = shouldBake(obj.hasDN);
+                    if (bakeDN || settings.directionalDN)
+                        bakeMeshThickness(meshData.vertices, meshData.indices, data, bakeDN, settings.directionalDN);
+                    data.meshes.push_back(std::move(meshData));
+                }
+                return true;
+            }
+            std::cout << "WARNING::OBJ_LOADER:: Could not parse " << path << ", falling back to Assimp" << std::endl;
+        }
+
+        // Read file
+        Assimp::Importer importer;
+        if (settings.mappedIO)
+            importer.SetIOHandler(new MappedIOSystem()); // Owned by the importer
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+
+        // Check for errors
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        // Process ASSIMP's root node recursively (nodes usually reference each mesh once)
+        data.meshes.reserve(scene->mNumMeshes);
+        processNode(scene->mRootNode, scene, data);
+        return true;
+    }
+
+private:
+    ModelLoadSettings settings;
+
+    static bool isObjFile(const std::string& path)
+    {
+        std::string extension = std::filesystem::path(path).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".obj";
+    }
+
+    bool shouldBake(bool hasDN) const
+    {
+        return settings.bakeMode == DNBakeMode::Always || (settings.bakeMode == DNBakeMode::IfMissing && !hasDN);
+    }
+
+    // Colour set 1 is read as the d_N gradient only next to grey d_N colours in set 0, the pair bake_dN writes
+    // A second colour set in any other file is someone else's colours, and the gradient is baked instead
+    static bool hasDNGradientColours(const aiMesh* mesh)
+    {
+        if (!mesh->HasVertexColors(0) || !mesh->HasVertexColors(1))
+            return false;
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            const aiColor4D& colour = mesh->mColors[0][i];
+            if (colour.r != colour.g || colour.r != colour.b)
+                return false;
+        }
+        return true;
+    }
+
+    // Point mesh data at a mapped cache file
+    bool loadFromCache(const MeshCacheKey& cacheKey, ModelData& data) const
+    {
+        auto cache = std::make_shared<MeshCache>();
+        if (!cache->open(cacheKey))
+            return false;
+
+        data.meshes.resize(cache->meshCount());
+        for (size_t i = 0; i < cache->meshCount(); i++)
+        {
+            const MeshCacheEntry& entry = cache->entry(i);
+            MeshData& meshData = data.meshes[i];
+            meshData.name = entry.name;
+            meshData.mappedVertices = cache->vertices(i);
+            meshData.mappedVertexCount = static_cast<size_t>(entry.vertexCount);
+            meshData.mappedIndices = cache->indices(i);
+            meshData.mappedIndexCount = static_cast<size_t>(entry.indexCount);
+            for (uint32_t l = 0; l < entry.lodCount; l++)
+                meshData.lods.push_back(MeshLod{ entry.lods[l].indexOffset, entry.lods[l].indexCount, entry.lods[l].error });
+            if (meshData.lods.empty())
+                meshData.lods.push_back(MeshLod{ 0, static_cast<uint32_t>(entry.indexCount), 0.0f });
+        }
+        data.cache = cache;
+        return true;
+    }
+
+    void saveToCache(const MeshCacheKey& cacheKey, const ModelData& data) const
+    {
+        std::vector<MeshCacheSource> sources;
+        for (const auto& meshData : data.meshes)
+            sources.push_back(MeshCacheSource{ meshData.vertexData(), meshData.vertexCount(), meshData.indexData(), meshData.indexCount(), meshData.name, meshData.lods });
+
+        if (!writeMeshCache(cacheKey, sources))
+            std::cout << "WARNING::MESH_CACHE:: Could not write cache for " << cacheKey.sourcePath << std::endl;
+    }
+
+    // Processes a node recursively
+    void processNode(aiNode* node, const aiScene* scene, ModelData& data) const
+    {
+        // Process each mesh located at current node
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            data.meshes.push_back(processMesh(mesh, data));
+        }
+        // Recursively process children nodes
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            processNode(node->mChildren[i], scene, data);
+    }
+
+    MeshData processMesh(aiMesh* mesh, ModelData& data) const
+    {
+        // Data to fill
+        MeshData meshData;
+        std::vector<Vertex>& vertices = meshData.vertices;
+        std::vector<unsigned int>& indices = meshData.indices;
+
+        // Size the arrays up front, growing them would briefly hold two copies
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
+
+        // Loop through mesh's vertices
+        bool storedGradient = hasDNGradientColours(mesh);
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex vertex;
+            glm::vec3 vector;
+
+            // Positions
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+
+            // Normals (if it has)
+            if (mesh->HasNormals())
+            {
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            }
+
+            // Precomputed d_N vertex color attribute from Blender
+            if (mesh->HasVertexColors(0))
+                vertex.d_N = mesh->mColors[0][i].r; // Assuming r = g = b = d_N
+            else
+                vertex.d_N = 0.0f; // Fallback value
+
+            // Directional d_N gradient written by tools/bake_dN.cpp
+            if (storedGradient)
+                vertex.d_NGradient = glm::vec3(mesh->mColors[1][i].r, mesh->mColors[1][i].g, mesh->mColors[1][i].b);
+
+            // Surface map coordinates (tools/bake_maps.cpp)
+            if (data.hasTexCoords && mesh->HasTextureCoords(0))
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+
+            vertices.push_back(vertex);
+        }
+
+        // Loop through mesh's faces and retrieve the corresponding vertex indices
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i]; // A copy would allocate its own index array
+
+            // Points and lines survive triangulation, they would shift every later triangle's indices
+            if (face.mNumIndices != 3)
+                continue;
+
+            // Retrieve the face's indices and store them in the indices vector
+            for (unsigned int j = 0; j < 3; j++)
+                indices.push_back(face.mIndices[j]);
+        }
+
+        // Bake d_N natively if requested, and its gradient if the file has none (or d_N itself changed)
+        bool bakeDN = shouldBake(mesh->HasVertexColors(0));
+        bool bakeGradient = settings.directionalDN && (bakeDN || !storedGradient);
+        if (bakeDN || bakeGradient)
+            bakeMeshThickness(vertices, indices, data, bakeDN, bakeGradient);
+
+        // Set name if present
+        std::string meshName = std::string(mesh->mName.C_Str());
+        if (!meshName.empty())
+            meshData.name = meshName;
+
+        return meshData;
+    }
+
+    // Run the BVH ray caster over one mesh and store the result in d_N and/or its gradient
+    void bakeMeshThickness(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, ModelData& data, bool bakeDN, bool bakeGradient) const
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<glm::vec3> positions(vertices.size()), normals(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            positions[i] = vertices[i].Position;
+            normals[i] = vertices[i].Normal;
+        }
+
+        DNBakeSettings bakeSettings;
+        TriangleBvh bvh;
+        bvh.build(positions, indices, bakeSettings.leafSize);
+
+        std::vector<float> d_N(vertices.size());
+        if (bakeDN)
+            d_N = bakeThickness(bvh, positions, normals, bakeSettings);
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            if (bakeDN)
+                vertices[i].d_N = d_N[i];
+            else
+                d_N[i] = vertices[i].d_N;
+        }
+
+        if (bakeGradient)
+        {
+            std::vector<glm::vec3> gradients = bakeThicknessGradient(bvh, positions, normals, d_N, bakeSettings);
+            for (size_t i = 0; i < vertices.size(); i++)
+                vertices[i].d_NGradient = gradients[i];
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        data.bakeMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+        data.bakedMeshes++;
+    }
+
+    void computeBounds(ModelData& data) const
+    {
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (const MeshData& meshData : data.meshes)
+        {
+            for (size_t i = 0; i < meshData.vertexCount(); i++)
+            {
+                boundsMin = glm::min(boundsMin, meshData.vertexData()[i].Position);
+                boundsMax = glm::max(boundsMax, meshData.vertexData()[i].Position);
+            }
+        }
+        if (boundsMin.x <= boundsMax.x)
+        {
+            data.boundsMin = boundsMin;
+            data.boundsMax = boundsMax;
+        }
+    }
+
+    // Split every mesh into meshlets (works on cached and freshly imported arrays alike)
+    void buildModelMeshlets(ModelData& data) const
+    {
+        globalThreadPool().parallelFor(data.meshes.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                // Each LOD gets its own meshlets, offset back into the shared index buffer
+                MeshData& meshData = data.meshes[i];
+                meshData.meshlets.clear();
+                for (MeshLod& lod : meshData.lods)
+                {
+                    std::vector<Meshlet> lodMeshlets = buildMeshlets(meshData.vertexData(), meshData.indexData() + lod.indexOffset, lod.indexCount);
+                    for (Meshlet& meshlet : lodMeshlets)
+                        meshlet.indexOffset += lod.indexOffset;
+                    lod.meshletOffset = static_cast<uint32_t>(meshData.meshlets.size());
+                    lod.meshletCount = static_cast<uint32_t>(lodMeshlets.size());
+                    meshData.meshlets.insert(meshData.meshlets.end(), lodMeshlets.begin(), lodMeshlets.end());
+                }
+            }
+        });
+    }
+
+    void buildLods(ModelData& data) const
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        globalThreadPool().parallelFor(data.meshes.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                buildMeshLods(data.meshes[i], std::min(settings.lodLevels, MESH_CACHE_MAX_LODS - 1));
+        });
+
+        auto end = std::chrono::high_resolution_clock::now();
+        data.lodMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void optimizeMeshes(ModelData& data) const
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        // Meshes are independent, so optimize them side by side
+        std::vector<MeshOptimizationStats> meshStats(data.meshes.size());
+        std::vector<char> optimized(data.meshes.size(), 0);
+        globalThreadPool().parallelFor(data.meshes.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                // Points and lines left over from triangulation would break the triangle ordering
+                MeshData& meshData = data.meshes[i];
+                if (meshData.indices.empty() || meshData.indices.size() % 3 != 0)
+                    continue;
+                meshStats[i] = optimizeMesh(meshData);
+                optimized[i] = 1;
+            }
+        });
+
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            if (!optimized[i])
+                continue;
+            accumulateOptimizationStats(data.optimization, meshStats[i]);
+            data.optimizedMeshes++;
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        data.optimizeMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+};
+
+#endif // MY_MODEL_LOADER_H
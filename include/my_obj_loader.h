@@ -0,0 +1,458 @@
+#ifndef MY_OBJ_LOADER_H
+#define MY_OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <my_mapped_file.h>
+#include <my_mesh_data.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ fast path: the file is mapped, cut into line-aligned chunks that are parsed side by side,
+// and the chunks are merged into one MeshData per object
+// Reads v (including the "v x y z r g b" vertex colour extension, whose red channel is d_N, like the
+// Blender vertex colours Assimp reads), vn, f (polygons are fanned), o and g (each starts a mesh)
+// vt is only read when asked for (models with surface maps), with V flipped like aiProcess_FlipUVs
+// Materials, smoothing groups, lines and points are skipped
+
+const size_t OBJ_CHUNK_BYTES = 256 * 1024;
+const int32_t OBJ_NO_INDEX = INT32_MIN;
+
+struct ObjFile
+{
+    std::vector<MeshData> meshes;
+    bool hasDN = false; // Vertex colours were present (the same for every mesh, like Assimp's OBJ importer)
+};
+
+// Chunk-level parse results, indices not yet resolved against the other chunks
+struct ObjCorner
+{
+    int32_t position;
+    int32_t normal;
+    int32_t texCoord;
+    uint8_t relative;   // Bit 0: position is chunk-relative, bit 1: normal is, bit 2: texCoord is
+};
+
+struct ObjObject
+{
+    std::string name;
+    size_t firstCorner;
+};
+
+struct ObjChunk
+{
+    std::vector<glm::vec3> positions;
+    std::vector<float> dN;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<ObjCorner> corners; // Three per triangle
+    std::vector<ObjObject> objects;
+    bool hasDN = false;
+    bool failed = false;
+};
+
+// Powers of ten exactly representable as doubles
+const double OBJ_POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const char* skipObjSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// Decimal float without locale or strtod, exact for the 6-decimal values exporters write
+// Returns nullptr if there is no number at p
+const char* parseObjFloat(const char* p, const char* end, float& value)
+{
+    p = skipObjSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        mantissa = mantissa * 10.0 + (*p++ - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            mantissa = mantissa * 10.0 + (*p++ - '0');
+            exponent--;
+            digits = true;
+        }
+    }
+    if (!digits)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = (*q++ == '-');
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            int e = 0;
+            while (q < end && *q >= '0' && *q <= '9')
+                e = std::min(e * 10 + (*q++ - '0'), 1000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = mantissa;
+    if (exponent < 0)
+        result = (-exponent <= 22) ? result / OBJ_POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        result = (exponent <= 22) ? result * OBJ_POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+const char* parseObjInt(const char* p, const char* end, int32_t& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    if (p >= end || *p < '0' || *p > '9')
+        return nullptr;
+    int64_t result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        result = std::min<int64_t>(result * 10 + (*p++ - '0'), INT32_MAX);
+    value = static_cast<int32_t>(negative ? -result : result);
+    return p;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element read so far
+// Negative ones are kept relative to the chunk and fixed up once the chunks before it are counted
+bool resolveObjIndex(int32_t raw, size_t countSoFar, int32_t& index, bool& relative)
+{
+    if (raw > 0)
+    {
+        index = raw - 1;
+        relative = false;
+        return true;
+    }
+    if (raw < 0)
+    {
+        index = static_cast<int32_t>(static_cast<int64_t>(countSoFar) + raw);
+        relative = true;
+        return true;
+    }
+    return false;
+}
+
+void parseObjChunk(const char* p, const char* end, ObjChunk& chunk, bool readTexCoords)
+{
+    std::vector<ObjCorner> polygon;
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!lineEnd)
+            lineEnd = end;
+        const char* q = skipObjSpaces(p, lineEnd);
+
+        if (lineEnd - q >= 2 && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t'))
+        {
+            glm::vec3 position(0.0f);
+            const char* r = q + 1;
+            for (int k = 0; k < 3 && r; k++)
+                r = parseObjFloat(r, lineEnd, position[k]);
+            if (!r)
+            {
+                chunk.failed = true;
+                return;
+            }
+            // A colour only when all of r, g and b follow; a lone fourth value is the w coordinate and is ignored
+            float rgb[3] = { 0.0f, 0.0f, 0.0f };
+            const char* colour = r;
+            for (int k = 0; k < 3 && colour; k++)
+                colour = parseObjFloat(colour, lineEnd, rgb[k]);
+            chunk.positions.push_back(position);
+            chunk.dN.push_back(colour ? rgb[0] : 0.0f);
+            chunk.hasDN = chunk.hasDN || colour != nullptr;
+        }
+        else if (lineEnd - q >= 3 && q[0] == 'v' && q[1] == 'n' && (q[2] == ' ' || q[2] == '\t'))
+        {
+            glm::vec3 normal(0.0f);
+            const char* r = q + 2;
+            for (int k = 0; k < 3 && r; k++)
+                r = parseObjFloat(r, lineEnd, normal[k]);
+            if (!r)
+            {
+                chunk.failed = true;
+                return;
+            }
+            chunk.normals.push_back(normal);
+        }
+        else if (readTexCoords && lineEnd - q >= 3 && q[0] == 'v' && q[1] == 't' && (q[2] == ' ' || q[2] == '\t'))
+        {
+            glm::vec2 texCoord(0.0f);
+            const char* r = q + 2;
+            for (int k = 0; k < 2 && r; k++)
+                r = parseObjFloat(r, lineEnd, texCoord[k]);
+            if (!r)
+            {
+                chunk.failed = true;
+                return;
+            }
+            chunk.texCoords.push_back(glm::vec2(texCoord.x, 1.0f - texCoord.y));
+        }
+        else if (lineEnd - q >= 2 && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t'))
+        {
+            // v, v/vt, v//vn or v/vt/vn per corner
+            polygon.clear();
+            const char* r = skipObjSpaces(q + 1, lineEnd);
+            while (r < lineEnd && *r != '\r' && *r != '#')
+            {
+                int32_t raw = 0;
+                r = parseObjInt(r, lineEnd, raw);
+                ObjCorner corner = { 0, OBJ_NO_INDEX, OBJ_NO_INDEX, 0 };
+                bool relative = false;
+                if (!r || !resolveObjIndex(raw, chunk.positions.size(), corner.position, relative))
+                {
+                    chunk.failed = true;
+                    return;
+                }
+                corner.relative |= relative ? 1 : 0;
+                if (r < lineEnd && *r == '/')
+                {
+                    r++;
+                    if (readTexCoords && r < lineEnd && *r != '/')
+                    {
+                        r = parseObjInt(r, lineEnd, raw);
+                        if (!r || !resolveObjIndex(raw, chunk.texCoords.size(), corner.texCoord, relative))
+                        {
+                            chunk.failed = true;
+                            return;
+                        }
+                        corner.relative |= relative ? 4 : 0;
+                    }
+                    while (r < lineEnd && *r != '/' && *r != ' ' && *r != '\t' && *r != '\r')
+                        r++; // Texture coordinate (skipped)
+                    if (r < lineEnd && *r == '/')
+                    {
+                        r = parseObjInt(r + 1, lineEnd, raw);
+                        if (!r || !resolveObjIndex(raw, chunk.normals.size(), corner.normal, relative))
+                        {
+                            chunk.failed = true;
+                            return;
+                        }
+                        corner.relative |= relative ? 2 : 0;
+                    }
+                }
+                polygon.push_back(corner);
+                r = skipObjSpaces(r, lineEnd);
+            }
+            for (size_t k = 2; k < polygon.size(); k++)
+            {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[k - 1]);
+                chunk.corners.push_back(polygon[k]);
+            }
+        }
+        else if (lineEnd - q >= 1 && (q[0] == 'o' || q[0] == 'g') && (lineEnd - q == 1 || q[1] == ' ' || q[1] == '\t' || q[1] == '\r'))
+        {
+            const char* nameBegin = skipObjSpaces(q + 1, lineEnd);
+            const char* nameEnd = lineEnd;
+            while (nameEnd > nameBegin && (nameEnd[-1] == '\r' || nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+                nameEnd--;
+            chunk.objects.push_back(ObjObject{ std::string(nameBegin, nameEnd), chunk.corners.size() });
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Triangles [firstCorner, endCorner) of the merged corner list as one mesh, sharing identical corners
+void buildObjMesh(const std::vector<glm::vec3>& positions, const std::vector<float>& dN, const std::vector<glm::vec3>& normals,
+    const std::vector<glm::vec2>& texCoords, const std::vector<ObjCorner>& corners, size_t firstCorner, size_t endCorner, MeshData& meshData)
+{
+    // Vertices of each position chained through nextVertex, so a corner only compares against the few
+    // vertices that share its position (positions of one object are nearly always a contiguous run)
+    int32_t minPosition = INT32_MAX, maxPosition = -1;
+    for (size_t c = firstCorner; c < endCorner; c++)
+    {
+        minPosition = std::min(minPosition, corners[c].position);
+        maxPosition = std::max(maxPosition, corners[c].position);
+    }
+    const unsigned int noVertex = UINT_MAX;
+    std::vector<unsigned int> firstVertex(static_cast<size_t>(maxPosition - minPosition) + 1, noVertex);
+    std::vector<unsigned int> nextVertex;
+    std::vector<int32_t> vertexNormal, vertexTexCoord;
+    meshData.indices.reserve(endCorner - firstCorner);
+    bool missingNormals = false;
+
+    for (size_t c = firstCorner; c < endCorner; c++)
+    {
+        const ObjCorner& corner = corners[c];
+        unsigned int& head = firstVertex[corner.position - minPosition];
+        unsigned int vertexIndex = head;
+        while (vertexIndex != noVertex && (vertexNormal[vertexIndex] != corner.normal || vertexTexCoord[vertexIndex] != corner.texCoord))
+            vertexIndex = nextVertex[vertexIndex];
+        if (vertexIndex == noVertex)
+        {
+            vertexIndex = static_cast<unsigned int>(meshData.vertices.size());
+            Vertex vertex;
+            vertex.Position = positions[corner.position];
+            vertex.Normal = (corner.normal != OBJ_NO_INDEX) ? normals[corner.normal] : glm::vec3(0.0f);
+            vertex.d_N = dN[corner.position];
+            if (corner.texCoord != OBJ_NO_INDEX)
+                vertex.TexCoords = texCoords[corner.texCoord];
+            missingNormals = missingNormals || corner.normal == OBJ_NO_INDEX;
+            meshData.vertices.push_back(vertex);
+            vertexNormal.push_back(corner.normal);
+            vertexTexCoord.push_back(corner.texCoord);
+            nextVertex.push_back(head);
+            head = vertexIndex;
+        }
+        meshData.indices.push_back(vertexIndex);
+    }
+
+    // Smooth area-weighted normals where the file had none (what aiProcess_GenSmoothNormals adds)
+    if (missingNormals)
+    {
+        std::vector<glm::vec3> generated(meshData.vertices.size(), glm::vec3(0.0f));
+        for (size_t t = firstCorner; t + 2 < endCorner; t += 3)
+        {
+            const ObjCorner* tri = &corners[t];
+            glm::vec3 faceNormal = glm::cross(positions[tri[1].position] - positions[tri[0].position], positions[tri[2].position] - positions[tri[0].position]);
+            for (int k = 0; k < 3; k++)
+                generated[meshData.indices[t - firstCorner + k]] += faceNormal;
+        }
+        for (size_t v = 0; v < meshData.vertices.size(); v++)
+        {
+            float length = glm::length(generated[v]);
+            if (meshData.vertices[v].Normal == glm::vec3(0.0f) && length > 0.0f)
+                meshData.vertices[v].Normal = generated[v] / length;
+        }
+    }
+}
+
+// Parse an OBJ file on the thread pool, returns false if it can't be read or uses something unsupported
+// Corners that differ only in texture coordinates share a vertex unless readTexCoords is set
+bool loadObj(const std::string& path, ObjFile& obj, bool readTexCoords = false)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    const char* text = reinterpret_cast<const char*>(file.data());
+    const size_t size = file.size();
+
+    // Chunk boundaries just past a newline, so no line is split
+    std::vector<size_t> boundaries(1, 0);
+    while (boundaries.back() < size)
+    {
+        size_t next = std::min(boundaries.back() + OBJ_CHUNK_BYTES, size);
+        const void* newline = (next < size) ? std::memchr(text + next, '\n', size - next) : nullptr;
+        next = newline ? static_cast<size_t>(static_cast<const char*>(newline) - text) + 1 : size;
+        boundaries.push_back(next);
+    }
+    const size_t chunkCount = boundaries.size() - 1;
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    globalThreadPool().parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            parseObjChunk(text + boundaries[i], text + boundaries[i + 1], chunks[i], readTexCoords);
+    });
+
+    // Offsets of each chunk's elements in the merged arrays
+    std::vector<size_t> positionBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0), texCoordBase(chunkCount + 1, 0), cornerBase(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        if (chunks[i].failed)
+            return false;
+        positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+        normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+        texCoordBase[i + 1] = texCoordBase[i] + chunks[i].texCoords.size();
+        cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size();
+        obj.hasDN = obj.hasDN || chunks[i].hasDN;
+    }
+
+    // Objects in file order (empty ones are dropped below)
+    std::vector<ObjObject> objects(1, ObjObject{ std::string(), 0 });
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        for (const ObjObject& object : chunks[i].objects)
+            objects.push_back(ObjObject{ object.name, cornerBase[i] + object.firstCorner });
+    }
+
+    std::vector<glm::vec3> positions(positionBase[chunkCount]), normals(normalBase[chunkCount]);
+    std::vector<glm::vec2> texCoords(texCoordBase[chunkCount]);
+    std::vector<float> dN(positionBase[chunkCount]);
+    std::vector<ObjCorner> corners(cornerBase[chunkCount]);
+    std::vector<char> chunkValid(chunkCount, 1);
+    globalThreadPool().parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            ObjChunk& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i]);
+            std::copy(chunk.dN.begin(), chunk.dN.end(), dN.begin() + positionBase[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i]);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordBase[i]);
+            for (size_t c = 0; c < chunk.corners.size(); c++)
+            {
+                ObjCorner corner = chunk.corners[c];
+                if (corner.relative & 1)
+                    corner.position += static_cast<int32_t>(positionBase[i]);
+                if (corner.relative & 2)
+                    corner.normal += static_cast<int32_t>(normalBase[i]);
+                if (corner.relative & 4)
+                    corner.texCoord += static_cast<int32_t>(texCoordBase[i]);
+                corner.relative = 0;
+
+                // Every reference must land inside the file's arrays
+                if (corner.position < 0 || static_cast<size_t>(corner.position) >= positions.size() ||
+                    (corner.normal != OBJ_NO_INDEX && (corner.normal < 0 || static_cast<size_t>(corner.normal) >= normals.size())) ||
+                    (corner.texCoord != OBJ_NO_INDEX && (corner.texCoord < 0 || static_cast<size_t>(corner.texCoord) >= texCoords.size())))
+                    chunkValid[i] = 0;
+                corners[cornerBase[i] + c] = corner;
+            }
+            chunk = ObjChunk(); // Merged, free it
+        }
+    });
+    if (std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end())
+        return false;
+
+    // One mesh per object with faces
+    std::vector<std::pair<size_t, size_t>> ranges;
+    std::vector<std::string> names;
+    for (size_t o = 0; o < objects.size(); o++)
+    {
+        size_t endCorner = (o + 1 < objects.size()) ? objects[o + 1].firstCorner : corners.size();
+        if (endCorner > objects[o].firstCorner)
+        {
+            ranges.push_back(std::make_pair(objects[o].firstCorner, endCorner));
+            names.push_back(objects[o].name);
+        }
+    }
+
+    obj.meshes.resize(ranges.size());
+    globalThreadPool().parallelFor(ranges.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t m = begin; m < end; m++)
+        {
+            obj.meshes[m].name = names[m];
+            buildObjMesh(positions, dN, normals, texCoords, corners, ranges[m].first, ranges[m].second, obj.meshes[m]);
+        }
+    });
+    return !obj.meshes.empty();
+}
+
+#endif // MY_OBJ_LOADER_H
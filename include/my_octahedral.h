@@ -0,0 +1,118 @@
+#ifndef MY_OCTAHEDRAL_H
+#define MY_OCTAHEDRAL_H
+
+#include <glm/glm.hpp>
+
+#include <my_thread_pool.h>
+#include <my_vertex_packing.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Octahedral environment maps: the sphere of directions projected onto an octahedron and unfolded into a square,
+// so an environment is one 2D texture with an ordinary mip chain instead of six cube faces
+// The mapping is the one packed normals use (octEncode/octDecode in my_vertex_packing.h) moved from [-1, 1]^2 to
+// [0, 1]^2: the upper hemisphere (+Z) fills the inner diamond, the lower one is folded over the four corners
+// The shaders look it up with the same octEncode (skyboxShader.fs, refractionShader.fs, frontfaceShader.fs)
+
+// Bilinear lookup of six float RGB faces (GL order and orientation), clamped at each face's edges like a
+// cubemap without seamless filtering
+void sampleCubeFaces(const std::vector<std::vector<float>>& faces, int faceSize, const glm::vec3& direction, float rgb[3])
+{
+    glm::vec3 a(std::fabs(direction.x), std::fabs(direction.y), std::fabs(direction.z));
+    int face;
+    float sc, tc, major;
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        face = direction.x > 0.0f ? 0 : 1;
+        sc = direction.x > 0.0f ? -direction.z : direction.z;
+        tc = -direction.y;
+        major = a.x;
+    }
+    else if (a.y >= a.z)
+    {
+        face = direction.y > 0.0f ? 2 : 3;
+        sc = direction.x;
+        tc = direction.y > 0.0f ? direction.z : -direction.z;
+        major = a.y;
+    }
+    else
+    {
+        face = direction.z > 0.0f ? 4 : 5;
+        sc = direction.z > 0.0f ? direction.x : -direction.x;
+        tc = -direction.y;
+        major = a.z;
+    }
+
+    float x = (sc / major * 0.5f + 0.5f) * faceSize - 0.5f;
+    float y = (tc / major * 0.5f + 0.5f) * faceSize - 0.5f;
+    float floorX = std::floor(x), floorY = std::floor(y);
+    float fx = x - floorX, fy = y - floorY;
+    int x0 = std::min(std::max(static_cast<int>(floorX), 0), faceSize - 1), x1 = std::min(std::max(static_cast<int>(floorX) + 1, 0), faceSize - 1);
+    int y0 = std::min(std::max(static_cast<int>(floorY), 0), faceSize - 1), y1 = std::min(std::max(static_cast<int>(floorY) + 1, 0), faceSize - 1);
+    const float* texels = faces[face].data();
+    for (int c = 0; c < 3; c++)
+    {
+        float top = texels[(static_cast<size_t>(y0) * faceSize + x0) * 3 + c] * (1.0f - fx) + texels[(static_cast<size_t>(y0) * faceSize + x1) * 3 + c] * fx;
+        float bottom = texels[(static_cast<size_t>(y1) * faceSize + x0) * 3 + c] * (1.0f - fx) + texels[(static_cast<size_t>(y1) * faceSize + x1) * 3 + c] * fx;
+        rgb[c] = top * (1.0f - fy) + bottom * fy;
+    }
+}
+
+// Resample six faceSize float RGB faces into a size x size octahedral map and its mips (float RGB, level 0 first)
+// Each octahedral texel averages 2x2 cube lookups, the mips are 2x2 box filtered
+std::vector<std::vector<float>> cubeToOctahedral(const std::vector<std::vector<float>>& faces, int faceSize, int size)
+{
+    std::vector<std::vector<float>> levels;
+    levels.emplace_back(static_cast<size_t>(size) * size * 3);
+    std::vector<float>& base = levels[0];
+    globalThreadPool().parallelFor(static_cast<size_t>(size), 16, [&](size_t begin, size_t end)
+    {
+        static const float offsets[2] = { 0.25f, 0.75f };
+        for (size_t y = begin; y < end; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                float sum[3] = { 0.0f, 0.0f, 0.0f };
+                for (float offsetY : offsets)
+                {
+                    for (float offsetX : offsets)
+                    {
+                        float rgb[3];
+                        glm::vec2 uv((x + offsetX) / size, (static_cast<float>(y) + offsetY) / size);
+                        sampleCubeFaces(faces, faceSize, octDecode(uv * 2.0f - glm::vec2(1.0f)), rgb);
+                        for (int c = 0; c < 3; c++)
+                            sum[c] += rgb[c] * 0.25f;
+                    }
+                }
+                std::copy(sum, sum + 3, &base[(y * size + x) * 3]);
+            }
+        }
+    });
+
+    for (int levelSize = size; levelSize > 1; levelSize /= 2)
+    {
+        const std::vector<float>& previous = levels.back();
+        int nextSize = levelSize / 2;
+        std::vector<float> next(static_cast<size_t>(nextSize) * nextSize * 3);
+        for (int y = 0; y < nextSize; y++)
+        {
+            for (int x = 0; x < nextSize; x++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    float sum = previous[((2 * y) * static_cast<size_t>(levelSize) + 2 * x) * 3 + c]
+                        + previous[((2 * y) * static_cast<size_t>(levelSize) + 2 * x + 1) * 3 + c]
+                        + previous[((2 * y + 1) * static_cast<size_t>(levelSize) + 2 * x) * 3 + c]
+                        + previous[((2 * y + 1) * static_cast<size_t>(levelSize) + 2 * x + 1) * 3 + c];
+                    next[(static_cast<size_t>(y) * nextSize + x) * 3 + c] = sum * 0.25f;
+                }
+            }
+        }
+        levels.push_back(std::move(next));
+    }
+    return levels;
+}
+
+#endif // MY_OCTAHEDRAL_H
@@ -4,17 +4,21 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <my_gl_resource.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
-    unsigned int ID;
+    GLProgram program;
 
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // fragmentIncludePaths are spliced into the fragment shader after its #version line, in order
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& fragmentIncludePaths = {})
     {
         std::string vertexCode;
         std::string fragmentCode;
@@ -42,6 +46,24 @@ public:
             // Convert stream to string
             vertexCode = vShaderStream.str();
             fragmentCode = fShaderStream.str();
+
+            // Shared code goes after the #version line, then #line puts the fragment shader's own line numbers back
+            if (!fragmentIncludePaths.empty())
+            {
+                std::stringstream includeStream;
+                for (const auto& includePath : fragmentIncludePaths)
+                {
+                    std::ifstream includeFile;
+                    includeFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+                    includeFile.open(includePath);
+                    includeStream << includeFile.rdbuf() << "\n";
+                    includeFile.close();
+                }
+
+                size_t versionEnd = fragmentCode.find('\n');
+                versionEnd = versionEnd == std::string::npos ? fragmentCode.size() : versionEnd + 1;
+                fragmentCode = fragmentCode.substr(0, versionEnd) + includeStream.str() + "#line 2\n" + fragmentCode.substr(versionEnd);
+            }
         }
         catch (std::ifstream::failure& e)
         {
@@ -52,97 +74,96 @@ public:
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
 
-        // Compile shaders
-        unsigned int vertex, fragment;
-
-        // Vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "Vertex");
+        // Compile shaders (deleted at the end of the constructor, they're linked into the program by then)
+        GLShaderObject vertex = GLShaderObject::create(GL_VERTEX_SHADER);
+        glShaderSource(vertex.id(), 1, &vShaderCode, NULL);
+        glCompileShader(vertex.id());
+        checkCompileErrors(vertex.id(), "Vertex");
 
         // Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "Fragment");
+        GLShaderObject fragment = GLShaderObject::create(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment.id(), 1, &fShaderCode, NULL);
+        glCompileShader(fragment.id());
+        checkCompileErrors(fragment.id(), "Fragment");
 
         // Shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "Program");
+        program = GLProgram::create();
+        glAttachShader(program.id(), vertex.id());
+        glAttachShader(program.id(), fragment.id());
+        glLinkProgram(program.id());
+        checkCompileErrors(program.id(), "Program");
+    }
 
-        // Delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    // Delete the program (before the context goes away)
+    void release()
+    {
+        program.reset();
     }
 
     // Activates the shader
     void use()
     {
-        glUseProgram(ID);
+        glUseProgram(program.id());
     }
 
     // Uniform functions
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(glGetUniformLocation(program.id(), name.c_str()), (int)value);
     }
 
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(glGetUniformLocation(program.id(), name.c_str()), value);
     }
 
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(glGetUniformLocation(program.id(), name.c_str()), value);
     }
 
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(glGetUniformLocation(program.id(), name.c_str()), 1, &value[0]);
     }
 
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(glGetUniformLocation(program.id(), name.c_str()), x, y);
     }
 
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(glGetUniformLocation(program.id(), name.c_str()), 1, &value[0]);
     }
 
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(glGetUniformLocation(program.id(), name.c_str()), x, y, z);
     }
 
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(glGetUniformLocation(program.id(), name.c_str()), 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(glGetUniformLocation(program.id(), name.c_str()), x, y, z, w);
     }
 
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(glGetUniformLocation(program.id(), name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(glGetUniformLocation(program.id(), name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(program.id(), name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
@@ -6,37 +6,756 @@
 
 #include <stb_image.h>
 
+#include <my_equirect.h>
+#include <my_gl_resource.h>
+#include <my_hdr_formats.h>
+#include <my_mapped_file.h>
+#include <my_mip_chain.h>
+#include <my_octahedral.h>
+#include <my_texture_compression.h>
+#include <my_thread_pool.h>
+#include <my_upload_thread.h>
+#include <my_virtual_texture.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem> // Requires C++17
+#include <future>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
-// Function to load cubemap textures
-GLuint loadCubemap(std::vector<std::string> faces)
+// Use skybox/<name>/cubemap_bc1.ktx (written by tools/compress_skybox.cpp) when it exists, else the PNG faces
+// The KTX stores the PNGs' sizes and modification times, and is passed over for the PNGs when they've changed since
+// Radiance .hdr faces (px.hdr ... nz.hdr) take precedence over both, packed into hdrSkyboxPacking
+// A directory with a single equirectangular panorama.hdr (before the KTX) or panorama.png/.jpg (last) is resampled
+// into faces of panoramaFaceSize texels, 0 for a quarter of the panorama's width
+bool useCompressedSkyboxes = true;
+HdrPacking hdrSkyboxPacking = HdrPacking::RGB9E5;
+int panoramaFaceSize = 0;
+const char* COMPRESSED_CUBEMAP_FILE = "cubemap_bc1.ktx";
+
+// Also build an octahedral environment map of each skybox once its faces are in (--octahedral-env), a square of
+// octahedralMapSize texels (0 for twice the face size, about two thirds of the cube's texels) with a full mip chain
+bool buildOctahedralEnvironments = false;
+int octahedralMapSize = 0;
+
+// A skybox directory with an environment.vtex tile file (tools/build_virtual_environment.cpp) streams it as a
+// virtual texture instead, through a cache of virtualCacheSlots^2 tiles
+bool useVirtualEnvironments = true;
+int virtualCacheSlots = 16;
+
+// Build the mip chain of PNG, HDR and panorama faces with the decode (--no-env-mips uploads the top level only)
+bool buildSkyboxMips = true;
+
+// S3TC is an extension in GL 3.3, though desktop drivers all have it (render thread)
+bool s3tcSupported()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        supported = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLubyte* extension = glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::strcmp(reinterpret_cast<const char*>(extension), "GL_EXT_texture_compression_s3tc") == 0)
+                supported = 1;
+        }
+    }
+    return supported == 1;
+}
+
+// One decoded face, shared so upload jobs (std::function) can hold it
+struct CubemapFace
+{
+    std::shared_ptr<unsigned char> pixels; // RGB8, null if the file could not be read
+    uint32_t compressedFormat = 0;         // Else the face is the mip chain in levels
+    std::vector<CompressedLevel> levels;
+    GLenum hdrFormat = 0;                  // Else the face is HDR, packed into hdrTexels
+    std::vector<uint32_t> hdrTexels;
+    std::vector<std::vector<uint32_t>> mips; // Levels 1 and down of a PNG face (RGBA8) or an HDR one (packed like hdrTexels)
+    int width = 0;
+    int height = 0;
+    double decodeMilliseconds = 0.0;
+    double mipMilliseconds = 0.0;            // Part of decodeMilliseconds
+    std::chrono::high_resolution_clock::time_point finished;
+};
+
+// Build a decoded PNG or HDR face's mip chain (thread pool worker), BC1 faces come with theirs
+void buildCubemapFaceMips(CubemapFace& face)
+{
+    if (!buildSkyboxMips || face.compressedFormat || face.width != face.height)
+        return;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (face.hdrFormat && !face.hdrTexels.empty())
+        face.mips = buildMipChainHdr(face.hdrTexels.data(), face.width, face.hdrFormat == GL_RGB9_E5 ? HdrPacking::RGB9E5 : HdrPacking::R11G11B10F);
+    else if (face.pixels)
+        face.mips = buildMipChainRGB8(face.pixels.get(), face.width);
+    face.mipMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Decode one face (runs on a thread pool worker, stb_image keeps no shared state)
+CubemapFace decodeCubemapFace(const std::string& path)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    CubemapFace face;
+    int nrChannels;
+    unsigned char* data = stbi_load(path.c_str(), &face.width, &face.height, &nrChannels, 3); // Always RGB, as uploaded
+    if (data)
+        face.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+    else
+        std::cerr << "Failed to load cubemap texture at " << path << std::endl;
+    buildCubemapFaceMips(face);
+    face.finished = std::chrono::high_resolution_clock::now();
+    face.decodeMilliseconds = std::chrono::duration<double, std::milli>(face.finished - start).count();
+    return face;
+}
+
+// Decode one Radiance .hdr face and pack it to 4 bytes a texel (thread pool worker)
+CubemapFace decodeHdrCubemapFace(const std::string& path, HdrPacking packing)
 {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    auto start = std::chrono::high_resolution_clock::now();
+    CubemapFace face;
+    int nrChannels;
+    float* data = stbi_loadf(path.c_str(), &face.width, &face.height, &nrChannels, 3);
+    if (data)
+    {
+        face.hdrTexels = packHdrImage(data, static_cast<size_t>(face.width) * static_cast<size_t>(face.height), packing);
+        face.hdrFormat = packing == HdrPacking::RGB9E5 ? GL_RGB9_E5 : GL_R11F_G11F_B10F;
+        stbi_image_free(data);
+    }
+    else
+        std::cerr << "Failed to load cubemap texture at " << path << std::endl;
+    buildCubemapFaceMips(face);
+    face.finished = std::chrono::high_resolution_clock::now();
+    face.decodeMilliseconds = std::chrono::duration<double, std::milli>(face.finished - start).count();
+    return face;
+}
+
+// The PNG faces of a skybox directory, in KTX face order
+std::vector<std::string> cubemapFacePaths(const std::string& directory, const char* extension)
+{
+    static const char* faceNames[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+    std::vector<std::string> paths;
+    for (const char* faceName : faceNames)
+        paths.push_back(directory + faceName + extension);
+    return paths;
+}
+
+// The KTX cubemap was compressed from the PNGs as they are now (or there are no PNGs to prefer over it)
+bool compressedCubemapCurrent(const std::string& directory)
+{
+    std::string current, stored;
+    if (!ktxSourceStamp(cubemapFacePaths(directory, ".png"), current))
+        return true;
+    MappedFile file;
+    if (file.open(directory + COMPRESSED_CUBEMAP_FILE) && readKtxKeyValue(file, KTX_SOURCE_KEY, stored) && stored == current)
+        return true;
+    std::cerr << "ERROR::SKYBOX:: " << directory + COMPRESSED_CUBEMAP_FILE << " is older than the PNG faces, decoding them instead"
+              << " (run compress_skybox again)" << std::endl;
+    return false;
+}
 
+// Copy one face's mip chain out of a KTX cubemap (thread pool worker), the PNG is decoded instead if that fails
+CubemapFace readCompressedCubemapFace(const std::string& ktxPath, int faceIndex, const std::string& pngPath)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    CubemapFace face;
+    MappedFile file;
+    if (!file.open(ktxPath) || !readKtxCubemapFace(file, faceIndex, face.compressedFormat, face.levels)
+        || face.compressedFormat != KTX_COMPRESSED_RGB_S3TC_DXT1)
+    {
+        std::cerr << "ERROR::SKYBOX:: " << ktxPath << " is not a BC1 cubemap, decoding " << pngPath << " instead" << std::endl;
+        return decodeCubemapFace(pngPath);
+    }
+    face.width = face.levels[0].width;
+    face.height = face.levels[0].height;
+    face.finished = std::chrono::high_resolution_clock::now();
+    face.decodeMilliseconds = std::chrono::duration<double, std::milli>(face.finished - start).count();
+    return face;
+}
+
+// Decode an equirectangular panorama and resample it into the six faces (thread pool worker, the tiles are spread over the pool too)
+std::vector<CubemapFace> decodePanoramaCubemap(const std::string& path, int faceSize, HdrPacking packing)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<CubemapFace> faces(6);
     int width, height, nrChannels;
+    bool hdr = stbi_is_hdr(path.c_str()) != 0;
+    void* data = hdr ? static_cast<void*>(stbi_loadf(path.c_str(), &width, &height, &nrChannels, 3))
+        : static_cast<void*>(stbi_load(path.c_str(), &width, &height, &nrChannels, 3));
+    if (!data)
+    {
+        std::cerr << "Failed to load cubemap panorama at " << path << std::endl;
+        return faces;
+    }
+
+    int size = faceSize > 0 ? faceSize : std::max(width / 4, 1);
+    size_t faceTexels = static_cast<size_t>(size) * static_cast<size_t>(size);
+    for (CubemapFace& face : faces)
+    {
+        face.width = size;
+        face.height = size;
+        if (hdr)
+        {
+            face.hdrFormat = packing == HdrPacking::RGB9E5 ? GL_RGB9_E5 : GL_R11F_G11F_B10F;
+            face.hdrTexels.resize(faceTexels);
+        }
+        else
+            face.pixels = std::shared_ptr<unsigned char>(new unsigned char[faceTexels * 3], std::default_delete<unsigned char[]>());
+    }
+
+    // Each tile goes straight into its face's upload format
+    auto store = [&](int faceIndex, int x, int y, int tileWidth, int tileHeight, const float* rgb)
+    {
+        CubemapFace& face = faces[faceIndex];
+        for (int row = 0; row < tileHeight; row++)
+        {
+            const float* source = rgb + static_cast<size_t>(row) * tileWidth * 3;
+            size_t first = static_cast<size_t>(y + row) * size + x;
+            if (hdr)
+                packHdrTexels(source, tileWidth, packing, face.hdrTexels.data() + first);
+            else
+            {
+                unsigned char* target = face.pixels.get() + first * 3;
+                for (int i = 0; i < tileWidth * 3; i++)
+                    target[i] = static_cast<unsigned char>(std::min(std::max(source[i] + 0.5f, 0.0f), 255.0f));
+            }
+        }
+    };
+    if (hdr)
+        equirectToCubemap(static_cast<const float*>(data), width, height, size, store);
+    else
+        equirectToCubemap(static_cast<const unsigned char*>(data), width, height, size, store);
+    stbi_image_free(data);
+    globalThreadPool().parallelFor(6, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            buildCubemapFaceMips(faces[i]);
+    });
+
+    // The whole decode is booked on the first face
+    auto finished = std::chrono::high_resolution_clock::now();
+    for (CubemapFace& face : faces)
+        face.finished = finished;
+    faces[0].decodeMilliseconds = std::chrono::duration<double, std::milli>(finished - start).count();
+    return faces;
+}
+
+std::vector<CubemapFace> singleFace(CubemapFace face)
+{
+    std::vector<CubemapFace> faces;
+    faces.push_back(std::move(face));
+    return faces;
+}
+
+// VRAM the face takes once uploaded (drivers pad RGB8 to four bytes a texel, the HDR formats are four bytes),
+// or what its top level alone takes
+size_t cubemapFaceBytes(const CubemapFace& face, bool topLevelOnly = false)
+{
+    if (face.compressedFormat)
+    {
+        size_t bytes = 0;
+        for (const CompressedLevel& level : face.levels)
+        {
+            bytes += level.data.size();
+            if (topLevelOnly)
+                break;
+        }
+        return bytes;
+    }
+    size_t bytes = static_cast<size_t>(face.width) * static_cast<size_t>(face.height) * 4;
+    if (!topLevelOnly)
+        for (const std::vector<uint32_t>& level : face.mips)
+            bytes += level.size() * sizeof(uint32_t);
+    return bytes;
+}
+
+// A face as float RGB for resampling: LDR faces keep their 0-255 range, HDR ones are linear radiance and compressed
+// ones decode their top level
+std::vector<float> cubemapFaceFloats(const CubemapFace& face)
+{
+    size_t texels = static_cast<size_t>(face.width) * static_cast<size_t>(face.height);
+    std::vector<float> rgb(texels * 3, 0.0f);
+    if (face.compressedFormat)
+    {
+        std::vector<unsigned char> decoded = decompressBC1(face.levels[0].data.data(), face.width, face.height);
+        std::copy(decoded.begin(), decoded.end(), rgb.begin());
+    }
+    else if (face.hdrFormat)
+    {
+        for (size_t i = 0; i < texels; i++)
+        {
+            if (face.hdrFormat == GL_RGB9_E5)
+                unpackRGB9E5(face.hdrTexels[i], &rgb[i * 3]);
+            else
+                unpackR11G11B10F(face.hdrTexels[i], &rgb[i * 3]);
+        }
+    }
+    else if (face.pixels)
+        std::copy(face.pixels.get(), face.pixels.get() + texels * 3, rgb.begin());
+    return rgb;
+}
+
+// An octahedral environment map ready for upload, every level packed to 4 bytes a texel like the cube's faces
+struct OctahedralMap
+{
+    GLenum internalFormat = 0; // 0 if it could not be built
+    GLenum format = 0;
+    GLenum type = 0;
+    int size = 0;
+    std::vector<std::vector<uint32_t>> levels;
+    double buildMilliseconds = 0.0;
+};
+
+// Resample a skybox's faces into an octahedral map (thread pool worker, the rows are spread over the pool too)
+OctahedralMap buildOctahedralMap(const std::vector<CubemapFace>& faces, int size)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    OctahedralMap map;
+    int faceSize = faces[0].width;
+    for (const CubemapFace& face : faces)
+    {
+        if (face.width != faceSize || face.height != faceSize || (!face.pixels && !face.compressedFormat && !face.hdrFormat))
+        {
+            std::cerr << "ERROR::SKYBOX:: Faces missing or of different sizes, no octahedral map" << std::endl;
+            return map;
+        }
+    }
+
+    std::vector<std::vector<float>> floatFaces;
+    for (const CubemapFace& face : faces)
+        floatFaces.push_back(cubemapFaceFloats(face));
+    std::vector<std::vector<float>> levels = cubeToOctahedral(floatFaces, faceSize, size);
+
+    GLenum hdrFormat = faces[0].hdrFormat;
+    map.internalFormat = hdrFormat ? hdrFormat : GL_RGBA8;
+    map.format = hdrFormat ? GL_RGB : GL_RGBA;
+    map.type = hdrFormat == GL_RGB9_E5 ? GL_UNSIGNED_INT_5_9_9_9_REV : (hdrFormat ? GL_UNSIGNED_INT_10F_11F_11F_REV : GL_UNSIGNED_BYTE);
+    map.size = size;
+    for (const std::vector<float>& level : levels)
+    {
+        size_t texels = level.size() / 3;
+        std::vector<uint32_t> packed(texels);
+        if (hdrFormat)
+            packHdrTexels(level.data(), texels, hdrFormat == GL_RGB9_E5 ? HdrPacking::RGB9E5 : HdrPacking::R11G11B10F, packed.data());
+        else
+        {
+            // RGBA8 bytes in memory order
+            for (size_t i = 0; i < texels; i++)
+            {
+                uint32_t texel = 0xFF000000u;
+                for (int c = 0; c < 3; c++)
+                    texel |= static_cast<uint32_t>(std::min(std::max(level[i * 3 + c] + 0.5f, 0.0f), 255.0f)) << (8 * c);
+                packed[i] = texel;
+            }
+        }
+        map.levels.push_back(std::move(packed));
+    }
+    map.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return map;
+}
+
+size_t octahedralMapBytes(const OctahedralMap& map)
+{
+    size_t bytes = 0;
+    for (const std::vector<uint32_t>& level : map.levels)
+        bytes += level.size() * sizeof(uint32_t);
+    return bytes;
+}
+
+// Submit an octahedral map and its mips to a 2D texture (runs on the upload thread)
+void fillOctahedralMap(GLuint texture, const OctahedralMap& map)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    int size = map.size;
+    for (GLint level = 0; level < static_cast<GLint>(map.levels.size()); level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, map.internalFormat, size, size, 0, map.format, map.type, map.levels[level].data());
+        size = std::max(size / 2, 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(map.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Submit six decoded faces to a cubemap texture (runs on the upload thread)
+void fillCubemap(GLuint texture, const std::vector<CubemapFace>& faces)
+{
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+    GLint maxLevel = 0;
     for (GLuint i = 0; i < faces.size(); i++) 
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data) 
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            
-        else 
-            std::cerr << "Failed to load cubemap texture at " << faces[i] << std::endl;
-        stbi_image_free(data);
+        if (faces[i].compressedFormat)
+        {
+            for (GLint level = 0; level < static_cast<GLint>(faces[i].levels.size()); level++)
+            {
+                const CompressedLevel& data = faces[i].levels[level];
+                glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, faces[i].compressedFormat, data.width, data.height, 0,
+                    static_cast<GLsizei>(data.data.size()), data.data.data());
+            }
+            maxLevel = static_cast<GLint>(faces[i].levels.size()) - 1;
+        }
+        else if (faces[i].hdrFormat)
+        {
+            GLenum type = faces[i].hdrFormat == GL_RGB9_E5 ? GL_UNSIGNED_INT_5_9_9_9_REV : GL_UNSIGNED_INT_10F_11F_11F_REV;
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, faces[i].hdrFormat, faces[i].width, faces[i].height, 0, GL_RGB, type,
+                faces[i].hdrTexels.data());
+        }
+        else if (faces[i].pixels) 
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, faces[i].width, faces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].pixels.get());
+
+        // Built mips: the HDR face's packing, RGBA8 texels for an RGB8 face
+        if (!faces[i].compressedFormat && !faces[i].mips.empty())
+        {
+            GLenum format = faces[i].hdrFormat ? GL_RGB : GL_RGBA;
+            GLenum type = faces[i].hdrFormat == GL_RGB9_E5 ? GL_UNSIGNED_INT_5_9_9_9_REV
+                : (faces[i].hdrFormat ? GL_UNSIGNED_INT_10F_11F_11F_REV : GL_UNSIGNED_BYTE);
+            GLint internalFormat = faces[i].hdrFormat ? static_cast<GLint>(faces[i].hdrFormat) : GL_RGB;
+            GLsizei size = faces[i].width;
+            for (GLint level = 1; level <= static_cast<GLint>(faces[i].mips.size()); level++)
+            {
+                size = std::max(size / 2, 1);
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, internalFormat, size, size, 0, format, type, faces[i].mips[level - 1].data());
+            }
+            maxLevel = static_cast<GLint>(faces[i].mips.size());
+        }
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, maxLevel);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, maxLevel > 0 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
+// A skybox cubemap loaded in the background: its six faces are decoded (or read from the compressed cubemap, or
+// resampled from a panorama) on the thread pool, all at once, and only the glTexImage2D calls go to the upload
+// thread once the last one is done
+// A skybox with a tile file loads none of this and streams its tiles as a VirtualEnvironment instead
+// With buildOctahedralEnvironments the faces are then resampled into an octahedral map on the pool as well, which
+// is uploaded to a second texture some time after the cube
+class Cubemap
+{
+public:
+    explicit Cubemap(std::string skyboxName)
+        : name(std::move(skyboxName))
+    {
+    }
+
+    // Start decoding (context thread), later calls do nothing
+    void request()
+    {
+        if (requested)
+            return;
+        requested = true;
+        requestTime = std::chrono::high_resolution_clock::now();
+        texture = GLTexture::create();
+        std::string directory = "skybox/" + name + "/";
+        auto exists = [&](const std::string& file)
+        {
+            std::error_code error;
+            return std::filesystem::is_regular_file(directory + file, error);
+        };
+        if (useVirtualEnvironments && exists(VIRTUAL_TILE_FILE))
+        {
+            virtualTiles = std::make_unique<VirtualEnvironment>();
+            if (virtualTiles->open(directory + VIRTUAL_TILE_FILE, virtualCacheSlots))
+                return;
+            std::cerr << "ERROR::SKYBOX:: " << directory + VIRTUAL_TILE_FILE << " is not a tile file, loading the faces instead" << std::endl;
+            virtualTiles.reset();
+        }
+        std::string ktxPath = directory + COMPRESSED_CUBEMAP_FILE;
+        bool hdr = exists("px.hdr");
+        std::string panorama = !hdr && exists("panorama.hdr") ? "panorama.hdr" : "";
+        bool compressed = !hdr && panorama.empty() && useCompressedSkyboxes && exists(COMPRESSED_CUBEMAP_FILE) && s3tcSupported()
+            && compressedCubemapCurrent(directory);
+        if (!hdr && panorama.empty() && !compressed && !exists("px.png"))
+            panorama = exists("panorama.png") ? "panorama.png" : (exists("panorama.jpg") ? "panorama.jpg" : "");
+        HdrPacking packing = hdrSkyboxPacking;
+
+        if (!panorama.empty())
+        {
+            std::string path = directory + panorama;
+            int faceSize = panoramaFaceSize;
+            decodes.push_back(globalThreadPool().submit([path, faceSize, packing]() { return decodePanoramaCubemap(path, faceSize, packing); }));
+            return;
+        }
+        static const char* faceNames[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+        for (int i = 0; i < 6; i++)
+        {
+            std::string path = directory + faceNames[i] + ".png";
+            if (hdr)
+            {
+                std::string hdrPath = directory + faceNames[i] + ".hdr";
+                decodes.push_back(globalThreadPool().submit([hdrPath, packing]() { return singleFace(decodeHdrCubemapFace(hdrPath, packing)); }));
+            }
+            else if (compressed)
+                decodes.push_back(globalThreadPool().submit([ktxPath, i, path]() { return singleFace(readCompressedCubemapFace(ktxPath, i, path)); }));
+            else
+                decodes.push_back(globalThreadPool().submit([path]() { return singleFace(decodeCubemapFace(path)); }));
+        }
+    }
+
+    // Requested, decoded and uploaded, so it can be sampled (never blocks)
+    bool ready()
+    {
+        request();
+        if (virtualTiles)
+        {
+            if (!virtualTiles->ready())
+                return false;
+            report();
+            return true;
+        }
+        if (!fence)
+        {
+            for (auto& decode : decodes)
+                if (decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    return false;
+            submitUpload();
+        }
+        if (!fence->signaled())
+            return false;
+        report();
+        return true;
+    }
+
+    // Wait for the decode and upload (for the skybox the first frame shows)
+    void wait()
+    {
+        request();
+        if (virtualTiles)
+        {
+            virtualTiles->wait();
+            report();
+            return;
+        }
+        if (!fence)
+            submitUpload();
+        fence->wait();
+        report();
+    }
+
+    GLuint id() const
+    {
+        return texture.id();
+    }
+
+    // The octahedral map is built and uploaded (never blocks), it trails ready() by its build
+    bool octahedralReady()
+    {
+        if (!octahedralFence)
+        {
+            if (!octahedralBuild.valid() || octahedralBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return false;
+            if (!submitOctahedralUpload())
+                return false;
+        }
+        if (!octahedralFence->signaled())
+            return false;
+        reportOctahedral();
+        return true;
+    }
+
+    GLuint octahedralId() const
+    {
+        return octahedralTexture.id();
+    }
+
+    // VRAM of the cube and of the octahedral map (0 until built)
+    size_t cubeBytes() const
+    {
+        return gpuBytes;
+    }
+
+    // VRAM of the cube's top level, what it took before the mip chains
+    size_t cubeTopLevelBytes() const
+    {
+        return topLevelBytes;
+    }
+
+    size_t octahedralBytes() const
+    {
+        return octahedralGpuBytes;
+    }
+
+    // Uploaded from HDR faces, so the shaders expose and tone-map it
+    bool hdr() const
+    {
+        return virtualTiles ? virtualTiles->hdr() : hdrFormat != 0;
+    }
+
+    // The tiles this skybox streams from, null for a plain cubemap
+    VirtualEnvironment* virtualEnvironment()
+    {
+        return virtualTiles.get();
+    }
+
+    void reset()
+    {
+        texture.reset();
+        fence.reset();
+        decodes.clear();
+        octahedralTexture.reset();
+        octahedralFence.reset();
+        octahedralBuild = std::future<OctahedralMap>();
+        octahedralGpuBytes = 0;
+        octahedralReported = false;
+        virtualTiles.reset();
+        requested = false;
+        reported = false;
+        hdrFormat = 0;
+    }
+
+private:
+    // Written by the upload job, read after its fence has signaled
+    struct UploadTiming
+    {
+        double milliseconds = 0.0;
+    };
+
+    std::string name;
+    GLTexture texture;
+    bool requested = false;
+    bool reported = false;
+    std::vector<std::future<std::vector<CubemapFace>>> decodes; // One per face, or one for a panorama
+    std::chrono::high_resolution_clock::time_point requestTime;
+    double decodeWallMilliseconds = 0.0;
+    double decodeSumMilliseconds = 0.0;
+    double mipSumMilliseconds = 0.0;
+    size_t gpuBytes = 0;
+    size_t topLevelBytes = 0;
+    bool compressed = false;
+    GLenum hdrFormat = 0;
+    std::shared_ptr<UploadTiming> uploadTiming;
+    std::shared_ptr<UploadFence> fence;
+    GLTexture octahedralTexture;
+    std::future<OctahedralMap> octahedralBuild;
+    int octahedralSize = 0;
+    size_t octahedralLevels = 0;
+    size_t octahedralGpuBytes = 0;
+    double octahedralBuildMilliseconds = 0.0;
+    bool octahedralReported = false;
+    std::shared_ptr<UploadTiming> octahedralUploadTiming;
+    std::shared_ptr<UploadFence> octahedralFence;
+    std::unique_ptr<VirtualEnvironment> virtualTiles;
+
+    // Collect the faces (blocks on any still decoding) and queue their upload
+    void submitUpload()
+    {
+        std::vector<CubemapFace> faces;
+        decodeSumMilliseconds = 0.0;
+        mipSumMilliseconds = 0.0;
+        gpuBytes = 0;
+        topLevelBytes = 0;
+        auto lastFinished = requestTime;
+        for (auto& decode : decodes)
+        {
+            for (CubemapFace& face : decode.get())
+            {
+                decodeSumMilliseconds += face.decodeMilliseconds;
+                mipSumMilliseconds += face.mipMilliseconds;
+                gpuBytes += cubemapFaceBytes(face);
+                topLevelBytes += cubemapFaceBytes(face, true);
+                lastFinished = std::max(lastFinished, face.finished);
+                faces.push_back(std::move(face));
+            }
+        }
+        decodes.clear();
+        decodeWallMilliseconds = std::chrono::duration<double, std::milli>(lastFinished - requestTime).count();
+        compressed = faces[0].compressedFormat != 0;
+        hdrFormat = faces[0].hdrFormat;
+
+        // The upload and the octahedral build share the faces
+        auto shared = std::make_shared<const std::vector<CubemapFace>>(std::move(faces));
+        if (buildOctahedralEnvironments)
+        {
+            int size = octahedralMapSize > 0 ? octahedralMapSize : 2 * (*shared)[0].width;
+            octahedralBuild = globalThreadPool().submit([shared, size]() { return buildOctahedralMap(*shared, size); });
+        }
+
+        GLuint id = texture.id();
+        auto timing = std::make_shared<UploadTiming>();
+        uploadTiming = timing;
+        fence = globalUploadThread().submit([id, shared, timing]()
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            fillCubemap(id, *shared);
+            timing->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        });
+    }
+
+    // Queue the built octahedral map's upload, false if it could not be built
+    bool submitOctahedralUpload()
+    {
+        auto map = std::make_shared<const OctahedralMap>(octahedralBuild.get());
+        if (!map->internalFormat)
+            return false;
+        octahedralSize = map->size;
+        octahedralLevels = map->levels.size();
+        octahedralGpuBytes = octahedralMapBytes(*map);
+        octahedralBuildMilliseconds = map->buildMilliseconds;
+
+        octahedralTexture = GLTexture::create();
+        GLuint id = octahedralTexture.id();
+        auto timing = std::make_shared<UploadTiming>();
+        octahedralUploadTiming = timing;
+        octahedralFence = globalUploadThread().submit([id, map, timing]()
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            fillOctahedralMap(id, *map);
+            timing->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        });
+        return true;
+    }
+
+    // How the load split between decode and upload, printed once
+    void report()
+    {
+        if (reported)
+            return;
+        reported = true;
+        if (virtualTiles)
+        {
+            const VirtualTileHeader& header = virtualTiles->info();
+            VirtualEnvironmentStats stats = virtualTiles->statistics();
+            std::cout << "Skybox " << name << ": virtual " << header.faceSize << "x" << header.faceSize << " faces in " << header.tileSize
+                      << "-texel tiles, " << header.levels << " levels, coarsest tiles in " << std::chrono::duration<double, std::milli>(
+                          std::chrono::high_resolution_clock::now() - requestTime).count() << " ms, " << stats.gpuBytes / (1024.0 * 1024.0)
+                      << " MB cache against " << stats.sourceBytes / (1024.0 * 1024.0) << " MB for the whole cubemap\n";
+            return;
+        }
+        const char* source = compressed ? "read (BC1)" : (hdrFormat == GL_RGB9_E5 ? "decoded (RGB9E5)" : (hdrFormat ? "decoded (R11G11B10F)" : "decoded"));
+        std::cout << "Skybox " << name << ": 6 faces " << source << " in " << decodeWallMilliseconds << " ms ("
+                  << decodeSumMilliseconds << " ms of decode on " << globalThreadPool().size() << " threads";
+        if (mipSumMilliseconds > 0.0)
+            std::cout << ", " << mipSumMilliseconds << " ms of it building mips";
+        std::cout << "), uploaded in " << uploadTiming->milliseconds << " ms, " << gpuBytes / (1024.0 * 1024.0) << " MB\n";
+    }
+
+    void reportOctahedral()
+    {
+        if (octahedralReported)
+            return;
+        octahedralReported = true;
+        std::cout << "Skybox " << name << ": octahedral map " << octahedralSize << "x" << octahedralSize << " (" << octahedralLevels
+                  << " levels) built in " << octahedralBuildMilliseconds << " ms, uploaded in " << octahedralUploadTiming->milliseconds << " ms, "
+                  << octahedralGpuBytes / (1024.0 * 1024.0) << " MB against the cube's " << gpuBytes / (1024.0 * 1024.0) << " MB\n";
+    }
+};
+
 // Skybox cube vertices
 float skyboxVertices[] =
 {
@@ -84,20 +803,27 @@ float skyboxVertices[] =
      1.0f, -1.0f,  1.0f
 };
 
+// Skybox cube buffers (one cube is shared by every cubemap)
+struct SkyboxMesh
+{
+    GLVertexArray VAO;
+    GLBuffer VBO;
+};
+
 // Function to set up skybox VAO
-GLuint setupSkyboxVAO()
+SkyboxMesh setupSkyboxVAO()
 {
-    GLuint skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+    SkyboxMesh skybox;
+    skybox.VAO = GLVertexArray::create();
+    skybox.VBO = GLBuffer::create();
+    glBindVertexArray(skybox.VAO.id());
+    glBindBuffer(GL_ARRAY_BUFFER, skybox.VBO.id());
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glBindVertexArray(0);
 
-    return skyboxVAO;
+    return skybox;
 }
 
 #endif // MY_SKYBOX_H
@@ -0,0 +1,104 @@
+#ifndef MY_STAGING_RING_H
+#define MY_STAGING_RING_H
+
+#include <glad/glad.h>
+
+#include <my_gl_resource.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// A few fixed-size staging buffers used round-robin to stream data into big GL buffers
+// Each chunk is written into a mapped staging buffer and copied on the GPU, so the CPU never holds more
+// than one chunk and a slot is only reused once the fence of its previous copy has passed
+
+const size_t STAGING_CHUNK_BYTES = 4 * 1024 * 1024;
+const unsigned int STAGING_RING_SLOTS = 3;
+const uint64_t STAGING_FENCE_TIMEOUT_NS = 1000000000; // Give up waiting on a slot after a second
+
+class StagingRing
+{
+public:
+    StagingRing() = default;
+
+    ~StagingRing()
+    {
+        for (Slot& slot : slots)
+        {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+        }
+    }
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    // Let fill write bytes (at most STAGING_CHUNK_BYTES) and copy them to dstBuffer at dstOffset
+    template <typename Fill>
+    void write(GLuint dstBuffer, size_t dstOffset, size_t bytes, Fill fill)
+    {
+        Slot& slot = slots[nextSlot];
+        nextSlot = (nextSlot + 1) % STAGING_RING_SLOTS;
+        if (!slot.buffer)
+        {
+            slot.buffer = GLBuffer::create();
+            glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer.id());
+            glBufferData(GL_COPY_READ_BUFFER, STAGING_CHUNK_BYTES, nullptr, GL_STREAM_COPY);
+        }
+        // Only skip the driver's own sync once the slot's fence has really passed; a wait that timed out or failed
+        // leaves the GPU possibly still copying from it, so the map synchronizes instead
+        bool slotIdle = true;
+        if (slot.fence)
+        {
+            GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, STAGING_FENCE_TIMEOUT_NS);
+            slotIdle = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+            if (!slotIdle)
+                std::cerr << "WARNING::STAGING_RING:: Slot fence not signaled, mapping synchronized" << std::endl;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer.id());
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | (slotIdle ? GL_MAP_UNSYNCHRONIZED_BIT : 0);
+        void* mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, access);
+        bool written = false;
+        if (mapped)
+        {
+            fill(mapped);
+            written = glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_TRUE; // GL_FALSE: the store was lost, write it again
+        }
+        if (!written)
+        {
+            // Mapping failed or its contents were lost: go through a chunk-sized CPU buffer instead
+            fallback.resize(bytes);
+            fill(static_cast<void*>(fallback.data()));
+            glBufferSubData(GL_COPY_READ_BUFFER, 0, bytes, fallback.data());
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, dstBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, dstOffset, bytes);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        bytesStreamed += bytes;
+    }
+
+    size_t totalBytes() const
+    {
+        return bytesStreamed;
+    }
+
+private:
+    struct Slot
+    {
+        GLBuffer buffer;
+        GLsync fence = nullptr;
+    };
+
+    Slot slots[STAGING_RING_SLOTS];
+    unsigned int nextSlot = 0;
+    std::vector<unsigned char> fallback;
+    size_t bytesStreamed = 0;
+};
+
+#endif // MY_STAGING_RING_H
@@ -0,0 +1,127 @@
+#ifndef MY_SURFACE_MAPS_H
+#define MY_SURFACE_MAPS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem> // Requires C++17
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Detail maps baked from a high-poly model onto a decimated copy of it (tools/bake_maps.cpp): a tangent-space
+// normal map and a d_N map, stored next to the low-poly model as <name>_normal.png and <name>_thickness.hdr
+// There is no tangent attribute. The baker and the two-surface shaders both build the cotangent frame of the
+// UVs (cotangentFrame below), the shaders from screen-space derivatives in shaders/surface_maps.glsl
+
+struct SurfaceMaps
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> normals; // RGB8, tangent space mapped from [-1, 1], row 0 at v = 0
+    std::vector<float> thickness;       // d_N per texel, same size as the normal map
+
+    bool valid() const
+    {
+        size_t texels = static_cast<size_t>(std::max(width, 0)) * static_cast<size_t>(std::max(height, 0));
+        return texels > 0 && normals.size() == texels * 3 && thickness.size() == texels;
+    }
+
+    // GPU size once uploaded: RGBA8 normals with mips, R16F thickness
+    size_t gpuBytes() const
+    {
+        size_t texels = static_cast<size_t>(width) * static_cast<size_t>(height);
+        return texels * 4 * 4 / 3 + texels * 2;
+    }
+};
+
+void surfaceMapPaths(const std::string& modelPath, std::string& normalMapPath, std::string& thicknessMapPath)
+{
+    std::filesystem::path path(modelPath);
+    std::string stem = (path.parent_path() / path.stem()).generic_string();
+    normalMapPath = stem + "_normal.png";
+    thicknessMapPath = stem + "_thickness.hdr";
+}
+
+// Both maps exist next to the model file
+bool hasSurfaceMaps(const std::string& modelPath)
+{
+    std::string normalMapPath, thicknessMapPath;
+    surfaceMapPaths(modelPath, normalMapPath, thicknessMapPath);
+    std::error_code error;
+    return std::filesystem::is_regular_file(normalMapPath, error) && std::filesystem::is_regular_file(thicknessMapPath, error);
+}
+
+// Tangent and bitangent along the surface gradients of u and v, the longer one scaled to unit length (Schueler's
+// cotangent frame). dp1 and dp2 are two position differences across a triangle and duv1, duv2 the matching UV ones
+// perturbNormal in shaders/surface_maps.glsl is the same frame and must stay in step with it
+void cotangentFrame(const glm::vec3& normal, const glm::vec3& dp1, const glm::vec3& dp2, const glm::vec2& duv1, const glm::vec2& duv2,
+    glm::vec3& tangent, glm::vec3& bitangent)
+{
+    glm::vec3 dp2perp = glm::cross(dp2, normal);
+    glm::vec3 dp1perp = glm::cross(normal, dp1);
+    float orientation = glm::dot(normal, glm::cross(dp1, dp2)) < 0.0f ? -1.0f : 1.0f; // Mirrored differences flip both
+    tangent = (dp2perp * duv1.x + dp1perp * duv2.x) * orientation;
+    bitangent = (dp2perp * duv1.y + dp1perp * duv2.y) * orientation;
+    float longest = std::max(glm::dot(tangent, tangent), glm::dot(bitangent, bitangent));
+    float scale = longest > 0.0f ? 1.0f / std::sqrt(longest) : 0.0f;
+    tangent *= scale;
+    bitangent *= scale;
+}
+
+// Normal-map value (in [-1, 1]) to a surface normal, as the shaders do it
+glm::vec3 applyTangentNormal(const glm::vec3& tangent, const glm::vec3& bitangent, const glm::vec3& normal, const glm::vec3& tangentNormal)
+{
+    glm::vec3 result = tangent * tangentNormal.x + bitangent * tangentNormal.y + normal * tangentNormal.z;
+    float len = glm::length(result);
+    return len > 0.0f ? result / len : normal;
+}
+
+// Inverse of applyTangentNormal: the unit normal-map value that turns the frame's normal into target
+glm::vec3 toTangentNormal(const glm::vec3& tangent, const glm::vec3& bitangent, const glm::vec3& normal, const glm::vec3& target)
+{
+    glm::mat3 frame(tangent, bitangent, normal);
+    if (std::fabs(glm::determinant(frame)) < 1e-12f)
+        return glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 result = glm::inverse(frame) * target;
+    float len = glm::length(result);
+    return len > 0.0f ? result / len : glm::vec3(0.0f, 0.0f, 1.0f);
+}
+
+unsigned char encodeNormalChannel(float value)
+{
+    return static_cast<unsigned char>(std::lround(std::min(std::max(value * 0.5f + 0.5f, 0.0f), 1.0f) * 255.0f));
+}
+
+// Bilinear lookups with clamp-to-edge addressing, like the GL samplers
+template <typename Fetch>
+auto sampleBilinear(const SurfaceMaps& maps, const glm::vec2& texCoords, Fetch fetch) -> decltype(fetch(0, 0))
+{
+    float x = std::min(std::max(texCoords.x, 0.0f), 1.0f) * maps.width - 0.5f;
+    float y = std::min(std::max(texCoords.y, 0.0f), 1.0f) * maps.height - 0.5f;
+    int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+    float fx = x - x0, fy = y - y0;
+    auto at = [&](int tx, int ty)
+    {
+        return fetch(std::min(std::max(tx, 0), maps.width - 1), std::min(std::max(ty, 0), maps.height - 1));
+    };
+    return (at(x0, y0) * (1.0f - fx) + at(x0 + 1, y0) * fx) * (1.0f - fy) + (at(x0, y0 + 1) * (1.0f - fx) + at(x0 + 1, y0 + 1) * fx) * fy;
+}
+
+// Normal-map value in [-1, 1] (not renormalized, like texture() in the shaders)
+glm::vec3 sampleNormalMap(const SurfaceMaps& maps, const glm::vec2& texCoords)
+{
+    return sampleBilinear(maps, texCoords, [&](int x, int y)
+    {
+        const unsigned char* texel = &maps.normals[(static_cast<size_t>(y) * maps.width + x) * 3];
+        return glm::vec3(texel[0], texel[1], texel[2]) * (2.0f / 255.0f) - glm::vec3(1.0f);
+    });
+}
+
+float sampleThicknessMap(const SurfaceMaps& maps, const glm::vec2& texCoords)
+{
+    return sampleBilinear(maps, texCoords, [&](int x, int y) { return maps.thickness[static_cast<size_t>(y) * maps.width + x]; });
+}
+
+#endif // MY_SURFACE_MAPS_H
@@ -0,0 +1,542 @@
+#ifndef MY_TEXTURE_COMPRESSION_H
+#define MY_TEXTURE_COMPRESSION_H
+
+#include <my_mapped_file.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem> // Requires C++17
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MY_TEXTURE_COMPRESSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// BC1 (S3TC DXT1) block compression of RGB8 images and the KTX 1.1 container for compressed cubemaps
+// (tools/compress_skybox.cpp writes them, Cubemap in my_skybox.h uploads them with glCompressedTexImage2D)
+// BC1 stores each 4x4 block as two RGB565 endpoints and a 2-bit index per texel into the four colours
+// between them, 8 bytes per block (6:1 against RGB8, 8:1 against the RGBA8 drivers pad RGB8 to)
+
+const uint32_t KTX_COMPRESSED_RGB_S3TC_DXT1 = 0x83F0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+const uint32_t KTX_BASE_FORMAT_RGB = 0x1907;          // GL_RGB
+
+// One mip level of a compressed image
+struct CompressedLevel
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> data;
+};
+
+size_t bc1LevelBytes(int width, int height)
+{
+    return static_cast<size_t>(std::max((width + 3) / 4, 1)) * static_cast<size_t>(std::max((height + 3) / 4, 1)) * 8;
+}
+
+// RGB565 to RGB8 by bit replication, as the hardware decodes it
+void expand565(uint16_t colour, int rgb[3])
+{
+    int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+uint16_t quantize565(const float rgb[3])
+{
+    auto channel = [](float value, int maxValue)
+    {
+        return static_cast<int>(std::min(std::max(value, 0.0f), 255.0f) * maxValue / 255.0f + 0.5f);
+    };
+    return static_cast<uint16_t>((channel(rgb[0], 31) << 11) | (channel(rgb[1], 63) << 5) | channel(rgb[2], 31));
+}
+
+// The four colours of a four-colour block (c0 > c1)
+void bc1Palette(uint16_t c0, uint16_t c1, float palette[4][3])
+{
+    int a[3], b[3];
+    expand565(c0, a);
+    expand565(c1, b);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[0][c] = static_cast<float>(a[c]);
+        palette[1][c] = static_cast<float>(b[c]);
+        palette[2][c] = static_cast<float>((2 * a[c] + b[c]) / 3);
+        palette[3][c] = static_cast<float>((a[c] + 2 * b[c]) / 3);
+    }
+}
+
+// Texels of one block, one array per channel so four texels fit a SIMD register
+struct BC1Block
+{
+    alignas(16) float r[16];
+    alignas(16) float g[16];
+    alignas(16) float b[16];
+};
+
+// Nearest palette colour of every texel, returns the squared error of the block
+float bc1PickIndices(const BC1Block& block, const float palette[4][3], uint32_t& indices)
+{
+    indices = 0;
+#ifdef MY_TEXTURE_COMPRESSION_SSE2
+    __m128 totalError = _mm_setzero_ps();
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 r = _mm_load_ps(block.r + i), g = _mm_load_ps(block.g + i), b = _mm_load_ps(block.b + i);
+        __m128 bestError = _mm_set1_ps(1e30f);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int k = 0; k < 4; k++)
+        {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+            __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128 closer = _mm_cmplt_ps(error, bestError);
+            bestError = _mm_min_ps(error, bestError);
+            __m128i closerMask = _mm_castps_si128(closer);
+            bestIndex = _mm_or_si128(_mm_and_si128(closerMask, _mm_set1_epi32(k)), _mm_andnot_si128(closerMask, bestIndex));
+        }
+        totalError = _mm_add_ps(totalError, bestError);
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+        for (int lane = 0; lane < 4; lane++)
+            indices |= static_cast<uint32_t>(lanes[lane]) << (2 * (i + lane));
+    }
+    alignas(16) float sums[4];
+    _mm_store_ps(sums, totalError);
+    return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+    float totalError = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float bestError = 1e30f;
+        uint32_t bestIndex = 0;
+        for (uint32_t k = 0; k < 4; k++)
+        {
+            float dr = block.r[i] - palette[k][0], dg = block.g[i] - palette[k][1], db = block.b[i] - palette[k][2];
+            float error = dr * dr + dg * dg + db * db;
+            if (error < bestError)
+            {
+                bestError = error;
+                bestIndex = k;
+            }
+        }
+        totalError += bestError;
+        indices |= bestIndex << (2 * i);
+    }
+    return totalError;
+#endif
+}
+
+// Quantize two endpoints and pick indices for them, kept in out if better than bestError
+void bc1TryEndpoints(const BC1Block& block, const float first[3], const float second[3], unsigned char out[8], float& bestError)
+{
+    uint16_t c0 = quantize565(first), c1 = quantize565(second);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    float palette[4][3];
+    bc1Palette(c0, c1, palette);
+    uint32_t indices;
+    float error;
+    if (c0 == c1)
+    {
+        // Equal endpoints select the three-colour mode, where index 3 is black, so use index 0 only
+        indices = 0;
+        error = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float dr = block.r[i] - palette[0][0], dg = block.g[i] - palette[0][1], db = block.b[i] - palette[0][2];
+            error += dr * dr + dg * dg + db * db;
+        }
+    }
+    else
+        error = bc1PickIndices(block, palette, indices);
+
+    if (error >= bestError)
+        return;
+    bestError = error;
+    out[0] = static_cast<unsigned char>(c0 & 0xFF);
+    out[1] = static_cast<unsigned char>(c0 >> 8);
+    out[2] = static_cast<unsigned char>(c1 & 0xFF);
+    out[3] = static_cast<unsigned char>(c1 >> 8);
+    for (int k = 0; k < 4; k++)
+        out[4 + k] = static_cast<unsigned char>((indices >> (8 * k)) & 0xFF);
+}
+
+// Endpoints that minimize the squared error for the current indices (least squares over the palette weights)
+bool bc1RefineEndpoints(const BC1Block& block, uint32_t indices, float first[3], float second[3])
+{
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }; // Weight of the first endpoint
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        float alpha = weights[(indices >> (2 * i)) & 3], beta = 1.0f - alpha;
+        float texel[3] = { block.r[i], block.g[i], block.b[i] };
+        aa += alpha * alpha;
+        ab += alpha * beta;
+        bb += beta * beta;
+        for (int c = 0; c < 3; c++)
+        {
+            ax[c] += alpha * texel[c];
+            bx[c] += beta * texel[c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < 3; c++)
+    {
+        first[c] = (bb * ax[c] - ab * bx[c]) / det;
+        second[c] = (aa * bx[c] - ab * ax[c]) / det;
+    }
+    return true;
+}
+
+// Encode one block: endpoints at the ends of the principal axis (slightly inset), then two least-squares refinements
+void encodeBC1Block(const BC1Block& block, unsigned char out[8])
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        mean[0] += block.r[i];
+        mean[1] += block.g[i];
+        mean[2] += block.b[i];
+    }
+    for (float& value : mean)
+        value /= 16.0f;
+
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++)
+    {
+        float r = block.r[i] - mean[0], g = block.g[i] - mean[1], b = block.b[i] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    // Power iteration for the principal axis
+    float axis[3] = { 0.9f, 1.0f, 0.7f };
+    for (int iteration = 0; iteration < 6; iteration++)
+    {
+        float next[3] =
+        {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        float longest = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+        if (longest < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / longest;
+    }
+
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float projection = (block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] + (block.b[i] - mean[2]) * axis[2];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float inset = (maxProjection - minProjection) / 16.0f;
+    float first[3], second[3];
+    for (int c = 0; c < 3; c++)
+    {
+        float scale = axisLengthSquared > 0.0f ? axis[c] / axisLengthSquared : 0.0f;
+        first[c] = mean[c] + (maxProjection - inset) * scale;
+        second[c] = mean[c] + (minProjection + inset) * scale;
+    }
+
+    float bestError = 1e30f;
+    bc1TryEndpoints(block, first, second, out, bestError);
+    for (int iteration = 0; iteration < 2 && bestError > 0.0f; iteration++)
+    {
+        uint32_t indices = static_cast<uint32_t>(out[4]) | (static_cast<uint32_t>(out[5]) << 8)
+            | (static_cast<uint32_t>(out[6]) << 16) | (static_cast<uint32_t>(out[7]) << 24);
+        uint16_t c0 = static_cast<uint16_t>(out[0] | (out[1] << 8)), c1 = static_cast<uint16_t>(out[2] | (out[3] << 8));
+        if (c0 == c1 || !bc1RefineEndpoints(block, indices, first, second))
+            break;
+        float previousError = bestError;
+        bc1TryEndpoints(block, first, second, out, bestError);
+        if (bestError >= previousError)
+            break;
+    }
+}
+
+// Compress an RGB8 image (rows top to bottom, any size) on the thread pool
+std::vector<unsigned char> compressBC1(const unsigned char* rgb, int width, int height)
+{
+    int blocksX = std::max((width + 3) / 4, 1), blocksY = std::max((height + 3) / 4, 1);
+    std::vector<unsigned char> result(static_cast<size_t>(blocksX) * blocksY * 8);
+    globalThreadPool().parallelFor(static_cast<size_t>(blocksY), 4, [&](size_t begin, size_t end)
+    {
+        BC1Block block;
+        for (size_t by = begin; by < end; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                // Texels past the edge repeat the last row or column
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(static_cast<int>(by) * 4 + (i >> 2), height - 1);
+                    const unsigned char* texel = rgb + (static_cast<size_t>(y) * width + x) * 3;
+                    block.r[i] = texel[0];
+                    block.g[i] = texel[1];
+                    block.b[i] = texel[2];
+                }
+                encodeBC1Block(block, &result[(by * blocksX + bx) * 8]);
+            }
+        }
+    });
+    return result;
+}
+
+// Decode a BC1 image back to RGB8 (four-colour blocks, as compressBC1 writes them)
+std::vector<unsigned char> decompressBC1(const unsigned char* blocks, int width, int height)
+{
+    std::vector<unsigned char> rgb(static_cast<size_t>(width) * height * 3);
+    int blocksX = std::max((width + 3) / 4, 1), blocksY = std::max((height + 3) / 4, 1);
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            const unsigned char* block = blocks + (static_cast<size_t>(by) * blocksX + bx) * 8;
+            uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8)), c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+            float palette[4][3];
+            bc1Palette(c0, c1, palette);
+            if (c0 <= c1)
+            {
+                // Three-colour mode: index 2 is the midpoint, 3 is black
+                for (int c = 0; c < 3; c++)
+                {
+                    palette[2][c] = std::floor((palette[0][c] + palette[1][c]) / 2.0f);
+                    palette[3][c] = 0.0f;
+                }
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                if (x >= width || y >= height)
+                    continue;
+                int index = (block[4 + i / 4] >> (2 * (i & 3))) & 3;
+                for (int c = 0; c < 3; c++)
+                    rgb[(static_cast<size_t>(y) * width + x) * 3 + c] = static_cast<unsigned char>(palette[index][c]);
+            }
+        }
+    }
+    return rgb;
+}
+
+// Next mip level of an RGB8 image (2x2 box filter, like glGenerateMipmap on a linear format)
+std::vector<unsigned char> downsampleRGB(const std::vector<unsigned char>& rgb, int width, int height, int& nextWidth, int& nextHeight)
+{
+    nextWidth = std::max(width / 2, 1);
+    nextHeight = std::max(height / 2, 1);
+    std::vector<unsigned char> result(static_cast<size_t>(nextWidth) * nextHeight * 3);
+    for (int y = 0; y < nextHeight; y++)
+    {
+        for (int x = 0; x < nextWidth; x++)
+        {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int c = 0; c < 3; c++)
+            {
+                int sum = rgb[(static_cast<size_t>(y0) * width + x0) * 3 + c] + rgb[(static_cast<size_t>(y0) * width + x1) * 3 + c]
+                    + rgb[(static_cast<size_t>(y1) * width + x0) * 3 + c] + rgb[(static_cast<size_t>(y1) * width + x1) * 3 + c];
+                result[(static_cast<size_t>(y) * nextWidth + x) * 3 + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+// Peak signal-to-noise ratio of two RGB8 images in dB
+double psnrRGB(const unsigned char* a, const unsigned char* b, size_t texels)
+{
+    double squaredSum = 0.0;
+    for (size_t i = 0; i < texels * 3; i++)
+    {
+        double difference = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+        squaredSum += difference * difference;
+    }
+    if (squaredSum == 0.0)
+        return 99.0;
+    return 10.0 * std::log10(255.0 * 255.0 * texels * 3 / squaredSum);
+}
+
+// KTX 1.1 cubemap: header, then per mip level its face size followed by the six faces (+X, -X, +Y, -Y, +Z, -Z)
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct KtxHeader
+{
+    uint32_t endianness = KTX_ENDIANNESS;
+    uint32_t glType = 0;
+    uint32_t glTypeSize = 1;
+    uint32_t glFormat = 0;
+    uint32_t glInternalFormat = 0;
+    uint32_t glBaseInternalFormat = 0;
+    uint32_t pixelWidth = 0;
+    uint32_t pixelHeight = 0;
+    uint32_t pixelDepth = 0;
+    uint32_t numberOfArrayElements = 0;
+    uint32_t numberOfFaces = 0;
+    uint32_t numberOfMipmapLevels = 0;
+    uint32_t bytesOfKeyValueData = 0;
+};
+
+// Key/value entry that ties a cubemap to the files it was compressed from, so a stale one can be told apart
+const char* KTX_SOURCE_KEY = "RTRSourceFiles";
+
+// Size and modification time of each source file, like the mesh cache's key, false if one is missing
+bool ktxSourceStamp(const std::vector<std::string>& sourcePaths, std::string& stamp)
+{
+    stamp.clear();
+    for (const std::string& path : sourcePaths)
+    {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
+        stamp += std::to_string(static_cast<uint64_t>(size)) + " " + std::to_string(static_cast<int64_t>(time.time_since_epoch().count())) + "\n";
+    }
+    return true;
+}
+
+// faces[face][level], every face with the same chain
+// A non-empty sourceStamp (from ktxSourceStamp) is stored under KTX_SOURCE_KEY
+bool writeKtxCubemap(const std::string& path, uint32_t internalFormat, uint32_t baseFormat, const std::vector<std::vector<CompressedLevel>>& faces,
+    const std::string& sourceStamp = std::string())
+{
+    if (faces.size() != 6 || faces[0].empty())
+        return false;
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    KtxHeader header;
+    header.glInternalFormat = internalFormat;
+    header.glBaseInternalFormat = baseFormat;
+    header.pixelWidth = static_cast<uint32_t>(faces[0][0].width);
+    header.pixelHeight = static_cast<uint32_t>(faces[0][0].height);
+    header.numberOfFaces = 6;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(faces[0].size());
+
+    // One key/value pair: its byte count, the key and the value (both with their terminating zero), padded to 4 bytes
+    uint32_t keyAndValueSize = static_cast<uint32_t>(std::strlen(KTX_SOURCE_KEY) + 1 + sourceStamp.size() + 1);
+    uint32_t keyValuePadding = (4 - keyAndValueSize % 4) % 4;
+    if (!sourceStamp.empty())
+        header.bytesOfKeyValueData = static_cast<uint32_t>(sizeof(keyAndValueSize)) + keyAndValueSize + keyValuePadding;
+    file.write(reinterpret_cast<const char*>(KTX_IDENTIFIER), sizeof(KTX_IDENTIFIER));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    static const char padding[4] = { 0, 0, 0, 0 };
+    if (!sourceStamp.empty())
+    {
+        file.write(reinterpret_cast<const char*>(&keyAndValueSize), sizeof(keyAndValueSize));
+        file.write(KTX_SOURCE_KEY, std::strlen(KTX_SOURCE_KEY) + 1);
+        file.write(sourceStamp.c_str(), sourceStamp.size() + 1);
+        file.write(padding, keyValuePadding);
+    }
+    for (size_t level = 0; level < faces[0].size(); level++)
+    {
+        uint32_t imageSize = static_cast<uint32_t>(faces[0][level].data.size());
+        file.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+        for (const auto& face : faces)
+        {
+            file.write(reinterpret_cast<const char*>(face[level].data.data()), face[level].data.size());
+            file.write(padding, (4 - face[level].data.size() % 4) % 4); // Cube padding
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// Value of a key/value entry of a mapped KTX file (up to its terminating zero), false if the file has none
+bool readKtxKeyValue(const MappedFile& file, const char* key, std::string& value)
+{
+    KtxHeader header;
+    if (!file.isOpen() || file.size() < sizeof(KTX_IDENTIFIER) + sizeof(header)
+        || std::memcmp(file.data(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+        return false;
+    std::memcpy(&header, file.data() + sizeof(KTX_IDENTIFIER), sizeof(header));
+    size_t offset = sizeof(KTX_IDENTIFIER) + sizeof(header);
+    size_t end = offset + header.bytesOfKeyValueData;
+    if (header.endianness != KTX_ENDIANNESS || end > file.size())
+        return false;
+
+    size_t keyLength = std::strlen(key);
+    while (offset + sizeof(uint32_t) <= end)
+    {
+        uint32_t keyAndValueSize;
+        std::memcpy(&keyAndValueSize, file.data() + offset, sizeof(keyAndValueSize));
+        offset += sizeof(keyAndValueSize);
+        if (keyAndValueSize > end - offset)
+            return false;
+        const char* entry = reinterpret_cast<const char*>(file.data() + offset);
+        if (keyAndValueSize > keyLength && std::memcmp(entry, key, keyLength + 1) == 0)
+        {
+            const char* begin = entry + keyLength + 1;
+            value.assign(begin, std::find(begin, entry + keyAndValueSize, '\0'));
+            return true;
+        }
+        offset += (static_cast<size_t>(keyAndValueSize) + 3) & ~static_cast<size_t>(3);
+    }
+    return false;
+}
+
+// Copy one face's mip chain out of a mapped KTX cubemap, false if the file isn't one
+bool readKtxCubemapFace(const MappedFile& file, int face, uint32_t& internalFormat, std::vector<CompressedLevel>& levels)
+{
+    KtxHeader header;
+    if (!file.isOpen() || file.size() < sizeof(KTX_IDENTIFIER) + sizeof(header)
+        || std::memcmp(file.data(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+        return false;
+    std::memcpy(&header, file.data() + sizeof(KTX_IDENTIFIER), sizeof(header));
+    if (header.endianness != KTX_ENDIANNESS || header.numberOfFaces != 6 || header.numberOfArrayElements != 0 || header.glType != 0)
+        return false;
+
+    internalFormat = header.glInternalFormat;
+    levels.clear();
+    size_t offset = sizeof(KTX_IDENTIFIER) + sizeof(header) + header.bytesOfKeyValueData;
+    int width = static_cast<int>(header.pixelWidth), height = static_cast<int>(header.pixelHeight);
+    for (uint32_t level = 0; level < std::max(header.numberOfMipmapLevels, 1u); level++)
+    {
+        uint32_t imageSize;
+        if (offset + sizeof(imageSize) > file.size())
+            return false;
+        std::memcpy(&imageSize, file.data() + offset, sizeof(imageSize));
+        size_t paddedSize = (static_cast<size_t>(imageSize) + 3) & ~static_cast<size_t>(3);
+        offset += sizeof(imageSize);
+        if (offset + paddedSize * 6 > file.size())
+            return false;
+
+        CompressedLevel compressed;
+        compressed.width = width;
+        compressed.height = height;
+        const unsigned char* begin = file.data() + offset + paddedSize * face;
+        compressed.data.assign(begin, begin + imageSize);
+        levels.push_back(std::move(compressed));
+
+        offset += paddedSize * 6;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return true;
+}
+
+#endif // MY_TEXTURE_COMPRESSION_H
@@ -0,0 +1,155 @@
+#ifndef MY_THREAD_POOL_H
+#define MY_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size worker pool shared by the CPU-side asset pipelines
+class ThreadPool
+{
+public:
+    // Constructor (0 threads = one per hardware core)
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    // Queue a task, the returned future holds its result
+    template<typename F>
+    auto submit(F&& task) -> std::future<decltype(task())>
+    {
+        using ResultType = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<ResultType()>>(std::forward<F>(task));
+        std::future<ResultType> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.emplace([packaged]() { (*packaged)(); });
+        }
+        queueCondition.notify_one();
+        return result;
+    }
+
+    // Run body(begin, end) over [0, count) in chunks of grain items
+    // The calling thread works through chunks too, so this is safe to call from inside a pool task
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+    {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(1, grain);
+        size_t chunkCount = (count + grain - 1) / grain;
+        if (chunkCount == 1 || workers.empty())
+        {
+            body(0, count);
+            return;
+        }
+
+        // Shared state outlives this call in case a helper starts after all chunks are done
+        struct ForState
+        {
+            std::function<void(size_t, size_t)> body;
+            size_t count, grain, chunkCount;
+            std::atomic<size_t> nextChunk{ 0 };
+            std::atomic<size_t> doneChunks{ 0 };
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+        };
+        auto state = std::make_shared<ForState>();
+        state->body = body;
+        state->count = count;
+        state->grain = grain;
+        state->chunkCount = chunkCount;
+
+        auto runChunks = [state]()
+        {
+            size_t chunk;
+            while ((chunk = state->nextChunk.fetch_add(1)) < state->chunkCount)
+            {
+                size_t begin = chunk * state->grain;
+                size_t end = std::min(state->count, begin + state->grain);
+                state->body(begin, end);
+                if (state->doneChunks.fetch_add(1) + 1 == state->chunkCount)
+                {
+                    std::lock_guard<std::mutex> lock(state->doneMutex);
+                    state->doneCondition.notify_all();
+                }
+            }
+        };
+
+        size_t helperCount = std::min<size_t>(workers.size(), chunkCount - 1);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            for (size_t i = 0; i < helperCount; i++)
+                tasks.emplace(runChunks);
+        }
+        queueCondition.notify_all();
+
+        // Help out, then wait for chunks claimed by other threads
+        runChunks();
+        std::unique_lock<std::mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&]() { return state->doneChunks.load() == state->chunkCount; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+// Process-wide pool, created on first use
+ThreadPool& globalThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif // MY_THREAD_POOL_H
@@ -0,0 +1,185 @@
+#ifndef MY_UPLOAD_THREAD_H
+#define MY_UPLOAD_THREAD_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Completion of one upload job, polled on the render thread
+class UploadFence
+{
+public:
+    // The job has run and the GPU has finished its commands (never blocks)
+    bool signaled()
+    {
+        if (done)
+            return true;
+        if (!submitted.load(std::memory_order_acquire))
+            return false;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+        glDeleteSync(fence);
+        fence = nullptr;
+        done = true;
+        return true;
+    }
+
+    // Block until signaled (for things the first frame can't do without)
+    void wait()
+    {
+        while (!done && !submitted.load(std::memory_order_acquire))
+            std::this_thread::yield();
+        if (!done)
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        signaled();
+    }
+
+private:
+    friend class UploadThread;
+    std::atomic<bool> submitted{ false };
+    GLsync fence = nullptr;
+    bool done = false;
+};
+
+// One thread with its own GL context, shared with the window's, that runs upload jobs (buffer and texture data)
+// so the render thread never blocks on them. Each job is followed by a fence, and whatever it filled may be
+// used on the render thread once that fence has signaled (objects must be bound again after that)
+// Without a shared context, jobs run on the calling thread instead
+class UploadThread
+{
+public:
+    ~UploadThread()
+    {
+        stop();
+    }
+
+    // Create the hidden upload context next to mainWindow and start the thread (main thread, mainWindow current)
+    bool start(GLFWwindow* mainWindow)
+    {
+        if (worker.joinable())
+            return true;
+
+        // Same context hints as the window, only hidden
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        uploadWindow = glfwCreateWindow(1, 1, "Upload", nullptr, mainWindow);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (!uploadWindow)
+        {
+            std::cerr << "ERROR::UPLOAD_THREAD:: Could not create a shared context, uploads stay on the render thread" << std::endl;
+            return false;
+        }
+
+        stopping = false;
+        worker = std::thread([this]() { run(); });
+        std::cout << "Upload thread started (shared GL context)\n";
+        return true;
+    }
+
+    // Finish the job in progress, drop the queued ones and destroy the upload context (main thread)
+    void stop()
+    {
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                jobs.clear();
+            }
+            wake.notify_one();
+            worker.join();
+        }
+        if (uploadWindow)
+        {
+            glfwDestroyWindow(uploadWindow);
+            uploadWindow = nullptr;
+        }
+    }
+
+    bool running() const
+    {
+        return worker.joinable();
+    }
+
+    // Jobs queued or running
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs.size() + (busy ? 1 : 0);
+    }
+
+    // Run job with the upload context current, the returned fence signals once its GL commands have completed
+    std::shared_ptr<UploadFence> submit(std::function<void()> job)
+    {
+        auto fence = std::make_shared<UploadFence>();
+        if (!running())
+        {
+            job();
+            publish(*fence);
+            return fence;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back(std::move(job), fence);
+        }
+        wake.notify_one();
+        return fence;
+    }
+
+private:
+    GLFWwindow* uploadWindow = nullptr;
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::pair<std::function<void()>, std::shared_ptr<UploadFence>>> jobs;
+    bool stopping = false;
+    bool busy = false;
+
+    static void publish(UploadFence& fence)
+    {
+        fence.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush(); // The fence must reach the GPU before another context waits on it
+        fence.submitted.store(true, std::memory_order_release);
+    }
+
+    void run()
+    {
+        glfwMakeContextCurrent(uploadWindow);
+        while (true)
+        {
+            std::pair<std::function<void()>, std::shared_ptr<UploadFence>> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                busy = false;
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping)
+                    break;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                busy = true;
+            }
+            job.first();
+            publish(*job.second);
+            // GL objects the job captured are released here, with the context still current
+        }
+        glfwMakeContextCurrent(nullptr);
+    }
+};
+
+// Shared upload thread (started by main once the window exists)
+UploadThread& globalUploadThread()
+{
+    static UploadThread uploadThread;
+    return uploadThread;
+}
+
+#endif // MY_UPLOAD_THREAD_H
@@ -0,0 +1,207 @@
+#ifndef MY_VERTEX_PACKING_H
+#define MY_VERTEX_PACKING_H
+
+#include <glm/glm.hpp>
+
+#include <my_mesh_data.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Vertex layouts Mesh can upload, chosen at load time
+enum class VertexFormat
+{
+    Float,  // Vertex as is: float3 position, float3 normal, float d_N, float3 d_N gradient, float2 texcoords (48 bytes) + 32-bit indices
+    Packed  // PackedVertex (24 bytes) + 16-bit indices below 65536 vertices
+};
+
+// Compact vertex, decoded in the vertex shaders
+struct PackedVertex
+{
+    uint16_t position[4];   // unorm16 in the mesh bounds (w unused), dequantized with positionScale/positionOffset
+    int16_t normal[2];      // Octahedral snorm16
+    uint16_t thickness[4];  // Half floats: d_N, then its gradient, read as one attribute at a 4-byte aligned offset
+    uint16_t texCoords[2];  // unorm16 (surface map atlases stay inside [0, 1])
+};
+
+// Packed copy of one mesh, built right before upload (the mesh cache stays in the float layout)
+struct PackedMeshData
+{
+    std::vector<PackedVertex> vertices;
+    std::vector<uint16_t> shortIndices; // Empty if the mesh needs 32-bit indices
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+};
+
+uint16_t packUnorm16(float value)
+{
+    return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+int16_t packSnorm16(float value)
+{
+    return static_cast<int16_t>(std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+}
+
+// IEEE half from float, round to nearest even
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    // NaN / infinity
+    if (exponent == 0xFFu)
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+
+    int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7C00u);
+
+    // Subnormal or zero
+    if (halfExponent <= 0)
+    {
+        if (halfExponent < -10)
+            return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (remainder > halfway || (remainder == halfway && (half & 1u)))
+            half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+        half++; // May carry into the exponent, which is still the correctly rounded result
+    return static_cast<uint16_t>(half);
+}
+
+float halfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Renormalize the subnormal
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400u))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+        }
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Unit vector to the [-1, 1]^2 octahedral square (decoded by octDecode in the shaders)
+glm::vec2 octEncode(glm::vec3 n)
+{
+    float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (length <= 0.0f)
+        return glm::vec2(0.0f);
+    n /= length;
+
+    glm::vec2 p(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        p = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return p;
+}
+
+glm::vec3 octDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+    return glm::normalize(n);
+}
+
+// Dequantization for a mesh: unorm16 decodes to [0, 1], so the scale is the bounds extent
+void computePackingTransform(const Vertex* vertices, size_t vertexCount, glm::vec3& positionScale, glm::vec3& positionOffset)
+{
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+    if (vertexCount == 0)
+        boundsMin = boundsMax = glm::vec3(0.0f);
+
+    positionScale = boundsMax - boundsMin;
+    positionOffset = boundsMin;
+}
+
+PackedVertex packVertex(const Vertex& vertex, const glm::vec3& positionScale, const glm::vec3& positionOffset)
+{
+    PackedVertex out;
+    for (int k = 0; k < 3; k++)
+        out.position[k] = positionScale[k] > 0.0f ? packUnorm16((vertex.Position[k] - positionOffset[k]) / positionScale[k]) : 0;
+    out.position[3] = 0;
+
+    glm::vec2 oct = octEncode(vertex.Normal);
+    out.normal[0] = packSnorm16(oct.x);
+    out.normal[1] = packSnorm16(oct.y);
+    out.thickness[0] = floatToHalf(vertex.d_N);
+    for (int k = 0; k < 3; k++)
+        out.thickness[k + 1] = floatToHalf(vertex.d_NGradient[k]);
+    out.texCoords[0] = packUnorm16(vertex.TexCoords.x);
+    out.texCoords[1] = packUnorm16(vertex.TexCoords.y);
+    return out;
+}
+
+// Packed meshes this small index their vertices with 16 bits
+bool usesShortIndices(size_t vertexCount)
+{
+    return vertexCount <= 65536;
+}
+
+// Quantize a mesh into the packed layout
+PackedMeshData packMeshData(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+    PackedMeshData packed;
+    computePackingTransform(vertices, vertexCount, packed.positionScale, packed.positionOffset);
+
+    packed.vertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        packed.vertices[i] = packVertex(vertices[i], packed.positionScale, packed.positionOffset);
+
+    if (usesShortIndices(vertexCount))
+        packed.shortIndices.assign(indices, indices + indexCount);
+    return packed;
+}
+
+#endif // MY_VERTEX_PACKING_H
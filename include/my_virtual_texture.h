@@ -0,0 +1,705 @@
+#ifndef MY_VIRTUAL_TEXTURE_H
+#define MY_VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <my_gl_resource.h>
+#include <my_mapped_file.h>
+#include <my_upload_thread.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Virtual-textured environments, for cube faces far larger than VRAM allows (8K a face and up)
+// The faces and their mips are cut into tiles in a tile file (written by tools/build_virtual_environment.cpp) that
+// stays memory-mapped. The skybox and refraction shaders write the tile each fragment wanted to a second render
+// target, VirtualFeedback reads a sparse sample of it back a few frames later, and VirtualEnvironment streams the
+// missing tiles from the mapping into a fixed cache texture on the upload thread. An indirection table (one texel
+// per tile, a 2D array layer per face and a mip per level) points every tile at its slot in the cache, or at the
+// closest resident ancestor while it streams in. Each face's coarsest tile is always resident
+
+const uint32_t VIRTUAL_TILE_MAGIC = 0x58544556; // "VETX"
+const char* VIRTUAL_TILE_FILE = "environment.vtex";
+const int VIRTUAL_TILE_BORDER = 1; // Texels copied from the neighbouring tiles, so bilinear lookups stay inside a slot
+
+struct VirtualTileHeader
+{
+    uint32_t magic = VIRTUAL_TILE_MAGIC;
+    uint32_t faceSize = 0;       // Level 0 texels a side, the tile size times a power of two
+    uint32_t tileSize = 0;       // Texels a side a tile covers, stored with VIRTUAL_TILE_BORDER around them
+    uint32_t levels = 0;         // Down to one tile a face
+    uint32_t internalFormat = 0; // GL_RGBA8, GL_RGB9_E5 or GL_R11F_G11F_B10F, 4 bytes a texel either way
+};
+
+uint32_t virtualTilesPerSide(uint32_t faceSize, uint32_t tileSize, uint32_t level)
+{
+    return std::max((faceSize / tileSize) >> level, 1u);
+}
+
+// Tiles of one face over all levels, the file holds face after face, each level after level, rows of tiles
+size_t virtualTilesPerFace(uint32_t faceSize, uint32_t tileSize, uint32_t levels)
+{
+    size_t tiles = 0;
+    for (uint32_t level = 0; level < levels; level++)
+        tiles += static_cast<size_t>(virtualTilesPerSide(faceSize, tileSize, level)) * virtualTilesPerSide(faceSize, tileSize, level);
+    return tiles;
+}
+
+// Tile key used on the CPU side: face in bits 0-2, level in 3-7, tile x in 8-19 and tile y in 20-31
+uint32_t virtualTileKey(uint32_t face, uint32_t level, uint32_t x, uint32_t y)
+{
+    return face | (level << 3) | (x << 8) | (y << 20);
+}
+
+void virtualTileFromKey(uint32_t key, uint32_t& face, uint32_t& level, uint32_t& x, uint32_t& y)
+{
+    face = key & 7;
+    level = (key >> 3) & 31;
+    x = (key >> 8) & 4095;
+    y = key >> 20;
+}
+
+// Write a tile file, tile(face, level, x, y, texels) fills one bordered tile of 4-byte texels
+bool writeVirtualTileFile(const std::string& path, const VirtualTileHeader& header,
+    const std::function<void(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t*)>& tile)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint32_t slotSize = header.tileSize + 2 * VIRTUAL_TILE_BORDER;
+    std::vector<uint32_t> texels(static_cast<size_t>(slotSize) * slotSize);
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            uint32_t tiles = virtualTilesPerSide(header.faceSize, header.tileSize, level);
+            for (uint32_t y = 0; y < tiles; y++)
+            {
+                for (uint32_t x = 0; x < tiles; x++)
+                {
+                    tile(face, level, x, y, texels.data());
+                    file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(uint32_t));
+                }
+            }
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// A mapped tile file
+class VirtualTileFile
+{
+public:
+    // Map and check the file, false if it isn't a complete tile file
+    bool open(const std::string& path)
+    {
+        if (!file.open(path) || file.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != VIRTUAL_TILE_MAGIC || header.tileSize == 0 || header.levels == 0 || header.levels > 16
+            || header.faceSize % header.tileSize != 0 || (header.faceSize >> (header.levels - 1)) != header.tileSize
+            || header.faceSize / header.tileSize > 256)
+            return false;
+        levelOffsets.clear();
+        size_t offset = 0;
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            levelOffsets.push_back(offset);
+            offset += static_cast<size_t>(tilesPerSide(level)) * tilesPerSide(level);
+        }
+        return file.size() >= sizeof(header) + 6 * tilesPerFace() * tileBytes();
+    }
+
+    const VirtualTileHeader& info() const
+    {
+        return header;
+    }
+
+    uint32_t tilesPerSide(uint32_t level) const
+    {
+        return virtualTilesPerSide(header.faceSize, header.tileSize, level);
+    }
+
+    size_t tilesPerFace() const
+    {
+        return virtualTilesPerFace(header.faceSize, header.tileSize, header.levels);
+    }
+
+    uint32_t slotSize() const
+    {
+        return header.tileSize + 2 * VIRTUAL_TILE_BORDER;
+    }
+
+    size_t tileBytes() const
+    {
+        return static_cast<size_t>(slotSize()) * slotSize() * 4;
+    }
+
+    const unsigned char* tile(uint32_t face, uint32_t level, uint32_t x, uint32_t y) const
+    {
+        size_t index = face * tilesPerFace() + levelOffsets[level] + static_cast<size_t>(y) * tilesPerSide(level) + x;
+        return file.data() + sizeof(header) + index * tileBytes();
+    }
+
+    // Drop a tile's pages once uploaded, so the process keeps only what is streaming in
+    void release(const unsigned char* tileData) const
+    {
+        file.evict(tileData, tileBytes());
+    }
+
+private:
+    MappedFile file;
+    VirtualTileHeader header;
+    std::vector<size_t> levelOffsets; // In tiles, within a face
+};
+
+// Where a virtual environment's memory goes
+struct VirtualEnvironmentStats
+{
+    size_t residentTiles = 0;
+    size_t cacheSlots = 0;
+    size_t requestedTiles = 0;  // Distinct tiles in the last feedback
+    size_t streamedTiles = 0;   // Since it was opened
+    size_t residentBytes = 0;   // Tiles in the cache
+    size_t gpuBytes = 0;        // Cache texture and indirection table, fixed
+    size_t sourceBytes = 0;     // The whole mip chain, as a plain cubemap upload would take
+};
+
+// Tiles of one tile file streamed on demand into a cache texture of cacheSlotsPerSide^2 slots (render thread)
+class VirtualEnvironment
+{
+public:
+    static const int MAX_UPLOADS_PER_FRAME = 32;
+
+    VirtualEnvironment() = default;
+    VirtualEnvironment(const VirtualEnvironment&) = delete;
+    VirtualEnvironment& operator=(const VirtualEnvironment&) = delete;
+
+    // Map the tile file, create the indirection table and queue the coarsest tiles
+    bool open(const std::string& path, int cacheSlotsPerSide)
+    {
+        auto tileFile = std::make_shared<VirtualTileFile>();
+        if (!tileFile->open(path))
+            return false;
+        file = tileFile;
+        const VirtualTileHeader& header = file->info();
+        int minimumSlots = 1;
+        while (minimumSlots * minimumSlots < 6 + MAX_UPLOADS_PER_FRAME)
+            minimumSlots++;
+        slotsPerSide = std::min(std::max(cacheSlotsPerSide, minimumSlots), 255);
+        slots.assign(static_cast<size_t>(slotsPerSide) * slotsPerSide, Slot());
+        residentSlots.clear();
+
+        // Indirection: RGBA8UI, slot x and y, the level the slot holds, 255 once it points anywhere
+        indirection = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, indirection.id());
+        indirectionLevels.clear();
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            GLsizei tiles = static_cast<GLsizei>(file->tilesPerSide(level));
+            indirectionLevels.emplace_back(static_cast<size_t>(tiles) * tiles * 6 * 4, 0);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8UI, tiles, tiles, 6, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(header.levels) - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // The cache's storage is made by the first upload job, so the upload context never sees it before it exists
+        cache = GLTexture::create();
+        std::vector<uint32_t> pinned;
+        for (uint32_t face = 0; face < 6; face++)
+            pinned.push_back(virtualTileKey(face, header.levels - 1, 0, 0));
+        stream(pinned, true);
+        return true;
+    }
+
+    // The coarsest tiles are in, so every lookup lands somewhere (never blocks)
+    bool ready()
+    {
+        retire();
+        return firstFence && firstFence->signaled();
+    }
+
+    void wait()
+    {
+        firstFence->wait();
+        retire();
+    }
+
+    // One frame's feedback: mark what was asked for as used, stream in what's missing (coarsest first)
+    // and update the indirection table for whatever arrived
+    void update(const std::vector<uint32_t>& requests)
+    {
+        frame++;
+        retire();
+        stats.requestedTiles = requests.size();
+        const VirtualTileHeader& header = file->info();
+        std::vector<uint32_t> missing;
+        for (uint32_t key : requests)
+        {
+            uint32_t face, level, x, y;
+            virtualTileFromKey(key, face, level, x, y);
+            if (face >= 6 || level >= header.levels || x >= file->tilesPerSide(level) || y >= file->tilesPerSide(level))
+                continue;
+
+            // The tile and the ancestors it falls back to stay in the cache while they're seen
+            bool resident = true;
+            for (uint32_t ancestor = level; ancestor < header.levels; ancestor++)
+            {
+                auto slot = residentSlots.find(virtualTileKey(face, ancestor, x >> (ancestor - level), y >> (ancestor - level)));
+                if (slot != residentSlots.end())
+                    slots[slot->second].lastUsed = frame;
+                else if (ancestor == level)
+                    resident = false;
+            }
+            if (!resident)
+                missing.push_back(key);
+        }
+
+        std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return ((a >> 3) & 31) > ((b >> 3) & 31); });
+        if (missing.size() > MAX_UPLOADS_PER_FRAME)
+            missing.resize(MAX_UPLOADS_PER_FRAME);
+        stream(missing, false);
+    }
+
+    // Frames fed so far (the shaders use it to alternate which lookup a fragment requests)
+    uint64_t frameIndex() const
+    {
+        return frame;
+    }
+
+    GLuint cacheId() const
+    {
+        return cache.id();
+    }
+
+    GLuint indirectionId() const
+    {
+        return indirection.id();
+    }
+
+    const VirtualTileHeader& info() const
+    {
+        return file->info();
+    }
+
+    bool hdr() const
+    {
+        return file->info().internalFormat != GL_RGBA8;
+    }
+
+    VirtualEnvironmentStats statistics() const
+    {
+        VirtualEnvironmentStats result = stats;
+        const VirtualTileHeader& header = file->info();
+        result.cacheSlots = slots.size();
+        result.residentTiles = 0;
+        for (const Slot& slot : slots)
+            if (slot.key != EMPTY_SLOT && !slot.loading)
+                result.residentTiles++;
+        result.residentBytes = result.residentTiles * file->tileBytes();
+        result.gpuBytes = slots.size() * file->tileBytes();
+        for (const std::vector<unsigned char>& level : indirectionLevels)
+            result.gpuBytes += level.size();
+        result.sourceBytes = 0;
+        for (uint32_t level = 0; level < header.levels; level++)
+            result.sourceBytes += 6 * static_cast<size_t>(header.faceSize >> level) * (header.faceSize >> level) * 4;
+        return result;
+    }
+
+    void reset()
+    {
+        cache.reset();
+        indirection.reset();
+        pending.clear();
+        firstFence.reset();
+        slots.clear();
+        residentSlots.clear();
+        indirectionLevels.clear();
+        file.reset();
+    }
+
+private:
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+    struct Slot
+    {
+        uint32_t key = EMPTY_SLOT;
+        uint64_t lastUsed = 0;
+        bool pinned = false;
+        bool loading = false; // Its upload's fence hasn't signaled, so nothing points at it yet
+    };
+
+    struct Batch
+    {
+        std::shared_ptr<UploadFence> fence;
+        std::vector<int> slots;
+    };
+
+    std::shared_ptr<VirtualTileFile> file;
+    GLTexture cache;
+    GLTexture indirection;
+    int slotsPerSide = 0;
+    std::vector<Slot> slots;
+    std::unordered_map<uint32_t, int> residentSlots; // Tile key to slot, loading or resident
+    std::vector<std::vector<unsigned char>> indirectionLevels;
+    std::deque<Batch> pending;
+    std::shared_ptr<UploadFence> firstFence;
+    uint64_t frame = 0;
+    VirtualEnvironmentStats stats;
+
+    // Least recently used slot not seen this frame, -1 if every slot is in use
+    int evictableSlot() const
+    {
+        int best = -1;
+        for (int i = 0; i < static_cast<int>(slots.size()); i++)
+        {
+            const Slot& slot = slots[i];
+            if (slot.key == EMPTY_SLOT)
+                return i;
+            if (slot.pinned || slot.loading || slot.lastUsed >= frame)
+                continue;
+            if (best < 0 || slot.lastUsed < slots[best].lastUsed)
+                best = i;
+        }
+        return best;
+    }
+
+    // Give the tiles slots (evicting the least recently used) and queue one upload job for all of them
+    void stream(const std::vector<uint32_t>& keys, bool first)
+    {
+        std::vector<std::pair<int, const unsigned char*>> uploads;
+        Batch batch;
+        bool evicted = false;
+        for (uint32_t key : keys)
+        {
+            int slot = evictableSlot();
+            if (slot < 0)
+                break;
+            if (slots[slot].key != EMPTY_SLOT)
+            {
+                residentSlots.erase(slots[slot].key);
+                evicted = true;
+            }
+            uint32_t face, level, x, y;
+            virtualTileFromKey(key, face, level, x, y);
+            slots[slot].key = key;
+            slots[slot].lastUsed = frame;
+            slots[slot].pinned = first;
+            slots[slot].loading = true;
+            residentSlots[key] = slot;
+            uploads.emplace_back(slot, file->tile(face, level, x, y));
+            batch.slots.push_back(slot);
+        }
+        // Point the evicted tiles' regions at their ancestors before anything is written over them, and fence the
+        // draws already issued that may still sample the old tiles: the upload context waits on it before writing
+        GLsync drawn = nullptr;
+        if (evicted)
+        {
+            updateIndirection();
+            if (!uploads.empty())
+            {
+                drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                glFlush(); // The fence must reach the GPU before another context waits on it
+            }
+        }
+        if (uploads.empty())
+            return;
+
+        GLuint id = cache.id();
+        auto tileFile = file;
+        GLint slotSize = static_cast<GLint>(file->slotSize());
+        GLint side = slotsPerSide;
+        GLenum internalFormat = file->info().internalFormat;
+        batch.fence = globalUploadThread().submit([id, tileFile, uploads, slotSize, side, internalFormat, first, drawn]()
+        {
+            if (drawn)
+            {
+                glWaitSync(drawn, 0, GL_TIMEOUT_IGNORED);
+                glDeleteSync(drawn);
+            }
+            GLenum format = internalFormat == GL_RGBA8 ? GL_RGBA : GL_RGB;
+            GLenum type = internalFormat == GL_RGB9_E5 ? GL_UNSIGNED_INT_5_9_9_9_REV
+                : (internalFormat == GL_R11F_G11F_B10F ? GL_UNSIGNED_INT_10F_11F_11F_REV : GL_UNSIGNED_BYTE);
+            glBindTexture(GL_TEXTURE_2D, id);
+            if (first)
+            {
+                glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, side * slotSize, side * slotSize, 0, format, type, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            for (const auto& upload : uploads)
+            {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, (upload.first % side) * slotSize, (upload.first / side) * slotSize, slotSize, slotSize,
+                    format, type, upload.second);
+                tileFile->release(upload.second);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+        });
+        if (first)
+            firstFence = batch.fence;
+        stats.streamedTiles += uploads.size();
+        pending.push_back(std::move(batch));
+    }
+
+    // Batches whose fence has signaled become resident, in submission order
+    void retire()
+    {
+        bool arrived = false;
+        while (!pending.empty() && pending.front().fence->signaled())
+        {
+            for (int slot : pending.front().slots)
+                slots[slot].loading = false;
+            pending.pop_front();
+            arrived = true;
+        }
+        if (arrived)
+            updateIndirection();
+    }
+
+    // Rebuild every level, coarsest first, so each tile inherits its parent's entry unless it is resident itself
+    void updateIndirection()
+    {
+        const VirtualTileHeader& header = file->info();
+        for (int level = static_cast<int>(header.levels) - 1; level >= 0; level--)
+        {
+            uint32_t tiles = file->tilesPerSide(level);
+            std::vector<unsigned char>& entries = indirectionLevels[level];
+            for (uint32_t face = 0; face < 6; face++)
+            {
+                for (uint32_t y = 0; y < tiles; y++)
+                {
+                    for (uint32_t x = 0; x < tiles; x++)
+                    {
+                        unsigned char* entry = &entries[((face * tiles + y) * tiles + x) * 4];
+                        auto slot = residentSlots.find(virtualTileKey(face, level, x, y));
+                        if (slot != residentSlots.end() && !slots[slot->second].loading)
+                        {
+                            entry[0] = static_cast<unsigned char>(slot->second % slotsPerSide);
+                            entry[1] = static_cast<unsigned char>(slot->second / slotsPerSide);
+                            entry[2] = static_cast<unsigned char>(level);
+                            entry[3] = 255;
+                        }
+                        else if (level + 1 < static_cast<int>(header.levels))
+                        {
+                            uint32_t parentTiles = file->tilesPerSide(level + 1);
+                            const unsigned char* parent = &indirectionLevels[level + 1][((face * parentTiles + y / 2) * parentTiles + x / 2) * 4];
+                            std::copy(parent, parent + 4, entry);
+                        }
+                        else
+                            std::fill(entry, entry + 4, 0);
+                    }
+                }
+            }
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, indirection.id());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            GLsizei tiles = static_cast<GLsizei>(file->tilesPerSide(level));
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, tiles, tiles, 6, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirectionLevels[level].data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+};
+
+// The scene rendered offscreen with a second target the shaders write their tile requests to. Every frame the
+// requests are sampled down by FEEDBACK_SCALE in each direction (a jittered pixel of each block, so every pixel
+// is seen over FEEDBACK_SCALE^2 frames) and read back through a ring of pixel buffers, mapped once their fence
+// has signaled so the render thread never waits
+class VirtualFeedback
+{
+public:
+    static const int FEEDBACK_SCALE = 8;
+    static const int READBACK_COUNT = 3;
+
+    ~VirtualFeedback()
+    {
+        reset();
+    }
+
+    // Render the frame into the scene framebuffer, (re)created at width x height
+    void begin(int width, int height)
+    {
+        if (width != sceneWidth || height != sceneHeight)
+            create(width, height);
+        active = true;
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.id());
+        GLfloat colour[4], depth = 1.0f;
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, colour); // Same as the window's
+        static const GLuint noRequest[4] = { 0, 0, 0, 0 };
+        glClearBufferfv(GL_COLOR, 0, colour);
+        glClearBufferuiv(GL_COLOR, 1, noRequest);
+        glClearBufferfv(GL_DEPTH, 0, &depth);
+    }
+
+    // The framebuffer passes draw to, 0 (the window) when not active
+    GLuint framebuffer() const
+    {
+        return active ? scene.id() : 0;
+    }
+
+    // Show the frame, start this frame's readback and collect the distinct requests of one that has arrived
+    void end(std::vector<uint32_t>& requests)
+    {
+        requests.clear();
+        if (!active)
+            return;
+        active = false;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scene.id());
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, sceneWidth, sceneHeight, 0, 0, sceneWidth, sceneHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        // One pixel of every block, a different one each frame
+        int jitterX = (frame * 5) % FEEDBACK_SCALE, jitterY = (frame * 3 + frame / FEEDBACK_SCALE) % FEEDBACK_SCALE;
+        frame++;
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sample.id());
+        glBlitFramebuffer(jitterX, jitterY, jitterX + sampleWidth * FEEDBACK_SCALE, jitterY + sampleHeight * FEEDBACK_SCALE,
+            0, 0, sampleWidth, sampleHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        // Collect the oldest readback if it has landed, then reuse its buffer for this frame's
+        Readback& readback = readbacks[next];
+        if (readback.fence)
+        {
+            GLenum status = glClientWaitSync(readback.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                return; // Still in flight: skip this frame's readback
+            }
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            collect(readback, requests);
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sample.id());
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer.id());
+        glReadPixels(0, 0, sampleWidth, sampleHeight, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % READBACK_COUNT;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void reset()
+    {
+        for (Readback& readback : readbacks)
+        {
+            if (readback.fence)
+                glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            readback.buffer.reset();
+        }
+        scene.reset();
+        sample.reset();
+        sceneColour.reset();
+        sceneRequests.reset();
+        sceneDepth.reset();
+        sampleRequests.reset();
+        sceneWidth = sceneHeight = 0;
+        active = false;
+    }
+
+private:
+    struct Readback
+    {
+        GLBuffer buffer;
+        GLsync fence = nullptr;
+    };
+
+    GLFramebuffer scene, sample;
+    GLTexture sceneColour, sceneRequests, sceneDepth, sampleRequests;
+    Readback readbacks[READBACK_COUNT];
+    int sceneWidth = 0, sceneHeight = 0;
+    int sampleWidth = 0, sampleHeight = 0;
+    int next = 0;
+    int frame = 0;
+    bool active = false;
+
+    static GLTexture createTarget(GLenum internalFormat, int width, int height, GLenum format, GLenum type)
+    {
+        GLTexture texture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, texture.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void create(int width, int height)
+    {
+        reset();
+        sceneWidth = width;
+        sceneHeight = height;
+        sampleWidth = std::max((width - FEEDBACK_SCALE + 1) / FEEDBACK_SCALE, 1);
+        sampleHeight = std::max((height - FEEDBACK_SCALE + 1) / FEEDBACK_SCALE, 1);
+
+        sceneColour = createTarget(GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE);
+        sceneRequests = createTarget(GL_RGBA8UI, width, height, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE);
+        sceneDepth = createTarget(GL_DEPTH_COMPONENT24, width, height, GL_DEPTH_COMPONENT, GL_FLOAT);
+        scene = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColour.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, sceneRequests.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth.id(), 0);
+        GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::FRAMEBUFFER:: Virtual texture feedback FBO is not complete!" << std::endl;
+
+        sampleRequests = createTarget(GL_RGBA8UI, sampleWidth, sampleHeight, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE);
+        sample = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, sample.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sampleRequests.id(), 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (Readback& readback : readbacks)
+        {
+            readback.buffer = GLBuffer::create();
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer.id());
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(sampleWidth) * sampleHeight * 4, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void collect(Readback& readback, std::vector<uint32_t>& requests)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer.id());
+        size_t bytes = static_cast<size_t>(sampleWidth) * sampleHeight * 4;
+        void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), GL_MAP_READ_BIT);
+        const unsigned char* texels = static_cast<const unsigned char*>(mapped);
+        if (texels)
+        {
+            // The shaders write x, y, face * 16 + level, and 255 for a valid request
+            for (size_t i = 0; i < bytes; i += 4)
+                if (texels[i + 3] == 255)
+                    requests.push_back(virtualTileKey(texels[i + 2] >> 4, texels[i + 2] & 15, texels[i], texels[i + 1]));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        std::sort(requests.begin(), requests.end());
+        requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+    }
+};
+
+#endif // MY_VIRTUAL_TEXTURE_H
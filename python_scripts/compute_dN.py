@@ -1,3 +1,4 @@
+# Blender-only d_N bake, superseded by the native baker in tools/bake_dN.cpp (also used by Model at load time)
 import bpy
 import bmesh
 import mathutils
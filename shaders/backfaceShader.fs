@@ -1,12 +1,21 @@
 #version 330 core
 
 in vec3 worldNormal;
+in vec3 worldPosition;
+in vec2 TexCoords;
 
 layout(location = 0) out vec4 FragColor;
 
+// Baked detail of the high-poly model (low-poly models only), normalMap and perturbNormal come from surface_maps.glsl
+uniform bool surfaceMaps;
+
 void main()
 {
+    vec3 normal = normalize(worldNormal);
+    if (surfaceMaps)
+        normal = perturbNormal(normal, worldPosition, TexCoords);
+
     // Encode the normals: map from [-1, 1] to [0, 1] for GL_RGBA compatibility
-    vec3 encodedNormal = normalize(worldNormal) * 0.5 + 0.5;
+    vec3 encodedNormal = normal * 0.5 + 0.5;
     FragColor = vec4(encodedNormal, 1.0);
 }
@@ -1,16 +1,38 @@
 #version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
+layout(location = 3) in vec3 aPositionScale;   // Per-mesh dequantization from the geometry pool
+layout(location = 4) in vec3 aPositionOffset;
+layout(location = 6) in vec2 aTexCoords;       // Surface map coordinates
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Normals are octahedral-encoded in the packed layout
+uniform bool packedNormals;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 out vec3 worldNormal;
+out vec3 worldPosition;
+out vec2 TexCoords;
 
 void main()
 {
-    vec4 worldPos = model * vec4(aPos, 1.0);
-    worldNormal = mat3(transpose(inverse(model))) * aNormal;
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    vec3 normal = packedNormals ? octDecode(aNormal.xy) : aNormal;
+
+    vec4 worldPos = model * vec4(position, 1.0);
+    worldNormal = mat3(transpose(inverse(model))) * normal;
+    worldPosition = worldPos.xyz;
+    TexCoords = aTexCoords;
     gl_Position = projection * view * worldPos;
 }
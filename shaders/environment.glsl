@@ -0,0 +1,110 @@
+// Environment lookups shared by the fragment shaders that sample the sky (or show it, like the props)
+// Shader splices this file in after a fragment shader's #version line when it is given as the include
+
+uniform samplerCube skybox;
+uniform bool hdrEnvironment;
+uniform float exposure;
+uniform bool octahedralEnvironment;
+uniform sampler2D octahedralMap;
+uniform bool environmentMips;
+uniform bool virtualEnvironment;
+uniform sampler2D virtualCache;
+uniform usampler2DArray virtualIndirection;
+uniform int virtualFaceSize;
+uniform int virtualTileSize;
+uniform int virtualLevels;
+uniform int virtualFrame;
+
+// HDR environments hold linear radiance: expose, tone-map (ACES fit) and gamma-encode; LDR ones are already display colours
+vec3 toDisplay(vec3 colour)
+{
+    if (!hdrEnvironment)
+        return colour;
+    colour *= exposure;
+    colour = clamp((colour * (2.51 * colour + 0.03)) / (colour * (2.43 * colour + 0.59) + 0.14), 0.0, 1.0);
+    return pow(colour, vec3(1.0 / 2.2));
+}
+
+// Angle between the directions of neighbouring pixels, the lookup's footprint: the ray differentials the pixel
+// quad's derivatives give. Rays refracted through tight curvature spread fast and want coarse mips
+float directionFootprint(vec3 d)
+{
+    return max(length(dFdx(d)), length(dFdy(d)));
+}
+
+// Virtual environment: cube faces cut into tiles that stream into a cache texture on demand (my_virtual_texture.h)
+// Each fragment asks for one tile through Feedback, the lookup takes the best tile already resident
+uvec4 virtualRequest = uvec4(0u);
+
+// GL's cube face selection, with the coordinates on the face in [0, 1]^2
+int cubeFaceCoordinates(vec3 d, out vec2 st)
+{
+    vec3 a = abs(d);
+    int face;
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        st = vec2(d.x > 0.0 ? -d.z : d.z, -d.y) / a.x;
+        face = d.x > 0.0 ? 0 : 1;
+    }
+    else if (a.y >= a.z)
+    {
+        st = vec2(d.x, d.y > 0.0 ? d.z : -d.z) / a.y;
+        face = d.y > 0.0 ? 2 : 3;
+    }
+    else
+    {
+        st = vec2(d.z > 0.0 ? d.x : -d.x, -d.y) / a.z;
+        face = d.z > 0.0 ? 4 : 5;
+    }
+    st = clamp(st * 0.5 + 0.5, 0.0, 0.99999);
+    return face;
+}
+
+vec3 sampleVirtualEnvironment(vec3 direction)
+{
+    vec3 d = normalize(direction);
+    vec2 st;
+    int face = cubeFaceCoordinates(d, st);
+
+    // A face spans pi / 2 radians, the level is picked like the octahedral LOD
+    float angle = directionFootprint(d);
+    int level = int(clamp(log2(max(angle * float(virtualFaceSize) * 0.6366, 1e-4)), 0.0, float(virtualLevels - 1)));
+    int tiles = (virtualFaceSize / virtualTileSize) >> level;
+    ivec2 tile = min(ivec2(st * float(tiles)), ivec2(tiles - 1));
+
+    // With several lookups the request alternates between them by pixel and frame
+    if (virtualRequest.a == 0u || ((int(gl_FragCoord.x) + int(gl_FragCoord.y) + virtualFrame) & 1) == 1)
+        virtualRequest = uvec4(uvec2(tile), uint(face * 16 + level), 255u);
+
+    // The entry points at this tile's slot, or at the slot of the closest ancestor that is resident
+    uvec4 entry = texelFetch(virtualIndirection, ivec3(tile, face), level);
+    int residentTiles = (virtualFaceSize / virtualTileSize) >> int(entry.b);
+    vec2 inTile = fract(st * float(residentTiles)) * float(virtualTileSize) + 1.0; // Past the border
+    vec2 uv = (vec2(entry.rg) * float(virtualTileSize + 2) + inTile) / vec2(textureSize(virtualCache, 0));
+    return textureLod(virtualCache, uv, 0.0).rgb;
+}
+
+// Octahedral environment: the whole sphere folded onto one square 2D texture (see my_octahedral.h)
+vec2 octEncode(vec3 direction)
+{
+    vec3 n = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+
+// Environment radiance along a direction, from whichever representation is bound, at the mip that matches the
+// lookup's footprint (without environmentMips, the top level as before the mip chains)
+// The LOD comes from the direction's derivatives, which stay continuous across the cube's face edges and the
+// octahedral folds where the texture coordinates jump. A cube face of N texels spans pi / 2 radians (about
+// 0.6366 N texels a radian), an octahedral square of N texels covers 4 pi sr (about N / sqrt(4 pi))
+vec3 sampleEnvironment(vec3 direction)
+{
+    if (virtualEnvironment)
+        return sampleVirtualEnvironment(direction);
+    vec3 d = normalize(direction);
+    float angle = environmentMips ? directionFootprint(d) : 0.0;
+    if (!octahedralEnvironment)
+        return textureLod(skybox, d, log2(max(angle * float(textureSize(skybox, 0).x) * 0.6366, 1e-4))).rgb;
+    float lod = log2(max(angle * float(textureSize(octahedralMap, 0).x) * 0.2821, 1e-4));
+    return textureLod(octahedralMap, octEncode(d), lod).rgb;
+}
@@ -4,10 +4,13 @@ in vec3 V;           // View direction (from surface to camera)
 in vec3 N;           // Surface normal
 in vec3 FragPos;     // Front surface world position (P1)
 in float d_N;        // Precomputed Blender thickness along normal
+in vec3 d_NGradient; // Change of d_N as the ray tilts away from -N (zero if the mesh has none)
+in vec2 TexCoords;   // Surface map coordinates
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uvec4 Feedback; // Virtual environment tile request
 
-uniform samplerCube skybox;
+// The environment uniforms, sampleEnvironment and toDisplay come from environment.glsl (spliced in by Shader)
 uniform sampler2D backfaceNormalTex;
 uniform sampler2D backfaceDepthTex;
 uniform mat4 projection;
@@ -17,6 +20,11 @@ float airIOR = 1.0;
 uniform float modelIOR;
 uniform bool reflectEnable;
 uniform bool viewSpaceOnly;
+uniform bool directionalThickness;
+
+// Baked detail of the high-poly model (low-poly models only), normalMap and perturbNormal come from surface_maps.glsl
+uniform bool surfaceMaps;
+uniform sampler2D thicknessMap;
 
 // Convert screen-space depth to world-space position
 vec3 getWorldPosFromDepth(float depth, vec2 uv)
@@ -47,8 +55,23 @@ float computeDistance(float d_N, float d_V, float ratio)
     return ratio * d_V + (1.0 - ratio) * d_N;
 }
 
+// Thickness along the refracted ray from the baked linear fit around -N
+float directionalDistance(vec3 T1, vec3 N1, float thickness)
+{
+    return max(thickness + dot(d_NGradient, T1 + N1), 0.0);
+}
+
 void main()
 {
+    // The maps replace the interpolated normal and d_N (before any discard, the frame needs derivatives)
+    vec3 N1 = normalize(N);
+    float thickness = d_N;
+    if (surfaceMaps)
+    {
+        N1 = perturbNormal(N1, FragPos, TexCoords);
+        thickness = texture(thicknessMap, TexCoords).r;
+    }
+
     // Clamp UV to prevent out-of-bounds errors
     vec2 uv = gl_FragCoord.xy / vec2(textureSize(backfaceDepthTex, 0));
     uv = clamp(uv, vec2(0.001), vec2(0.999));
@@ -63,7 +86,7 @@ void main()
     d_V = length(PV - P1); // Convert depth to real-world view ray thickness
 
     vec3 I = -V; // Incoming ray (eye to surface)
-    vec3 T1 = refract(I, N, airIOR / modelIOR); // First refraction (air -> glass, so 1.0 / eta)
+    vec3 T1 = refract(I, N1, airIOR / modelIOR); // First refraction (air -> glass, so 1.0 / eta)
 
     // If only view-space (no d_N)
     if (viewSpaceOnly)
@@ -74,47 +97,57 @@ void main()
             discard;
         
         // Step 3: View direction & surface normal
-        vec3 T1 = refract(I, N, airIOR / modelIOR); // Air → Glass
+        vec3 T1 = refract(I, N1, airIOR / modelIOR); // Air → Glass
         
         // Step 4: Second refraction (glass → air), bail if T2 is a zero vector (total internal reflection)
         vec3 T2 = refract(T1, -N2, modelIOR / airIOR); // Invert N2 for correct refraction
         if (length(T2) < 0.001)
-            T2 = reflect(I, N); // fallback to reflection
+            T2 = reflect(I, N1); // fallback to reflection
 
         // Set final colour as refracted colour for now
-        vec3 finalColor = texture(skybox, T2).rgb;
+        vec3 finalColor = sampleEnvironment(T2);
 
         // Check if reflection enabled
         if (reflectEnable)
         {
             // Compute Fresnel term
-            float cosTheta = clamp(dot(I, -N), 0.0, 1.0);
+            float cosTheta = clamp(dot(I, -N1), 0.0, 1.0);
             float fresnel = fresnelSchlick(cosTheta);
 
             // Sample skybox for reflection and refraction
-            vec3 refractedColor = texture(skybox, T2).rgb;
-            vec3 reflectedColor = texture(skybox, reflect(I, N)).rgb;
+            vec3 refractedColor = sampleEnvironment(T2);
+            vec3 reflectedColor = sampleEnvironment(reflect(I, N1));
 
             // Blend using Fresnel term
             finalColor = mix(refractedColor, reflectedColor, fresnel);
         }
 
-        FragColor = vec4(finalColor, 1.0);
+        FragColor = vec4(toDisplay(finalColor), 1.0);
+        Feedback = virtualRequest;
     }
     // Else do weigthed sum of d_V and d_N
     else
     {
-        // Compute angles
-        float theta_i = acos(clamp(dot(N, I), -1.0, 1.0));
-        float theta_t = acos(clamp(dot(-N, T1), -1.0, 1.0));
+        float d;
+        if (directionalThickness && dot(d_NGradient, d_NGradient) > 0.0)
+        {
+            // Thickness looked up along T1 itself
+            d = directionalDistance(T1, N1, thickness);
+        }
+        else
+        {
+            // Compute angles
+            float theta_i = acos(clamp(dot(N1, I), -1.0, 1.0));
+            float theta_t = acos(clamp(dot(-N1, T1), -1.0, 1.0));
 
-        // Bail early if angle is degenerate
-        if (theta_i < 0.001 || theta_t < 0.001)
-            discard;
+            // Bail early if angle is degenerate
+            if (theta_i < 0.001 || theta_t < 0.001)
+                discard;
 
-        // Distance blend from paper
-        float ratio = theta_t / theta_i;
-        float d = computeDistance(d_N, d_V, ratio);
+            // Distance blend from paper
+            float ratio = theta_t / theta_i;
+            d = computeDistance(thickness, d_V, ratio);
+        }
         vec3 P2 = P1 + T1 * d;
 
         // Project P2 into screen space
@@ -131,21 +164,22 @@ void main()
         // Second refraction (TIR check)
         vec3 T2 = refract(T1, -N2, modelIOR / airIOR);
         if (length(T2) < 0.001)
-            T2 = reflect(I, N); // fallback is to reflect original incident ray at N1
+            T2 = reflect(I, N1); // fallback is to reflect original incident ray at N1
 
         // Sample environment
-        vec3 refractedColor = texture(skybox, T2).rgb;
+        vec3 refractedColor = sampleEnvironment(T2);
         vec3 finalColor = refractedColor;
 
         // Optional reflection blending
         if (reflectEnable)
         {
-            float cosTheta = clamp(dot(I, -N), 0.0, 1.0);
+            float cosTheta = clamp(dot(I, -N1), 0.0, 1.0);
             float fresnel = fresnelSchlick(cosTheta);
-            vec3 reflectedColor = texture(skybox, reflect(I, N)).rgb;
+            vec3 reflectedColor = sampleEnvironment(reflect(I, N1));
             finalColor = mix(refractedColor, reflectedColor, fresnel);
         }
 
-        FragColor = vec4(finalColor, 1.0);
+        FragColor = vec4(toDisplay(finalColor), 1.0);
+        Feedback = virtualRequest;
     }
 }   
\ No newline at end of file
@@ -2,32 +2,59 @@
 
 layout(location = 0) in vec3 aPos;      // Vertex position
 layout(location = 1) in vec3 aNormal;   // Vertex normal
-layout(location = 2) in float aD_N;     // Vertex precomputed d_N
+layout(location = 2) in vec4 aThickness; // Vertex precomputed d_N, then its change as the ray tilts away from -normal
+layout(location = 3) in vec3 aPositionScale;  // Per-mesh dequantization (geometry pool)
+layout(location = 4) in vec3 aPositionOffset; // Per-mesh dequantization (geometry pool)
+layout(location = 6) in vec2 aTexCoords;      // Surface map coordinates
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Normals are octahedral-encoded in the packed layout
+uniform bool packedNormals;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 out vec3 V; // View direction (in view space)
 out vec3 N; // Normal vector (in view space)
 out vec3 FragPos; // Position in world space
 out float d_N; // Precomptuted d_N
+out vec3 d_NGradient; // d_N gradient (in world space)
+out vec2 TexCoords; // Surface map coordinates
 
 void main() 
 {
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    vec3 normal = packedNormals ? octDecode(aNormal.xy) : aNormal;
+
     // Transform vertex to world space
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    vec4 worldPos = model * vec4(position, 1.0);
     FragPos = worldPos.xyz;
 
     // d_N
-    d_N = aD_N;
+    d_N = aThickness.x;
+    TexCoords = aTexCoords;
 
     // Compute view direction in world space
     vec3 viewPos = vec3(inverse(view) * vec4(0.0, 0.0, 0.0, 1.0)); 
     V = normalize(viewPos - worldPos.xyz); 
 
     // Transform normal properly
-    N = normalize(mat3(transpose(inverse(model))) * aNormal);
+    mat3 normalMatrix = mat3(transpose(inverse(model)));
+    N = normalize(normalMatrix * normal);
+
+    // The gradient is dotted with directions, so it turns with the normal but keeps its model-space length
+    vec3 gradient = normalMatrix * aThickness.yzw;
+    float gradientLength = length(gradient);
+    d_NGradient = gradientLength > 0.0 ? gradient * (length(aThickness.yzw) / gradientLength) : vec3(0.0);
 
     // Project the vertex
     gl_Position = projection * view * worldPos;
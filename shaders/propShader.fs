@@ -0,0 +1,21 @@
+#version 330 core
+
+in vec3 worldPosition;
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uvec4 Feedback; // No virtual environment tile request
+
+uniform vec3 propColour;
+uniform bool rawRadiance; // Drawn into the environment probe, which holds what the skybox shader samples
+
+// toDisplay comes from environment.glsl (spliced in by Shader), the skybox's display transform, so a prop seen
+// directly matches its refraction
+
+void main()
+{
+    // Flat-shaded by the face normal, lit from above
+    vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));
+    vec3 colour = propColour * (0.35 + 0.65 * abs(dot(normal, normalize(vec3(0.3, 1.0, 0.5)))));
+    FragColor = vec4(rawRadiance ? colour : toDisplay(colour), 1.0);
+    Feedback = uvec4(0u);
+}
@@ -3,10 +3,10 @@
 in vec3 V; // View direction
 in vec3 N; // Normal at the fragment
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uvec4 Feedback; // Virtual environment tile request
 
-// Skybox
-uniform samplerCube skybox;
+// The environment uniforms, sampleEnvironment and toDisplay come from environment.glsl (spliced in by Shader)
 
 // Index of refratction
 float airIOR = 1.0;
@@ -34,7 +34,7 @@ void main()
     
     // Compute refraction direction (air -> glass)
     vec3 refractedDir = refract(I, N, airIOR / modelIOR);
-    vec3 finalColor = texture(skybox, refractedDir).rgb;
+    vec3 finalColor = sampleEnvironment(refractedDir);
 
     // Check if reflection enabled
     if (reflectEnable)
@@ -47,12 +47,13 @@ void main()
         vec3 reflectedDir = reflect(I, N);
 
         // Sample skybox for reflection and refraction
-        vec3 reflectedColor = texture(skybox, reflectedDir).rgb;
-        vec3 refractedColor = texture(skybox, refractedDir).rgb;
+        vec3 reflectedColor = sampleEnvironment(reflectedDir);
+        vec3 refractedColor = sampleEnvironment(refractedDir);
 
         // Blend using Fresnel term
         finalColor = mix(refractedColor, reflectedColor, fresnel);
     }
 
-    FragColor = vec4(finalColor, 1.0);
+    FragColor = vec4(toDisplay(finalColor), 1.0);
+    Feedback = virtualRequest;
 }
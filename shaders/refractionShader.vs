@@ -2,20 +2,37 @@
 
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
+layout(location = 3) in vec3 aPositionScale;   // Per-mesh dequantization from the geometry pool
+layout(location = 4) in vec3 aPositionOffset;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Normals are octahedral-encoded in the packed layout
+uniform bool packedNormals;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 out vec3 V; // View direction (from fragment to camera)
 out vec3 N; // Normal vector
 
 void main()
 {
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    vec3 normal = packedNormals ? octDecode(aNormal.xy) : aNormal;
+
+    vec4 worldPos = model * vec4(position, 1.0);
     vec3 camPos = vec3(inverse(view) * vec4(0.0, 0.0, 0.0, 1.0));
     V = normalize(camPos - worldPos.xyz);
-    N = normalize(mat3(transpose(inverse(model))) * aNormal);
+    N = normalize(mat3(transpose(inverse(model))) * normal);
     
     gl_Position = projection * view * worldPos;
 }
@@ -2,11 +2,15 @@
 
 in vec3 TexCoords;
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uvec4 Feedback; // Virtual environment tile request
 
-uniform samplerCube skybox;
+// The environment uniforms, sampleEnvironment and toDisplay come from environment.glsl (spliced in by Shader)
+uniform bool rawRadiance; // Drawn into the environment probe, which is tone-mapped where it is sampled
 
 void main() 
 {    
-    FragColor = texture(skybox, TexCoords);
+    vec3 radiance = sampleEnvironment(TexCoords);
+    FragColor = vec4(rawRadiance ? radiance : toDisplay(radiance), 1.0);
+    Feedback = virtualRequest;
 }
@@ -0,0 +1,25 @@
+// Baked normal map lookup shared by the two-surface fragment shaders (low-poly models only)
+// Shader splices this file in after a fragment shader's #version line when it is given as an include
+
+uniform sampler2D normalMap;
+
+// Normal from the baked tangent-space map, in the cotangent frame of the UVs. Must stay in step with
+// cotangentFrame and applyTangentNormal in my_surface_maps.h, which the baker uses to write the map
+vec3 perturbNormal(vec3 normal, vec3 position, vec2 texCoords)
+{
+    vec3 dp1 = dFdx(position);
+    vec3 dp2 = dFdy(position);
+    vec2 duv1 = dFdx(texCoords);
+    vec2 duv2 = dFdy(texCoords);
+    vec3 dp2perp = cross(dp2, normal);
+    vec3 dp1perp = cross(normal, dp1);
+    float orientation = dot(normal, cross(dp1, dp2)) < 0.0 ? -1.0 : 1.0; // Mirrored differences flip both
+    vec3 T = (dp2perp * duv1.x + dp1perp * duv2.x) * orientation;
+    vec3 B = (dp2perp * duv1.y + dp1perp * duv2.y) * orientation;
+    float longest = max(dot(T, T), dot(B, B));
+    float scale = longest > 0.0 ? inversesqrt(longest) : 0.0;
+    vec3 mapped = texture(normalMap, texCoords).rgb * 2.0 - 1.0;
+    vec3 result = mat3(T * scale, B * scale, normal) * mapped;
+    float len = length(result);
+    return len > 0.0 ? result / len : normal;
+}
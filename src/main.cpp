@@ -36,27 +36,45 @@ float deltaTime = 0.0f;
 float prevFrame = 0.0f;
 float elapsedTime = 0.0f;
 
-// Model names
-#define TEAPOT_MODEL "models/teapot.fbx"
-#define DONUT_MODEL "models/donut.fbx"
-#define SPHERE_MODEL "models/sphere.fbx"
-#define MONKEY_MODEL "models/suzanne_monkey.fbx"
-#define BUDDHA_MODEL "models/buddha.fbx"
-std::vector<Model> allModels = {};
+// Models (scanned from a directory, loaded on first selection)
+std::string modelDirectory = "models";
+ModelCatalog modelCatalog;
+int drawnModel = -1; // Keeps drawing while the selected model loads
 
 // Model matrix params
 float rotY = 0.0f;
 
 // Skyboxes
-GLuint graffitiSkyboxVAO;
-GLuint graffitiCubemapTexture;
-GLuint nightSkyboxVAO;
-GLuint nightCubemapTexture;
-GLuint museumSkyboxVAO;
-GLuint museumCubemapTexture;
+SkyboxMesh skyboxMesh;
+Cubemap cubemaps[3] = { Cubemap("graffiti_cubemap"), Cubemap("nightsky_cubemap"), Cubemap("museum_cubemap") }; // Indexed by Skyboxes
+Skyboxes drawnSkybox = Graffiti; // Keeps showing while the selected skybox loads
 
 // Backface components
-GLuint backfaceFBO, backfaceNormalTex, backfaceDepthTex;
+GLFramebuffer backfaceFBO;
+GLTexture backfaceNormalTex, backfaceDepthTex;
+
+// Offscreen scene with the tile requests of virtual-textured skyboxes
+VirtualFeedback virtualFeedback;
+
+// Dynamic probe: the model passes sample it through the skybox unit once all its faces are in
+bool environmentFromProbe = false;
+Skyboxes probeSkybox = Graffiti; // The skybox its faces last saw
+
+// Props orbiting the model for the probe to capture: orbit radius, height, angular speed (rad/s), colour
+struct Prop
+{
+    float radius;
+    float height;
+    float speed;
+    glm::vec3 colour;
+};
+const Prop props[4] =
+{
+    { 2.2f, 0.4f, 0.7f, glm::vec3(0.9f, 0.2f, 0.15f) },
+    { 2.6f, -0.6f, -0.5f, glm::vec3(0.15f, 0.7f, 0.25f) },
+    { 3.0f, 1.1f, 0.35f, glm::vec3(0.2f, 0.35f, 0.95f) },
+    { 2.4f, -1.3f, 0.9f, glm::vec3(0.95f, 0.8f, 0.1f) }
+};
 
 // Shader types
 enum ShaderType
@@ -124,33 +142,29 @@ int setupGLFW(GLFWwindow** window)
     return 0;
 }
 
-void loadModels()
+void setupModelCatalog(bool preload)
 {
-    allModels.clear();
-    Model teapotModel(TEAPOT_MODEL, "Teapot"); allModels.push_back(teapotModel);
-    Model donutModel(DONUT_MODEL, "Donut"); allModels.push_back(donutModel);
-    Model sphereModel(SPHERE_MODEL, "Sphere"); allModels.push_back(sphereModel);
-    Model monkeyModel(MONKEY_MODEL, "Monkey"); allModels.push_back(monkeyModel);
-    Model buddhaModel(BUDDHA_MODEL, "Buddha"); allModels.push_back(buddhaModel);
+    modelCatalog.scanDirectory(modelDirectory);
+    selectedModel = static_cast<int>(modelCatalog.find("teapot"));
+
+    // Optionally fill the GPU budget up front using the parallel loader
+    if (preload)
+        modelCatalog.preloadAll();
 }
 
-void setupSkybox(GLuint* skyboxVAO, GLuint* cubemapTexture, const std::string skyboxName)
+void setupSkyboxes()
 {
-    // Setup skybox VAO
-    *skyboxVAO = setupSkyboxVAO();
-
-    std::vector<std::string> facesCubemap =
-    {
-        "skybox/" + skyboxName + "/px.png",   
-        "skybox/" + skyboxName + "/nx.png",  
-        "skybox/" + skyboxName + "/py.png",     
-        "skybox/" + skyboxName + "/ny.png",   
-        "skybox/" + skyboxName + "/pz.png",    
-        "skybox/" + skyboxName + "/nz.png"      
-    };
-
-    // Skybox cubemap
-    *cubemapTexture = loadCubemap(facesCubemap);
+    // Compressed cubemaps have mips, which must filter across face edges
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    // Start decoding every face of every skybox, then wait only for the first one shown
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto& cubemap : cubemaps)
+        cubemap.request();
+    cubemaps[selectedSkybox].wait();
+    drawnSkybox = selectedSkybox;
+    std::cout << "First skybox ready after " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms (" << sizeof(cubemaps) / sizeof(cubemaps[0]) * 6 << " faces decoding in parallel)\n";
 }
 
 void setupCamera()
@@ -163,7 +177,32 @@ void setupCamera()
     camera.setZoomEnabled(false);
 }
 
-void drawSkyBox(Shader& skyboxShader, const glm::mat4& projection, const glm::mat4 view)
+// Environment uniforms shared by the skybox and model shaders (drawSkyBox binds the textures)
+void setEnvironmentUniforms(Shader& shader)
+{
+    shader.setInt("skybox", 0);
+    shader.setBool("hdrEnvironment", cubemaps[drawnSkybox].hdr());
+    shader.setFloat("exposure", exposure);
+    shader.setInt("octahedralMap", 5);
+    shader.setBool("octahedralEnvironment", octahedralEnvironment && octahedralAvailable && !environmentFromProbe);
+    shader.setBool("environmentMips", environmentMips);
+
+    // The probe is a plain cube on the skybox unit, whatever the skybox it captured is stored as
+    VirtualEnvironment* virtualEnvironment = environmentFromProbe ? nullptr : cubemaps[drawnSkybox].virtualEnvironment();
+    shader.setBool("virtualEnvironment", virtualEnvironment != nullptr);
+    shader.setInt("virtualCache", 6);
+    shader.setInt("virtualIndirection", 7);
+    if (virtualEnvironment)
+    {
+        shader.setInt("virtualFaceSize", static_cast<int>(virtualEnvironment->info().faceSize));
+        shader.setInt("virtualTileSize", static_cast<int>(virtualEnvironment->info().tileSize));
+        shader.setInt("virtualLevels", static_cast<int>(virtualEnvironment->info().levels));
+        shader.setInt("virtualFrame", static_cast<int>(virtualEnvironment->frameIndex() & 0xFFFF));
+    }
+}
+
+// The skybox cube with the environment textures already bound, to the screen or, untone-mapped, into the probe
+void drawSkyBoxCube(Shader& skyboxShader, const glm::mat4& projection, const glm::mat4& view, bool rawRadiance)
 {
     glDisable(GL_DEPTH_TEST);
     skyboxShader.use();
@@ -172,34 +211,69 @@ void drawSkyBox(Shader& skyboxShader, const glm::mat4& projection, const glm::ma
     glm::mat4 viewNoTrans = glm::mat4(glm::mat3(view));
     skyboxShader.setMat4("view", viewNoTrans);
     skyboxShader.setMat4("projection", projection);
+    skyboxShader.setBool("rawRadiance", rawRadiance);
+    setEnvironmentUniforms(skyboxShader);
+
+    glBindVertexArray(skyboxMesh.VAO.id());
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
 
+void drawSkyBox(Shader& skyboxShader, const glm::mat4& projection, const glm::mat4 view)
+{
     // Bind the skybox texture and render
+    // The previous skybox stays up until the selected one's upload has finished
+    if (cubemaps[selectedSkybox].ready())
+        drawnSkybox = selectedSkybox;
+    // Its octahedral map goes on unit 5 once built
+    octahedralAvailable = cubemaps[drawnSkybox].octahedralReady();
+    cubeEnvironmentBytes = cubemaps[drawnSkybox].cubeBytes();
+    cubeTopLevelBytes = cubemaps[drawnSkybox].cubeTopLevelBytes();
+    octahedralEnvironmentBytes = cubemaps[drawnSkybox].octahedralBytes();
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, cubemaps[drawnSkybox].octahedralId());
+
+    // A virtual-textured skybox's tile cache and indirection table on units 6 and 7
+    VirtualEnvironment* virtualEnvironment = cubemaps[drawnSkybox].virtualEnvironment();
+    virtualEnvironmentActive = virtualEnvironment != nullptr;
+    if (virtualEnvironment)
+        virtualEnvironmentStats = virtualEnvironment->statistics();
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, virtualEnvironment ? virtualEnvironment->cacheId() : 0);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, virtualEnvironment ? virtualEnvironment->indirectionId() : 0);
     glActiveTexture(GL_TEXTURE0);
-    switch (selectedSkybox)
-    {
-    case Graffiti: 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, graffitiCubemapTexture);
-        glBindVertexArray(graffitiSkyboxVAO);
-        break;
-
-    case NightSky:
-        glBindTexture(GL_TEXTURE_CUBE_MAP, nightCubemapTexture);
-        glBindVertexArray(nightSkyboxVAO);
-        break;
-
-    case Museum:
-        glBindTexture(GL_TEXTURE_CUBE_MAP, museumCubemapTexture);
-        glBindVertexArray(museumSkyboxVAO);
-        break;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemaps[drawnSkybox].id());
+    drawSkyBoxCube(skyboxShader, projection, view, false);
+}
 
-    default:
-        break;
+// Orbiting props (the skybox cube, scaled down), in the main view or into the probe
+void drawProps(Shader& propShader, const glm::mat4& projection, const glm::mat4& view, bool rawRadiance)
+{
+    propShader.use();
+    propShader.setMat4("view", view);
+    propShader.setMat4("projection", projection);
+    propShader.setBool("hdrEnvironment", cubemaps[drawnSkybox].hdr());
+    propShader.setFloat("exposure", exposure);
+    propShader.setBool("rawRadiance", rawRadiance);
+
+    // Both windings are drawn, the two-surface pass leaves face culling on
+    GLboolean culling = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+    glBindVertexArray(skyboxMesh.VAO.id());
+    for (const Prop& prop : props)
+    {
+        float angle = elapsedTime * prop.speed;
+        glm::mat4 model = glm::translate(glm::identity<glm::mat4>(), glm::vec3(prop.radius * std::cos(angle), prop.height, prop.radius * std::sin(angle)));
+        model = glm::rotate(model, angle * 2.0f, glm::vec3(0.3f, 1.0f, 0.2f));
+        propShader.setMat4("model", glm::scale(model, glm::vec3(0.2f)));
+        propShader.setVec3("propColour", prop.colour);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
     }
-    skyboxShader.setInt("skybox", 0);
-
-    glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
-    glEnable(GL_DEPTH_TEST);
+    if (culling)
+        glEnable(GL_CULL_FACE);
 }
 
 void drawModel(Shader& shader, const glm::mat4& projection, const glm::mat4 view, const ShaderType& shaderType)
@@ -217,17 +291,19 @@ void drawModel(Shader& shader, const glm::mat4& projection, const glm::mat4 view
     shader.setMat4("projection", projection);
 
     // Set the rest of the uniforms based on which shader is in use
+    MeshletCulling culling = MeshletCulling::None;
     switch (shaderType)
     {
     case OneSurfaceShader:
         // F0, eta, and skybox
         shader.setFloat("modelIOR", IOR);
         shader.setBool("reflectEnable", enableReflect);
-        shader.setInt("skybox", 0);
+        setEnvironmentUniforms(shader);
         break;
 
     case TwoSurfacesBackFaceShader:
-        // No other uniforms
+        // No other uniforms, only back faces are rasterized
+        culling = MeshletCulling::DrawBackFaces;
         break;
 
     case TwoSurfacesFrontFaceShader:
@@ -235,34 +311,129 @@ void drawModel(Shader& shader, const glm::mat4& projection, const glm::mat4 view
         shader.setFloat("modelIOR", IOR);
         shader.setBool("reflectEnable", enableReflect);
         shader.setBool("viewSpaceOnly", screenSpaceOnly);
-        shader.setInt("skybox", 0);
+        shader.setBool("directionalThickness", directionalDN);
+        setEnvironmentUniforms(shader);
         shader.setInt("backfaceNormalTex", 1);
         shader.setInt("backfaceDepthTex", 2);
+        culling = MeshletCulling::DrawFrontFaces;
         break;
     default:
         std::cerr << "Invalid shader type provided to drawModel(). Returning.\n";
         return;
     }
 
-    // Draw
-    allModels[selectedModel].draw(shader);
+    // Draw (loads the model on first use), skipping meshlets facing away from the pass
+    // While the selected model loads, the one drawn before it stands in
+    Model* activeModel = modelCatalog.acquire(selectedModel);
+    if (activeModel)
+        drawnModel = selectedModel;
+    else
+        activeModel = modelCatalog.resident(static_cast<size_t>(drawnModel));
+    if (!activeModel)
+        return;
+    if (!meshletCulling)
+        culling = MeshletCulling::None;
+    glm::vec3 viewPosition = glm::vec3(glm::inverse(model) * glm::vec4(camera.position, 1.0f));
+
+    // Pick the LOD from how many pixels a model unit covers at the front of the bounding sphere
+    int lod = 0;
+    if (autoLod)
+    {
+        float distance = std::max(glm::length(viewPosition - activeModel->boundsCenter()) - activeModel->boundsRadius(), 0.1f);
+        float pixelsPerUnit = 0.5f * static_cast<float>(SCREEN_HEIGHT) / (distance * std::tan(glm::radians(camera.zoom) * 0.5f));
+        float pixelError = lodPixelError * (shaderType == TwoSurfacesBackFaceShader ? backfaceLodErrorScale : 1.0f);
+        lod = activeModel->selectLod(pixelsPerUnit, pixelError);
+    }
+
+    // The d_N gradient is baked for the rest pose, a deforming model takes the d_N/d_V blend
+    if (shaderType == TwoSurfacesFrontFaceShader && activeModel->isDeforming())
+        shader.setBool("directionalThickness", false);
+
+    // Both two-surface passes read the baked maps of low-poly models
+    if (shaderType != OneSurfaceShader)
+        activeModel->bindSurfaceMaps(shader, useSurfaceMaps);
+
+    unsigned int triangles = activeModel->draw(shader, culling, viewPosition, lod);
+    if (shaderType == TwoSurfacesBackFaceShader)
+    {
+        backfacePassTriangles = triangles;
+        backfacePassLod = lod;
+    }
+    else
+    {
+        frontfacePassTriangles = triangles;
+        frontfacePassLod = lod;
+    }
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // Command line options
+    bool preloadModels = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--models" && i + 1 < argc)
+            modelDirectory = argv[++i];
+        else if (arg == "--gpu-budget" && i + 1 < argc)
+            modelCatalog.gpuBudgetBytes = static_cast<size_t>(std::atof(argv[++i]) * 1024.0 * 1024.0);
+        else if (arg == "--preload")
+            preloadModels = true;
+        else if (arg == "--no-optimize")
+            modelCatalog.loadSettings.optimizeMeshes = false;
+        else if (arg == "--packed-vertices")
+            modelCatalog.vertexFormat = VertexFormat::Packed;
+        else if (arg == "--lod-levels" && i + 1 < argc)
+            modelCatalog.loadSettings.lodLevels = static_cast<unsigned int>(std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--no-directional-dn")
+            modelCatalog.loadSettings.directionalDN = false;
+        else if (arg == "--stream-upload")
+            modelCatalog.streamAll = true;
+        else if (arg == "--frame-trace" && i + 1 < argc)
+            frameTrace.open(argv[++i]);
+        else if (arg == "--png-skyboxes")
+            useCompressedSkyboxes = false;
+        else if (arg == "--panorama-face-size" && i + 1 < argc)
+            panoramaFaceSize = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--hdr-format" && i + 1 < argc)
+            hdrSkyboxPacking = std::string(argv[++i]) == "r11g11b10f" ? HdrPacking::R11G11B10F : HdrPacking::RGB9E5;
+        else if (arg == "--no-env-mips")
+            buildSkyboxMips = false;
+        else if (arg == "--octahedral-env")
+            buildOctahedralEnvironments = octahedralEnvironment = true;
+        else if (arg == "--octahedral-size" && i + 1 < argc)
+            octahedralMapSize = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--no-virtual-env")
+            useVirtualEnvironments = false;
+        else if (arg == "--virtual-cache-tiles" && i + 1 < argc)
+            virtualCacheSlots = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--dynamic-probe")
+            dynamicProbe = true;
+        else if (arg == "--probe-size" && i + 1 < argc)
+            environmentProbe.setFaceSize(std::max(1, std::atoi(argv[++i])));
+        else if (arg == "--probe-faces" && i + 1 < argc)
+            probeFacesPerFrame = std::min(std::max(0, std::atoi(argv[++i])), EnvironmentProbe::FACE_COUNT);
+        else if (arg == "--probe-schedule" && i + 1 < argc)
+            probeSchedule = static_cast<int>(std::string(argv[++i]) == "round-robin" ? ProbeSchedule::RoundRobin : ProbeSchedule::Priority);
+    }
+
     // Window
     GLFWwindow* window = nullptr;
     if (setupGLFW(&window))
         return -1;
 
+    // Upload thread with a context shared with the window's (models and skyboxes load without stalling frames)
+    globalUploadThread().start(window);
+
     // Shaders
-    Shader skyboxShader("shaders/skyboxShader.vs", "shaders/skyboxShader.fs");
-    Shader refractionShader("shaders/refractionShader.vs", "shaders/refractionShader.fs");
-    Shader backfaceShader("shaders/backfaceShader.vs", "shaders/backfaceShader.fs");
-    Shader frontfaceShader("shaders/frontfaceShader.vs", "shaders/frontfaceShader.fs");
+    Shader skyboxShader("shaders/skyboxShader.vs", "shaders/skyboxShader.fs", { "shaders/environment.glsl" });
+    Shader refractionShader("shaders/refractionShader.vs", "shaders/refractionShader.fs", { "shaders/environment.glsl" });
+    Shader backfaceShader("shaders/backfaceShader.vs", "shaders/backfaceShader.fs", { "shaders/surface_maps.glsl" });
+    Shader frontfaceShader("shaders/frontfaceShader.vs", "shaders/frontfaceShader.fs", { "shaders/environment.glsl", "shaders/surface_maps.glsl" });
+    Shader propShader("shaders/propShader.vs", "shaders/propShader.fs", { "shaders/environment.glsl" });
 
     // Models
-    loadModels();
+    setupModelCatalog(preloadModels);
 
     // Camera
     setupCamera();
@@ -271,33 +442,32 @@ int main()
     ImGuiSetup(window);
 
     // Skyboxes
-    setupSkybox(&graffitiSkyboxVAO, &graffitiCubemapTexture, "graffiti_cubemap");
-    setupSkybox(&nightSkyboxVAO, &nightCubemapTexture, "nightsky_cubemap");
-    setupSkybox(&museumSkyboxVAO, &museumCubemapTexture, "museum_cubemap");
+    skyboxMesh = setupSkyboxVAO();
+    setupSkyboxes();
 
     // Backface framebuffer components
-    glGenFramebuffers(1, &backfaceFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, backfaceFBO);
+    backfaceFBO = GLFramebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, backfaceFBO.id());
 
     // Backface normals RGBA texture
-    glGenTextures(1, &backfaceNormalTex);
-    glBindTexture(GL_TEXTURE_2D, backfaceNormalTex);
+    backfaceNormalTex = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, backfaceNormalTex.id());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, backfaceNormalTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, backfaceNormalTex.id(), 0);
 
     // Backface depth buffer texture
-    glGenTextures(1, &backfaceDepthTex);
-    glBindTexture(GL_TEXTURE_2D, backfaceDepthTex);
+    backfaceDepthTex = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, backfaceDepthTex.id());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, backfaceDepthTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, backfaceDepthTex.id(), 0);
 
     // Tell OpenGL which color attachments
     GLenum drawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
@@ -352,10 +522,56 @@ int main()
         if (fpsTracker.active)
             fpsTracker.update(deltaTime);
 
-        // Skybox
+        // Finish background loads and stream a slice of any model still uploading
+        modelCatalog.update();
+
+        // Swaps show up in the trace as the frame where the drawn model or skybox changes
+        frameTrace.record(elapsedTime, deltaTime, modelCatalog.size() > 0 ? modelCatalog.name(selectedModel) : "",
+            drawnModel >= 0 ? modelCatalog.name(drawnModel) : "", skyboxOptions[selectedSkybox], skyboxOptions[drawnSkybox],
+            globalUploadThread().pending());
+
+        // Deform the selected model (its d_N follows the new pose)
+        if (deformModel)
+            deformStats = modelCatalog.deform(selectedModel, elapsedTime);
+        else
+            modelCatalog.stopDeforming();
+
+        // A virtual-textured skybox needs the frame offscreen, with the tiles it asked for in a second target
+        if (cubemaps[drawnSkybox].virtualEnvironment())
+            virtualFeedback.begin(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+        // Skybox (each pass timed on the GPU, one timer running at a time)
+        environmentFromProbe = false;
+        skyboxPassTimer.begin();
         drawSkyBox(skyboxShader, projection, view);
+        skyboxPassTimer.end();
+
+        // Dynamic probe: this frame's faces captured around the model (skybox and props), then the props on screen
+        // Once every face is in, the probe takes the skybox's unit for the model passes
+        if (dynamicProbe)
+        {
+            if (probeSkybox != drawnSkybox)
+            {
+                environmentProbe.invalidate();
+                probeSkybox = drawnSkybox;
+            }
+            environmentProbe.update(probeFacesPerFrame, static_cast<ProbeSchedule>(probeSchedule), glm::vec3(0.0f), glm::normalize(-camera.position),
+                [&](const glm::mat4& faceProjection, const glm::mat4& faceView)
+                {
+                    drawSkyBoxCube(skyboxShader, faceProjection, faceView, true);
+                    drawProps(propShader, faceProjection, faceView, true);
+                });
+            drawProps(propShader, projection, view, false);
+            if (environmentProbe.complete())
+            {
+                environmentFromProbe = true;
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, environmentProbe.id());
+            }
+        }
 
         // Draw model
+        modelPassTimer.begin();
         switch (selectedRefractionMethod)
         {
         case OneSurface:
@@ -365,7 +581,7 @@ int main()
 
         case TwoSurfaces:
             // First pass: backface rendering
-            glBindFramebuffer(GL_FRAMEBUFFER, backfaceFBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, backfaceFBO.id());
             glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             glEnable(GL_CULL_FACE);
@@ -374,14 +590,14 @@ int main()
             drawModel(backfaceShader, projection, view, TwoSurfacesBackFaceShader); // Renders backface normals + depth
 
             glCullFace(GL_BACK); // Reset culling
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, virtualFeedback.framebuffer());
 
             // Bind the textures to the expected units
             glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, backfaceNormalTex);
+            glBindTexture(GL_TEXTURE_2D, backfaceNormalTex.id());
 
             glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, backfaceDepthTex);
+            glBindTexture(GL_TEXTURE_2D, backfaceDepthTex.id());
 
             // Second pass: main rendering using backface data
             drawModel(frontfaceShader, projection, view, TwoSurfacesFrontFaceShader);
@@ -392,6 +608,14 @@ int main()
             drawModel(refractionShader, projection, view, OneSurfaceShader);
             break;
         }
+        modelPassTimer.end();
+        environmentComparison.update(skyboxPassTimer, modelPassTimer);
+
+        // Show the offscreen frame and stream in the tiles an earlier frame asked for
+        std::vector<uint32_t> tileRequests;
+        virtualFeedback.end(tileRequests);
+        if (VirtualEnvironment* virtualEnvironment = cubemaps[drawnSkybox].virtualEnvironment())
+            virtualEnvironment->update(tileRequests);
 
         // If screenshot
         if (takeScreenshot)
@@ -407,7 +631,7 @@ int main()
             std::ostringstream oss; // Requires C++17
             oss << std::fixed << std::setprecision(3) << IOR;
             std::string IOR_3dp = oss.str();
-            std::string fileName = std::string(modelOptions[selectedModel]) + "_"
+            std::string fileName = (modelCatalog.size() > 0 ? modelCatalog.name(selectedModel) : std::string("none")) + "_"
                 + std::string(skyboxOptions[selectedSkybox]) + "_"
                 + std::string("IOR_") + IOR_3dp + refractType + std::string(".png");
             saveScreenshot(fileName, SCREEN_WIDTH, SCREEN_HEIGHT);
@@ -416,13 +640,35 @@ int main()
 
         // IMGUI drawing
         if (!fpsTracker.active)
-            ImGuiDrawWindow();
+            ImGuiDrawWindow(modelCatalog);
 
         // Swap buffers and poll events
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    // Delete GL objects while the context still exists (models before the pool they live in),
+    // after the upload thread has finished its last job
+    frameTrace.close();
+    globalUploadThread().stop();
+    modelCatalog.releaseAll();
+    releaseGeometryPools();
+    skyboxMesh = SkyboxMesh();
+    for (auto& cubemap : cubemaps)
+        cubemap.reset();
+    skyboxPassTimer.reset();
+    modelPassTimer.reset();
+    virtualFeedback.reset();
+    environmentProbe.reset();
+    backfaceFBO.reset();
+    backfaceNormalTex.reset();
+    backfaceDepthTex.reset();
+    skyboxShader.release();
+    refractionShader.release();
+    backfaceShader.release();
+    frontfaceShader.release();
+    propShader.release();
+
     // Shutdown procedure
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -0,0 +1,387 @@
+// Standalone d_N baker, the native counterpart of python_scripts/compute_dN.py
+//
+// Usage: bake_dN <input model> [output model] [--max-distance D] [--cone DEGREES] [--verify TOLERANCE]
+//        bake_dN --self-test
+//
+// The input is imported with the same Assimp flags as ModelLoader, d_N is baked per mesh
+// and written to vertex colour set 0 (r = g = b = d_N) of the output file, and the directional
+// d_N gradient to colour set 1 (rgb = gradient), which ModelLoader reads instead of baking it.
+// Each mesh also reports how well d_N alone and d_N plus the gradient predict the thickness
+// along tilted rays inside the cone (mean absolute error against a ray cast).
+// --verify compares the bake against the d_N vertex colours already in the input (e.g. produced
+// by compute_dN.py) and exits with a non-zero code if any vertex differs by more than TOLERANCE, or if
+// the input has no d_N colours to compare.
+// --self-test bakes shapes of known thickness (a sphere, a slab, and a strip deep enough to need the
+// heap traversal stack) and exits with a non-zero code if the bake strays from the analytic values.
+
+#include <assimp/Importer.hpp>
+#include <assimp/Exporter.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <my_dn_baker.h>
+#include <my_model_loader.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void printUsage()
+{
+    std::cout << "Usage: bake_dN <input model> [output model] [--max-distance D] [--cone DEGREES] [--verify TOLERANCE]\n"
+        << "       bake_dN --self-test\n";
+}
+
+// Cast one tilted ray from a sample of vertices and compare both thickness estimates with it
+void reportDirectionalError(const TriangleBvh& bvh, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+    const std::vector<float>& d_N, const std::vector<glm::vec3>& gradients, const DNBakeSettings& settings)
+{
+    double scalarError = 0.0, directionalError = 0.0;
+    size_t samples = 0;
+    size_t step = std::max<size_t>(1, positions.size() / 4096);
+    for (size_t v = 0; v < positions.size(); v += step)
+    {
+        float len = glm::length(normals[v]);
+        if (d_N[v] <= 0.0f || len <= 0.0f)
+            continue;
+
+        // Deterministic tilt and azimuth per vertex
+        uint32_t hash = static_cast<uint32_t>(v) * 2654435761u;
+        float tilt = glm::radians(settings.gradientConeDegrees) * std::sqrt((hash & 0xFFFF) / 65535.0f);
+        float azimuth = 6.2831853f * (hash >> 16) / 65535.0f;
+        glm::vec3 n = normals[v] / len, tangent, bitangent;
+        orthonormalBasis(n, tangent, bitangent);
+        glm::vec3 dir = (tangent * std::cos(azimuth) + bitangent * std::sin(azimuth)) * std::sin(tilt) - n * std::cos(tilt);
+
+        float thickness = bvh.furthestHit(positions[v], dir, settings.maxDistance);
+        if (thickness <= 1e-6f)
+            continue;
+        float directional = std::max(d_N[v] + glm::dot(gradients[v], dir + n), 0.0f);
+        scalarError += std::fabs(thickness - d_N[v]);
+        directionalError += std::fabs(thickness - directional);
+        samples++;
+    }
+    if (samples > 0)
+        std::cout << "  Thickness along tilted rays (" << samples << " samples): mean error " << scalarError / samples
+            << " with d_N, " << directionalError / samples << " with d_N + gradient\n";
+}
+
+// UV sphere of the given radius with radial normals
+// With an odd ring and segment count no ring lies on the equator and no vertex's antipode is a vertex, so the
+// rays along -N cross triangle interiors
+void makeSphere(float radius, int rings, int segments, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices)
+{
+    for (int ring = 0; ring <= rings; ring++)
+    {
+        float polar = 3.14159265f * ring / rings;
+        for (int segment = 0; segment < segments; segment++)
+        {
+            float azimuth = 6.2831853f * segment / segments;
+            glm::vec3 n(std::sin(polar) * std::cos(azimuth), std::cos(polar), std::sin(polar) * std::sin(azimuth));
+            positions.push_back(n * radius);
+            normals.push_back(n);
+        }
+    }
+    for (int ring = 0; ring < rings; ring++)
+    {
+        for (int segment = 0; segment < segments; segment++)
+        {
+            unsigned int a = ring * segments + segment, b = ring * segments + (segment + 1) % segments;
+            unsigned int c = a + segments, d = b + segments;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+}
+
+// Square slab of the given thickness between y = 0 and y = -thickness, top and bottom grids only
+// The bottom grid is shifted by a third of a cell so the rays along -N land inside its triangles
+void makeSlab(float thickness, int cells, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices)
+{
+    for (int side = 0; side < 2; side++)
+    {
+        unsigned int base = static_cast<unsigned int>(positions.size());
+        float shift = side ? 1.0f / 3.0f : 0.0f;
+        for (int z = 0; z <= cells; z++)
+        {
+            for (int x = 0; x <= cells; x++)
+            {
+                positions.push_back(glm::vec3(x + shift, side ? -thickness : 0.0f, z + shift));
+                normals.push_back(glm::vec3(0.0f, side ? -1.0f : 1.0f, 0.0f));
+            }
+        }
+        for (int z = 0; z < cells; z++)
+        {
+            for (int x = 0; x < cells; x++)
+            {
+                unsigned int a = base + z * (cells + 1) + x, b = a + 1, c = a + cells + 1, d = c + 1;
+                if (side)
+                    indices.insert(indices.end(), { a, b, c, b, d, c });
+                else
+                    indices.insert(indices.end(), { a, c, b, b, c, d });
+            }
+        }
+    }
+}
+
+// Bake the analytic shapes and compare with their known thickness, returns the number of failed checks
+int runSelfTest()
+{
+    DNBakeSettings settings;
+    int failures = 0;
+    auto check = [&](const char* name, double error, double tolerance)
+    {
+        bool passed = error <= tolerance;
+        std::cout << "  " << name << ": max error " << error << " (tolerance " << tolerance << ") " << (passed ? "passed" : "FAILED") << "\n";
+        if (!passed)
+            failures++;
+    };
+
+    // Sphere: d_N is the diameter, and the chord along w is 2r cos(angle to -N) = d_N + dot(-2r N, w + N) exactly
+    {
+        const float radius = 1.5f;
+        const int rings = 47, segments = 97;
+        std::vector<glm::vec3> positions, normals;
+        std::vector<unsigned int> indices;
+        makeSphere(radius, rings, segments, positions, normals, indices);
+        TriangleBvh bvh;
+        bvh.build(positions, indices, settings.leafSize);
+        std::vector<float> d_N = bakeThickness(bvh, positions, normals, settings);
+        std::vector<glm::vec3> gradients = bakeThicknessGradient(bvh, positions, normals, d_N, settings);
+        // The pole rings are skipped: their rays run pole to pole, through a vertex of degenerate triangles
+        double thicknessError = 0.0, gradientError = 0.0;
+        for (size_t i = segments; i < positions.size() - segments; i++)
+        {
+            thicknessError = std::max(thicknessError, static_cast<double>(std::fabs(d_N[i] - 2.0f * radius)));
+            gradientError = std::max(gradientError, static_cast<double>(glm::length(gradients[i] + 2.0f * radius * normals[i])));
+        }
+        std::cout << "> Sphere of radius " << radius << ", " << indices.size() / 3 << " triangles\n";
+        check("d_N against the diameter", thicknessError, 0.01 * radius);
+        check("Gradient against -2r N", gradientError, 0.05 * radius);
+    }
+
+    // Slab: d_N is the thickness everywhere on both faces
+    {
+        const float thickness = 0.37f;
+        std::vector<glm::vec3> positions, normals;
+        std::vector<unsigned int> indices;
+        makeSlab(thickness, 16, positions, normals, indices);
+        TriangleBvh bvh;
+        bvh.build(positions, indices, settings.leafSize);
+        std::vector<float> d_N = bakeThickness(bvh, positions, normals, settings);
+
+        // Skip the vertices whose ray leaves past the other grid's edge (the last row and column of the top one,
+        // the first of the shifted bottom one)
+        double error = 0.0;
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            const glm::vec3& p = positions[i];
+            if (p.x < 1.0f || p.z < 1.0f || p.x > 15.0f || p.z > 15.0f)
+                continue;
+            error = std::max(error, static_cast<double>(std::fabs(d_N[i] - thickness)));
+        }
+        std::cout << "> Slab of thickness " << thickness << ", " << indices.size() / 3 << " triangles\n";
+        check("d_N against the thickness", error, 1e-4);
+    }
+
+    // Chain of squares in a hand-built tree where every interior node holds one leaf and the rest of the chain,
+    // far deeper than the traversal's stack array: the furthest hit must still be the last square
+    {
+        const unsigned int squares = 300;
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+        for (unsigned int i = 0; i < squares; i++)
+        {
+            float x = static_cast<float>(i + 1);
+            positions.insert(positions.end(), { glm::vec3(x, -1.0f, -1.0f), glm::vec3(x, 1.0f, -1.0f), glm::vec3(x, -1.0f, 1.0f), glm::vec3(x, 1.0f, 1.0f) });
+            indices.insert(indices.end(), { 4 * i, 4 * i + 1, 4 * i + 2, 4 * i + 1, 4 * i + 3, 4 * i + 2 });
+        }
+        TriangleBvh bvh;
+        bvh.build(positions, indices, settings.leafSize);
+
+        // Node 2k + 1 is the leaf of square k, node 2k + 2 the rest of the chain; refit fills in the bounds
+        bvh.nodes.assign(2 * squares - 1, BvhNode{ glm::vec3(0.0f), 0, glm::vec3(0.0f), 0 });
+        for (unsigned int i = 0; i < 2 * squares; i++)
+            bvh.triangleIds[i] = i;
+        for (unsigned int k = 0; k + 1 < squares; k++)
+        {
+            bvh.nodes[k == 0 ? 0 : 2 * k].leftFirst = 2 * k + 1;
+            bvh.nodes[2 * k + 1] = BvhNode{ glm::vec3(0.0f), 2 * k, glm::vec3(0.0f), 2 };
+        }
+        bvh.nodes[2 * squares - 2] = BvhNode{ glm::vec3(0.0f), 2 * squares - 2, glm::vec3(0.0f), 2 };
+        bvh.depth = squares - 1;
+        bvh.refit(positions, indices);
+
+        float furthest = bvh.furthestHit(glm::vec3(0.0f, 0.1f, 0.2f), glm::vec3(1.0f, 0.0f, 0.0f), 2.0f * squares);
+        std::cout << "> Chain of " << squares << " squares, BVH depth " << bvh.depth << "\n";
+        check("Furthest hit against the last square", std::fabs(furthest - static_cast<float>(squares)), 1e-4);
+    }
+
+    std::cout << (failures ? "FAILED\n" : "PASSED\n");
+    return failures;
+}
+
+// Assimp exporter id from the output file extension
+std::string exportFormatId(const std::string& path)
+{
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+int main(int argc, char** argv)
+{
+    std::string inputPath, outputPath;
+    DNBakeSettings settings;
+    bool verify = false;
+    float tolerance = 0.0f;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--self-test")
+            return runSelfTest() > 0 ? 2 : 0;
+        else if (arg == "--max-distance" && i + 1 < argc)
+            settings.maxDistance = std::strtof(argv[++i], nullptr);
+        else if (arg == "--cone" && i + 1 < argc)
+            settings.gradientConeDegrees = std::strtof(argv[++i], nullptr);
+        else if (arg == "--verify" && i + 1 < argc)
+        {
+            verify = true;
+            tolerance = std::strtof(argv[++i], nullptr);
+        }
+        else if (inputPath.empty())
+            inputPath = arg;
+        else if (outputPath.empty())
+            outputPath = arg;
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (inputPath.empty() || (outputPath.empty() && !verify))
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Same import as ModelLoader so vertex order matches the renderer
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(inputPath, MODEL_IMPORT_FLAGS);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Baking d_N with " << globalThreadPool().size() << " thread(s)\n";
+
+    double maxError = 0.0, errorSum = 0.0;
+    size_t comparedVertices = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+    {
+        aiMesh* mesh = scene->mMeshes[m];
+
+        std::vector<glm::vec3> positions(mesh->mNumVertices), normals(mesh->mNumVertices);
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            positions[i] = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+            if (mesh->HasNormals())
+                normals[i] = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        }
+
+        std::vector<unsigned int> indices;
+        indices.reserve(mesh->mNumFaces * 3);
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            // Points and lines survive triangulation, they take no part in the ray cast
+            if (mesh->mFaces[i].mNumIndices != 3)
+                continue;
+            for (unsigned int j = 0; j < 3; j++)
+                indices.push_back(mesh->mFaces[i].mIndices[j]);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        TriangleBvh bvh;
+        bvh.build(positions, indices, settings.leafSize);
+        std::vector<float> d_N = bakeThickness(bvh, positions, normals, settings);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::vector<glm::vec3> gradients = bakeThicknessGradient(bvh, positions, normals, d_N, settings);
+        auto gradientEnd = std::chrono::high_resolution_clock::now();
+
+        std::cout << "> Mesh " << m << " (" << mesh->mName.C_Str() << "): " << mesh->mNumVertices << " vertices, "
+            << indices.size() / 3 << " triangles, d_N " << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms, gradient " << std::chrono::duration<double, std::milli>(gradientEnd - end).count() << " ms\n";
+        reportDirectionalError(bvh, positions, normals, d_N, gradients, settings);
+
+        // Compare against the Blender bake
+        if (verify)
+        {
+            if (!mesh->HasVertexColors(0))
+            {
+                std::cout << "  No d_N vertex colours to verify against\n";
+            }
+            else
+            {
+                for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+                {
+                    double error = std::fabs(static_cast<double>(d_N[i]) - mesh->mColors[0][i].r);
+                    maxError = std::max(maxError, error);
+                    errorSum += error;
+                    comparedVertices++;
+                }
+            }
+        }
+
+        // Store as vertex colours, matching compute_dN.py's output
+        if (!outputPath.empty())
+        {
+            if (!mesh->HasVertexColors(0))
+                mesh->mColors[0] = new aiColor4D[mesh->mNumVertices];
+            for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+                mesh->mColors[0][i] = aiColor4D(d_N[i], d_N[i], d_N[i], 1.0f);
+
+            if (!mesh->HasVertexColors(1))
+                mesh->mColors[1] = new aiColor4D[mesh->mNumVertices];
+            for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+                mesh->mColors[1][i] = aiColor4D(gradients[i].x, gradients[i].y, gradients[i].z, 1.0f);
+        }
+    }
+
+    if (!outputPath.empty())
+    {
+        Assimp::Exporter exporter;
+        if (exporter.Export(scene, exportFormatId(outputPath).c_str(), outputPath) != aiReturn_SUCCESS)
+        {
+            std::cout << "ERROR::ASSIMP:: " << exporter.GetErrorString() << std::endl;
+            return 1;
+        }
+        std::cout << "Exported to " << outputPath << "\n";
+    }
+
+    if (verify && comparedVertices == 0)
+    {
+        std::cout << "FAILED: no mesh has d_N vertex colours to verify against\n";
+        return 2;
+    }
+    if (verify)
+    {
+        std::cout << "Verified " << comparedVertices << " vertices: max error " << maxError
+            << ", mean error " << errorSum / comparedVertices << " (tolerance " << tolerance << ")\n";
+        if (maxError > tolerance)
+        {
+            std::cout << "FAILED: baked d_N differs from the stored values\n";
+            return 2;
+        }
+        std::cout << "PASSED\n";
+    }
+    return 0;
+}
@@ -0,0 +1,428 @@
+// High-to-low surface map baker
+//
+// Usage: bake_maps <high model> [low .obj] [--ratio R] [--size TEXELS] [--gutter TEXELS] [--cage FRACTION] [--views N] [--images PREFIX]
+//
+// The high-poly model is loaded like the renderer loads it (d_N baked if missing) and decimated to about
+// R of its triangles. Each low-poly triangle gets its own cell of a texture atlas, and the high-poly normal
+// (in the low-poly's tangent frame) and d_N are projected onto it. The low-poly model is written as an OBJ
+// with UVs and d_N vertex colours (default <high>_low.obj next to the input), the maps next to it as
+// <low>_normal.png and <low>_thickness.hdr, which ModelCatalog picks up.
+// The tool then renders the high-poly, the bare low-poly and the low-poly with its maps through a CPU copy of
+// the two-surface shader from a few views and prints the image error of both low-poly versions.
+// --images writes each view as PREFIX_viewN.png (high | low | low + maps).
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include <my_dn_baker.h>
+#include <my_map_baker.h>
+#include <my_model_loader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem> // Requires C++17
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const int COMPARISON_IMAGE_SIZE = 256;
+const float COMPARISON_IOR = 1.5f;
+const float COMPARISON_FOV_DEGREES = 40.0f;
+
+void printUsage()
+{
+    std::cout << "Usage: bake_maps <high model> [low .obj] [--ratio R] [--size TEXELS] [--gutter TEXELS] [--cage FRACTION] [--views N] [--images PREFIX]\n";
+}
+
+// OBJ with UVs and the d_N colour extension my_obj_loader.h reads (one v/vt/vn per vertex)
+bool writeLowPolyObj(const std::string& path, const MeshData& mesh)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << "# Low-poly model written by bake_maps, d_N in the vertex colours\n";
+    for (const Vertex& vertex : mesh.vertices)
+        file << "v " << vertex.Position.x << " " << vertex.Position.y << " " << vertex.Position.z << " " << vertex.d_N << " " << vertex.d_N << " " << vertex.d_N << "\n";
+    for (const Vertex& vertex : mesh.vertices)
+        file << "vt " << vertex.TexCoords.x << " " << 1.0f - vertex.TexCoords.y << "\n";
+    for (const Vertex& vertex : mesh.vertices)
+        file << "vn " << vertex.Normal.x << " " << vertex.Normal.y << " " << vertex.Normal.z << "\n";
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+    {
+        file << "f";
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int index = mesh.indices[t + k] + 1;
+            file << " " << index << "/" << index << "/" << index;
+        }
+        file << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+// Write the maps, then read them back so the comparison sees the stored precision (8-bit normals, RGBE d_N)
+bool writeSurfaceMaps(const std::string& modelPath, SurfaceMaps& maps)
+{
+    std::string normalMapPath, thicknessMapPath;
+    surfaceMapPaths(modelPath, normalMapPath, thicknessMapPath);
+    if (!stbi_write_png(normalMapPath.c_str(), maps.width, maps.height, 3, maps.normals.data(), maps.width * 3)
+        || !stbi_write_hdr(thicknessMapPath.c_str(), maps.width, maps.height, 1, maps.thickness.data()))
+        return false;
+
+    int width, height, channels;
+    float* thickness = stbi_loadf(thicknessMapPath.c_str(), &width, &height, &channels, 1);
+    if (!thickness || width != maps.width || height != maps.height)
+    {
+        stbi_image_free(thickness);
+        return false;
+    }
+    maps.thickness.assign(thickness, thickness + static_cast<size_t>(width) * height);
+    stbi_image_free(thickness);
+    return true;
+}
+
+// One model as the comparison renderer sees it
+struct ComparisonSurface
+{
+    const MeshData* mesh = nullptr;
+    const SurfaceMaps* maps = nullptr; // Null to use the vertex normals and d_N
+    TriangleBvh bvh;
+
+    ComparisonSurface(const MeshData& meshData, const SurfaceMaps* surfaceMaps)
+        : mesh(&meshData), maps(surfaceMaps)
+    {
+        std::vector<glm::vec3> positions(meshData.vertices.size());
+        for (size_t v = 0; v < positions.size(); v++)
+            positions[v] = meshData.vertices[v].Position;
+        bvh.build(positions, meshData.indices, DNBakeSettings().leafSize);
+    }
+
+    // Shading normal and d_N at a hit, as the two-surface shaders get them
+    void shade(const BvhHit& hit, glm::vec3& normal, float& thickness) const
+    {
+        const unsigned int* tri = &mesh->indices[static_cast<size_t>(hit.triangle) * 3];
+        const Vertex* corner[3] = { &mesh->vertices[tri[0]], &mesh->vertices[tri[1]], &mesh->vertices[tri[2]] };
+        float w[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+        normal = glm::vec3(0.0f);
+        thickness = 0.0f;
+        glm::vec2 texCoords(0.0f);
+        for (int k = 0; k < 3; k++)
+        {
+            normal += corner[k]->Normal * w[k];
+            thickness += corner[k]->d_N * w[k];
+            texCoords += corner[k]->TexCoords * w[k];
+        }
+        normal = glm::normalize(normal);
+        if (!maps)
+            return;
+
+        glm::vec3 tangent, bitangent;
+        cotangentFrame(normal, corner[1]->Position - corner[0]->Position, corner[2]->Position - corner[0]->Position,
+            corner[1]->TexCoords - corner[0]->TexCoords, corner[2]->TexCoords - corner[0]->TexCoords, tangent, bitangent);
+        normal = applyTangentNormal(tangent, bitangent, normal, sampleNormalMap(*maps, texCoords));
+        thickness = sampleThicknessMap(*maps, texCoords);
+    }
+};
+
+struct ComparisonCamera
+{
+    glm::vec3 eye, forward, right, up;
+    float tanHalfFov;
+
+    glm::vec3 ray(int x, int y) const
+    {
+        float px = ((x + 0.5f) / COMPARISON_IMAGE_SIZE * 2.0f - 1.0f) * tanHalfFov;
+        float py = (1.0f - (y + 0.5f) / COMPARISON_IMAGE_SIZE * 2.0f) * tanHalfFov;
+        return glm::normalize(forward + right * px + up * py);
+    }
+
+    // Pixel a point projects to, false if behind the camera or off screen
+    bool project(const glm::vec3& point, int& x, int& y) const
+    {
+        glm::vec3 offset = point - eye;
+        float depth = glm::dot(offset, forward);
+        if (depth <= 1e-6f)
+            return false;
+        float px = glm::dot(offset, right) / (depth * tanHalfFov), py = glm::dot(offset, up) / (depth * tanHalfFov);
+        x = static_cast<int>(std::floor((px * 0.5f + 0.5f) * COMPARISON_IMAGE_SIZE));
+        y = static_cast<int>(std::floor((0.5f - py * 0.5f) * COMPARISON_IMAGE_SIZE));
+        return x >= 0 && y >= 0 && x < COMPARISON_IMAGE_SIZE && y < COMPARISON_IMAGE_SIZE;
+    }
+};
+
+// Sky over ground with a latitude-longitude checker, so refraction errors show up as shifted edges
+glm::vec3 environment(const glm::vec3& dir)
+{
+    const float pi = 3.14159265f;
+    float sky = std::min(std::max(dir.y * 2.5f + 0.5f, 0.0f), 1.0f);
+    glm::vec3 colour = glm::vec3(0.35f, 0.28f, 0.2f) * (1.0f - sky) + glm::vec3(0.45f, 0.65f, 0.95f) * sky;
+    float longitude = std::atan2(dir.z, dir.x), latitude = std::asin(std::min(std::max(dir.y, -1.0f), 1.0f));
+    int checker = (static_cast<int>(std::floor(longitude * 8.0f / pi)) + static_cast<int>(std::floor(latitude * 8.0f / pi))) & 1;
+    return colour * (checker ? 1.0f : 0.6f);
+}
+
+struct ComparisonImage
+{
+    std::vector<glm::vec3> colour;
+    std::vector<glm::vec3> normal;   // Front-surface shading normal (zero where the model isn't hit)
+    std::vector<float> thickness;
+};
+
+// Two-surface refraction as in frontfaceShader.fs (d_N along T1, no reflection): a back-face normal buffer
+// first, then refract at the front face, step d_N along T1, look up the back normal there and refract out
+ComparisonImage renderTwoSurfaces(const ComparisonSurface& surface, const ComparisonCamera& camera)
+{
+    const size_t pixels = static_cast<size_t>(COMPARISON_IMAGE_SIZE) * COMPARISON_IMAGE_SIZE;
+    std::vector<glm::vec3> backNormals(pixels, glm::vec3(0.0f));
+    ComparisonImage image;
+    image.colour.resize(pixels);
+    image.normal.assign(pixels, glm::vec3(0.0f));
+    image.thickness.assign(pixels, 0.0f);
+
+    globalThreadPool().parallelFor(pixels, 256, [&](size_t begin, size_t end)
+    {
+        for (size_t p = begin; p < end; p++)
+        {
+            BvhHit hit;
+            if (surface.bvh.closestHit(camera.eye, camera.ray(static_cast<int>(p % COMPARISON_IMAGE_SIZE), static_cast<int>(p / COMPARISON_IMAGE_SIZE)), FLT_MAX, hit, -1))
+            {
+                float unused;
+                surface.shade(hit, backNormals[p], unused);
+            }
+        }
+    });
+
+    globalThreadPool().parallelFor(pixels, 256, [&](size_t begin, size_t end)
+    {
+        for (size_t p = begin; p < end; p++)
+        {
+            glm::vec3 I = camera.ray(static_cast<int>(p % COMPARISON_IMAGE_SIZE), static_cast<int>(p / COMPARISON_IMAGE_SIZE));
+            BvhHit hit;
+            if (glm::dot(backNormals[p], backNormals[p]) == 0.0f || !surface.bvh.closestHit(camera.eye, I, FLT_MAX, hit, 1))
+            {
+                image.colour[p] = environment(I);
+                continue;
+            }
+            glm::vec3 N1;
+            float d;
+            surface.shade(hit, N1, d);
+            image.normal[p] = N1;
+            image.thickness[p] = d;
+
+            glm::vec3 P1 = camera.eye + I * hit.t;
+            glm::vec3 T1 = glm::refract(I, N1, 1.0f / COMPARISON_IOR);
+            int x, y;
+            glm::vec3 N2(0.0f);
+            if (camera.project(P1 + T1 * d, x, y))
+                N2 = backNormals[static_cast<size_t>(y) * COMPARISON_IMAGE_SIZE + x];
+            if (glm::dot(N2, N2) == 0.0f)
+            {
+                image.colour[p] = environment(T1); // No back face under P2 (the shader reads the cleared buffer)
+                continue;
+            }
+            glm::vec3 T2 = glm::refract(T1, -N2, COMPARISON_IOR);
+            if (glm::dot(T2, T2) < 1e-6f)
+                T2 = glm::reflect(I, N1);
+            image.colour[p] = environment(T2);
+        }
+    });
+    return image;
+}
+
+struct ImageError
+{
+    double meanColourError = 0.0;   // 8-bit units over pixels either image covers
+    double psnr = 0.0;              // dB over the same pixels
+    double meanNormalDegrees = 0.0; // Front normals where both images hit the model
+    double meanThicknessError = 0.0;
+
+    void add(const ImageError& other, int count)
+    {
+        meanColourError += other.meanColourError / count;
+        psnr += other.psnr / count;
+        meanNormalDegrees += other.meanNormalDegrees / count;
+        meanThicknessError += other.meanThicknessError / count;
+    }
+};
+
+ImageError compareImages(const ComparisonImage& reference, const ComparisonImage& image)
+{
+    ImageError error;
+    double colourSum = 0.0, squaredSum = 0.0, angleSum = 0.0, thicknessSum = 0.0;
+    size_t covered = 0, bothHit = 0;
+    for (size_t p = 0; p < reference.colour.size(); p++)
+    {
+        bool referenceHit = glm::dot(reference.normal[p], reference.normal[p]) > 0.0f;
+        bool imageHit = glm::dot(image.normal[p], image.normal[p]) > 0.0f;
+        if (!referenceHit && !imageHit)
+            continue;
+        glm::vec3 difference = glm::abs(reference.colour[p] - image.colour[p]);
+        colourSum += (difference.x + difference.y + difference.z) / 3.0;
+        squaredSum += glm::dot(difference, difference) / 3.0;
+        covered++;
+        if (referenceHit && imageHit)
+        {
+            angleSum += std::acos(std::min(std::max(glm::dot(reference.normal[p], image.normal[p]), -1.0f), 1.0f));
+            thicknessSum += std::fabs(reference.thickness[p] - image.thickness[p]);
+            bothHit++;
+        }
+    }
+    if (covered > 0)
+    {
+        error.meanColourError = colourSum / covered * 255.0;
+        error.psnr = squaredSum > 0.0 ? 10.0 * std::log10(covered / squaredSum) : 99.0;
+    }
+    if (bothHit > 0)
+    {
+        error.meanNormalDegrees = glm::degrees(static_cast<float>(angleSum / bothHit));
+        error.meanThicknessError = thicknessSum / bothHit;
+    }
+    return error;
+}
+
+void writeComparisonImage(const std::string& path, const std::vector<const ComparisonImage*>& images)
+{
+    int width = COMPARISON_IMAGE_SIZE * static_cast<int>(images.size());
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * COMPARISON_IMAGE_SIZE * 3);
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        for (int y = 0; y < COMPARISON_IMAGE_SIZE; y++)
+        {
+            for (int x = 0; x < COMPARISON_IMAGE_SIZE; x++)
+            {
+                const glm::vec3& colour = images[i]->colour[static_cast<size_t>(y) * COMPARISON_IMAGE_SIZE + x];
+                unsigned char* out = &pixels[(static_cast<size_t>(y) * width + i * COMPARISON_IMAGE_SIZE + x) * 3];
+                for (int k = 0; k < 3; k++)
+                    out[k] = static_cast<unsigned char>(std::lround(std::min(std::max(colour[k], 0.0f), 1.0f) * 255.0f));
+            }
+        }
+    }
+    if (!stbi_write_png(path.c_str(), width, COMPARISON_IMAGE_SIZE, 3, pixels.data(), width * 3))
+        std::cout << "ERROR::BAKE_MAPS:: Could not write " << path << std::endl;
+}
+
+// Float-layout GPU size of a mesh (as Model reports it)
+size_t meshBytes(const MeshData& mesh)
+{
+    return mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(unsigned int);
+}
+
+int main(int argc, char** argv)
+{
+    std::string inputPath, outputPath, imagePrefix;
+    MapBakeSettings settings;
+    int views = 3;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--ratio" && i + 1 < argc)
+            settings.triangleRatio = std::strtof(argv[++i], nullptr);
+        else if (arg == "--size" && i + 1 < argc)
+            settings.mapSize = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--gutter" && i + 1 < argc)
+            settings.gutter = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--cage" && i + 1 < argc)
+            settings.cageDistance = std::strtof(argv[++i], nullptr);
+        else if (arg == "--views" && i + 1 < argc)
+            views = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--images" && i + 1 < argc)
+            imagePrefix = argv[++i];
+        else if (inputPath.empty())
+            inputPath = arg;
+        else if (outputPath.empty())
+            outputPath = arg;
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (inputPath.empty() || settings.mapSize == 0 || settings.triangleRatio <= 0.0f)
+    {
+        printUsage();
+        return 1;
+    }
+    if (outputPath.empty())
+    {
+        std::filesystem::path path(inputPath);
+        outputPath = (path.parent_path() / (path.stem().string() + "_low.obj")).generic_string();
+    }
+
+    // Loaded as the renderer loads it, so the high-poly d_N is the one the app would use
+    ModelData high = ModelLoader(ModelLoadSettings{ DNBakeMode::IfMissing }).load(inputPath, inputPath);
+    if (!high.valid)
+        return 1;
+    MeshData highMesh = mergeMeshes(high.meshes);
+    high = ModelData();
+
+    std::cout << "Baking surface maps with " << globalThreadPool().size() << " thread(s)\n";
+    MapBakeStats stats;
+    MeshData lowMesh = simplifyForBake(highMesh, settings, stats);
+    if (lowMesh.indices.empty())
+    {
+        std::cout << "ERROR::BAKE_MAPS:: Simplification left no triangles\n";
+        return 1;
+    }
+    layoutTriangleAtlas(lowMesh, settings, stats);
+
+    ComparisonSurface highSurface(highMesh, nullptr);
+    SurfaceMaps maps = bakeSurfaceMaps(highMesh, highSurface.bvh, lowMesh, settings, stats);
+
+    std::cout << "> Triangles: " << stats.highTriangles << " -> " << stats.lowTriangles << " (" << stats.lowVertices << " vertices, max collapse distance "
+        << stats.simplifyError << ") in " << stats.simplifyMilliseconds << " ms\n";
+    std::cout << "> Maps: " << maps.width << "x" << maps.height << ", " << stats.cellTexels << " texel cells, " << stats.bakedTexels << " texels baked ("
+        << 100.0 * stats.missedTexels / std::max<size_t>(stats.bakedTexels, 1) << "% outside the cage) in " << stats.bakeMilliseconds << " ms\n";
+    if (stats.cellTexels < 8.0f)
+        std::cout << "  Atlas cells are under 8 texels, raise --size or lower --ratio\n";
+
+    if (!writeLowPolyObj(outputPath, lowMesh) || !writeSurfaceMaps(outputPath, maps))
+    {
+        std::cout << "ERROR::BAKE_MAPS:: Could not write " << outputPath << " or its maps\n";
+        return 1;
+    }
+    std::cout << "Wrote " << outputPath << " and its maps\n";
+    std::cout << "> GPU memory (float layout): high " << meshBytes(highMesh) / 1024 << " KB, low " << meshBytes(lowMesh) / 1024
+        << " KB + maps " << maps.gpuBytes() / 1024 << " KB\n";
+
+    // Image error of the bare low-poly and the mapped one against the high-poly
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (const Vertex& vertex : highMesh.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+    ComparisonSurface lowSurface(lowMesh, nullptr), mappedSurface(lowMesh, &maps);
+    ImageError lowTotal, mappedTotal;
+    for (int view = 0; view < views; view++)
+    {
+        float azimuth = glm::radians(360.0f * view / views + 30.0f), elevation = glm::radians(20.0f);
+        ComparisonCamera camera;
+        camera.tanHalfFov = std::tan(glm::radians(COMPARISON_FOV_DEGREES) * 0.5f);
+        camera.eye = center + glm::vec3(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth))
+            * (radius / std::sin(glm::radians(COMPARISON_FOV_DEGREES) * 0.5f));
+        camera.forward = glm::normalize(center - camera.eye);
+        camera.right = glm::normalize(glm::cross(camera.forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        camera.up = glm::cross(camera.right, camera.forward);
+
+        ComparisonImage reference = renderTwoSurfaces(highSurface, camera);
+        ComparisonImage low = renderTwoSurfaces(lowSurface, camera);
+        ComparisonImage mapped = renderTwoSurfaces(mappedSurface, camera);
+        lowTotal.add(compareImages(reference, low), views);
+        mappedTotal.add(compareImages(reference, mapped), views);
+        if (!imagePrefix.empty())
+            writeComparisonImage(imagePrefix + "_view" + std::to_string(view) + ".png", { &reference, &low, &mapped });
+    }
+
+    std::cout << "Two-surface image error against the high-poly (" << views << " views, " << COMPARISON_IMAGE_SIZE << "x" << COMPARISON_IMAGE_SIZE << "):\n";
+    std::cout << "  Low-poly:        " << lowTotal.meanColourError << " mean abs error, " << lowTotal.psnr << " dB PSNR, normals off by "
+        << lowTotal.meanNormalDegrees << " deg, d_N off by " << lowTotal.meanThicknessError << "\n";
+    std::cout << "  Low-poly + maps: " << mappedTotal.meanColourError << " mean abs error, " << mappedTotal.psnr << " dB PSNR, normals off by "
+        << mappedTotal.meanNormalDegrees << " deg, d_N off by " << mappedTotal.meanThicknessError << "\n";
+    return 0;
+}
@@ -0,0 +1,236 @@
+// Virtual environment tile file builder
+//
+// Usage: build_virtual_environment <skybox directory> [--tile-size TEXELS] [--hdr-format rgb9e5|r11g11b10f] [--synthetic SIZE]
+//
+// Cuts the six faces of a skybox directory (px/nx/py/ny/pz/nz .hdr, else .png) and their mips into bordered tiles
+// and writes them to <directory>/environment.vtex, which Cubemap in my_skybox.h then streams as a virtual texture
+// (my_virtual_texture.h) instead of uploading the faces. The face size must be the tile size (default 128) times
+// a power of two. --synthetic SIZE writes a generated test environment of SIZE-texel faces instead, to try 8K or
+// 16K faces without a capture; only one face is ever held in memory, and a synthetic one not at all.
+
+#include <stb_image.h>
+
+#include <my_hdr_formats.h>
+#include <my_texture_compression.h>
+#include <my_virtual_texture.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem> // Requires C++17
+#include <iostream>
+#include <string>
+#include <vector>
+
+const char* FACE_NAMES[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+void printUsage()
+{
+    std::cout << "Usage: build_virtual_environment <skybox directory> [--tile-size TEXELS] [--hdr-format rgb9e5|r11g11b10f] [--synthetic SIZE]\n";
+}
+
+// One face's mip chain, LDR (RGB8) or HDR (float RGB), loaded when the writer reaches it
+struct FaceLevels
+{
+    int face = -1;
+    std::vector<int> sizes;
+    std::vector<std::vector<unsigned char>> ldr;
+    std::vector<std::vector<float>> hdr;
+};
+
+std::vector<float> downsampleFloatRGB(const std::vector<float>& rgb, int size)
+{
+    int next = size / 2;
+    std::vector<float> result(static_cast<size_t>(next) * next * 3);
+    for (int y = 0; y < next; y++)
+        for (int x = 0; x < next; x++)
+            for (int c = 0; c < 3; c++)
+                result[(static_cast<size_t>(y) * next + x) * 3 + c] = 0.25f * (rgb[((2 * y) * static_cast<size_t>(size) + 2 * x) * 3 + c]
+                    + rgb[((2 * y) * static_cast<size_t>(size) + 2 * x + 1) * 3 + c] + rgb[((2 * y + 1) * static_cast<size_t>(size) + 2 * x) * 3 + c]
+                    + rgb[((2 * y + 1) * static_cast<size_t>(size) + 2 * x + 1) * 3 + c]);
+    return result;
+}
+
+bool loadFace(const std::string& directory, int face, bool hdr, uint32_t levels, FaceLevels& out)
+{
+    out = FaceLevels();
+    out.face = face;
+    std::string path = directory + "/" + FACE_NAMES[face] + (hdr ? ".hdr" : ".png");
+    int width, height, channels;
+    if (hdr)
+    {
+        float* data = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+        if (!data)
+            return false;
+        out.hdr.emplace_back(data, data + static_cast<size_t>(width) * height * 3);
+        stbi_image_free(data);
+    }
+    else
+    {
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 3);
+        if (!data)
+            return false;
+        out.ldr.emplace_back(data, data + static_cast<size_t>(width) * height * 3);
+        stbi_image_free(data);
+    }
+    out.sizes.push_back(width);
+    for (uint32_t level = 1; level < levels; level++)
+    {
+        int size = out.sizes.back(), next = size / 2, nextHeight;
+        if (hdr)
+            out.hdr.push_back(downsampleFloatRGB(out.hdr.back(), size));
+        else
+            out.ldr.push_back(downsampleRGB(out.ldr.back(), size, size, next, nextHeight));
+        out.sizes.push_back(next);
+    }
+    return true;
+}
+
+// Generated environment: smooth colour over the sphere with ripples a few texels wide at level 0, so the
+// streamed level shows
+void syntheticTexel(int face, uint32_t faceSize, uint32_t level, int x, int y, float rgb[3])
+{
+    float texel = static_cast<float>(1u << level);
+    float s = ((x + 0.5f) * texel / faceSize) * 2.0f - 1.0f, t = ((y + 0.5f) * texel / faceSize) * 2.0f - 1.0f;
+    float direction[3];
+    switch (face)
+    {
+    case 0: direction[0] = 1.0f; direction[1] = -t; direction[2] = -s; break;
+    case 1: direction[0] = -1.0f; direction[1] = -t; direction[2] = s; break;
+    case 2: direction[0] = s; direction[1] = 1.0f; direction[2] = t; break;
+    case 3: direction[0] = s; direction[1] = -1.0f; direction[2] = -t; break;
+    case 4: direction[0] = s; direction[1] = -t; direction[2] = 1.0f; break;
+    default: direction[0] = -s; direction[1] = -t; direction[2] = -1.0f; break;
+    }
+    float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    float ripple = 0.5f + 0.5f * std::cos((x + y) * texel * 6.2832f / 8.0f) * std::max(1.0f - level * 0.25f, 0.0f);
+    for (int c = 0; c < 3; c++)
+        rgb[c] = (0.5f + 0.4f * direction[c] / length) * (0.75f + 0.25f * ripple) * 255.0f;
+}
+
+int main(int argc, char** argv)
+{
+    std::string directory;
+    uint32_t tileSize = 128;
+    uint32_t syntheticSize = 0;
+    HdrPacking packing = HdrPacking::RGB9E5;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tile-size" && i + 1 < argc)
+            tileSize = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 4));
+        else if (arg == "--synthetic" && i + 1 < argc)
+            syntheticSize = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 1));
+        else if (arg == "--hdr-format" && i + 1 < argc)
+            packing = std::string(argv[++i]) == "r11g11b10f" ? HdrPacking::R11G11B10F : HdrPacking::RGB9E5;
+        else if (directory.empty() && arg.rfind("--", 0) != 0)
+            directory = arg;
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (directory.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Face size from the first face's header, or the synthetic size
+    bool hdr = false;
+    uint32_t faceSize = syntheticSize;
+    if (!syntheticSize)
+    {
+        std::error_code error;
+        hdr = std::filesystem::is_regular_file(directory + "/px.hdr", error);
+        std::string path = directory + "/px" + (hdr ? ".hdr" : ".png");
+        int width, height, channels;
+        if (!stbi_info(path.c_str(), &width, &height, &channels) || width != height)
+        {
+            std::cout << "ERROR::BUILD_VIRTUAL_ENVIRONMENT:: Could not read a square face from " << path << "\n";
+            return 1;
+        }
+        faceSize = static_cast<uint32_t>(width);
+    }
+    uint32_t levels = 1;
+    while ((tileSize << (levels - 1)) < faceSize)
+        levels++;
+    if ((tileSize << (levels - 1)) != faceSize || faceSize / tileSize > 256)
+    {
+        std::cout << "ERROR::BUILD_VIRTUAL_ENVIRONMENT:: Face size " << faceSize << " is not " << tileSize
+                  << " times a power of two up to 256\n";
+        return 1;
+    }
+
+    VirtualTileHeader header;
+    header.faceSize = faceSize;
+    header.tileSize = tileSize;
+    header.levels = levels;
+    header.internalFormat = hdr ? (packing == HdrPacking::RGB9E5 ? GL_RGB9_E5 : GL_R11F_G11F_B10F) : GL_RGBA8;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    FaceLevels current;
+    bool failed = false;
+    int slotSize = static_cast<int>(tileSize) + 2 * VIRTUAL_TILE_BORDER;
+    std::vector<float> rgb(static_cast<size_t>(slotSize) * slotSize * 3);
+    std::string outputPath = directory + "/" + VIRTUAL_TILE_FILE;
+    bool written = writeVirtualTileFile(outputPath, header, [&](uint32_t face, uint32_t level, uint32_t tileX, uint32_t tileY, uint32_t* texels)
+    {
+        if (!syntheticSize && current.face != static_cast<int>(face) && !failed)
+        {
+            failed = !loadFace(directory, static_cast<int>(face), hdr, levels, current) || current.sizes[0] != static_cast<int>(faceSize);
+            if (failed)
+                std::cout << "ERROR::BUILD_VIRTUAL_ENVIRONMENT:: Could not read face " << FACE_NAMES[face] << " at " << faceSize << "x" << faceSize << "\n";
+        }
+
+        // The tile and its border, clamped at the face's edges
+        int levelSize = static_cast<int>(faceSize >> level);
+        for (int y = 0; y < slotSize; y++)
+        {
+            for (int x = 0; x < slotSize; x++)
+            {
+                int sx = std::min(std::max(static_cast<int>(tileX * tileSize) + x - VIRTUAL_TILE_BORDER, 0), levelSize - 1);
+                int sy = std::min(std::max(static_cast<int>(tileY * tileSize) + y - VIRTUAL_TILE_BORDER, 0), levelSize - 1);
+                float* out = &rgb[(static_cast<size_t>(y) * slotSize + x) * 3];
+                size_t source = (static_cast<size_t>(sy) * levelSize + sx) * 3;
+                if (syntheticSize)
+                    syntheticTexel(static_cast<int>(face), faceSize, level, sx, sy, out);
+                else if (failed)
+                    std::fill(out, out + 3, 0.0f);
+                else if (hdr)
+                    std::copy(&current.hdr[level][source], &current.hdr[level][source] + 3, out);
+                else
+                    for (int c = 0; c < 3; c++)
+                        out[c] = current.ldr[level][source + c];
+            }
+        }
+
+        size_t count = static_cast<size_t>(slotSize) * slotSize;
+        if (hdr)
+            packHdrTexels(rgb.data(), count, packing, texels);
+        else
+            for (size_t i = 0; i < count; i++)
+                texels[i] = 0xFF000000u | static_cast<uint32_t>(std::min(std::max(rgb[i * 3] + 0.5f, 0.0f), 255.0f))
+                    | (static_cast<uint32_t>(std::min(std::max(rgb[i * 3 + 1] + 0.5f, 0.0f), 255.0f)) << 8)
+                    | (static_cast<uint32_t>(std::min(std::max(rgb[i * 3 + 2] + 0.5f, 0.0f), 255.0f)) << 16);
+    });
+    if (!written || failed)
+    {
+        std::cout << "ERROR::BUILD_VIRTUAL_ENVIRONMENT:: Could not write " << outputPath << "\n";
+        return 1;
+    }
+
+    size_t tiles = 6 * virtualTilesPerFace(faceSize, tileSize, levels);
+    size_t cubemapBytes = 0;
+    for (uint32_t level = 0; level < levels; level++)
+        cubemapBytes += 6 * static_cast<size_t>(faceSize >> level) * (faceSize >> level) * 4;
+    std::cout << "Wrote " << outputPath << ": " << faceSize << "x" << faceSize << (hdr ? " HDR" : "") << " faces, " << levels << " levels, "
+              << tiles << " tiles of " << tileSize << "x" << tileSize << ", " << tiles * (static_cast<size_t>(slotSize) * slotSize * 4) / (1024.0 * 1024.0)
+              << " MB (the whole cubemap takes " << cubemapBytes / (1024.0 * 1024.0) << " MB of VRAM) in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() << " ms\n";
+    return 0;
+}
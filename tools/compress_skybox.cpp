@@ -0,0 +1,170 @@
+// Skybox cubemap compressor
+//
+// Usage: compress_skybox [skybox directory ...] [--no-mips]
+//
+// Each directory holds the six faces as px/nx/py/ny/pz/nz.png, like skybox/graffiti_cubemap (the default is
+// all three skyboxes under skybox/). The faces and their mip chains are BC1-compressed on the thread pool and
+// written to <directory>/cubemap_bc1.ktx, which Cubemap in my_skybox.h uploads instead of the PNGs. The file
+// records the PNGs' sizes and modification times, and the renderer goes back to the PNGs once they change.
+// For each skybox the tool prints the PSNR of the compressed faces, the VRAM before and after, and the CPU time
+// to get the faces ready for upload both ways (PNG decode against reading the KTX file).
+
+#include <stb_image.h>
+
+#include <my_mapped_file.h>
+#include <my_texture_compression.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem> // Requires C++17
+#include <iostream>
+#include <string>
+#include <vector>
+
+const char* FACE_NAMES[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+struct SkyboxStats
+{
+    size_t uncompressedBytes = 0; // RGB8 padded to RGBA8, as drivers store it
+    size_t compressedBytes = 0;
+    double pngMilliseconds = 0.0;
+    double ktxMilliseconds = 0.0;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: compress_skybox [skybox directory ...] [--no-mips]\n";
+}
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool compressSkybox(const std::string& directory, bool mips, SkyboxStats& stats)
+{
+    std::vector<std::vector<CompressedLevel>> faces(6);
+    double minPsnr = 99.0, meanPsnr = 0.0;
+    double encodeMilliseconds = 0.0;
+    for (int face = 0; face < 6; face++)
+    {
+        std::string path = directory + "/" + FACE_NAMES[face] + ".png";
+        auto start = std::chrono::high_resolution_clock::now();
+        int width, height, channels;
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 3);
+        stats.pngMilliseconds += millisecondsSince(start);
+        if (!data)
+        {
+            std::cout << "ERROR::COMPRESS_SKYBOX:: Could not read " << path << "\n";
+            return false;
+        }
+        std::vector<unsigned char> rgb(data, data + static_cast<size_t>(width) * height * 3);
+        stbi_image_free(data);
+        stats.uncompressedBytes += static_cast<size_t>(width) * height * 4;
+
+        start = std::chrono::high_resolution_clock::now();
+        while (true)
+        {
+            CompressedLevel level;
+            level.width = width;
+            level.height = height;
+            level.data = compressBC1(rgb.data(), width, height);
+            if (faces[face].empty())
+            {
+                std::vector<unsigned char> decoded = decompressBC1(level.data.data(), width, height);
+                double psnr = psnrRGB(rgb.data(), decoded.data(), static_cast<size_t>(width) * height);
+                minPsnr = std::min(minPsnr, psnr);
+                meanPsnr += psnr / 6.0;
+                std::cout << "  " << FACE_NAMES[face] << ": " << width << "x" << height << ", " << psnr << " dB PSNR\n";
+            }
+            stats.compressedBytes += level.data.size();
+            faces[face].push_back(std::move(level));
+            if (!mips || (width == 1 && height == 1))
+                break;
+            int nextWidth, nextHeight;
+            rgb = downsampleRGB(rgb, width, height, nextWidth, nextHeight);
+            width = nextWidth;
+            height = nextHeight;
+        }
+        encodeMilliseconds += millisecondsSince(start);
+    }
+
+    // The PNGs' sizes and times go into the file, so the renderer can tell when it is out of date
+    std::vector<std::string> sourcePaths;
+    for (const char* faceName : FACE_NAMES)
+        sourcePaths.push_back(directory + "/" + faceName + ".png");
+    std::string sourceStamp;
+    ktxSourceStamp(sourcePaths, sourceStamp);
+
+    std::string outputPath = directory + "/cubemap_bc1.ktx";
+    if (!writeKtxCubemap(outputPath, KTX_COMPRESSED_RGB_S3TC_DXT1, KTX_BASE_FORMAT_RGB, faces, sourceStamp))
+    {
+        std::cout << "ERROR::COMPRESS_SKYBOX:: Could not write " << outputPath << "\n";
+        return false;
+    }
+
+    // Read back as the renderer does, one face at a time
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int face = 0; face < 6; face++)
+    {
+        MappedFile file;
+        uint32_t format = 0;
+        std::vector<CompressedLevel> levels;
+        if (!file.open(outputPath) || !readKtxCubemapFace(file, face, format, levels) || levels.size() != faces[face].size()
+            || levels[0].data != faces[face][0].data)
+        {
+            std::cout << "ERROR::COMPRESS_SKYBOX:: " << outputPath << " did not read back\n";
+            return false;
+        }
+    }
+    stats.ktxMilliseconds = millisecondsSince(start);
+
+    std::cout << "  Wrote " << outputPath << " (" << faces[0].size() << " mip level(s)), encoded in " << encodeMilliseconds << " ms\n";
+    std::cout << "  PSNR " << meanPsnr << " dB mean, " << minPsnr << " dB worst face\n";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> directories;
+    bool mips = true;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-mips")
+            mips = false;
+        else if (arg.rfind("--", 0) == 0)
+        {
+            printUsage();
+            return 1;
+        }
+        else
+            directories.push_back(arg);
+    }
+    if (directories.empty())
+        directories = { "skybox/graffiti_cubemap", "skybox/nightsky_cubemap", "skybox/museum_cubemap" };
+
+    std::cout << "Compressing with " << globalThreadPool().size() << " thread(s)\n";
+    SkyboxStats total;
+    for (const std::string& directory : directories)
+    {
+        std::cout << std::filesystem::path(directory).filename().string() << ":\n";
+        SkyboxStats stats;
+        if (!compressSkybox(directory, mips, stats))
+            return 1;
+        std::cout << "  VRAM " << stats.uncompressedBytes / (1024.0 * 1024.0) << " MB -> " << stats.compressedBytes / (1024.0 * 1024.0)
+                  << " MB, faces ready in " << stats.pngMilliseconds << " ms from PNG, " << stats.ktxMilliseconds << " ms from KTX\n";
+        total.uncompressedBytes += stats.uncompressedBytes;
+        total.compressedBytes += stats.compressedBytes;
+        total.pngMilliseconds += stats.pngMilliseconds;
+        total.ktxMilliseconds += stats.ktxMilliseconds;
+    }
+
+    std::cout << "Total: VRAM " << total.uncompressedBytes / (1024.0 * 1024.0) << " MB -> " << total.compressedBytes / (1024.0 * 1024.0)
+              << " MB (" << (total.uncompressedBytes - std::min(total.uncompressedBytes, total.compressedBytes)) / (1024.0 * 1024.0)
+              << " MB saved), load " << total.pngMilliseconds << " ms -> " << total.ktxMilliseconds << " ms ("
+              << total.pngMilliseconds / std::max(total.ktxMilliseconds, 1e-3) << "x faster)\n";
+    return 0;
+}
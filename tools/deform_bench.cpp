@@ -0,0 +1,150 @@
+// Deforming-mesh thickness benchmark (CPU side only, no OpenGL context needed)
+//
+// Usage: deform_bench [--frames N] [--max-vertices N] [--threshold T]
+//
+// Tori of growing vertex count are animated with the same wave deformer as the "Deform" checkbox.
+// Per frame: deformer plus normals, BVH refit, stale-vertex detection and the re-cast of stale vertices,
+// against rebuilding the BVH and re-casting every vertex. The last two columns compare the incremental d_N
+// with a full re-cast of the final pose: mean difference relative to the torus' diameter, and the share of
+// vertices off by more than twice the rebake threshold (rays that graze an edge of the far side, where d_N jumps).
+
+#include <my_deformation.h>
+#include <my_dn_baker.h>
+#include <my_mesh_data.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Closed torus around the z axis (major radius 1, minor radius 0.35) with rings * sides vertices. Each ring is
+// twisted out of its plane so rays through the tube don't run exactly along the far side's edges
+void makeTorus(unsigned int rings, unsigned int sides, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    vertices.clear();
+    indices.clear();
+    for (unsigned int r = 0; r < rings; r++)
+    {
+        for (unsigned int s = 0; s < sides; s++)
+        {
+            float tube = 6.2831853f * s / sides;
+            float around = 6.2831853f * (r + 0.3f * std::cos(tube)) / rings;
+            glm::vec3 center(std::cos(around), std::sin(around), 0.0f);
+            Vertex vertex;
+            vertex.Normal = center * std::cos(tube) + glm::vec3(0.0f, 0.0f, std::sin(tube));
+            vertex.Position = center + vertex.Normal * 0.35f;
+            vertex.d_N = 0.0f;
+            vertices.push_back(vertex);
+        }
+    }
+    for (unsigned int r = 0; r < rings; r++)
+    {
+        for (unsigned int s = 0; s < sides; s++)
+        {
+            unsigned int a = r * sides + s, b = r * sides + (s + 1) % sides;
+            unsigned int c = ((r + 1) % rings) * sides + s, d = ((r + 1) % rings) * sides + (s + 1) % sides;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 60;
+    size_t maxVertices = 140000;
+    DeformSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--max-vertices" && i + 1 < argc)
+            maxVertices = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--threshold" && i + 1 < argc)
+            settings.rebakeThreshold = std::strtof(argv[++i], nullptr);
+    }
+
+    std::cout << "Deforming thickness benchmark, " << frames << " frame(s) at 60 Hz, " << globalThreadPool().size() << " worker thread(s)\n";
+    std::cout << "Milliseconds per frame\n";
+    std::cout << std::right << std::setw(10) << "Vertices" << std::setw(10) << "Deform" << std::setw(10) << "Refit" << std::setw(10) << "Detect"
+        << std::setw(10) << "Rebaked" << std::setw(10) << "Rebake" << std::setw(12) << "Total" << std::setw(12) << "Full" << std::setw(10) << "Speedup"
+        << std::setw(12) << "Mean error" << std::setw(10) << "Off" << "\n";
+
+    DNBakeSettings bakeSettings;
+    for (unsigned int rings = 64; rings * (rings / 2 + 1) <= maxVertices; rings *= 2)
+    {
+        std::vector<Vertex> rest;
+        std::vector<unsigned int> indices;
+        makeTorus(rings, rings / 2 + 1, rest, indices);
+
+        // Rest pose bake, as the loader would have done
+        std::vector<glm::vec3> positions(rest.size()), normals(rest.size());
+        for (size_t i = 0; i < rest.size(); i++)
+        {
+            positions[i] = rest[i].Position;
+            normals[i] = rest[i].Normal;
+        }
+        std::vector<float> restThickness = bakeThickness(positions, normals, indices, bakeSettings);
+        for (size_t i = 0; i < rest.size(); i++)
+            rest[i].d_N = restThickness[i];
+
+        DeformableThickness thickness;
+        thickness.init(rest, indices, settings);
+        MeshDeformFunction deform = makeWaveDeformer(glm::vec3(0.0f), 1.35f);
+
+        double deformTime = 0.0, refitTime = 0.0, detectTime = 0.0, rebakeTime = 0.0, fullTime = 0.0;
+        size_t rebaked = 0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            deform(rest, frame / 60.0f, positions);
+            thickness.deformNormals(positions, normals);
+            deformTime += millisecondsSince(start);
+
+            ThicknessUpdateStats stats = thickness.update(positions, normals);
+            refitTime += stats.refitMilliseconds;
+            detectTime += stats.detectMilliseconds;
+            rebakeTime += stats.rebakeMilliseconds;
+            rebaked += stats.rebakedVertices;
+
+            // What the same frame costs without the incremental path
+            start = std::chrono::high_resolution_clock::now();
+            std::vector<float> full = bakeThickness(positions, normals, indices, bakeSettings);
+            fullTime += millisecondsSince(start);
+
+            if (frame == frames - 1)
+            {
+                // Same threshold DeformableThickness derives from the rest bounds
+                float diameter = 2.0f * 1.35f;
+                float threshold = settings.rebakeThreshold * glm::length(glm::vec3(diameter, diameter, 0.7f));
+                double errorSum = 0.0;
+                size_t off = 0;
+                for (size_t i = 0; i < full.size(); i++)
+                {
+                    float error = std::fabs(full[i] - thickness.thickness()[i]);
+                    errorSum += error;
+                    off += error > 2.0f * threshold ? 1 : 0;
+                }
+
+                double total = (deformTime + refitTime + detectTime + rebakeTime) / frames;
+                std::cout << std::setw(10) << rest.size() << std::fixed << std::setprecision(2)
+                    << std::setw(10) << deformTime / frames << std::setw(10) << refitTime / frames << std::setw(10) << detectTime / frames
+                    << std::setw(9) << std::setprecision(1) << 100.0 * rebaked / (static_cast<double>(rest.size()) * frames) << "%"
+                    << std::setprecision(2) << std::setw(10) << rebakeTime / frames << std::setw(12) << total << std::setw(12) << fullTime / frames
+                    << std::setw(9) << fullTime / frames / std::max(total, 1e-6) << "x" << std::setprecision(5) << std::setw(12) << errorSum / full.size() / diameter
+                    << std::setw(9) << std::setprecision(2) << 100.0 * off / full.size() << "%\n";
+            }
+        }
+    }
+    return 0;
+}
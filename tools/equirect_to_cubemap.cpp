@@ -0,0 +1,184 @@
+// Equirectangular panorama to cubemap faces
+//
+// Usage: equirect_to_cubemap [panorama] [output directory] [--size TEXELS] [--bench]
+//
+// Resamples the panorama (.hdr, or anything stb_image reads as 8-bit) with the tiled SIMD resampler in
+// my_equirect.h and writes px/nx/py/ny/pz/nz.png (.hdr for an HDR panorama) to the output directory, which
+// makes it a skybox directory. --size sets the face size (default a quarter of the panorama's width).
+// The renderer can also take the panorama itself as skybox/<name>/panorama.hdr/.png/.jpg.
+// --bench times the scalar resampler, the SIMD one on one thread and the SIMD one over the thread pool at
+// 1K, 2K and 4K faces (from an 8192x4096 test pattern if no panorama is given) and prints their throughput.
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include <my_equirect.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem> // Requires C++17
+#include <iostream>
+#include <string>
+#include <vector>
+
+const char* FACE_NAMES[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+void printUsage()
+{
+    std::cout << "Usage: equirect_to_cubemap [panorama] [output directory] [--size TEXELS] [--bench]\n";
+}
+
+// Six faces of interleaved float RGB
+struct FloatFaces
+{
+    int size = 0;
+    std::vector<std::vector<float>> faces;
+
+    explicit FloatFaces(int faceSize)
+        : size(faceSize), faces(6, std::vector<float>(static_cast<size_t>(faceSize) * faceSize * 3))
+    {
+    }
+
+    void store(int face, int x, int y, int tileWidth, int tileHeight, const float* rgb)
+    {
+        for (int row = 0; row < tileHeight; row++)
+            std::copy(rgb + static_cast<size_t>(row) * tileWidth * 3, rgb + static_cast<size_t>(row + 1) * tileWidth * 3,
+                faces[face].begin() + (static_cast<size_t>(y + row) * size + x) * 3);
+    }
+};
+
+template <typename T>
+double timeResample(const T* texels, int width, int height, FloatFaces& out, bool vectorized, bool parallel)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    equirectToCubemap(texels, width, height, out.size,
+        [&](int face, int x, int y, int tileWidth, int tileHeight, const float* rgb) { out.store(face, x, y, tileWidth, tileHeight, rgb); },
+        vectorized, parallel);
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template <typename T>
+void runBench(const T* texels, int width, int height)
+{
+    std::cout << "Resampling a " << width << "x" << height << " panorama, thread pool of " << globalThreadPool().size() << "\n";
+    for (int size : { 1024, 2048, 4096 })
+    {
+        FloatFaces reference(size), simd(size), tiled(size);
+        double scalarMs = timeResample(texels, width, height, reference, false, false);
+        double simdMs = timeResample(texels, width, height, simd, true, false);
+        double tiledMs = timeResample(texels, width, height, tiled, true, true);
+
+        double maxDifference = 0.0;
+        for (int face = 0; face < 6; face++)
+            for (size_t i = 0; i < reference.faces[face].size(); i++)
+                maxDifference = std::max(maxDifference, static_cast<double>(std::fabs(reference.faces[face][i] - tiled.faces[face][i])));
+
+        double megatexels = 6.0 * size * size / 1e6;
+        std::cout << "  " << size << "x" << size << " faces: scalar " << scalarMs << " ms (" << megatexels / (scalarMs / 1000.0) << " Mtexel/s), SIMD "
+                  << simdMs << " ms (" << megatexels / (simdMs / 1000.0) << "), SIMD tiled " << tiledMs << " ms (" << megatexels / (tiledMs / 1000.0)
+                  << "), largest difference from scalar " << maxDifference << "\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string inputPath, outputDirectory;
+    int faceSize = 0;
+    bool bench = false;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc)
+            faceSize = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--bench")
+            bench = true;
+        else if (inputPath.empty())
+            inputPath = arg;
+        else if (outputDirectory.empty())
+            outputDirectory = arg;
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (inputPath.empty() && !bench)
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (inputPath.empty())
+    {
+        // Test pattern: gradients with a checkerboard, so seams and misplaced texels show
+        const int width = 8192, height = 4096;
+        std::vector<unsigned char> pattern(static_cast<size_t>(width) * height * 3);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char* texel = &pattern[(static_cast<size_t>(y) * width + x) * 3];
+                texel[0] = static_cast<unsigned char>(x * 255 / width);
+                texel[1] = static_cast<unsigned char>(y * 255 / height);
+                texel[2] = ((x / 128 + y / 128) & 1) ? 255 : 0;
+            }
+        }
+        runBench(pattern.data(), width, height);
+        return 0;
+    }
+
+    int width, height, channels;
+    bool hdr = stbi_is_hdr(inputPath.c_str()) != 0;
+    void* data = hdr ? static_cast<void*>(stbi_loadf(inputPath.c_str(), &width, &height, &channels, 3))
+        : static_cast<void*>(stbi_load(inputPath.c_str(), &width, &height, &channels, 3));
+    if (!data)
+    {
+        std::cout << "ERROR::EQUIRECT_TO_CUBEMAP:: Could not read " << inputPath << "\n";
+        return 1;
+    }
+
+    if (bench)
+    {
+        if (hdr)
+            runBench(static_cast<const float*>(data), width, height);
+        else
+            runBench(static_cast<const unsigned char*>(data), width, height);
+    }
+
+    if (!outputDirectory.empty())
+    {
+        FloatFaces faces(faceSize > 0 ? faceSize : std::max(width / 4, 1));
+        double milliseconds = hdr ? timeResample(static_cast<const float*>(data), width, height, faces, true, true)
+            : timeResample(static_cast<const unsigned char*>(data), width, height, faces, true, true);
+        std::cout << "Resampled into " << faces.size << "x" << faces.size << " faces in " << milliseconds << " ms\n";
+
+        std::filesystem::create_directories(outputDirectory);
+        for (int face = 0; face < 6; face++)
+        {
+            std::string path = outputDirectory + "/" + FACE_NAMES[face] + (hdr ? ".hdr" : ".png");
+            bool written;
+            if (hdr)
+                written = stbi_write_hdr(path.c_str(), faces.size, faces.size, 3, faces.faces[face].data()) != 0;
+            else
+            {
+                std::vector<unsigned char> rgb(faces.faces[face].size());
+                for (size_t i = 0; i < rgb.size(); i++)
+                    rgb[i] = static_cast<unsigned char>(std::min(std::max(faces.faces[face][i] + 0.5f, 0.0f), 255.0f));
+                written = stbi_write_png(path.c_str(), faces.size, faces.size, 3, rgb.data(), faces.size * 3) != 0;
+            }
+            if (!written)
+            {
+                std::cout << "ERROR::EQUIRECT_TO_CUBEMAP:: Could not write " << path << "\n";
+                stbi_image_free(data);
+                return 1;
+            }
+        }
+        std::cout << "Wrote " << outputDirectory << "/{px,nx,py,ny,pz,nz}" << (hdr ? ".hdr" : ".png") << "\n";
+    }
+    stbi_image_free(data);
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Model load-time benchmark (CPU side only, no OpenGL context needed)
+//
+// Usage: load_bench [model ...] [--runs N] [--no-optimize] [--stdio-io]
+//
+// Cold: Assimp import + vertex/index extraction + mesh optimization + mesh cache write, the path ModelLoader takes on a first launch
+// Warm: map and validate the mesh cache and read every byte once, which is what glBufferData does with the mapping
+// Serial vs parallel: cold loads of all models one after another vs all at once on the thread pool
+// Vertex formats: GPU bytes of the float and packed layouts, and the packed layout's quantization error
+// Peak RSS: largest resident set of the whole run, mostly the biggest cold import
+// --stdio-io: let Assimp read through its default stdio IOSystem instead of the mapped one, run once with and once
+// without to compare cold times and peak RSS (peak RSS is per process, so it can't be split within one run)
+
+#include <my_memory_usage.h>
+#include <my_model_loader.h>
+#include <my_thread_pool.h>
+#include <my_vertex_packing.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem> // Requires C++17
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+void removeMeshCache(const std::string& model)
+{
+    std::error_code error;
+    std::filesystem::remove(meshCachePath(model), error);
+}
+
+// Read every vertex/index cache line so mapped pages are actually faulted in
+uint64_t touchMeshData(const ModelData& data)
+{
+    uint64_t checksum = 0;
+    for (const MeshData& meshData : data.meshes)
+    {
+        const unsigned char* vertexBytes = reinterpret_cast<const unsigned char*>(meshData.vertexData());
+        const unsigned char* indexBytes = reinterpret_cast<const unsigned char*>(meshData.indexData());
+        size_t vertexSize = meshData.vertexCount() * sizeof(Vertex);
+        size_t indexSize = meshData.indexCount() * sizeof(unsigned int);
+        for (size_t i = 0; i < vertexSize; i += 64)
+            checksum += vertexBytes[i];
+        for (size_t i = 0; i < indexSize; i += 64)
+            checksum += indexBytes[i];
+    }
+    return checksum;
+}
+
+// Same sizes Mesh::gpuBytes reports for each layout
+void reportVertexFormats(const std::string& model, const ModelData& data)
+{
+    size_t floatBytes = 0, packedBytes = 0;
+    float maxPositionError = 0.0f, maxNormalDegrees = 0.0f, maxDNError = 0.0f;
+    for (const MeshData& meshData : data.meshes)
+    {
+        PackedMeshData packed = packMeshData(meshData.vertexData(), meshData.vertexCount(), meshData.indexData(), meshData.indexCount());
+        floatBytes += meshData.vertexCount() * sizeof(Vertex) + meshData.indexCount() * sizeof(unsigned int);
+        packedBytes += packed.vertices.size() * sizeof(PackedVertex) + meshData.indexCount() * (packed.shortIndices.empty() ? sizeof(unsigned int) : sizeof(uint16_t));
+
+        // Decode exactly like the vertex shaders do
+        float extent = std::max(std::max(packed.positionScale.x, packed.positionScale.y), std::max(packed.positionScale.z, 1e-12f));
+        for (size_t i = 0; i < packed.vertices.size(); i++)
+        {
+            const Vertex& vertex = meshData.vertexData()[i];
+            const PackedVertex& p = packed.vertices[i];
+            glm::vec3 position = glm::vec3(p.position[0], p.position[1], p.position[2]) / 65535.0f * packed.positionScale + packed.positionOffset;
+            glm::vec3 normal = octDecode(glm::max(glm::vec2(p.normal[0], p.normal[1]) / 32767.0f, glm::vec2(-1.0f)));
+            maxPositionError = std::max(maxPositionError, glm::length(position - vertex.Position) / extent);
+            if (glm::length(vertex.Normal) > 0.0f)
+            {
+                float cosine = std::min(1.0f, glm::dot(normal, glm::normalize(vertex.Normal)));
+                maxNormalDegrees = std::max(maxNormalDegrees, std::acos(cosine) * 57.29578f);
+            }
+            maxDNError = std::max(maxDNError, std::fabs(halfToFloat(p.thickness[0]) - vertex.d_N));
+        }
+    }
+
+    std::cout << std::left << std::setw(32) << model << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << floatBytes / 1024.0 << std::setw(12) << packedBytes / 1024.0
+        << std::setw(9) << 100.0 * packedBytes / std::max<size_t>(floatBytes, 1) << "%"
+        << std::setprecision(5) << std::setw(12) << maxPositionError
+        << std::setprecision(3) << std::setw(12) << maxNormalDegrees
+        << std::setprecision(4) << std::setw(12) << maxDNError << "\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> models;
+    int runs = 5;
+    ModelLoadSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--no-optimize")
+            settings.optimizeMeshes = false;
+        else if (arg == "--stdio-io")
+            settings.mappedIO = false;
+        else
+            models.push_back(arg);
+    }
+    if (models.empty())
+        models = { "models/teapot.fbx", "models/donut.fbx", "models/sphere.fbx", "models/suzanne_monkey.fbx", "models/buddha.fbx" };
+
+    // Keep the benchmark's caches apart from the renderer's
+    meshCacheDirectory = "cache/bench";
+    ModelLoader loader(settings);
+    uint64_t checksum = 0;
+
+    std::cout << "Mesh cache benchmark, median of " << runs << " run(s), Assimp reads through " << (settings.mappedIO ? "the mapped IOSystem" : "stdio") << "\n";
+    std::cout << std::left << std::setw(32) << "Model" << std::right << std::setw(14) << "Cold (ms)" << std::setw(14) << "Warm (ms)" << std::setw(10) << "Speedup" << "\n";
+    for (const std::string& model : models)
+    {
+        std::vector<double> coldTimes, warmTimes;
+        bool ok = true;
+        for (int run = 0; run < runs && ok; run++)
+        {
+            removeMeshCache(model);
+            auto start = std::chrono::high_resolution_clock::now();
+            ModelData cold = loader.load(model, model);
+            checksum += touchMeshData(cold);
+            coldTimes.push_back(millisecondsSince(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            ModelData warm = loader.load(model, model);
+            checksum += touchMeshData(warm);
+            warmTimes.push_back(millisecondsSince(start));
+            ok = cold.valid && warm.valid && warm.loadedFromCache;
+        }
+        if (!ok)
+        {
+            std::cout << std::left << std::setw(32) << model << " failed to load\n";
+            continue;
+        }
+
+        double cold = median(coldTimes), warm = median(warmTimes);
+        std::cout << std::left << std::setw(32) << model << std::right << std::fixed << std::setprecision(2)
+            << std::setw(14) << cold << std::setw(14) << warm << std::setw(9) << cold / std::max(warm, 1e-6) << "x\n";
+    }
+
+    // GPU memory of the two vertex layouts
+    std::cout << "\nVertex formats (KB on the GPU, position error relative to the bounds, normal error in degrees)\n";
+    std::cout << std::left << std::setw(32) << "Model" << std::right << std::setw(12) << "Float" << std::setw(12) << "Packed"
+        << std::setw(10) << "Size" << std::setw(12) << "Pos err" << std::setw(12) << "Nrm err" << std::setw(12) << "d_N err" << "\n";
+    for (const std::string& model : models)
+    {
+        ModelData data = loader.load(model, model);
+        if (data.valid)
+            reportVertexFormats(model, data);
+    }
+
+    // Whole model set, cold, one at a time vs all at once
+    std::vector<double> serialTimes, parallelTimes;
+    for (int run = 0; run < runs; run++)
+    {
+        for (const std::string& model : models)
+            removeMeshCache(model);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const std::string& model : models)
+            checksum += touchMeshData(loader.load(model, model));
+        serialTimes.push_back(millisecondsSince(start));
+
+        for (const std::string& model : models)
+            removeMeshCache(model);
+        start = std::chrono::high_resolution_clock::now();
+        std::vector<std::future<ModelData>> pending;
+        for (const std::string& model : models)
+            pending.push_back(globalThreadPool().submit([&loader, model]() { return loader.load(model, model); }));
+        for (auto& result : pending)
+            checksum += touchMeshData(result.get());
+        parallelTimes.push_back(millisecondsSince(start));
+    }
+    std::cout << "\nAll models, cold, " << globalThreadPool().size() << " worker thread(s): serial " << std::fixed << std::setprecision(2)
+        << median(serialTimes) << " ms, parallel " << median(parallelTimes) << " ms\n";
+
+    std::cout << "Peak RSS: " << std::setprecision(1) << peakResidentBytes() / (1024.0 * 1024.0) << " MB\n";
+    std::cout << "(checksum " << checksum << ")\n";
+    return 0;
+}
@@ -0,0 +1,105 @@
+// OBJ import benchmark (CPU side only, no OpenGL context needed)
+//
+// Usage: obj_bench [model.obj ...] [--runs N]
+//
+// Fast: the memory-mapped parallel parser in my_obj_loader.h
+// Assimp: the same file through Assimp's OBJ importer and our aiMesh extraction
+// Both columns are the raw import only (no d_N bake, optimization, LODs or mesh cache)
+
+#include <my_model_loader.h>
+#include <my_thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem> // Requires C++17
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Median import time of one file with the given loader, counts from the last run
+bool timeImport(const ModelLoader& loader, const std::string& model, int runs, double& milliseconds, size_t& vertices, size_t& triangles)
+{
+    std::vector<double> times;
+    for (int run = 0; run < runs; run++)
+    {
+        ModelData data;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!loader.importModel(model, data))
+            return false;
+        times.push_back(millisecondsSince(start));
+
+        vertices = 0;
+        triangles = 0;
+        for (const MeshData& meshData : data.meshes)
+        {
+            vertices += meshData.vertexCount();
+            triangles += meshData.indexCount() / 3;
+        }
+    }
+    milliseconds = median(times);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> models;
+    int runs = 5;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            runs = std::max(1, std::atoi(argv[++i]));
+        else
+            models.push_back(arg);
+    }
+    if (models.empty())
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("models", error))
+        {
+            if (entry.path().extension() == ".obj")
+                models.push_back(entry.path().string());
+        }
+        std::sort(models.begin(), models.end());
+    }
+
+    ModelLoadSettings fastSettings, assimpSettings;
+    assimpSettings.fastObj = false;
+    fastSettings.directionalDN = assimpSettings.directionalDN = false;
+    ModelLoader fastLoader(fastSettings), assimpLoader(assimpSettings);
+
+    std::cout << "OBJ import benchmark, median of " << runs << " run(s), " << globalThreadPool().size() << " worker thread(s)\n";
+    std::cout << std::left << std::setw(32) << "Model" << std::right << std::setw(12) << "Vertices" << std::setw(12) << "Triangles"
+        << std::setw(12) << "Fast (ms)" << std::setw(14) << "Assimp (ms)" << std::setw(10) << "Speedup" << "\n";
+    for (const std::string& model : models)
+    {
+        double fastTime = 0.0, assimpTime = 0.0;
+        size_t fastVertices = 0, fastTriangles = 0, assimpVertices = 0, assimpTriangles = 0;
+        if (!timeImport(fastLoader, model, runs, fastTime, fastVertices, fastTriangles) ||
+            !timeImport(assimpLoader, model, runs, assimpTime, assimpVertices, assimpTriangles))
+        {
+            std::cout << std::left << std::setw(32) << model << " failed to load\n";
+            continue;
+        }
+
+        std::cout << std::left << std::setw(32) << model << std::right << std::setw(12) << fastVertices << std::setw(12) << fastTriangles
+            << std::fixed << std::setprecision(2) << std::setw(12) << fastTime << std::setw(14) << assimpTime
+            << std::setw(9) << assimpTime / std::max(fastTime, 1e-6) << "x\n";
+        if (fastTriangles != assimpTriangles)
+            std::cout << "  (Assimp: " << assimpVertices << " vertices, " << assimpTriangles << " triangles)\n";
+    }
+    return 0;
+}